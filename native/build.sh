@@ -4,14 +4,36 @@ set -ex
 
 cd "`dirname "$0"`"
 
-rm -f libnfd.so libnfd_gtk.so libnfd_zenity.so
+rm -f libnfd.so libnfd_gtk.so libnfd_zenity.so libnfd_portal.so libnfd_x11.so libnfd_script.so libnfd_remote.so nfd_remote_server
 rm -f libnfd.dylib
 rm -f nfd.dll
 
-# Linux (includes GTK, Zenity, and a library to support both)
-cc -O3 -fpic -fPIC -shared -o libnfd_gtk.so nfd_common.c nfd_gtk.c `pkg-config --cflags gtk+-3.0` -lgtk-3 -lgobject-2.0 -lglib-2.0 -Wl,--no-undefined
-cc -O3 -fpic -fPIC -shared -o libnfd_zenity.so nfd_common.c nfd_zenity.c -Wl,--no-undefined
-cc -O3 -fpic -fPIC -shared -o libnfd.so nfd_linux.c `sdl2-config --cflags --libs` -Wl,--no-undefined
+if [ "$1" = "monolithic" ]; then
+	# Linux, a single libnfd.so with GTK, Zenity, script and remote built in. GTK itself is
+	# dlopen'd on first use, and only the public API is exported.
+	MONO="-O3 -fpic -fPIC -pthread -fvisibility=hidden"
+	cc $MONO -c -o nfd_common.o nfd_common.c
+	cc $MONO -c -o nfd_index.o nfd_index.c
+	cc $MONO -c -o nfd_gtk.o -DNFD_MONOLITHIC_BACKEND=gtk nfd_gtk.c `pkg-config --cflags gtk+-3.0`
+	cc $MONO -c -o nfd_zenity.o -DNFD_MONOLITHIC_BACKEND=zenity nfd_zenity.c
+	cc $MONO -c -o nfd_script.o -DNFD_MONOLITHIC_BACKEND=script nfd_script.c
+	cc $MONO -c -o nfd_remote.o -DNFD_MONOLITHIC_BACKEND=remote nfd_remote.c
+	cc $MONO -c -o nfd_linux.o -DNFD_MONOLITHIC nfd_linux.c
+	cc -pthread -shared -o libnfd.so nfd_common.o nfd_index.o nfd_gtk.o nfd_zenity.o nfd_script.o nfd_remote.o nfd_linux.o -ldl -Wl,--no-undefined
+	rm -f nfd_common.o nfd_index.o nfd_gtk.o nfd_zenity.o nfd_script.o nfd_remote.o nfd_linux.o
+	exit 0
+fi
+
+# Linux (includes GTK, Zenity, Xlib, xdg-desktop-portal, headless script and remote backends, and a library to support all of them).
+# The backends bind their own NFD_* calls with -Bsymbolic, since libnfd.so exports the same names.
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_gtk.so nfd_common.c nfd_index.c nfd_gtk.c `pkg-config --cflags --libs gtk+-3.0` -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_zenity.so nfd_common.c nfd_zenity.c -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_x11.so nfd_common.c nfd_index.c nfd_x11.c -lX11 -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_portal.so nfd_common.c nfd_portal.c `pkg-config --cflags --libs dbus-1` -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_script.so nfd_common.c nfd_script.c -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -shared -o libnfd_remote.so nfd_common.c nfd_remote.c -Wl,-Bsymbolic -Wl,--no-undefined
+cc -O3 -fpic -fPIC -pthread -fvisibility=hidden -shared -o libnfd.so -DNFD_DISPATCHER nfd_linux.c nfd_common.c -ldl -Wl,--no-undefined
+cc -O3 -pthread -o nfd_remote_server nfd_remote_server.c -L. -lnfd -Wl,-rpath,'$ORIGIN'
 
 # Windows
 x86_64-w64-mingw32-gcc -O3 -fpic -fPIC -shared -o nfd.dll nfd_win.c nfd_common.c -lole32
@@ -19,6 +19,8 @@ extern "C" {
 #ifndef DECLSPEC
 #if defined(_WIN32)
 #define DECLSPEC __declspec(dllexport)
+#elif defined(__GNUC__)
+#define DECLSPEC __attribute__((visibility("default")))
 #else
 #define DECLSPEC
 #endif
@@ -37,12 +39,66 @@ typedef struct {
 typedef enum {
     NFD_ERROR,       /* programmatic error */
     NFD_OKAY,        /* user pressed okay, or successful return */
-    NFD_CANCEL       /* user pressed cancel */
+    NFD_CANCEL       /* user pressed cancel, or the request was cancelled */
 }nfdresult_t;
+
+/* opaque front-coded copy of a path set -- see NFD_CompactPathSet_* */
+typedef struct nfdcompactpathset_s nfdcompactpathset_t;
+
+/* opaque per-dialog request -- see NFD_Request_* and NFD_Cancel */
+typedef struct nfdrequest_s nfdrequest_t;
+
+/* request flags -- see NFD_Request_SetFlags */
+#define NFD_REQUEST_PATHINFO  0x1 /* stat the selection, see NFD_Request_GetPathInfo */
+#define NFD_REQUEST_READAHEAD 0x2 /* start reading the selection into the page cache */
+#define NFD_REQUEST_PREVIEW   0x4 /* image thumbnails beside the open dialogs, GTK only */
+
+typedef enum {
+    NFD_FILETYPE_UNKNOWN,   /* stat failed, see error */
+    NFD_FILETYPE_REGULAR,
+    NFD_FILETYPE_DIRECTORY,
+    NFD_FILETYPE_OTHER
+}nfdfiletype_t;
+
+/* read-only view of a file -- see NFD_OpenDialogMapped */
+typedef struct {
+    const void *data;   /* NULL for an empty file */
+    size_t length;
+}nfdmapping_t;
+
+#define NFD_MAP_POPULATE 0x1 /* fault the whole file in before returning */
+
+/* progress for NFD_PickFolderAndScan, reported on the calling thread */
+typedef void (*nfdscanprogress_t)( void *userdata,
+                                   size_t filesFound,
+                                   size_t foldersScanned );
+
+typedef struct {
+    unsigned int maxDepth;      /* folder levels to read, 1 for only the chosen
+                                   folder, 0 for no limit */
+    size_t maxCount;            /* stop after this many files, 0 for no limit */
+    nfdscanprogress_t progress; /* may be NULL */
+    void *userdata;
+}nfdscanoptions_t;
+
+/* metadata for one selected path, symlinks are followed */
+typedef struct {
+    unsigned long long size;
+    long long mtime;          /* seconds since the epoch */
+    unsigned long long inode;
+    unsigned long long device;
+    int type;                 /* nfdfiletype_t */
+    int error;                /* errno from stat, 0 if the above are valid */
+}nfdpathinfo_t;
     
 
 /* nfd_<targetplatform>.c */
 
+/* filterList is "png,jpg;pdf": ',' separates types and ';' separates the
+   groups the user picks between.  A type is an extension, or a glob over
+   the whole file name if it has '*', '?' or "[...]" ("level_*.map").
+   Globs are left out on macOS, where only extensions can be offered. */
+
 /* single file open dialog */    
 DECLSPEC nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
                                      const nfdchar_t *defaultPath,
@@ -63,6 +119,139 @@ DECLSPEC nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
 DECLSPEC nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
                                      nfdchar_t **outPath);
 
+/* variants of the above driven by a request, which may be NULL.
+   GTK, zenity and the portal close the dialog on NFD_Cancel or timeout;
+   Windows and macOS only honour a request cancelled before the call. */
+DECLSPEC nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                                       const nfdchar_t *defaultPath,
+                                       nfdchar_t **outPath,
+                                       nfdrequest_t *request );
+
+DECLSPEC nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                               const nfdchar_t *defaultPath,
+                                               nfdpathset_t *outPaths,
+                                               nfdrequest_t *request );
+
+DECLSPEC nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                                       const nfdchar_t *defaultPath,
+                                       nfdchar_t **outPath,
+                                       nfdrequest_t *request );
+
+DECLSPEC nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                                       nfdchar_t **outPath,
+                                       nfdrequest_t *request );
+
+/* NFD_OpenDialogEx, then map the chosen file read-only.  On NFD_OKAY release
+   outPath with NFD_Free and outMapping with NFD_Unmap; if the file cannot be
+   mapped this returns NFD_ERROR and outPath has already been freed.
+   mapFlags takes NFD_MAP_* flags. */
+DECLSPEC nfdresult_t NFD_OpenDialogMapped( const nfdchar_t *filterList,
+                                           const nfdchar_t *defaultPath,
+                                           nfdchar_t **outPath,
+                                           nfdmapping_t *outMapping,
+                                           unsigned int mapFlags,
+                                           nfdrequest_t *request );
+
+DECLSPEC void NFD_Unmap( nfdmapping_t *mapping );
+
+/* select folder dialog, then collect every file below the chosen folder that
+   matches filterList (NULL or "" for all files) into outPaths, sorted
+   bytewise.  The folder is returned in outPath.  Directories are read in
+   parallel and symlinked folders are not followed.  NFD_Cancel stops the
+   scan as well.  options may be NULL.  POSIX only. */
+DECLSPEC nfdresult_t NFD_PickFolderAndScan( const nfdchar_t *filterList,
+                                            const nfdchar_t *defaultPath,
+                                            nfdchar_t **outPath,
+                                            nfdpathset_t *outPaths,
+                                            const nfdscanoptions_t *options,
+                                            nfdrequest_t *request );
+
+/* find a file by name below roots (NULL-terminated) as the user types:
+   every space separated word must appear in the name, case-insensitively,
+   and the name must match filterList (NULL or "" for all files).  The file
+   names are indexed in the background, cached on disk and kept current
+   with inotify, so the same roots come back searchable at once.  Dot files
+   are left out and symlinked folders are not followed.  Linux gtk, x11 and
+   script backends; the others return NFD_ERROR. */
+DECLSPEC nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                                       const nfdchar_t *filterList,
+                                       nfdchar_t **outPath,
+                                       nfdrequest_t *request );
+
+/* asynchronous dialogs -- nfd_linux.c only.  Dialogs run one at a time on a
+   dialog thread owned by the library, which also invokes the callback.
+   On NFD_OKAY the callback owns outPath (NFD_Free) or the contents of
+   outPaths (NFD_PathSet_Free); outPaths itself is only valid during the call.
+   NFD_GetError is per thread, so call it from the callback on NFD_ERROR.
+   With the gtk backend, do not mix these with the blocking calls. */
+typedef void (*nfdcallback_t)( void *userdata,
+                               nfdresult_t result,
+                               nfdchar_t *outPath,
+                               nfdpathset_t *outPaths );
+
+/* result of an async dialog whose callback was NULL -- see NFD_GetEventType */
+typedef struct {
+    nfdresult_t result;
+    nfdchar_t *outPath;     /* NFD_OKAY from a single path dialog, else NULL */
+    nfdpathset_t outPaths;  /* NFD_OKAY from NFD_OpenDialogMultipleAsync,
+                               else zeroed */
+    char *error;            /* NFD_ERROR: what NFD_GetError said on the
+                               dialog thread, may be NULL */
+}nfdeventresult_t;
+
+/* all return NFD_OKAY once the dialog is queued; request may be NULL.
+   With a NULL callback the result is pushed to the SDL event queue instead,
+   so SDL_Init(SDL_INIT_EVENTS) must have been called. */
+DECLSPEC nfdresult_t NFD_OpenDialogAsync( const nfdchar_t *filterList,
+                                          const nfdchar_t *defaultPath,
+                                          nfdrequest_t *request,
+                                          nfdcallback_t callback,
+                                          void *userdata );
+
+DECLSPEC nfdresult_t NFD_OpenDialogMultipleAsync( const nfdchar_t *filterList,
+                                                  const nfdchar_t *defaultPath,
+                                                  nfdrequest_t *request,
+                                                  nfdcallback_t callback,
+                                                  void *userdata );
+
+DECLSPEC nfdresult_t NFD_SaveDialogAsync( const nfdchar_t *filterList,
+                                          const nfdchar_t *defaultPath,
+                                          nfdrequest_t *request,
+                                          nfdcallback_t callback,
+                                          void *userdata );
+
+DECLSPEC nfdresult_t NFD_PickFolderAsync( const nfdchar_t *defaultPath,
+                                          nfdrequest_t *request,
+                                          nfdcallback_t callback,
+                                          void *userdata );
+
+/* SDL event type registered for async results, 0 if SDL has none left or
+   the process has no SDL2 loaded (libnfd.so finds it at runtime).
+   The SDL_UserEvent has code set to the nfdresult_t, data1 to an
+   nfdeventresult_t (NULL if it could not be allocated, with NFD_ERROR) and
+   data2 to the userdata.  Events still queued at SDL_Quit leak data1. */
+DECLSPEC unsigned int NFD_GetEventType( void );
+
+/* Free data1 of an async result event, including its paths; NULL is fine */
+DECLSPEC void NFD_EventResult_Free( nfdeventresult_t *eventResult );
+
+/* backend selection -- nfd_linux.c picks between several backends, the
+   other platforms only ever report their single native one */
+
+/* force a backend by name ("gtk", "zenity", "x11", "portal", "script",
+   "remote"), or NULL to auto-detect, which prefers a running portal.
+   "x11" is the built-in Xlib chooser.  "script" answers from NFD_SCRIPT
+   and "remote" asks the dialog server at NFD_REMOTE; neither is ever
+   auto-detected.
+   The NFD_BACKEND environment variable is used when nothing is forced.
+   Failed probes are remembered for NFD_BACKEND_RETRY milliseconds.
+   Switching fails while a dialog is open, an async dialog is queued or
+   a request is alive. */
+DECLSPEC nfdresult_t NFD_SetBackend( const char *name );
+
+/* name of the backend in use, or NULL if none could be loaded */
+DECLSPEC const char *NFD_GetBackendName( void );
+
 /* nfd_common.c */
 
 /* get last error -- set when nfdresult_t returns NFD_ERROR */
@@ -73,6 +262,58 @@ DECLSPEC size_t      NFD_PathSet_GetCount( const nfdpathset_t *pathSet );
 DECLSPEC nfdchar_t  *NFD_PathSet_GetPath( const nfdpathset_t *pathSet, size_t index );
 /* Free the pathSet */    
 DECLSPEC void        NFD_PathSet_Free( nfdpathset_t *pathSet );
+/* Flatten pathSet into buf as one position-independent blob that can be
+   copied, sent to another process or mapped from a file.  Returns the size
+   needed, and only writes when bufSize is at least that; 0 on failure.
+   buf must be aligned for size_t. */
+DECLSPEC size_t      NFD_PathSet_Serialize( const nfdpathset_t *pathSet, void *buf, size_t bufSize );
+/* Point outView into a blob from NFD_PathSet_Serialize, without copying.
+   Fails unless the blob was written with the same size_t and byte order.
+   outView is read-only, valid as long as the blob, and must not be passed
+   to NFD_PathSet_Free. */
+DECLSPEC nfdresult_t NFD_PathSet_View( const void *blob, size_t blobSize, nfdpathset_t *outView );
+/* Pack pathSet so that paths sharing a directory store it only once; the
+   original can be freed afterwards.  NULL on failure or past 4 GiB. */
+DECLSPEC nfdcompactpathset_t *NFD_PathSet_Compact( const nfdpathset_t *pathSet );
+DECLSPEC size_t      NFD_CompactPathSet_GetCount( const nfdcompactpathset_t *pathSet );
+/* Copy the path at index into buf, truncating to bufSize bytes including the
+   terminator.  Returns the full length, so >= bufSize means it was cut. */
+DECLSPEC size_t      NFD_CompactPathSet_GetPath( const nfdcompactpathset_t *pathSet,
+                                                 size_t index,
+                                                 nfdchar_t *buf,
+                                                 size_t bufSize );
+DECLSPEC void        NFD_CompactPathSet_Free( nfdcompactpathset_t *pathSet );
+/* Match count paths against filterList the way the dialogs do: outGroups[i]
+   is the index of the first ';' separated group the file name of paths[i]
+   matches, or -1.  NULL or "" matches nothing.  NFD_ERROR if a glob can't
+   be compiled. */
+DECLSPEC nfdresult_t NFD_Filter_MatchBatch( const nfdchar_t *filterList,
+                                            const nfdchar_t *const *paths,
+                                            size_t count,
+                                            int *outGroups );
+/* Free an outPath -- use this instead of free() across runtime boundaries */
+DECLSPEC void        NFD_Free( void *ptr );
+
+/* create a request for one dialog -- NULL on failure */
+DECLSPEC nfdrequest_t *NFD_Request_Create( void );
+/* give up with NFD_CANCEL after this many milliseconds, 0 waits forever */
+DECLSPEC void          NFD_Request_SetTimeout( nfdrequest_t *request, unsigned int milliseconds );
+/* close the dialog running this request from any thread; it returns
+   NFD_CANCEL.  Cancellation is sticky, so later dialogs return at once. */
+DECLSPEC void          NFD_Cancel( nfdrequest_t *request );
+/* NFD_REQUEST_* flags for the dialogs using this request, 0 by default */
+DECLSPEC void          NFD_Request_SetFlags( nfdrequest_t *request, unsigned int flags );
+/* with NFD_REQUEST_READAHEAD, the open and folder dialogs hint the selected
+   files to the kernel in the background as they return, in selection order
+   until this many bytes are covered.  64 MiB by default, POSIX only. */
+DECLSPEC void          NFD_Request_SetReadAheadLimit( nfdrequest_t *request, unsigned long long bytes );
+/* with NFD_REQUEST_PATHINFO, metadata for the last open or folder dialog that
+   returned NFD_OKAY, one entry per path in selection order; NULL otherwise.
+   Gathered in parallel before the dialog returns, valid until the next
+   such result or NFD_Request_Free.  Not implemented on Windows. */
+DECLSPEC const nfdpathinfo_t *NFD_Request_GetPathInfo( const nfdrequest_t *request, size_t *count );
+/* Free the request -- no dialog may still be using it */
+DECLSPEC void          NFD_Request_Free( nfdrequest_t *request );
 
 
 #ifdef __cplusplus
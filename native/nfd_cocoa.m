@@ -26,8 +26,12 @@ static NSArray *BuildAllowedFileTypes( const char *filterList )
                 ++p_typebuf;
             *p_typebuf = '\0';
 
-            NSString *thisType = [NSString stringWithUTF8String: typebuf];
-            [buildFilterList addObject:thisType];
+            // allowedFileTypes only knows extensions, so globs are left out
+            if ( !NFDi_IsFilterGlob( typebuf ) )
+            {
+                NSString *thisType = [NSString stringWithUTF8String: typebuf];
+                [buildFilterList addObject:thisType];
+            }
             p_typebuf = typebuf;
             *p_typebuf = '\0';
         }
@@ -284,3 +288,78 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
     [keyWindow makeKeyAndOrderFront:nil];
     return nfdResult;
 }
+
+/* requests can only be honoured before the dialog opens on this platform */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPath( request,
+                                    NFD_OpenDialog( filterList, defaultPath, outPath ),
+                                    outPath );
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPathSet( request,
+                                       NFD_OpenDialogMultiple( filterList, defaultPath, outPaths ),
+                                       outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFD_SaveDialog( filterList, defaultPath, outPath );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPath( request,
+                                    NFD_PickFolder( defaultPath, outPath ),
+                                    outPath );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    _NFD_UNUSED(roots);
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(request);
+    NFDi_SetError("NFD_SearchDialog is not available on macOS.");
+    return NFD_ERROR;
+}
+
+nfdresult_t NFD_SetBackend( const char *name )
+{
+    if ( name && strcmp( name, "cocoa" ) != 0 )
+    {
+        NFDi_SetError("Only the cocoa backend is available.");
+        return NFD_ERROR;
+    }
+    return NFD_OKAY;
+}
+
+const char *NFD_GetBackendName( void )
+{
+    return "cocoa";
+}
@@ -4,19 +4,37 @@
   http://www.frogtoss.com/labs
  */
 
+/* pipe2 */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include "nfd_common.h"
+#include "nfd_probes.h"
 
-static char g_errorstr[NFD_MAX_STRLEN] = {0};
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#endif
 
-/* public routines */
+/* per thread, since async dialogs fail on a thread of their own */
+#ifdef _MSC_VER
+static __declspec(thread) char g_errorstr[NFD_MAX_STRLEN] = {0};
+#else
+static __thread char g_errorstr[NFD_MAX_STRLEN] = {0};
+#endif
 
-const char *NFD_GetError( void )
-{
-    return g_errorstr;
-}
+/* public routines */
 
 size_t NFD_PathSet_GetCount( const nfdpathset_t *pathset )
 {
@@ -39,6 +57,498 @@ void NFD_PathSet_Free( nfdpathset_t *pathset )
     NFDi_Free( pathset->buf );
 }
 
+void NFD_Free( void *ptr )
+{
+    free( ptr );
+}
+
+#ifndef NFD_DISPATCHER
+
+const char *NFD_GetError( void )
+{
+    return g_errorstr;
+}
+
+nfdrequest_t *NFD_Request_Create( void )
+{
+    nfdrequest_t *request = NFDi_Malloc( sizeof(nfdrequest_t) );
+    if ( !request )
+        return NULL;
+
+    request->timeout = 0;
+    request->cancelled = 0;
+    request->flags = 0;
+    request->readAheadLimit = NFD_DEFAULT_READAHEAD_LIMIT;
+    request->info = NULL;
+    request->infoCount = 0;
+
+#ifndef _WIN32
+    if ( NFDi_Pipe( request->cancelPipe ) != 0 )
+    {
+        NFDi_SetError("Could not create the request cancel pipe.");
+        NFDi_Free( request );
+        return NULL;
+    }
+    fcntl( request->cancelPipe[1], F_SETFL, O_NONBLOCK );
+#endif
+
+    return request;
+}
+
+void NFD_Request_SetTimeout( nfdrequest_t *request, unsigned int milliseconds )
+{
+    assert(request);
+    request->timeout = milliseconds;
+}
+
+void NFD_Cancel( nfdrequest_t *request )
+{
+    assert(request);
+    if ( request->cancelled )
+        return;
+    request->cancelled = 1;
+
+#ifndef _WIN32
+    {
+        /* never drained, so the read end stays readable from now on */
+        char byte = 1;
+        ssize_t written = write( request->cancelPipe[1], &byte, 1 );
+        _NFD_UNUSED(written);
+    }
+#endif
+}
+
+void NFD_Request_SetFlags( nfdrequest_t *request, unsigned int flags )
+{
+    assert(request);
+    request->flags = flags;
+}
+
+void NFD_Request_SetReadAheadLimit( nfdrequest_t *request, unsigned long long bytes )
+{
+    assert(request);
+    request->readAheadLimit = bytes;
+}
+
+const nfdpathinfo_t *NFD_Request_GetPathInfo( const nfdrequest_t *request, size_t *count )
+{
+    assert(request);
+    if ( count )
+        *count = request->info ? request->infoCount : 0;
+    return request->info;
+}
+
+void NFD_Request_Free( nfdrequest_t *request )
+{
+    assert(request);
+#ifndef _WIN32
+    close( request->cancelPipe[0] );
+    close( request->cancelPipe[1] );
+#endif
+    if ( request->info )
+        NFDi_Free( request->info );
+    NFDi_Free( request );
+}
+
+#ifndef _WIN32 /* nfd_win.c has its own */
+
+nfdresult_t NFD_OpenDialogMapped( const nfdchar_t *filterList,
+                                  const nfdchar_t *defaultPath,
+                                  nfdchar_t **outPath,
+                                  nfdmapping_t *outMapping,
+                                  unsigned int mapFlags,
+                                  nfdrequest_t *request )
+{
+    struct stat st;
+    void *data;
+    int mmapFlags;
+    int fd;
+    nfdresult_t result;
+
+    assert(outMapping);
+    outMapping->data = NULL;
+    outMapping->length = 0;
+
+    result = NFD_OpenDialogEx( filterList, defaultPath, outPath, request );
+    if ( result != NFD_OKAY )
+        return result;
+
+    fd = open( *outPath, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        NFDi_SetError("Could not open the selected file.");
+        goto fail;
+    }
+    if ( fstat( fd, &st ) != 0 || !S_ISREG( st.st_mode ) )
+    {
+        NFDi_SetError("The selected file cannot be mapped.");
+        close( fd );
+        goto fail;
+    }
+    if ( (unsigned long long) st.st_size > (size_t) -1 )
+    {
+        NFDi_SetError("The selected file is too large to map.");
+        close( fd );
+        goto fail;
+    }
+
+    /* mmap refuses empty files, those just get no data */
+    if ( st.st_size > 0 )
+    {
+        mmapFlags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if ( mapFlags & NFD_MAP_POPULATE )
+            mmapFlags |= MAP_POPULATE;
+#endif
+        data = mmap( NULL, (size_t) st.st_size, PROT_READ, mmapFlags, fd, 0 );
+        if ( data == MAP_FAILED )
+        {
+            NFDi_SetError("Could not map the selected file.");
+            close( fd );
+            goto fail;
+        }
+#ifndef MAP_POPULATE
+        if ( mapFlags & NFD_MAP_POPULATE )
+            madvise( data, (size_t) st.st_size, MADV_WILLNEED );
+#endif
+        outMapping->data = data;
+        outMapping->length = (size_t) st.st_size;
+    }
+
+    /* the mapping keeps the file alive */
+    close( fd );
+    return NFD_OKAY;
+
+fail:
+    NFDi_Free( *outPath );
+    *outPath = NULL;
+    return NFD_ERROR;
+}
+
+#endif
+
+#endif /* NFD_DISPATCHER */
+
+#ifndef _WIN32
+
+/* A mapping is plain memory, so whoever holds it can unmap it */
+void NFD_Unmap( nfdmapping_t *mapping )
+{
+    assert(mapping);
+    if ( mapping->data )
+        munmap( (void*) mapping->data, mapping->length );
+    mapping->data = NULL;
+    mapping->length = 0;
+}
+
+#endif
+
+static size_t PathSetDataSize( const nfdpathset_t *pathSet )
+{
+    size_t last;
+    if ( pathSet->count == 0 )
+        return 0;
+    last = pathSet->indices[pathSet->count - 1];
+    return last + strlen( pathSet->buf + last ) + 1;
+}
+
+size_t NFD_PathSet_Serialize( const nfdpathset_t *pathSet, void *buf, size_t bufSize )
+{
+    nfdblobheader_t *header;
+    size_t dataSize, indicesSize, total;
+
+    assert(pathSet);
+
+    dataSize = PathSetDataSize( pathSet );
+    indicesSize = sizeof(size_t) * pathSet->count;
+    total = sizeof(nfdblobheader_t) + indicesSize + dataSize;
+    if ( !buf || bufSize < total )
+        return total;
+
+    if ( (uintptr_t) buf % sizeof(size_t) != 0 )
+    {
+        NFDi_SetError("NFD_PathSet_Serialize needs a size_t aligned buffer.");
+        return 0;
+    }
+
+    header = (nfdblobheader_t*) buf;
+    memcpy( header->magic, NFD_BLOB_MAGIC, 4 );
+    header->version = NFD_BLOB_VERSION;
+    header->sizeofSizeT = (uint8_t) sizeof(size_t);
+    header->byteOrder = NFD_BLOB_BYTE_ORDER;
+    header->count = pathSet->count;
+    header->dataSize = dataSize;
+
+    /* indices were already relative to buf, so they copy as they are */
+    if ( pathSet->count > 0 )
+    {
+        memcpy( header + 1, pathSet->indices, indicesSize );
+        memcpy( (char*) ( header + 1 ) + indicesSize, pathSet->buf, dataSize );
+    }
+    return total;
+}
+
+nfdresult_t NFD_PathSet_View( const void *blob, size_t blobSize, nfdpathset_t *outView )
+{
+    const nfdblobheader_t *header = (const nfdblobheader_t*) blob;
+    const size_t *indices;
+    const char *data;
+    size_t i;
+
+    assert(blob);
+    assert(outView);
+
+    if ( blobSize < sizeof(nfdblobheader_t) ||
+         (uintptr_t) blob % sizeof(size_t) != 0 ||
+         memcmp( header->magic, NFD_BLOB_MAGIC, 4 ) != 0 ||
+         header->version != NFD_BLOB_VERSION )
+    {
+        NFDi_SetError("Not a serialized path set.");
+        return NFD_ERROR;
+    }
+    if ( header->sizeofSizeT != sizeof(size_t) ||
+         header->byteOrder != NFD_BLOB_BYTE_ORDER )
+    {
+        NFDi_SetError("Serialized path set is from an incompatible architecture.");
+        return NFD_ERROR;
+    }
+    if ( header->count > ( blobSize - sizeof(nfdblobheader_t) ) / sizeof(size_t) ||
+         header->dataSize != blobSize - sizeof(nfdblobheader_t) - sizeof(size_t) * header->count ||
+         ( header->count > 0 && header->dataSize == 0 ) )
+    {
+        NFDi_SetError("Serialized path set is truncated.");
+        return NFD_ERROR;
+    }
+
+    /* every path then ends inside the blob, so readers never overrun it */
+    indices = (const size_t*) ( header + 1 );
+    data = (const char*) ( indices + header->count );
+    if ( header->count > 0 && data[header->dataSize - 1] != '\0' )
+    {
+        NFDi_SetError("Serialized path set is corrupt.");
+        return NFD_ERROR;
+    }
+    for ( i = 0; i < header->count; ++i )
+    {
+        if ( indices[i] >= header->dataSize )
+        {
+            NFDi_SetError("Serialized path set is corrupt.");
+            return NFD_ERROR;
+        }
+    }
+
+    outView->buf = (nfdchar_t*) data;
+    outView->indices = (size_t*) indices;
+    outView->count = (size_t) header->count;
+    return NFD_OKAY;
+}
+
+/* LEB128, so short lengths take a single byte */
+static size_t VarintSize( size_t value )
+{
+    size_t size = 1;
+    while ( value >= 0x80 )
+    {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+static unsigned char *PutVarint( unsigned char *p, size_t value )
+{
+    while ( value >= 0x80 )
+    {
+        *p++ = (unsigned char) ( value | 0x80 );
+        value >>= 7;
+    }
+    *p++ = (unsigned char) value;
+    return p;
+}
+
+static const unsigned char *GetVarint( const unsigned char *p, size_t *value )
+{
+    size_t result = 0;
+    int shift = 0;
+    while ( *p & 0x80 )
+    {
+        result |= (size_t) ( *p++ & 0x7F ) << shift;
+        shift += 7;
+    }
+    *value = result | ( (size_t) *p++ << shift );
+    return p;
+}
+
+static size_t SharedPrefix( const nfdchar_t *a, const nfdchar_t *b )
+{
+    size_t i = 0;
+    while ( a[i] != '\0' && a[i] == b[i] )
+        ++i;
+    return i;
+}
+
+nfdcompactpathset_t *NFD_PathSet_Compact( const nfdpathset_t *pathSet )
+{
+    nfdcompactpathset_t *compact;
+    const nfdchar_t *path, *prev = NULL;
+    unsigned char *p;
+    size_t numRestarts, dataSize, len, shared, i;
+
+    assert(pathSet);
+
+    /* first pass sizes everything, so there's a single allocation */
+    dataSize = 0;
+    for ( i = 0; i < pathSet->count; ++i )
+    {
+        path = NFD_PathSet_GetPath( pathSet, i );
+        len = strlen( path );
+        if ( i % NFD_COMPACT_RESTART == 0 )
+        {
+            if ( dataSize > UINT32_MAX )
+            {
+                NFDi_SetError("Path set is too large to compact.");
+                return NULL;
+            }
+            dataSize += VarintSize( len ) + len;
+        }
+        else
+        {
+            shared = SharedPrefix( prev, path );
+            dataSize += VarintSize( shared ) + VarintSize( len - shared ) + len - shared;
+        }
+        prev = path;
+    }
+
+    numRestarts = ( pathSet->count + NFD_COMPACT_RESTART - 1 ) / NFD_COMPACT_RESTART;
+    compact = NFDi_Malloc( sizeof(nfdcompactpathset_t) +
+                           sizeof(uint32_t) * numRestarts +
+                           dataSize );
+    if ( !compact )
+        return NULL;
+
+    compact->count = pathSet->count;
+    compact->dataSize = dataSize;
+    compact->restarts = (uint32_t*) ( compact + 1 );
+    compact->data = (unsigned char*) ( compact->restarts + numRestarts );
+
+    p = compact->data;
+    for ( i = 0; i < pathSet->count; ++i )
+    {
+        path = NFD_PathSet_GetPath( pathSet, i );
+        len = strlen( path );
+        if ( i % NFD_COMPACT_RESTART == 0 )
+        {
+            compact->restarts[i / NFD_COMPACT_RESTART] = (uint32_t) ( p - compact->data );
+            p = PutVarint( p, len );
+            memcpy( p, path, len );
+            p += len;
+        }
+        else
+        {
+            shared = SharedPrefix( prev, path );
+            p = PutVarint( p, shared );
+            p = PutVarint( p, len - shared );
+            memcpy( p, path + shared, len - shared );
+            p += len - shared;
+        }
+        prev = path;
+    }
+    assert( (size_t) ( p - compact->data ) == dataSize );
+
+    return compact;
+}
+
+size_t NFD_CompactPathSet_GetCount( const nfdcompactpathset_t *pathSet )
+{
+    assert(pathSet);
+    return pathSet->count;
+}
+
+size_t NFD_CompactPathSet_GetPath( const nfdcompactpathset_t *pathSet,
+                                   size_t index,
+                                   nfdchar_t *buf,
+                                   size_t bufSize )
+{
+    const unsigned char *p;
+    size_t shared, suffix, len, i;
+
+    assert(pathSet);
+    assert(index < pathSet->count);
+
+    /* Replay from the last whole path.  Bytes past bufSize are dropped, which
+       is safe: a prefix the wanted path shares is never longer than it. */
+    i = index - index % NFD_COMPACT_RESTART;
+    p = pathSet->data + pathSet->restarts[i / NFD_COMPACT_RESTART];
+    len = 0;
+    for ( ; i <= index; ++i )
+    {
+        shared = 0;
+        if ( i % NFD_COMPACT_RESTART != 0 )
+            p = GetVarint( p, &shared );
+        p = GetVarint( p, &suffix );
+
+        if ( shared < bufSize )
+            memcpy( buf + shared, p, ( suffix < bufSize - shared ) ? suffix : bufSize - shared );
+        p += suffix;
+        len = shared + suffix;
+    }
+
+    if ( bufSize > 0 )
+        buf[ ( len < bufSize ) ? len : bufSize - 1 ] = '\0';
+    return len;
+}
+
+void NFD_CompactPathSet_Free( nfdcompactpathset_t *pathSet )
+{
+    assert(pathSet);
+    NFDi_Free( pathSet );
+}
+
+nfdresult_t NFD_Filter_MatchBatch( const nfdchar_t *filterList,
+                                   const nfdchar_t *const *paths,
+                                   size_t count,
+                                   int *outGroups )
+{
+    nfdfilter_t filter;
+    const nfdchar_t *name, *end;
+    size_t i, limit;
+
+    assert(paths || count == 0);
+    assert(outGroups || count == 0);
+
+    if ( !NFDi_Filter_Parse( &filter, filterList ) )
+        return NFD_ERROR;
+    limit = ( filter.globCount > 0 ) ? (size_t) -1 : filter.maxLen;
+
+    for ( i = 0; i < count; ++i )
+    {
+        if ( !paths[i] || filter.typeCount == 0 )
+        {
+            outGroups[i] = -1;
+            continue;
+        }
+
+        /* without globs only the tail can hold an extension, so stop
+           looking for the last separator once it is longer than that */
+        end = paths[i] + strlen( paths[i] );
+        name = end;
+        while ( name > paths[i] && (size_t) ( end - name ) <= limit )
+        {
+            if ( name[-1] == '/' )
+                break;
+#ifdef _WIN32
+            if ( name[-1] == '\\' )
+                break;
+#endif
+            --name;
+        }
+        outGroups[i] = NFDi_Filter_Match( &filter, name, (size_t) ( end - name ) );
+    }
+
+    NFDi_Filter_Free( &filter );
+    return NFD_OKAY;
+}
+
 /* internal routines */
 
 void *NFDi_Malloc( size_t bytes )
@@ -62,6 +572,57 @@ void NFDi_SetError( const char *msg )
     assert( !bTruncate );  _NFD_UNUSED(bTruncate);
 }
 
+const char *NFDi_GetError( void )
+{
+    return g_errorstr;
+}
+
+
+#ifndef _WIN32
+int NFDi_Pipe( int fds[2] )
+{
+#ifdef __linux__
+    return pipe2( fds, O_CLOEXEC );
+#else
+    if ( pipe( fds ) != 0 )
+        return -1;
+    fcntl( fds[0], F_SETFD, FD_CLOEXEC );
+    fcntl( fds[1], F_SETFD, FD_CLOEXEC );
+    return 0;
+#endif
+}
+
+long long NFDi_NowMs( void )
+{
+    struct timespec now;
+    clock_gettime( CLOCK_MONOTONIC, &now );
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+int NFDi_WriteAll( int fd, const void *buf, size_t len )
+{
+    size_t done = 0;
+    while ( done < len )
+    {
+        ssize_t n = write( fd, (const char*)buf + done, len - done );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return 0;
+        done += (size_t)n;
+    }
+    return 1;
+}
+#endif
+
+uint64_t NFDi_Hash( uint64_t hash, const void *bytes, size_t len )
+{
+    const unsigned char *p = (const unsigned char*)bytes;
+    size_t i;
+    for ( i = 0; i < len; ++i )
+        hash = NFDi_HASH_STEP( hash, p[i] );
+    return hash;
+}
 
 int NFDi_SafeStrncpy( char *dst, const char *src, size_t maxCopy )
 {
@@ -140,3 +701,1422 @@ int NFDi_IsFilterSegmentChar( char ch )
     return (ch==','||ch==';'||ch=='\0');
 }
 
+int NFDi_IsFilterGlob( const char *type )
+{
+    return strpbrk( type, "*?[" ) != NULL;
+}
+
+void NFDi_FilterTypeToPattern( const char *type, char *buf, size_t bufSize )
+{
+    assert( bufSize > 2 );
+    if ( NFDi_IsFilterGlob( type ) )
+    {
+        NFDi_SafeStrncpy( buf, type, bufSize );
+        return;
+    }
+    buf[0] = '*';
+    buf[1] = '.';
+    NFDi_SafeStrncpy( buf + 2, type, bufSize - 2 );
+}
+
+/* the dialogs match case-insensitively on Windows and macOS only */
+static unsigned char FilterFold( unsigned char ch )
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    if ( ch >= 'A' && ch <= 'Z' )
+        ch += 'a' - 'A';
+#endif
+    return ch;
+}
+
+static int FilterTypeEquals( const char *a, const char *b, size_t len )
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    size_t i;
+    for ( i = 0; i < len; ++i )
+    {
+        if ( FilterFold( (unsigned char) a[i] ) != FilterFold( (unsigned char) b[i] ) )
+            return 0;
+    }
+    return 1;
+#else
+    return memcmp( a, b, len ) == 0;
+#endif
+}
+
+/* FNV-1a, folded the same way FilterTypeEquals compares */
+static size_t FilterHash( const char *ext, size_t len )
+{
+    uint64_t hash = NFDi_HASH_INIT;
+    size_t i;
+    for ( i = 0; i < len; ++i )
+        hash = NFDi_HASH_STEP( hash, FilterFold( (unsigned char) ext[i] ) );
+    return (size_t)hash;
+}
+
+/* index of the first type spelled ext in group, or in any group for -1 */
+static int FindFilterType( const nfdfilter_t *filter, const char *ext, size_t len, int group )
+{
+    const nfdfiltertype_t *type;
+    size_t slot = FilterHash( ext, len ) & filter->bucketMask;
+    int index;
+
+    /* a chain holds equal extensions in insertion order, so the first
+       hit is also the earliest in filterList */
+    while ( ( index = filter->buckets[slot] ) >= 0 )
+    {
+        type = &filter->types[index];
+        if ( type->len == len && FilterTypeEquals( ext, type->ext, len ) &&
+             ( group < 0 || type->group == group ) )
+            return index;
+        slot = ( slot + 1 ) & filter->bucketMask;
+    }
+    return -1;
+}
+
+static int BuildFilterBuckets( nfdfilter_t *filter )
+{
+    size_t numBuckets = 8, i, slot;
+
+    while ( numBuckets < filter->typeCount * 2 )
+        numBuckets *= 2;
+    filter->buckets = NFDi_Malloc( sizeof(int) * numBuckets );
+    if ( !filter->buckets )
+        return 0;
+    memset( filter->buckets, 0xff, sizeof(int) * numBuckets );
+    filter->bucketMask = numBuckets - 1;
+
+    for ( i = 0; i < filter->typeCount; ++i )
+    {
+        const nfdfiltertype_t *type = &filter->types[i];
+        if ( type->isGlob )
+            continue;
+        if ( type->len > filter->maxLen )
+            filter->maxLen = type->len;
+
+        slot = FilterHash( type->ext, type->len ) & filter->bucketMask;
+        while ( filter->buckets[slot] >= 0 )
+            slot = ( slot + 1 ) & filter->bucketMask;
+        filter->buckets[slot] = (int) i;
+    }
+    return 1;
+}
+
+/* Globs compile to a byte-level NFA per group, which is then turned into a
+   DFA so that matching costs one table lookup per byte of the name. */
+
+#ifndef NFD_GLOB_MAX_STATES
+#define NFD_GLOB_MAX_STATES 4096
+#endif
+
+#define GLOB_SET_ADD( set, b ) ( (set)[(b) >> 3] |= (unsigned char) ( 1u << ( (b) & 7 ) ) )
+#define GLOB_SET_HAS( set, b ) ( ( (set)[(b) >> 3] >> ( (b) & 7 ) ) & 1 )
+
+typedef struct
+{
+    int from, to;
+    unsigned char set[32];  /* bytes taking this edge */
+} GlobEdge;
+
+typedef struct
+{
+    GlobEdge *edges;
+    size_t edgeCount, edgeCap;
+    int *starts, *accepts;
+    size_t startCount, acceptCount, listCap;
+    int stateCount;
+} GlobNfa;
+
+static void GlobSetRange( unsigned char *set, int lo, int hi )
+{
+    int b;
+    for ( b = lo; b <= hi; ++b )
+        GLOB_SET_ADD( set, b );
+}
+
+static void FoldGlobSet( unsigned char *set )
+{
+#if defined(_WIN32) || defined(__APPLE__)
+    int b;
+    for ( b = 'a'; b <= 'z'; ++b )
+    {
+        if ( GLOB_SET_HAS( set, b ) || GLOB_SET_HAS( set, b - 'a' + 'A' ) )
+        {
+            GLOB_SET_ADD( set, b );
+            GLOB_SET_ADD( set, b - 'a' + 'A' );
+        }
+    }
+#else
+    (void) set;
+#endif
+}
+
+static int AddGlobEdge( GlobNfa *nfa, int from, int to, const unsigned char *set )
+{
+    GlobEdge *edge;
+
+    if ( nfa->edgeCount == nfa->edgeCap )
+    {
+        size_t cap = nfa->edgeCap ? nfa->edgeCap * 2 : 32;
+        GlobEdge *edges = realloc( nfa->edges, sizeof(GlobEdge) * cap );
+        if ( !edges )
+            return 0;
+        nfa->edges = edges;
+        nfa->edgeCap = cap;
+    }
+    edge = &nfa->edges[nfa->edgeCount++];
+    edge->from = from;
+    edge->to = to;
+    memcpy( edge->set, set, sizeof(edge->set) );
+    return 1;
+}
+
+/* one character from 'from' to 'to': ascii holds the single byte matches,
+   and multibyte also takes any longer UTF-8 sequence, as '?' and [!...] do */
+static int AddGlobChar( GlobNfa *nfa, int from, int to, const unsigned char *ascii, int multibyte )
+{
+    unsigned char set[32];
+    int c1, c2, c3;
+
+    if ( !AddGlobEdge( nfa, from, to, ascii ) )
+        return 0;
+    if ( !multibyte )
+        return 1;
+
+    /* cN still needs N continuation bytes */
+    c1 = nfa->stateCount++;
+    c2 = nfa->stateCount++;
+    c3 = nfa->stateCount++;
+
+    memset( set, 0, sizeof(set) );
+    GlobSetRange( set, 0xC2, 0xDF );
+    if ( !AddGlobEdge( nfa, from, c1, set ) )
+        return 0;
+    memset( set, 0, sizeof(set) );
+    GlobSetRange( set, 0xE0, 0xEF );
+    if ( !AddGlobEdge( nfa, from, c2, set ) )
+        return 0;
+    memset( set, 0, sizeof(set) );
+    GlobSetRange( set, 0xF0, 0xF4 );
+    if ( !AddGlobEdge( nfa, from, c3, set ) )
+        return 0;
+
+    memset( set, 0, sizeof(set) );
+    GlobSetRange( set, 0x80, 0xBF );
+    return AddGlobEdge( nfa, c3, c2, set ) &&
+           AddGlobEdge( nfa, c2, c1, set ) &&
+           AddGlobEdge( nfa, c1, to, set );
+}
+
+/* parses the "[...]" at p into set; returns the byte after ']', or NULL if
+   it never closes and the '[' is literal after all */
+static const char *ParseGlobClass( const char *p, unsigned char *set, int *negate, int *nonAscii )
+{
+    unsigned char lo, hi;
+
+    ++p;
+    *negate = ( *p == '!' || *p == '^' );
+    if ( *negate )
+        ++p;
+
+    /* a ']' right away is a member, not the end */
+    do
+    {
+        if ( *p == '\0' )
+            return NULL;
+        lo = hi = (unsigned char) *p++;
+        if ( *p == '-' && p[1] != ']' && p[1] != '\0' )
+        {
+            hi = (unsigned char) p[1];
+            p += 2;
+        }
+        if ( lo >= 0x80 || hi >= 0x80 )
+            *nonAscii = 1;
+        else if ( lo <= hi )
+            GlobSetRange( set, lo, hi );
+    } while ( *p != ']' );
+    return p + 1;
+}
+
+static int CompileGlob( GlobNfa *nfa, const char *glob )
+{
+    unsigned char set[32];
+    const char *p = glob, *end;
+    int cur, next, negate, nonAscii = 0, ok;
+
+    if ( nfa->listCap < nfa->startCount + 1 || nfa->listCap < nfa->acceptCount + 1 )
+    {
+        size_t cap = nfa->listCap ? nfa->listCap * 2 : 8;
+        int *starts = realloc( nfa->starts, sizeof(int) * cap );
+        int *accepts;
+        if ( !starts )
+            return 0;
+        nfa->starts = starts;
+        accepts = realloc( nfa->accepts, sizeof(int) * cap );
+        if ( !accepts )
+            return 0;
+        nfa->accepts = accepts;
+        nfa->listCap = cap;
+    }
+
+    cur = nfa->stateCount++;
+    nfa->starts[nfa->startCount++] = cur;
+    while ( *p != '\0' )
+    {
+        memset( set, 0, sizeof(set) );
+        if ( *p == '*' )
+        {
+            memset( set, 0xff, sizeof(set) );
+            if ( !AddGlobEdge( nfa, cur, cur, set ) )
+                return 0;
+            ++p;
+            continue;
+        }
+
+        next = nfa->stateCount++;
+        if ( *p == '?' )
+        {
+            GlobSetRange( set, 0x00, 0x7F );
+            ok = AddGlobChar( nfa, cur, next, set, 1 );
+            ++p;
+        }
+        else if ( *p == '[' && ( end = ParseGlobClass( p, set, &negate, &nonAscii ) ) != NULL )
+        {
+            if ( nonAscii )
+            {
+                NFDi_SetError("Filter patterns only support ASCII inside [...].");
+                return 0;
+            }
+            FoldGlobSet( set );
+            if ( negate )
+            {
+                int b;
+                for ( b = 0; b < 16; ++b )
+                    set[b] = (unsigned char) ~set[b];
+            }
+            ok = AddGlobChar( nfa, cur, next, set, negate );
+            p = end;
+        }
+        else
+        {
+            /* a literal byte; multibyte characters are just several */
+            if ( *p == '\\' && p[1] != '\0' )
+                ++p;
+            GLOB_SET_ADD( set, (unsigned char) *p );
+            FoldGlobSet( set );
+            ok = AddGlobEdge( nfa, cur, next, set );
+            ++p;
+        }
+        if ( !ok )
+            return 0;
+        cur = next;
+    }
+
+    nfa->accepts[nfa->acceptCount++] = cur;
+    return 1;
+}
+
+static void FreeGlobNfa( GlobNfa *nfa )
+{
+    free( nfa->edges );
+    free( nfa->starts );
+    free( nfa->accepts );
+    memset( nfa, 0, sizeof(GlobNfa) );
+}
+
+/* splits the 256 bytes into the fewest classes no edge tells apart */
+static void BuildByteClasses( nfdfilter_t *filter, const GlobNfa *nfas, int nfaCount )
+{
+    int remap[512];
+    unsigned char next[256];
+    size_t e, count;
+    int g, b, key;
+
+    memset( filter->byteClass, 0, sizeof(filter->byteClass) );
+    filter->classCount = 1;
+    for ( g = 0; g < nfaCount; ++g )
+    {
+        for ( e = 0; e < nfas[g].edgeCount; ++e )
+        {
+            memset( remap, 0xff, sizeof(remap) );
+            count = 0;
+            for ( b = 0; b < 256; ++b )
+            {
+                key = filter->byteClass[b] * 2 + GLOB_SET_HAS( nfas[g].edges[e].set, b );
+                if ( remap[key] < 0 )
+                    remap[key] = (int) count++;
+                next[b] = (unsigned char) remap[key];
+            }
+            memcpy( filter->byteClass, next, sizeof(next) );
+            filter->classCount = count;
+        }
+    }
+}
+
+typedef struct
+{
+    size_t words;           /* per NFA state set */
+    size_t classCount;
+    unsigned int *sets;     /* the NFA states behind each DFA state */
+    unsigned short *next;
+    unsigned char *accept;
+    size_t count, cap;
+    int *table;             /* NFD_GLOB_MAX_STATES * 2 slots, DFA state or -1 */
+} GlobDfaBuilder;
+
+static size_t HashGlobSet( const unsigned int *set, size_t words )
+{
+    return (size_t)NFDi_Hash( NFDi_HASH_INIT, set, words * sizeof(*set) );
+}
+
+/* the DFA state for this set of NFA states, added if new; -1 on failure */
+static int AddGlobDfaState( GlobDfaBuilder *builder, const GlobNfa *nfa, const unsigned int *set )
+{
+    const size_t mask = NFD_GLOB_MAX_STATES * 2 - 1;
+    size_t slot = HashGlobSet( set, builder->words ) & mask, i;
+    size_t bytes = sizeof(unsigned int) * builder->words;
+    void *grown;
+    int state;
+
+    while ( ( state = builder->table[slot] ) >= 0 )
+    {
+        if ( memcmp( &builder->sets[state * builder->words], set, bytes ) == 0 )
+            return state;
+        slot = ( slot + 1 ) & mask;
+    }
+
+    if ( builder->count == NFD_GLOB_MAX_STATES )
+    {
+        NFDi_SetError("Filter pattern is too complex.");
+        return -1;
+    }
+    if ( builder->count == builder->cap )
+    {
+        size_t cap = builder->cap ? builder->cap * 2 : 16;
+        if ( !( grown = realloc( builder->sets, bytes * cap ) ) )
+            return -1;
+        builder->sets = grown;
+        if ( !( grown = realloc( builder->next, sizeof(unsigned short) * builder->classCount * cap ) ) )
+            return -1;
+        builder->next = grown;
+        if ( !( grown = realloc( builder->accept, cap ) ) )
+            return -1;
+        builder->accept = grown;
+        builder->cap = cap;
+    }
+
+    state = (int) builder->count++;
+    memcpy( &builder->sets[state * builder->words], set, bytes );
+    builder->accept[state] = 0;
+    for ( i = 0; i < nfa->acceptCount; ++i )
+    {
+        if ( ( set[nfa->accepts[i] / 32] >> ( nfa->accepts[i] % 32 ) ) & 1 )
+            builder->accept[state] = 1;
+    }
+    builder->table[slot] = state;
+    return state;
+}
+
+/* subset construction, one row of classCount targets per DFA state */
+static int BuildGlobDfa( const nfdfilter_t *filter, const GlobNfa *nfa, nfdglobdfa_t *dfa )
+{
+    GlobDfaBuilder builder;
+    unsigned char *edgeClasses = NULL;
+    unsigned int *targets = NULL;
+    size_t i, c, e;
+    int b, state, ok = 0;
+
+    memset( dfa, 0, sizeof(nfdglobdfa_t) );
+    memset( &builder, 0, sizeof(builder) );
+    builder.words = ( (size_t) nfa->stateCount + 31 ) / 32;
+    builder.classCount = filter->classCount;
+    builder.table = malloc( sizeof(int) * NFD_GLOB_MAX_STATES * 2 );
+    targets = calloc( builder.classCount, sizeof(unsigned int) * builder.words );
+    edgeClasses = calloc( nfa->edgeCount ? nfa->edgeCount : 1, builder.classCount );
+    if ( !builder.table || !targets || !edgeClasses )
+        goto done;
+    memset( builder.table, 0xff, sizeof(int) * NFD_GLOB_MAX_STATES * 2 );
+
+    for ( e = 0; e < nfa->edgeCount; ++e )
+    {
+        for ( b = 0; b < 256; ++b )
+        {
+            if ( GLOB_SET_HAS( nfa->edges[e].set, b ) )
+                edgeClasses[e * builder.classCount + filter->byteClass[b]] = 1;
+        }
+    }
+
+    /* the empty set becomes the dead state 0, the starts state 1 */
+    if ( AddGlobDfaState( &builder, nfa, targets ) < 0 )
+        goto done;
+    for ( i = 0; i < nfa->startCount; ++i )
+        targets[nfa->starts[i] / 32] |= 1u << ( nfa->starts[i] % 32 );
+    if ( AddGlobDfaState( &builder, nfa, targets ) < 0 )
+        goto done;
+
+    for ( i = 0; i < builder.count; ++i )
+    {
+        memset( targets, 0, sizeof(unsigned int) * builder.words * builder.classCount );
+        for ( e = 0; e < nfa->edgeCount; ++e )
+        {
+            const GlobEdge *edge = &nfa->edges[e];
+            if ( !( ( builder.sets[i * builder.words + edge->from / 32] >> ( edge->from % 32 ) ) & 1 ) )
+                continue;
+            for ( c = 0; c < builder.classCount; ++c )
+            {
+                if ( edgeClasses[e * builder.classCount + c] )
+                    targets[c * builder.words + edge->to / 32] |= 1u << ( edge->to % 32 );
+            }
+        }
+
+        for ( c = 0; c < builder.classCount; ++c )
+        {
+            state = AddGlobDfaState( &builder, nfa, &targets[c * builder.words] );
+            if ( state < 0 )
+                goto done;
+            builder.next[i * builder.classCount + c] = (unsigned short) state;
+        }
+    }
+    ok = 1;
+
+done:
+    free( builder.table );
+    free( builder.sets );
+    free( targets );
+    free( edgeClasses );
+    if ( !ok )
+    {
+        free( builder.next );
+        free( builder.accept );
+        return 0;
+    }
+    dfa->next = builder.next;
+    dfa->accept = builder.accept;
+    dfa->stateCount = builder.count;
+    return 1;
+}
+
+static int RunGlobDfa( const nfdfilter_t *filter, const nfdglobdfa_t *dfa,
+                       const nfdchar_t *name, size_t nameLen )
+{
+    size_t state = 1, i;
+
+    for ( i = 0; i < nameLen && state != 0; ++i )
+        state = dfa->next[state * filter->classCount + filter->byteClass[(unsigned char) name[i]]];
+    return dfa->accept[state];
+}
+
+static int BuildFilterDfas( nfdfilter_t *filter )
+{
+    GlobNfa *nfas;
+    size_t i;
+    int group, ok = 1;
+
+    nfas = calloc( (size_t) filter->groupCount, sizeof(GlobNfa) );
+    filter->dfas = NFDi_Malloc( sizeof(nfdglobdfa_t) * (size_t) filter->groupCount );
+    if ( !nfas || !filter->dfas )
+    {
+        free( nfas );
+        return 0;
+    }
+    memset( filter->dfas, 0, sizeof(nfdglobdfa_t) * (size_t) filter->groupCount );
+
+    for ( i = 0; i < filter->typeCount && ok; ++i )
+    {
+        if ( filter->types[i].isGlob )
+            ok = CompileGlob( &nfas[filter->types[i].group], filter->types[i].ext );
+    }
+
+    /* one set of byte classes for every group keeps the lookup shared */
+    if ( ok )
+        BuildByteClasses( filter, nfas, filter->groupCount );
+    for ( group = 0; group < filter->groupCount && ok; ++group )
+    {
+        if ( nfas[group].startCount > 0 )
+            ok = BuildGlobDfa( filter, &nfas[group], &filter->dfas[group] );
+    }
+
+    for ( group = 0; group < filter->groupCount; ++group )
+        FreeGlobNfa( &nfas[group] );
+    free( nfas );
+    return ok;
+}
+
+int NFDi_Filter_Parse( nfdfilter_t *filter, const nfdchar_t *filterList )
+{
+    size_t len, maxTypes, i, start;
+    int group = 0;
+
+    memset( filter, 0, sizeof(nfdfilter_t) );
+    if ( !filterList || filterList[0] == '\0' )
+        return 1;
+
+    /* same grammar as AddFiltersToDialog: ',' separates types and ';'
+       separates groups; empty types are skipped rather than asserted */
+    len = strlen( filterList );
+    maxTypes = len / 2 + 1;
+    filter->storage = NFDi_Malloc( len + 1 );
+    filter->types = NFDi_Malloc( sizeof(nfdfiltertype_t) * maxTypes );
+    if ( !filter->storage || !filter->types )
+    {
+        NFDi_Filter_Free( filter );
+        return 0;
+    }
+    memcpy( filter->storage, filterList, len + 1 );
+
+    start = 0;
+    for ( i = 0; i <= len; ++i )
+    {
+        if ( !NFDi_IsFilterSegmentChar( filter->storage[i] ) )
+            continue;
+
+        if ( i > start )
+        {
+            nfdfiltertype_t *type = &filter->types[filter->typeCount++];
+            type->ext = filter->storage + start;
+            type->len = i - start;
+            type->group = group;
+        }
+        if ( filter->storage[i] == ';' || filter->storage[i] == '\0' )
+            ++group;
+
+        filter->storage[i] = '\0';
+        start = i + 1;
+    }
+    filter->groupCount = group;
+
+    for ( i = 0; i < filter->typeCount; ++i )
+    {
+        filter->types[i].isGlob = NFDi_IsFilterGlob( filter->types[i].ext );
+        if ( filter->types[i].isGlob )
+            ++filter->globCount;
+    }
+
+    if ( filter->typeCount > 0 && !BuildFilterBuckets( filter ) )
+    {
+        NFDi_Filter_Free( filter );
+        return 0;
+    }
+    if ( filter->globCount > 0 && !BuildFilterDfas( filter ) )
+    {
+        NFDi_Filter_Free( filter );
+        return 0;
+    }
+    return 1;
+}
+
+/* index of the earliest extension type in group (or any, for -1) that name
+   ends in, or -1 */
+static int MatchFilterExtension( const nfdfilter_t *filter, int group,
+                                 const nfdchar_t *name, size_t nameLen )
+{
+    size_t dot, stop;
+    int index, best = -1;
+
+    /* "*.ext" in the dialog, so ".ext" on its own matches too.  Look up the
+       suffix after each '.' close enough to the end to be an extension;
+       the first type in filterList order wins, as "gz;tar.gz" expects */
+    stop = ( nameLen > filter->maxLen + 1 ) ? nameLen - filter->maxLen - 1 : 0;
+    for ( dot = nameLen; dot-- > stop; )
+    {
+        if ( name[dot] != '.' || dot + 1 == nameLen )
+            continue;
+        index = FindFilterType( filter, name + dot + 1, nameLen - dot - 1, group );
+        if ( index >= 0 && ( best < 0 || index < best ) )
+            best = index;
+    }
+    return best;
+}
+
+int NFDi_Filter_Match( const nfdfilter_t *filter, const nfdchar_t *name, size_t nameLen )
+{
+    int best, group, limit;
+
+    if ( filter->typeCount == 0 )
+        return -1;
+
+    best = MatchFilterExtension( filter, -1, name, nameLen );
+    limit = ( best >= 0 ) ? filter->types[best].group : filter->groupCount;
+
+    /* only a glob in an earlier group can beat the extension */
+    for ( group = 0; group < limit && filter->dfas; ++group )
+    {
+        if ( filter->dfas[group].stateCount > 0 &&
+             RunGlobDfa( filter, &filter->dfas[group], name, nameLen ) )
+            return group;
+    }
+    return ( best >= 0 ) ? filter->types[best].group : -1;
+}
+
+int NFDi_Filter_MatchGroup( const nfdfilter_t *filter, int group, const nfdchar_t *name, size_t nameLen )
+{
+    if ( group < 0 || group >= filter->groupCount )
+        return 0;
+    if ( MatchFilterExtension( filter, group, name, nameLen ) >= 0 )
+        return 1;
+    return filter->dfas && filter->dfas[group].stateCount > 0 &&
+           RunGlobDfa( filter, &filter->dfas[group], name, nameLen );
+}
+
+void NFDi_Filter_Free( nfdfilter_t *filter )
+{
+    if ( filter->storage )
+        NFDi_Free( filter->storage );
+    if ( filter->types )
+        NFDi_Free( filter->types );
+    if ( filter->buckets )
+        NFDi_Free( filter->buckets );
+    if ( filter->dfas )
+    {
+        int group;
+        for ( group = 0; group < filter->groupCount; ++group )
+        {
+            free( filter->dfas[group].next );
+            free( filter->dfas[group].accept );
+        }
+        NFDi_Free( filter->dfas );
+    }
+    memset( filter, 0, sizeof(nfdfilter_t) );
+}
+
+#ifndef NFD_DISPATCHER
+
+int NFDi_Request_IsCancelled( const nfdrequest_t *request )
+{
+    return request && request->cancelled;
+}
+
+int NFDi_Request_GetCancelFd( const nfdrequest_t *request )
+{
+#ifndef _WIN32
+    if ( request )
+        return request->cancelPipe[0];
+#endif
+    _NFD_UNUSED(request);
+    return -1;
+}
+
+unsigned int NFDi_Request_GetTimeout( const nfdrequest_t *request )
+{
+    return request ? request->timeout : 0;
+}
+
+unsigned int NFDi_Request_GetFlags( const nfdrequest_t *request )
+{
+    return request ? request->flags : 0;
+}
+
+#ifndef _WIN32
+
+/* stat is mostly spent waiting on the disk, so this uses more threads than
+   there are cores; each one claims NFD_STAT_CHUNK paths at a time */
+#define NFD_STAT_CHUNK 32
+#define NFD_STAT_MAX_THREADS 16
+
+typedef struct
+{
+    const nfdpathset_t *paths;
+    nfdpathinfo_t *info;
+    size_t next;
+} StatJob;
+
+static void StatPath( const nfdchar_t *path, nfdpathinfo_t *info )
+{
+    struct stat st;
+
+    memset( info, 0, sizeof(nfdpathinfo_t) );
+    if ( stat( path, &st ) != 0 )
+    {
+        info->type = NFD_FILETYPE_UNKNOWN;
+        info->error = errno;
+        return;
+    }
+
+    info->size = (unsigned long long) st.st_size;
+    info->mtime = (long long) st.st_mtime;
+    info->inode = (unsigned long long) st.st_ino;
+    info->device = (unsigned long long) st.st_dev;
+    if ( S_ISREG( st.st_mode ) )
+        info->type = NFD_FILETYPE_REGULAR;
+    else if ( S_ISDIR( st.st_mode ) )
+        info->type = NFD_FILETYPE_DIRECTORY;
+    else
+        info->type = NFD_FILETYPE_OTHER;
+}
+
+static void *StatWorker( void *data )
+{
+    StatJob *job = (StatJob*) data;
+    size_t count = job->paths->count;
+    size_t i, end;
+
+    for ( ;; )
+    {
+        i = __atomic_fetch_add( &job->next, NFD_STAT_CHUNK, __ATOMIC_RELAXED );
+        if ( i >= count )
+            break;
+
+        end = ( count - i < NFD_STAT_CHUNK ) ? count : i + NFD_STAT_CHUNK;
+        for ( ; i < end; ++i )
+            StatPath( NFD_PathSet_GetPath( job->paths, i ), &job->info[i] );
+    }
+    return NULL;
+}
+
+static void GatherPathInfo( const nfdpathset_t *paths, nfdpathinfo_t *info )
+{
+    pthread_t threads[NFD_STAT_MAX_THREADS];
+    size_t numThreads, started, i;
+    StatJob job;
+
+    job.paths = paths;
+    job.info = info;
+    job.next = 0;
+
+    /* the calling thread takes a share too */
+    numThreads = ( paths->count + NFD_STAT_CHUNK - 1 ) / NFD_STAT_CHUNK - 1;
+    if ( numThreads > NFD_STAT_MAX_THREADS )
+        numThreads = NFD_STAT_MAX_THREADS;
+
+    started = 0;
+    for ( i = 0; i < numThreads; ++i )
+    {
+        if ( pthread_create( &threads[started], NULL, StatWorker, &job ) == 0 )
+            ++started;
+    }
+
+    StatWorker( &job );
+
+    for ( i = 0; i < started; ++i )
+        pthread_join( threads[i], NULL );
+}
+
+typedef struct
+{
+    nfdpathset_t paths;     /* private copy, the caller may free theirs */
+    unsigned long long limit;
+} ReadAheadJob;
+
+static void *ReadAheadWorker( void *data )
+{
+    ReadAheadJob *job = (ReadAheadJob*) data;
+    unsigned long long remaining = job->limit;
+    unsigned long long length;
+    struct stat st;
+    size_t i;
+    int fd;
+
+    for ( i = 0; i < job->paths.count && remaining > 0; ++i )
+    {
+        fd = open( NFD_PathSet_GetPath( &job->paths, i ), O_RDONLY | O_CLOEXEC );
+        if ( fd < 0 )
+            continue;
+
+        if ( fstat( fd, &st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 )
+        {
+            /* earlier paths in the selection get the budget first */
+            length = (unsigned long long) st.st_size;
+            if ( length > remaining )
+                length = remaining;
+            remaining -= length;
+
+#ifdef __APPLE__
+            {
+                struct radvisory advice;
+                advice.ra_offset = 0;
+                advice.ra_count = ( length > INT_MAX ) ? INT_MAX : (int) length;
+                fcntl( fd, F_RDADVISE, &advice );
+            }
+#else
+            posix_fadvise( fd, 0, (off_t) length, POSIX_FADV_WILLNEED );
+#endif
+        }
+        close( fd );
+    }
+
+    NFD_PathSet_Free( &job->paths );
+    NFDi_Free( job );
+    return NULL;
+}
+
+/* fire and forget, the dialog returns while the kernel pulls pages in */
+static void StartReadAhead( const nfdpathset_t *paths, unsigned long long limit )
+{
+    ReadAheadJob *job;
+    pthread_t thread;
+    size_t last, size;
+
+    if ( limit == 0 || paths->count == 0 )
+        return;
+
+    job = NFDi_Malloc( sizeof(ReadAheadJob) );
+    if ( !job )
+        return;
+
+    last = paths->indices[paths->count - 1];
+    size = last + strlen( paths->buf + last ) + 1;
+    job->paths.buf = NFDi_Malloc( size );
+    job->paths.indices = NFDi_Malloc( sizeof(size_t) * paths->count );
+    if ( !job->paths.buf || !job->paths.indices )
+    {
+        if ( job->paths.buf )
+            NFDi_Free( job->paths.buf );
+        if ( job->paths.indices )
+            NFDi_Free( job->paths.indices );
+        NFDi_Free( job );
+        return;
+    }
+    memcpy( job->paths.buf, paths->buf, size );
+    memcpy( job->paths.indices, paths->indices, sizeof(size_t) * paths->count );
+    job->paths.count = paths->count;
+    job->limit = limit;
+
+    if ( pthread_create( &thread, NULL, ReadAheadWorker, job ) != 0 )
+    {
+        NFD_PathSet_Free( &job->paths );
+        NFDi_Free( job );
+        return;
+    }
+    pthread_detach( thread );
+}
+
+#endif
+
+static void ApplyRequestFlags( nfdrequest_t *request, const nfdpathset_t *paths )
+{
+#ifndef _WIN32
+    /* first, so the disk is busy while we stat */
+    if ( request->flags & NFD_REQUEST_READAHEAD )
+        StartReadAhead( paths, request->readAheadLimit );
+
+    if ( request->flags & NFD_REQUEST_PATHINFO )
+    {
+        nfdpathinfo_t *info = NFDi_Malloc( sizeof(nfdpathinfo_t) * paths->count );
+        if ( info )
+            GatherPathInfo( paths, info );
+
+        if ( request->info )
+            NFDi_Free( request->info );
+        request->info = info;
+        request->infoCount = paths->count;
+    }
+#else
+    _NFD_UNUSED(request);
+    _NFD_UNUSED(paths);
+#endif
+}
+
+nfdresult_t NFDi_Request_FinishPath( nfdrequest_t *request, nfdresult_t result, nfdchar_t **outPath )
+{
+    nfdpathset_t single;
+    size_t index = 0;
+
+    if ( request && result == NFD_OKAY )
+    {
+        single.buf = *outPath;
+        single.indices = &index;
+        single.count = 1;
+        ApplyRequestFlags( request, &single );
+    }
+    return result;
+}
+
+nfdresult_t NFDi_Request_FinishPathSet( nfdrequest_t *request, nfdresult_t result, const nfdpathset_t *outPaths )
+{
+    if ( request && result == NFD_OKAY )
+        ApplyRequestFlags( request, outPaths );
+    return result;
+}
+
+#ifndef _WIN32
+
+/* Scanning is mostly waiting on directory reads, so it gets its own
+   threads; the calling thread only reports progress and polls NFD_Cancel. */
+#ifndef NFD_SCAN_MAX_THREADS
+#define NFD_SCAN_MAX_THREADS 8
+#endif
+#define NFD_SCAN_PROGRESS_MS 100
+
+typedef struct ScanDir
+{
+    struct ScanDir *next;
+    unsigned int depth;     /* 0 for the chosen folder */
+    size_t len;
+    char path[];
+} ScanDir;
+
+/* each worker collects its own files, merged at the end */
+typedef struct
+{
+    char *buf;
+    size_t bufLen, bufCap;
+    size_t *offsets;
+    size_t count, cap;
+} ScanOutput;
+
+typedef struct
+{
+    const nfdfilter_t *filter;
+    const nfdrequest_t *request;
+    unsigned int maxDepth;
+    size_t maxCount;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    /* new directories, or nothing left to do */
+    ScanDir *pending;
+    size_t busy;            /* workers reading a directory right now */
+
+    int stop;               /* __atomic, workers set it without the lock */
+    int failed;
+    size_t found;
+    size_t scanned;
+} ScanState;
+
+typedef struct
+{
+    ScanState *scan;
+    ScanOutput out;
+    pthread_t thread;
+} ScanWorker;
+
+static void StopScan( ScanState *scan )
+{
+    __atomic_store_n( &scan->stop, 1, __ATOMIC_RELAXED );
+}
+
+static int ScanStopped( ScanState *scan )
+{
+    return __atomic_load_n( &scan->stop, __ATOMIC_RELAXED );
+}
+
+static ScanDir *NewScanDir( const char *parent, size_t parentLen,
+                            const char *name, size_t nameLen,
+                            unsigned int depth )
+{
+    /* "/" is the only path that already ends in a separator */
+    size_t sep = ( nameLen > 0 && parent[parentLen - 1] != '/' ) ? 1 : 0;
+    ScanDir *dir = malloc( sizeof(ScanDir) + parentLen + sep + nameLen + 1 );
+    if ( !dir )
+        return NULL;
+
+    dir->next = NULL;
+    dir->depth = depth;
+    dir->len = parentLen + sep + nameLen;
+    memcpy( dir->path, parent, parentLen );
+    if ( sep )
+        dir->path[parentLen] = '/';
+    memcpy( dir->path + parentLen + sep, name, nameLen );
+    dir->path[dir->len] = '\0';
+    return dir;
+}
+
+static int AddScanFile( ScanOutput *out, const ScanDir *dir, const char *name, size_t nameLen )
+{
+    size_t need = dir->len + 1 + nameLen + 1;
+    size_t sep = ( dir->path[dir->len - 1] != '/' ) ? 1 : 0;
+
+    if ( out->bufLen + need > out->bufCap )
+    {
+        size_t cap = out->bufCap ? out->bufCap * 2 : 64 * 1024;
+        char *buf;
+        while ( cap < out->bufLen + need )
+            cap *= 2;
+        buf = realloc( out->buf, cap );
+        if ( !buf )
+            return 0;
+        out->buf = buf;
+        out->bufCap = cap;
+    }
+    if ( out->count == out->cap )
+    {
+        size_t cap = out->cap ? out->cap * 2 : 1024;
+        size_t *offsets = realloc( out->offsets, sizeof(size_t) * cap );
+        if ( !offsets )
+            return 0;
+        out->offsets = offsets;
+        out->cap = cap;
+    }
+
+    out->offsets[out->count++] = out->bufLen;
+    memcpy( out->buf + out->bufLen, dir->path, dir->len );
+    out->bufLen += dir->len;
+    if ( sep )
+        out->buf[out->bufLen++] = '/';
+    memcpy( out->buf + out->bufLen, name, nameLen );
+    out->bufLen += nameLen;
+    out->buf[out->bufLen++] = '\0';
+    return 1;
+}
+
+DIR *NFDi_OpenDir( const char *path, struct stat *st )
+{
+    DIR *stream;
+    int fd, error;
+
+    fd = open( path, O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+    if ( fd < 0 )
+        return NULL;
+    if ( ( st && fstat( fd, st ) != 0 ) || !( stream = fdopendir( fd ) ) )
+    {
+        error = errno;
+        close( fd );
+        errno = error;
+        return NULL;
+    }
+    return stream;
+}
+
+int NFDi_EntryType( DIR *stream, const struct dirent *entry )
+{
+    struct stat st;
+
+    /* d_type saves a stat per entry on most filesystems */
+    if ( entry->d_type == DT_DIR )
+        return NFDi_ENTRY_DIR;
+    if ( entry->d_type == DT_REG )
+        return NFDi_ENTRY_FILE;
+    if ( entry->d_type != DT_UNKNOWN && entry->d_type != DT_LNK )
+        return NFDi_ENTRY_OTHER;
+
+    if ( fstatat( dirfd( stream ), entry->d_name, &st,
+                  entry->d_type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW ) != 0 )
+        return NFDi_ENTRY_OTHER;
+    if ( S_ISREG( st.st_mode ) )
+        return NFDi_ENTRY_FILE;
+    if ( S_ISDIR( st.st_mode ) && entry->d_type != DT_LNK )
+        return NFDi_ENTRY_DIR;
+    return NFDi_ENTRY_OTHER;
+}
+
+/* reads one directory, returning its subdirectories as a list */
+static ScanDir *ScanDirectory( ScanState *scan, const ScanDir *dir, ScanOutput *out )
+{
+    ScanDir *subdirs = NULL, *sub;
+    struct dirent *entry;
+    size_t nameLen, found;
+    int descend, type;
+    DIR *stream;
+
+    stream = NFDi_OpenDir( dir->path, NULL );
+    if ( !stream )
+        return NULL;
+
+    descend = ( scan->maxDepth == 0 || dir->depth + 1 < scan->maxDepth );
+    while ( !ScanStopped( scan ) && ( entry = readdir( stream ) ) != NULL )
+    {
+        if ( entry->d_name[0] == '.' &&
+             ( entry->d_name[1] == '\0' ||
+               ( entry->d_name[1] == '.' && entry->d_name[2] == '\0' ) ) )
+            continue;
+
+        type = NFDi_EntryType( stream, entry );
+        nameLen = strlen( entry->d_name );
+        if ( type == NFDi_ENTRY_DIR && descend )
+        {
+            sub = NewScanDir( dir->path, dir->len, entry->d_name, nameLen, dir->depth + 1 );
+            if ( !sub )
+            {
+                scan->failed = 1;
+                StopScan( scan );
+                break;
+            }
+            sub->next = subdirs;
+            subdirs = sub;
+        }
+        else if ( type == NFDi_ENTRY_FILE &&
+                  ( scan->filter->groupCount == 0 ||
+                    NFDi_Filter_Match( scan->filter, entry->d_name, nameLen ) >= 0 ) )
+        {
+            if ( scan->maxCount != 0 )
+            {
+                found = __atomic_fetch_add( &scan->found, 1, __ATOMIC_RELAXED );
+                if ( found >= scan->maxCount )
+                {
+                    StopScan( scan );
+                    break;
+                }
+            }
+            else
+            {
+                __atomic_fetch_add( &scan->found, 1, __ATOMIC_RELAXED );
+            }
+
+            if ( !AddScanFile( out, dir, entry->d_name, nameLen ) )
+            {
+                scan->failed = 1;
+                StopScan( scan );
+                break;
+            }
+        }
+    }
+
+    closedir( stream );
+    __atomic_fetch_add( &scan->scanned, 1, __ATOMIC_RELAXED );
+    return subdirs;
+}
+
+static void *ScanWorkerMain( void *data )
+{
+    ScanWorker *worker = (ScanWorker*) data;
+    ScanState *scan = worker->scan;
+    ScanDir *dir, *subdirs, *last;
+
+    pthread_mutex_lock( &scan->lock );
+    for ( ;; )
+    {
+        while ( !scan->pending && scan->busy > 0 && !ScanStopped( scan ) )
+            pthread_cond_wait( &scan->wake, &scan->lock );
+        /* also here, since without threads nobody else is watching */
+        if ( NFDi_Request_IsCancelled( scan->request ) )
+            StopScan( scan );
+        if ( !scan->pending || ScanStopped( scan ) )
+            break;
+
+        /* depth first, which keeps the pending list short */
+        dir = scan->pending;
+        scan->pending = dir->next;
+        ++scan->busy;
+        pthread_mutex_unlock( &scan->lock );
+
+        subdirs = ScanDirectory( scan, dir, &worker->out );
+        free( dir );
+
+        pthread_mutex_lock( &scan->lock );
+        if ( subdirs )
+        {
+            for ( last = subdirs; last->next; last = last->next )
+                ;
+            last->next = scan->pending;
+            scan->pending = subdirs;
+        }
+        --scan->busy;
+        pthread_cond_broadcast( &scan->wake );
+    }
+    pthread_cond_broadcast( &scan->wake );
+    pthread_mutex_unlock( &scan->lock );
+    return NULL;
+}
+
+static int CompareScanPaths( const void *a, const void *b )
+{
+    return strcmp( *(const char* const*) a, *(const char* const*) b );
+}
+
+static nfdresult_t MergeScanOutput( ScanWorker *workers, size_t numWorkers, nfdpathset_t *outPaths )
+{
+    const char **sorted;
+    size_t count = 0, bufLen = 0, i, j, len;
+    char *p;
+
+    for ( i = 0; i < numWorkers; ++i )
+    {
+        count += workers[i].out.count;
+        bufLen += workers[i].out.bufLen;
+    }
+
+    /* NFD_PathSet_Free expects both, even for an empty set */
+    outPaths->buf = NFDi_Malloc( bufLen ? bufLen : 1 );
+    outPaths->indices = NFDi_Malloc( sizeof(size_t) * ( count ? count : 1 ) );
+    sorted = NFDi_Malloc( sizeof(const char*) * ( count ? count : 1 ) );
+    if ( !outPaths->buf || !outPaths->indices || !sorted )
+    {
+        if ( outPaths->buf )
+            NFDi_Free( outPaths->buf );
+        if ( outPaths->indices )
+            NFDi_Free( outPaths->indices );
+        if ( sorted )
+            NFDi_Free( (void*) sorted );
+        return NFD_ERROR;
+    }
+
+    count = 0;
+    for ( i = 0; i < numWorkers; ++i )
+        for ( j = 0; j < workers[i].out.count; ++j )
+            sorted[count++] = workers[i].out.buf + workers[i].out.offsets[j];
+    qsort( (void*) sorted, count, sizeof(const char*), CompareScanPaths );
+
+    p = outPaths->buf;
+    for ( i = 0; i < count; ++i )
+    {
+        len = strlen( sorted[i] ) + 1;
+        outPaths->indices[i] = (size_t) ( p - outPaths->buf );
+        memcpy( p, sorted[i], len );
+        p += len;
+    }
+    outPaths->count = count;
+
+    NFDi_Free( (void*) sorted );
+    NFD_PROBE2( pathset_built, count, bufLen );
+    return NFD_OKAY;
+}
+
+static nfdresult_t ScanFolder( const nfdchar_t *folder,
+                               const nfdfilter_t *filter,
+                               const nfdscanoptions_t *options,
+                               nfdrequest_t *request,
+                               nfdpathset_t *outPaths )
+{
+    ScanWorker workers[NFD_SCAN_MAX_THREADS];
+    size_t numWorkers = 0, i;
+    struct timespec deadline;
+    ScanState scan;
+    ScanDir *dir;
+    long cpus;
+    nfdresult_t result;
+
+    memset( &scan, 0, sizeof(scan) );
+    scan.filter = filter;
+    scan.request = request;
+    scan.maxDepth = options ? options->maxDepth : 0;
+    scan.maxCount = options ? options->maxCount : 0;
+    scan.pending = NewScanDir( folder, strlen( folder ), "", 0, 0 );
+    if ( !scan.pending )
+    {
+        NFDi_SetError("NFDi_Malloc failed.");
+        return NFD_ERROR;
+    }
+
+    pthread_mutex_init( &scan.lock, NULL );
+    pthread_cond_init( &scan.wake, NULL );
+
+    cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    for ( i = 0; i < NFD_SCAN_MAX_THREADS && ( i == 0 || (long) i < cpus ); ++i )
+    {
+        memset( &workers[numWorkers], 0, sizeof(ScanWorker) );
+        workers[numWorkers].scan = &scan;
+        if ( pthread_create( &workers[numWorkers].thread, NULL, ScanWorkerMain, &workers[numWorkers] ) == 0 )
+            ++numWorkers;
+    }
+    if ( numWorkers == 0 )
+    {
+        /* no threads at all, so scan on this one */
+        memset( &workers[0], 0, sizeof(ScanWorker) );
+        workers[0].scan = &scan;
+        ScanWorkerMain( &workers[0] );
+        numWorkers = 1;
+    }
+    else
+    {
+        pthread_mutex_lock( &scan.lock );
+        while ( scan.pending || scan.busy > 0 )
+        {
+            clock_gettime( CLOCK_REALTIME, &deadline );
+            deadline.tv_nsec += NFD_SCAN_PROGRESS_MS * 1000000L;
+            if ( deadline.tv_nsec >= 1000000000L )
+            {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+
+            /* workers broadcast after every directory, only stop for the
+               deadline or the end of the scan */
+            while ( ( scan.pending || scan.busy > 0 ) && !ScanStopped( &scan ) )
+            {
+                if ( pthread_cond_timedwait( &scan.wake, &scan.lock, &deadline ) == ETIMEDOUT )
+                    break;
+            }
+            if ( ScanStopped( &scan ) || ( !scan.pending && scan.busy == 0 ) )
+                break;
+
+            pthread_mutex_unlock( &scan.lock );
+            if ( NFDi_Request_IsCancelled( request ) )
+                StopScan( &scan );
+            if ( options && options->progress )
+                options->progress( options->userdata,
+                                   __atomic_load_n( &scan.found, __ATOMIC_RELAXED ),
+                                   __atomic_load_n( &scan.scanned, __ATOMIC_RELAXED ) );
+            pthread_mutex_lock( &scan.lock );
+        }
+        StopScan( &scan );
+        pthread_cond_broadcast( &scan.wake );
+        pthread_mutex_unlock( &scan.lock );
+
+        for ( i = 0; i < numWorkers; ++i )
+            pthread_join( workers[i].thread, NULL );
+    }
+
+    while ( scan.pending )
+    {
+        dir = scan.pending;
+        scan.pending = dir->next;
+        free( dir );
+    }
+    pthread_cond_destroy( &scan.wake );
+    pthread_mutex_destroy( &scan.lock );
+
+    if ( scan.failed )
+    {
+        NFDi_SetError("Out of memory while scanning the folder.");
+        result = NFD_ERROR;
+    }
+    else if ( NFDi_Request_IsCancelled( request ) )
+    {
+        result = NFD_CANCEL;
+    }
+    else
+    {
+        result = MergeScanOutput( workers, numWorkers, outPaths );
+        if ( options && options->progress && result == NFD_OKAY )
+            options->progress( options->userdata, outPaths->count, scan.scanned );
+    }
+
+    for ( i = 0; i < numWorkers; ++i )
+    {
+        free( workers[i].out.buf );
+        free( workers[i].out.offsets );
+    }
+    return result;
+}
+
+nfdresult_t NFD_PickFolderAndScan( const nfdchar_t *filterList,
+                                   const nfdchar_t *defaultPath,
+                                   nfdchar_t **outPath,
+                                   nfdpathset_t *outPaths,
+                                   const nfdscanoptions_t *options,
+                                   nfdrequest_t *request )
+{
+    nfdfilter_t filter;
+    nfdresult_t result;
+
+    assert(outPaths);
+
+    if ( !NFDi_Filter_Parse( &filter, filterList ) )
+        return NFD_ERROR;
+
+    result = NFD_PickFolderEx( defaultPath, outPath, request );
+    if ( result == NFD_OKAY )
+    {
+        result = ScanFolder( *outPath, &filter, options, request, outPaths );
+        if ( result != NFD_OKAY )
+        {
+            NFDi_Free( *outPath );
+            *outPath = NULL;
+        }
+    }
+
+    NFDi_Filter_Free( &filter );
+    return result;
+}
+
+#else
+
+nfdresult_t NFD_PickFolderAndScan( const nfdchar_t *filterList,
+                                   const nfdchar_t *defaultPath,
+                                   nfdchar_t **outPath,
+                                   nfdpathset_t *outPaths,
+                                   const nfdscanoptions_t *options,
+                                   nfdrequest_t *request )
+{
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(defaultPath);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(outPaths);
+    _NFD_UNUSED(options);
+    _NFD_UNUSED(request);
+    NFDi_SetError("NFD_PickFolderAndScan is not available on Windows.");
+    return NFD_ERROR;
+}
+
+#endif
+
+#endif /* NFD_DISPATCHER */
@@ -14,6 +14,11 @@
 
 #include <stdint.h>
 
+#ifndef _WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -23,13 +28,176 @@ extern "C" {
 
 #define NFD_UTF8_BOM "\xEF\xBB\xBF"
 
+#define NFD_DEFAULT_READAHEAD_LIMIT (64ull * 1024 * 1024)
+
+/* every NFD_COMPACT_RESTART'th path is stored whole, the ones in between
+   as (shared prefix length, suffix length, suffix) against the previous */
+#define NFD_COMPACT_RESTART 32
+
+struct nfdcompactpathset_s
+{
+    size_t count;
+    size_t dataSize;
+    uint32_t *restarts;     /* offset into data of each whole path */
+    unsigned char *data;    /* LEB128 lengths and path bytes */
+};
+
+/* NFD_PathSet_Serialize layout: this header, then size_t indices[count]
+   relative to the path bytes, then the path bytes */
+#define NFD_BLOB_MAGIC "NFDP"
+#define NFD_BLOB_VERSION 1
+#define NFD_BLOB_BYTE_ORDER 0x0102
+
+typedef struct
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t sizeofSizeT;
+    uint16_t byteOrder;     /* NFD_BLOB_BYTE_ORDER as written by the producer */
+    uint64_t count;
+    uint64_t dataSize;
+} nfdblobheader_t;
+
+/* one type of a parsed filterList, either an extension or a glob */
+typedef struct
+{
+    const char *ext;        /* without the leading '.', or the whole glob */
+    size_t len;
+    int group;              /* index of its ';' separated group */
+    int isGlob;             /* has '*', '?' or '[', matched against the whole name */
+} nfdfiltertype_t;
+
+/* the globs of one group, compiled into a single DFA */
+typedef struct
+{
+    unsigned short *next;   /* stateCount rows of classCount targets, state 0 is dead, 1 starts */
+    unsigned char *accept;
+    size_t stateCount;      /* 0 if the group has no globs */
+} nfdglobdfa_t;
+
+/* filterList parsed the way the dialogs read it, see NFDi_Filter_Parse */
+typedef struct
+{
+    char *storage;
+    nfdfiltertype_t *types; /* in filterList order */
+    size_t typeCount;
+    int groupCount;
+    int *buckets;           /* open addressed extension types, in filterList order per chain */
+    size_t bucketMask;
+    size_t maxLen;          /* longest extension, bounds the suffixes to look up */
+    size_t globCount;
+    nfdglobdfa_t *dfas;     /* one per group, NULL without globs */
+    unsigned char byteClass[256]; /* bytes no glob tells apart share a DFA column */
+    size_t classCount;
+} nfdfilter_t;
+
+struct nfdrequest_s
+{
+    unsigned int timeout;   /* milliseconds, 0 for none */
+    volatile int cancelled;
+#ifndef _WIN32
+    int cancelPipe[2];      /* NFD_Cancel writes a byte, backends poll the read end */
+#endif
+    unsigned int flags;     /* NFD_REQUEST_* */
+    unsigned long long readAheadLimit; /* bytes, for NFD_REQUEST_READAHEAD */
+    nfdpathinfo_t *info;    /* NFD_REQUEST_PATHINFO results, or NULL */
+    size_t infoCount;
+};
+
 
 void  *NFDi_Malloc( size_t bytes );
 void   NFDi_Free( void *ptr );
 void   NFDi_SetError( const char *msg );
+const char *NFDi_GetError( void );
 int    NFDi_SafeStrncpy( char *dst, const char *src, size_t maxCopy );
 int32_t NFDi_UTF8_Strlen( const nfdchar_t *str );
 int    NFDi_IsFilterSegmentChar( char ch );
+
+#ifndef _WIN32
+/* pipe() with both ends close-on-exec from the start, so that a zenity
+   fork/exec on another thread never inherits them */
+int    NFDi_Pipe( int fds[2] );
+/* CLOCK_MONOTONIC in milliseconds, for deadlines */
+long long NFDi_NowMs( void );
+/* write() until done, retrying EINTR; 0 on error */
+int    NFDi_WriteAll( int fd, const void *buf, size_t len );
+
+/* a close-on-exec directory stream, NULL with errno set on failure; st, if
+   given, is the directory's stat from before any entry was read */
+DIR   *NFDi_OpenDir( const char *path, struct stat *st );
+
+/* what a directory entry is, from d_type where the filesystem reports it.
+   File links are followed but folder links are not, so walks cannot loop. */
+enum
+{
+    NFDi_ENTRY_OTHER,
+    NFDi_ENTRY_FILE,
+    NFDi_ENTRY_DIR
+};
+int    NFDi_EntryType( DIR *stream, const struct dirent *entry );
+#endif
+
+/* 64-bit FNV-1a: start from NFDi_HASH_INIT, or a previous result to go on.
+   The step is for callers that fold bytes as they hash them. */
+#define NFDi_HASH_INIT 14695981039346656037ULL
+#define NFDi_HASH_STEP( hash, byte ) ( ( (hash) ^ (unsigned char)(byte) ) * 1099511628211ULL )
+uint64_t NFDi_Hash( uint64_t hash, const void *bytes, size_t len );
+
+/* a type with '*', '?' or '[' is a glob over the whole file name */
+int    NFDi_IsFilterGlob( const char *type );
+/* the pattern a dialog wants for one type: globs as is, extensions as "*.ext" */
+void   NFDi_FilterTypeToPattern( const char *type, char *buf, size_t bufSize );
+
+/* NULL or "" parses to zero groups.  Returns 0 and sets the error on
+   allocation failure or a glob that can't be compiled. */
+int    NFDi_Filter_Parse( nfdfilter_t *filter, const nfdchar_t *filterList );
+/* first group that name (a file name, not a path) matches, or -1 */
+int    NFDi_Filter_Match( const nfdfilter_t *filter, const nfdchar_t *name, size_t nameLen );
+/* whether name matches one particular group, for per-group dialog filters */
+int    NFDi_Filter_MatchGroup( const nfdfilter_t *filter, int group, const nfdchar_t *name, size_t nameLen );
+void   NFDi_Filter_Free( nfdfilter_t *filter );
+
+/* all of these accept a NULL request */
+int          NFDi_Request_IsCancelled( const nfdrequest_t *request );
+int          NFDi_Request_GetCancelFd( const nfdrequest_t *request );
+unsigned int NFDi_Request_GetTimeout( const nfdrequest_t *request );
+unsigned int NFDi_Request_GetFlags( const nfdrequest_t *request );
+
+/* backends pass every open/folder result through these before returning it,
+   they act on the request flags when result is NFD_OKAY */
+nfdresult_t  NFDi_Request_FinishPath( nfdrequest_t *request, nfdresult_t result, nfdchar_t **outPath );
+nfdresult_t  NFDi_Request_FinishPathSet( nfdrequest_t *request, nfdresult_t result, const nfdpathset_t *outPaths );
+
+/* split libnfd.so (build.sh): nfd_linux.c is linked with nfd_common.c
+   compiled with NFD_DISPATCHER, which leaves out everything that belongs
+   to a backend (requests, dialogs, path sets it allocated) and keeps what
+   works on caller data alone, so that needs no backend at all. */
+
+/* monolithic libnfd.so (build.sh monolithic): each backend is compiled with
+   NFD_MONOLITHIC_BACKEND set to its name, which renames its dialogs to
+   NFDi_<name>_* for the table in nfd_linux.c.  nfd.h is already included,
+   so the public declarations keep their names and visibility. */
+#ifdef NFD_MONOLITHIC_BACKEND
+#define NFDi_BACKEND_NAME_( backend, func ) NFDi_##backend##_##func
+#define NFDi_BACKEND_NAME( backend, func )  NFDi_BACKEND_NAME_( backend, func )
+
+#define NFD_OpenDialog           NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, OpenDialog )
+#define NFD_OpenDialogMultiple   NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, OpenDialogMultiple )
+#define NFD_SaveDialog           NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, SaveDialog )
+#define NFD_PickFolder           NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, PickFolder )
+#define NFD_OpenDialogEx         NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, OpenDialogEx )
+#define NFD_OpenDialogMultipleEx NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, OpenDialogMultipleEx )
+#define NFD_SaveDialogEx         NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, SaveDialogEx )
+#define NFD_PickFolderEx         NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, PickFolderEx )
+#define NFD_SearchDialog         NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, SearchDialog )
+
+#define NFDi_Backend_Probe       NFDi_BACKEND_NAME( NFD_MONOLITHIC_BACKEND, Probe )
+#endif
+
+/* nonzero if the backend can be used.  Monolithic it stands in for library
+   loading; split, nfd_linux.c calls it after loading when a backend
+   exports one, for backends whose library says nothing (portal, zenity). */
+int    NFDi_Backend_Probe( void );
     
 #ifdef __cplusplus
 }
@@ -4,16 +4,237 @@
   http://www.frogtoss.com/labs
 */
 
+#ifdef NFD_MONOLITHIC_BACKEND
+/* the GTK_* casts would otherwise call every *_get_type through the table */
+#define G_DISABLE_CAST_CHECKS
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 #include "nfd.h"
 #include "nfd_common.h"
+#include "nfd_index.h"
+#include "nfd_probes.h"
 
 
 const char INIT_FAIL_MSG[] = "gtk_init_check failed to initilaize GTK+";
 
+#ifdef NFD_MONOLITHIC_BACKEND
+/* The monolithic libnfd.so has to load where GTK isn't installed, so GTK is
+   opened on first use and everything below calls it through this table.
+   dlsym on the GTK handle also finds GLib and GObject, its dependencies. */
+#include <dlfcn.h>
+
+#define GTK_LIBRARY "libgtk-3.so.0"
+
+#define GTK_FUNCS \
+    GTK_FUNC( gtk_init_check ) \
+    GTK_FUNC( gtk_file_chooser_dialog_new ) \
+    GTK_FUNC( gtk_dialog_run ) \
+    GTK_FUNC( gtk_dialog_response ) \
+    GTK_FUNC( gtk_file_filter_new ) \
+    GTK_FUNC( gtk_file_filter_set_name ) \
+    GTK_FUNC( gtk_file_filter_add_custom ) \
+    GTK_FUNC( gtk_file_filter_add_pattern ) \
+    GTK_FUNC( gtk_file_chooser_add_filter ) \
+    GTK_FUNC( gtk_file_chooser_set_current_folder ) \
+    GTK_FUNC( gtk_file_chooser_set_select_multiple ) \
+    GTK_FUNC( gtk_file_chooser_set_do_overwrite_confirmation ) \
+    GTK_FUNC( gtk_file_chooser_get_filename ) \
+    GTK_FUNC( gtk_file_chooser_get_filenames ) \
+    GTK_FUNC( gtk_events_pending ) \
+    GTK_FUNC( gtk_main_iteration ) \
+    GTK_FUNC( gtk_widget_destroy ) \
+    GTK_FUNC( g_free ) \
+    GTK_FUNC( g_slist_length ) \
+    GTK_FUNC( g_slist_free ) \
+    GTK_FUNC( g_unix_fd_add ) \
+    GTK_FUNC( g_timeout_add ) \
+    GTK_FUNC( g_source_remove ) \
+    GTK_FUNC( g_object_set_data_full ) \
+    GTK_FUNC( g_object_unref ) \
+    GTK_FUNC( g_signal_connect_data ) \
+    GTK_FUNC( g_idle_add ) \
+    GTK_FUNC( gtk_file_chooser_set_preview_widget ) \
+    GTK_FUNC( gtk_file_chooser_set_preview_widget_active ) \
+    GTK_FUNC( gtk_file_chooser_set_use_preview_label ) \
+    GTK_FUNC( gtk_file_chooser_get_preview_filename ) \
+    GTK_FUNC( gtk_image_new ) \
+    GTK_FUNC( gtk_image_clear ) \
+    GTK_FUNC( gtk_image_set_from_pixbuf ) \
+    GTK_FUNC( gtk_widget_set_size_request ) \
+    GTK_FUNC( gdk_pixbuf_get_file_info ) \
+    GTK_FUNC( gdk_pixbuf_new_from_file_at_scale ) \
+    GTK_FUNC( gdk_pixbuf_new_from_data ) \
+    GTK_FUNC( gdk_pixbuf_get_width ) \
+    GTK_FUNC( gdk_pixbuf_get_height ) \
+    GTK_FUNC( gdk_pixbuf_get_rowstride ) \
+    GTK_FUNC( gdk_pixbuf_get_n_channels ) \
+    GTK_FUNC( gdk_pixbuf_get_pixels ) \
+    GTK_FUNC( gtk_dialog_new_with_buttons ) \
+    GTK_FUNC( gtk_dialog_get_content_area ) \
+    GTK_FUNC( gtk_dialog_set_default_response ) \
+    GTK_FUNC( gtk_entry_new ) \
+    GTK_FUNC( gtk_entry_get_text ) \
+    GTK_FUNC( gtk_entry_set_activates_default ) \
+    GTK_FUNC( gtk_list_store_new ) \
+    GTK_FUNC( gtk_list_store_clear ) \
+    GTK_FUNC( gtk_list_store_insert_with_values ) \
+    GTK_FUNC( gtk_tree_view_new_with_model ) \
+    GTK_FUNC( gtk_tree_view_insert_column_with_attributes ) \
+    GTK_FUNC( gtk_tree_view_get_selection ) \
+    GTK_FUNC( gtk_tree_selection_get_selected ) \
+    GTK_FUNC( gtk_tree_selection_select_iter ) \
+    GTK_FUNC( gtk_tree_model_get_iter_first ) \
+    GTK_FUNC( gtk_tree_model_get ) \
+    GTK_FUNC( gtk_cell_renderer_text_new ) \
+    GTK_FUNC( gtk_scrolled_window_new ) \
+    GTK_FUNC( gtk_container_add ) \
+    GTK_FUNC( gtk_box_pack_start ) \
+    GTK_FUNC( gtk_label_new ) \
+    GTK_FUNC( gtk_label_set_text ) \
+    GTK_FUNC( gtk_widget_show_all )
+
+static struct
+{
+#define GTK_FUNC( name ) __typeof__(&name) name;
+    GTK_FUNCS
+#undef GTK_FUNC
+} gtkFuncs;
+
+static pthread_once_t gtkOnce = PTHREAD_ONCE_INIT;
+static const char *gtkError = NULL;
+
+static void LoadGtkOnce( void )
+{
+    /* never closed, GTK can't be unloaded once initialized */
+    void *lib = dlopen( GTK_LIBRARY, RTLD_NOW | RTLD_LOCAL );
+    if ( !lib )
+    {
+        gtkError = "Could not load " GTK_LIBRARY;
+        return;
+    }
+
+#define GTK_FUNC( name ) \
+    gtkFuncs.name = (__typeof__(gtkFuncs.name)) dlsym( lib, #name ); \
+    if ( !gtkFuncs.name ) \
+    { \
+        gtkError = GTK_LIBRARY " lacks " #name; \
+        return; \
+    }
+    GTK_FUNCS
+#undef GTK_FUNC
+}
+
+int NFDi_Backend_Probe( void )
+{
+    pthread_once( &gtkOnce, LoadGtkOnce );
+    return gtkError == NULL;
+}
+
+/* from here on every call goes through gtkFuncs; g_free may be a macro */
+#undef g_free
+#define gtk_init_check                                 gtkFuncs.gtk_init_check
+#define gtk_file_chooser_dialog_new                    gtkFuncs.gtk_file_chooser_dialog_new
+#define gtk_dialog_run                                 gtkFuncs.gtk_dialog_run
+#define gtk_dialog_response                            gtkFuncs.gtk_dialog_response
+#define gtk_file_filter_new                            gtkFuncs.gtk_file_filter_new
+#define gtk_file_filter_set_name                       gtkFuncs.gtk_file_filter_set_name
+#define gtk_file_filter_add_custom                     gtkFuncs.gtk_file_filter_add_custom
+#define gtk_file_filter_add_pattern                    gtkFuncs.gtk_file_filter_add_pattern
+#define gtk_file_chooser_add_filter                    gtkFuncs.gtk_file_chooser_add_filter
+#define gtk_file_chooser_set_current_folder            gtkFuncs.gtk_file_chooser_set_current_folder
+#define gtk_file_chooser_set_select_multiple           gtkFuncs.gtk_file_chooser_set_select_multiple
+#define gtk_file_chooser_set_do_overwrite_confirmation gtkFuncs.gtk_file_chooser_set_do_overwrite_confirmation
+#define gtk_file_chooser_get_filename                  gtkFuncs.gtk_file_chooser_get_filename
+#define gtk_file_chooser_get_filenames                 gtkFuncs.gtk_file_chooser_get_filenames
+#define gtk_events_pending                             gtkFuncs.gtk_events_pending
+#define gtk_main_iteration                             gtkFuncs.gtk_main_iteration
+#define gtk_widget_destroy                             gtkFuncs.gtk_widget_destroy
+#define g_free                                         gtkFuncs.g_free
+#define g_slist_length                                 gtkFuncs.g_slist_length
+#define g_slist_free                                   gtkFuncs.g_slist_free
+#define g_unix_fd_add                                  gtkFuncs.g_unix_fd_add
+#define g_timeout_add                                  gtkFuncs.g_timeout_add
+#define g_source_remove                                gtkFuncs.g_source_remove
+#define g_object_set_data_full                         gtkFuncs.g_object_set_data_full
+#define g_object_unref                                 gtkFuncs.g_object_unref
+#define g_signal_connect_data                          gtkFuncs.g_signal_connect_data
+#define g_idle_add                                     gtkFuncs.g_idle_add
+#define gtk_file_chooser_set_preview_widget            gtkFuncs.gtk_file_chooser_set_preview_widget
+#define gtk_file_chooser_set_preview_widget_active     gtkFuncs.gtk_file_chooser_set_preview_widget_active
+#define gtk_file_chooser_set_use_preview_label         gtkFuncs.gtk_file_chooser_set_use_preview_label
+#define gtk_file_chooser_get_preview_filename          gtkFuncs.gtk_file_chooser_get_preview_filename
+#define gtk_image_new                                  gtkFuncs.gtk_image_new
+#define gtk_image_clear                                gtkFuncs.gtk_image_clear
+#define gtk_image_set_from_pixbuf                      gtkFuncs.gtk_image_set_from_pixbuf
+#define gtk_widget_set_size_request                    gtkFuncs.gtk_widget_set_size_request
+#define gdk_pixbuf_get_file_info                       gtkFuncs.gdk_pixbuf_get_file_info
+#define gdk_pixbuf_new_from_file_at_scale              gtkFuncs.gdk_pixbuf_new_from_file_at_scale
+#define gdk_pixbuf_new_from_data                       gtkFuncs.gdk_pixbuf_new_from_data
+#define gdk_pixbuf_get_width                           gtkFuncs.gdk_pixbuf_get_width
+#define gdk_pixbuf_get_height                          gtkFuncs.gdk_pixbuf_get_height
+#define gdk_pixbuf_get_rowstride                       gtkFuncs.gdk_pixbuf_get_rowstride
+#define gdk_pixbuf_get_n_channels                      gtkFuncs.gdk_pixbuf_get_n_channels
+#define gdk_pixbuf_get_pixels                          gtkFuncs.gdk_pixbuf_get_pixels
+#define gtk_dialog_new_with_buttons                    gtkFuncs.gtk_dialog_new_with_buttons
+#define gtk_dialog_get_content_area                    gtkFuncs.gtk_dialog_get_content_area
+#define gtk_dialog_set_default_response                gtkFuncs.gtk_dialog_set_default_response
+#define gtk_entry_new                                  gtkFuncs.gtk_entry_new
+#define gtk_entry_get_text                             gtkFuncs.gtk_entry_get_text
+#define gtk_entry_set_activates_default                gtkFuncs.gtk_entry_set_activates_default
+#define gtk_list_store_new                             gtkFuncs.gtk_list_store_new
+#define gtk_list_store_clear                           gtkFuncs.gtk_list_store_clear
+#define gtk_list_store_insert_with_values              gtkFuncs.gtk_list_store_insert_with_values
+#define gtk_tree_view_new_with_model                   gtkFuncs.gtk_tree_view_new_with_model
+#define gtk_tree_view_insert_column_with_attributes    gtkFuncs.gtk_tree_view_insert_column_with_attributes
+#define gtk_tree_view_get_selection                    gtkFuncs.gtk_tree_view_get_selection
+#define gtk_tree_selection_get_selected                gtkFuncs.gtk_tree_selection_get_selected
+#define gtk_tree_selection_select_iter                 gtkFuncs.gtk_tree_selection_select_iter
+#define gtk_tree_model_get_iter_first                  gtkFuncs.gtk_tree_model_get_iter_first
+#define gtk_tree_model_get                             gtkFuncs.gtk_tree_model_get
+#define gtk_cell_renderer_text_new                     gtkFuncs.gtk_cell_renderer_text_new
+#define gtk_scrolled_window_new                        gtkFuncs.gtk_scrolled_window_new
+#define gtk_container_add                              gtkFuncs.gtk_container_add
+#define gtk_box_pack_start                             gtkFuncs.gtk_box_pack_start
+#define gtk_label_new                                  gtkFuncs.gtk_label_new
+#define gtk_label_set_text                             gtkFuncs.gtk_label_set_text
+#define gtk_widget_show_all                            gtkFuncs.gtk_widget_show_all
+#endif
+
+static int InitGtk( void )
+{
+    gboolean ok;
+
+#ifdef NFD_MONOLITHIC_BACKEND
+    if ( !NFDi_Backend_Probe() )
+    {
+        NFDi_SetError( gtkError );
+        return 0;
+    }
+#endif
+    NFD_PROBE1( toolkit_init_start, "gtk" );
+    ok = gtk_init_check( NULL, NULL );
+    NFD_PROBE2( toolkit_init_done, "gtk", ok );
+    if ( !ok )
+    {
+        NFDi_SetError( INIT_FAIL_MSG );
+        return 0;
+    }
+    return 1;
+}
+
 
 static void AddTypeToFilterName( const char *typebuf, char *filterName, size_t bufsize )
 {
@@ -29,67 +250,85 @@ static void AddTypeToFilterName( const char *typebuf, char *filterName, size_t b
     strncat( filterName, typebuf, bufsize - len - 1 );
 }
 
-static void AddFiltersToDialog( GtkWidget *dialog, const char *filterList )
+/* the parsed filterList of one dialog, owned by the dialog */
+typedef struct
+{
+    const nfdfilter_t *filter;
+    int group;
+} FilterGroup;
+
+typedef struct
+{
+    nfdfilter_t filter;
+    FilterGroup groups[];
+} DialogFilter;
+
+static gboolean MatchFilterGroup( const GtkFileFilterInfo *info, gpointer data )
+{
+    const FilterGroup *group = (const FilterGroup*) data;
+    const char *name = info->display_name;
+
+    /* the same name GTK's own patterns are matched against */
+    return name && NFDi_Filter_MatchGroup( group->filter, group->group, name, strlen(name) );
+}
+
+static void FreeDialogFilter( gpointer data )
+{
+    DialogFilter *dialogFilter = (DialogFilter*) data;
+    NFDi_Filter_Free( &dialogFilter->filter );
+    NFDi_Free( dialogFilter );
+}
+
+/* globs and extensions both go through NFDi_Filter, so each group is one
+   custom filter backed by a DFA rather than a list of GTK patterns */
+static int AddFiltersToDialog( GtkWidget *dialog, const char *filterList )
 {
     GtkFileFilter *filter;
-    char typebuf[NFD_MAX_STRLEN] = {0};
-    const char *p_filterList = filterList;
-    char *p_typebuf = typebuf;
-    char filterName[NFD_MAX_STRLEN] = {0};
-    
+    DialogFilter *dialogFilter;
+    nfdfilter_t parsed;
+    char filterName[NFD_MAX_STRLEN];
+    size_t i = 0;
+    int group;
+
     if ( !filterList || strlen(filterList) == 0 )
-        return;
+        return 1;
 
-    filter = gtk_file_filter_new();
-    while ( 1 )
+    if ( !NFDi_Filter_Parse( &parsed, filterList ) )
+        return 0;
+    dialogFilter = NFDi_Malloc( sizeof(DialogFilter) + sizeof(FilterGroup) * (size_t) parsed.groupCount );
+    if ( !dialogFilter )
     {
-        
-        if ( NFDi_IsFilterSegmentChar(*p_filterList) )
-        {
-            char typebufWildcard[NFD_MAX_STRLEN];
-            /* add another type to the filter */
-            assert( strlen(typebuf) > 0 );
-            assert( strlen(typebuf) < NFD_MAX_STRLEN-1 );
-            
-            snprintf( typebufWildcard, NFD_MAX_STRLEN, "*.%s", typebuf );
-            AddTypeToFilterName( typebuf, filterName, NFD_MAX_STRLEN );
-            
-            gtk_file_filter_add_pattern( filter, typebufWildcard );
-            
-            p_typebuf = typebuf;
-            memset( typebuf, 0, sizeof(char) * NFD_MAX_STRLEN );
-        }
-        
-        if ( *p_filterList == ';' || *p_filterList == '\0' )
-        {
-            /* end of filter -- add it to the dialog */
-            
-            gtk_file_filter_set_name( filter, filterName );
-            gtk_file_chooser_add_filter( GTK_FILE_CHOOSER(dialog), filter );
-
-            filterName[0] = '\0';
+        NFDi_Filter_Free( &parsed );
+        return 0;
+    }
+    dialogFilter->filter = parsed;
+    g_object_set_data_full( G_OBJECT(dialog), "nfd-filter", dialogFilter, FreeDialogFilter );
 
-            if ( *p_filterList == '\0' )
-                break;
+    for ( group = 0; group < parsed.groupCount; ++group )
+    {
+        filterName[0] = '\0';
+        for ( ; i < parsed.typeCount && parsed.types[i].group == group; ++i )
+            AddTypeToFilterName( parsed.types[i].ext, filterName, NFD_MAX_STRLEN );
 
-            filter = gtk_file_filter_new();            
-        }
+        dialogFilter->groups[group].filter = &dialogFilter->filter;
+        dialogFilter->groups[group].group = group;
+        if ( filterName[0] == '\0' )
+            continue;   /* ";;" in filterList */
 
-        if ( !NFDi_IsFilterSegmentChar( *p_filterList ) )
-        {
-            *p_typebuf = *p_filterList;
-            p_typebuf++;
-        }
-
-        p_filterList++;
+        filter = gtk_file_filter_new();
+        gtk_file_filter_set_name( filter, filterName );
+        gtk_file_filter_add_custom( filter, GTK_FILE_FILTER_DISPLAY_NAME,
+                                    MatchFilterGroup, &dialogFilter->groups[group], NULL );
+        gtk_file_chooser_add_filter( GTK_FILE_CHOOSER(dialog), filter );
     }
-    
+
     /* always append a wildcard option to the end*/
 
     filter = gtk_file_filter_new();
     gtk_file_filter_set_name( filter, "*.*" );
     gtk_file_filter_add_pattern( filter, "*" );
     gtk_file_chooser_add_filter( GTK_FILE_CHOOSER(dialog), filter );
+    return 1;
 }
 
 static void SetDefaultPath( GtkWidget *dialog, const char *defaultPath )
@@ -153,7 +392,8 @@ static nfdresult_t AllocPathSet( GSList *fileList, nfdpathset_t *pathSet )
     }
 
     g_slist_free( fileList );
-    
+
+    NFD_PROBE2( pathset_built, pathSet->count, bufSize );
     return NFD_OKAY;
 }
 
@@ -162,21 +402,653 @@ static void WaitForCleanup(void)
     while (gtk_events_pending())
         gtk_main_iteration();
 }
+
+typedef struct
+{
+    GtkWidget *dialog;
+    guint cancelSource;
+    guint timeoutSource;
+} RequestSources;
+
+static gboolean OnRequestCancelled( gint fd, GIOCondition condition, gpointer data )
+{
+    RequestSources *sources = (RequestSources*)data;
+    sources->cancelSource = 0;
+    gtk_dialog_response( GTK_DIALOG(sources->dialog), GTK_RESPONSE_CANCEL );
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean OnRequestTimeout( gpointer data )
+{
+    RequestSources *sources = (RequestSources*)data;
+    sources->timeoutSource = 0;
+    gtk_dialog_response( GTK_DIALOG(sources->dialog), GTK_RESPONSE_CANCEL );
+    return G_SOURCE_REMOVE;
+}
+
+/* gtk_dialog_run, but NFD_Cancel or the request timeout close the dialog */
+static gint RunDialog( GtkWidget *dialog, nfdrequest_t *request )
+{
+    RequestSources sources = { dialog, 0, 0 };
+    int cancelFd = NFDi_Request_GetCancelFd( request );
+    unsigned int timeout = NFDi_Request_GetTimeout( request );
+    gint response;
+
+    if ( NFDi_Request_IsCancelled( request ) )
+        return GTK_RESPONSE_CANCEL;
+
+    if ( cancelFd >= 0 )
+        sources.cancelSource = g_unix_fd_add( cancelFd, G_IO_IN, OnRequestCancelled, &sources );
+    if ( timeout > 0 )
+        sources.timeoutSource = g_timeout_add( timeout, OnRequestTimeout, &sources );
+
+    NFD_PROBE1( dialog_shown, "gtk" );
+    response = gtk_dialog_run( GTK_DIALOG(dialog) );
+    NFD_PROBE2( dialog_closed, "gtk", response );
+
+    if ( sources.cancelSource )
+        g_source_remove( sources.cancelSource );
+    if ( sources.timeoutSource )
+        g_source_remove( sources.timeoutSource );
+
+    return response;
+}
+
+/* NFD_REQUEST_PREVIEW: a thumbnail pane for the open dialogs.  Thumbnails
+   are decoded on a small worker pool and kept in a disk cache, so the GTK
+   thread only ever hands out paths and shows finished pixbufs. */
+
+#define PREVIEW_SIZE        256 /* longest edge of a thumbnail */
+#define PREVIEW_MAX_WORKERS 4
+
+#define THUMB_MAGIC "NFT1"
+
+struct PreviewJob;
+
+/* one per dialog, referenced by the dialog and every job it queued */
+typedef struct
+{
+    GtkWidget *dialog;
+    GtkWidget *image;
+    unsigned int generation;  /* bumped on every selection change, atomic */
+    int refs;                 /* atomic */
+    int closed;               /* under previewLock */
+    struct PreviewJob *ready; /* waiting for their idle source, under previewLock */
+} Preview;
+
+typedef struct PreviewJob
+{
+    Preview *preview;
+    unsigned int generation;
+    GdkPixbuf *thumbnail;     /* NULL hides the pane */
+    guint source;             /* ShowThumbnail, once the thumbnail is ready */
+    struct PreviewJob *next;  /* in previewJobs, then in preview->ready */
+    char path[];
+} PreviewJob;
+
+/* a cache file is this header, the path, then width * height RGBA pixels;
+   all of it has to match the file as it is now */
+typedef struct
+{
+    char magic[4];
+    uint32_t width;
+    uint32_t height;
+    uint32_t pathLen;
+    int64_t mtimeSec;
+    int64_t mtimeNsec;
+    uint64_t size;
+} ThumbHeader;
+
+static pthread_mutex_t previewLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t previewCond = PTHREAD_COND_INITIALIZER;
+static PreviewJob *previewJobs = NULL;  /* newest first, it's the one on screen */
+static pthread_t previewWorkers[PREVIEW_MAX_WORKERS];
+static int previewWorkerCount = 0;
+static int previewIdle = 0;
+static int previewShutdown = 0;
+
+static pthread_once_t thumbDirOnce = PTHREAD_ONCE_INIT;
+static char thumbDir[PATH_MAX];
+
+/* $XDG_CACHE_HOME/nfd/thumbnails, or empty to run without a cache */
+static void FindThumbDirOnce( void )
+{
+    const char *cache = getenv( "XDG_CACHE_HOME" );
+    const char *home = getenv( "HOME" );
+    int len = -1;
+
+    if ( cache && cache[0] == '/' )
+        len = snprintf( thumbDir, sizeof(thumbDir), "%s", cache );
+    else if ( home && home[0] == '/' )
+        len = snprintf( thumbDir, sizeof(thumbDir), "%s/.cache", home );
+
+    /* leave room for "/nfd/thumbnails/<hash>.XXXXXX" */
+    if ( len < 0 || (size_t)len + 40 > sizeof(thumbDir) )
+    {
+        thumbDir[0] = '\0';
+        return;
+    }
+
+    mkdir( thumbDir, 0700 );
+    strcpy( thumbDir + len, "/nfd" );
+    mkdir( thumbDir, 0700 );
+    strcpy( thumbDir + len + 4, "/thumbnails" );
+    if ( mkdir( thumbDir, 0700 ) != 0 && errno != EEXIST )
+        thumbDir[0] = '\0';
+}
+
+static void FillThumbHeader( ThumbHeader *header, const char *path, const struct stat *st,
+                             uint32_t width, uint32_t height )
+{
+    memset( header, 0, sizeof(ThumbHeader) );
+    memcpy( header->magic, THUMB_MAGIC, sizeof(header->magic) );
+    header->width = width;
+    header->height = height;
+    header->pathLen = (uint32_t)strlen( path );
+    header->mtimeSec = (int64_t)st->st_mtim.tv_sec;
+    header->mtimeNsec = (int64_t)st->st_mtim.tv_nsec;
+    header->size = (uint64_t)st->st_size;
+}
+
+/* FNV-1a of the path, mtime and size, so an edited file misses the cache */
+static void GetThumbPath( char *thumbPath, const char *path, const struct stat *st )
+{
+    ThumbHeader key;
+    uint64_t hash;
+
+    hash = NFDi_Hash( NFDi_HASH_INIT, path, strlen( path ) );
+    FillThumbHeader( &key, path, st, 0, 0 );
+    hash = NFDi_Hash( hash, &key.mtimeSec, sizeof(key) - offsetof(ThumbHeader, mtimeSec) );
+
+    snprintf( thumbPath, PATH_MAX, "%s/%016llx", thumbDir, (unsigned long long)hash );
+}
+
+static int ReadAll( int fd, void *buf, size_t len )
+{
+    size_t done = 0;
+    while ( done < len )
+    {
+        ssize_t n = read( fd, (char*)buf + done, len - done );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return 0;
+        done += (size_t)n;
+    }
+    return 1;
+}
+
+static void FreePixels( guchar *pixels, gpointer data )
+{
+    free( pixels );
+}
+
+/* takes the pixels, packed RGBA */
+static GdkPixbuf *WrapPixels( guchar *pixels, int width, int height )
+{
+    GdkPixbuf *pixbuf = gdk_pixbuf_new_from_data( pixels, GDK_COLORSPACE_RGB, TRUE, 8,
+                                                  width, height, width * 4, FreePixels, NULL );
+    if ( !pixbuf )
+        free( pixels );
+    return pixbuf;
+}
+
+static guchar *LoadThumbnail( const char *thumbPath, const char *path, const struct stat *st,
+                              int *width, int *height )
+{
+    ThumbHeader header, expected;
+    char *storedPath = NULL;
+    guchar *pixels = NULL;
+    size_t pixelsLen;
+    int fd = open( thumbPath, O_RDONLY | O_CLOEXEC );
+
+    if ( fd < 0 )
+        return NULL;
+
+    if ( !ReadAll( fd, &header, sizeof(header) ) )
+        goto done;
+    FillThumbHeader( &expected, path, st, header.width, header.height );
+    if ( memcmp( &header, &expected, sizeof(header) ) != 0 ||
+         header.width == 0 || header.width > PREVIEW_SIZE ||
+         header.height == 0 || header.height > PREVIEW_SIZE )
+        goto done;
+
+    /* a hash collision with another path */
+    storedPath = malloc( header.pathLen );
+    if ( !storedPath || !ReadAll( fd, storedPath, header.pathLen ) ||
+         memcmp( storedPath, path, header.pathLen ) != 0 )
+        goto done;
+
+    pixelsLen = (size_t)header.width * header.height * 4;
+    pixels = malloc( pixelsLen );
+    if ( pixels && !ReadAll( fd, pixels, pixelsLen ) )
+    {
+        free( pixels );
+        pixels = NULL;
+    }
+    *width = (int)header.width;
+    *height = (int)header.height;
+
+done:
+    free( storedPath );
+    close( fd );
+    return pixels;
+}
+
+/* written aside and renamed over, so no reader sees half a thumbnail */
+static void SaveThumbnail( const char *thumbPath, const char *path, const struct stat *st,
+                           const guchar *pixels, int width, int height )
+{
+    char tmpPath[PATH_MAX];
+    ThumbHeader header;
+    int fd, ok;
+
+    snprintf( tmpPath, sizeof(tmpPath), "%s.XXXXXX", thumbPath );
+    fd = mkstemp( tmpPath );
+    if ( fd < 0 )
+        return;
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    FillThumbHeader( &header, path, st, (uint32_t)width, (uint32_t)height );
+    ok = NFDi_WriteAll( fd, &header, sizeof(header) ) &&
+         NFDi_WriteAll( fd, path, header.pathLen ) &&
+         NFDi_WriteAll( fd, pixels, (size_t)width * height * 4 );
+    ok = close( fd ) == 0 && ok;
+
+    if ( !ok || rename( tmpPath, thumbPath ) != 0 )
+        unlink( tmpPath );
+}
+
+/* packed RGBA of path scaled to fit PREVIEW_SIZE, NULL if it isn't an image */
+static guchar *DecodeThumbnail( const char *path, int *width, int *height )
+{
+    GdkPixbuf *scaled;
+    const guchar *src;
+    guchar *pixels = NULL;
+    int fileWidth, fileHeight, channels, stride, x, y;
+
+    /* reads only the header, so most files that aren't images stop here */
+    if ( !gdk_pixbuf_get_file_info( path, &fileWidth, &fileHeight ) ||
+         fileWidth <= 0 || fileHeight <= 0 )
+        return NULL;
+
+    /* loaders like JPEG's decode straight to the smaller size; never
+       scales up */
+    scaled = gdk_pixbuf_new_from_file_at_scale( path,
+                                                MIN( fileWidth, PREVIEW_SIZE ),
+                                                MIN( fileHeight, PREVIEW_SIZE ),
+                                                TRUE, NULL );
+    if ( !scaled )
+        return NULL;
+
+    *width = gdk_pixbuf_get_width( scaled );
+    *height = gdk_pixbuf_get_height( scaled );
+    channels = gdk_pixbuf_get_n_channels( scaled );
+    stride = gdk_pixbuf_get_rowstride( scaled );
+    src = gdk_pixbuf_get_pixels( scaled );
+
+    if ( (channels == 3 || channels == 4) &&
+         *width > 0 && *width <= PREVIEW_SIZE && *height > 0 && *height <= PREVIEW_SIZE )
+        pixels = malloc( (size_t)*width * *height * 4 );
+
+    if ( pixels )
+    {
+        for ( y = 0; y < *height; ++y )
+        {
+            const guchar *in = src + (size_t)y * stride;
+            guchar *out = pixels + (size_t)y * *width * 4;
+            for ( x = 0; x < *width; ++x, in += channels, out += 4 )
+            {
+                out[0] = in[0];
+                out[1] = in[1];
+                out[2] = in[2];
+                out[3] = channels == 4 ? in[3] : 255;
+            }
+        }
+    }
+
+    g_object_unref( scaled );
+    return pixels;
+}
+
+/* on a worker */
+static GdkPixbuf *MakeThumbnail( const char *path )
+{
+    char thumbPath[PATH_MAX];
+    struct stat st;
+    guchar *pixels = NULL;
+    int width, height;
+
+    if ( stat( path, &st ) != 0 || !S_ISREG( st.st_mode ) )
+        return NULL;
+
+    pthread_once( &thumbDirOnce, FindThumbDirOnce );
+    if ( thumbDir[0] )
+    {
+        GetThumbPath( thumbPath, path, &st );
+        pixels = LoadThumbnail( thumbPath, path, &st, &width, &height );
+    }
+
+    if ( !pixels )
+    {
+        pixels = DecodeThumbnail( path, &width, &height );
+        if ( !pixels )
+            return NULL;
+        if ( thumbDir[0] )
+            SaveThumbnail( thumbPath, path, &st, pixels, width, height );
+    }
+
+    return WrapPixels( pixels, width, height );
+}
+
+static void ReleasePreview( Preview *preview )
+{
+    if ( __atomic_sub_fetch( &preview->refs, 1, __ATOMIC_ACQ_REL ) == 0 )
+        free( preview );
+}
+
+static void FreePreviewJob( PreviewJob *job )
+{
+    if ( job->thumbnail )
+        g_object_unref( job->thumbnail );
+    ReleasePreview( job->preview );
+    free( job );
+}
+
+/* on the GTK thread, unless the selection moved on; ClosePreview removes
+   the ones still pending */
+static gboolean ShowThumbnail( gpointer data )
+{
+    PreviewJob *job = (PreviewJob*)data;
+    Preview *preview = job->preview;
+    PreviewJob **link;
+
+    pthread_mutex_lock( &previewLock );
+    for ( link = &preview->ready; *link != job; link = &(*link)->next )
+        ;
+    *link = job->next;
+    pthread_mutex_unlock( &previewLock );
+
+    if ( job->generation == preview->generation )
+    {
+        if ( job->thumbnail )
+            gtk_image_set_from_pixbuf( GTK_IMAGE(preview->image), job->thumbnail );
+        gtk_file_chooser_set_preview_widget_active( GTK_FILE_CHOOSER(preview->dialog),
+                                                    job->thumbnail != NULL );
+    }
+
+    FreePreviewJob( job );
+    return G_SOURCE_REMOVE;
+}
+
+static void *PreviewWorkerMain( void *data )
+{
+    pthread_mutex_lock( &previewLock );
+    while ( 1 )
+    {
+        PreviewJob *job;
+        int closed;
+
+        while ( !previewJobs && !previewShutdown )
+        {
+            ++previewIdle;
+            pthread_cond_wait( &previewCond, &previewLock );
+            --previewIdle;
+        }
+        if ( previewShutdown )
+            break;
+
+        job = previewJobs;
+        previewJobs = job->next;
+        closed = job->preview->closed;
+        pthread_mutex_unlock( &previewLock );
+
+        /* stale jobs are dropped without decoding anything */
+        if ( closed || job->generation != __atomic_load_n( &job->preview->generation, __ATOMIC_RELAXED ) )
+        {
+            FreePreviewJob( job );
+            pthread_mutex_lock( &previewLock );
+            continue;
+        }
+
+        job->thumbnail = MakeThumbnail( job->path );
+
+        /* the default context may never run again once the dialog is
+           gone, so the source is only added while ClosePreview can still
+           take it back */
+        pthread_mutex_lock( &previewLock );
+        if ( job->preview->closed )
+        {
+            pthread_mutex_unlock( &previewLock );
+            FreePreviewJob( job );
+            pthread_mutex_lock( &previewLock );
+            continue;
+        }
+        job->next = job->preview->ready;
+        job->preview->ready = job;
+        job->source = g_idle_add( ShowThumbnail, job );
+    }
+    pthread_mutex_unlock( &previewLock );
+    return NULL;
+}
+
+/* workers start on demand, up to one per core */
+static void QueuePreviewJob( PreviewJob *job )
+{
+    long cores = sysconf( _SC_NPROCESSORS_ONLN );
+    int maxWorkers = cores < 1 ? 1 : cores > PREVIEW_MAX_WORKERS ? PREVIEW_MAX_WORKERS : (int)cores;
+
+    pthread_mutex_lock( &previewLock );
+    job->next = previewJobs;
+    previewJobs = job;
+    if ( previewIdle == 0 && previewWorkerCount < maxWorkers &&
+         pthread_create( &previewWorkers[previewWorkerCount], NULL, PreviewWorkerMain, NULL ) == 0 )
+        ++previewWorkerCount;
+    pthread_cond_signal( &previewCond );
+    pthread_mutex_unlock( &previewLock );
+}
+
+/* workers still running when the library is unloaded would crash */
+__attribute__((destructor)) static void StopPreviewWorkers( void )
+{
+    int i;
+
+    pthread_mutex_lock( &previewLock );
+    previewShutdown = 1;
+    pthread_cond_broadcast( &previewCond );
+    pthread_mutex_unlock( &previewLock );
+
+    for ( i = 0; i < previewWorkerCount; ++i )
+        pthread_join( previewWorkers[i], NULL );
+}
+
+static void OnUpdatePreview( GtkFileChooser *chooser, gpointer data )
+{
+    Preview *preview = (Preview*)data;
+    char *path = gtk_file_chooser_get_preview_filename( chooser );
+    size_t len = path ? strlen( path ) : 0;
+    PreviewJob *job = path ? malloc( sizeof(PreviewJob) + len + 1 ) : NULL;
+    unsigned int generation = __atomic_add_fetch( &preview->generation, 1, __ATOMIC_RELAXED );
+
+    /* the pane stays up until the worker knows whether this is an image */
+    gtk_image_clear( GTK_IMAGE(preview->image) );
+    if ( !job )
+    {
+        gtk_file_chooser_set_preview_widget_active( chooser, FALSE );
+        g_free( path );
+        return;
+    }
+
+    job->preview = preview;
+    job->generation = generation;
+    job->thumbnail = NULL;
+    job->source = 0;
+    memcpy( job->path, path, len + 1 );
+    g_free( path );
+
+    __atomic_add_fetch( &preview->refs, 1, __ATOMIC_RELAXED );
+    QueuePreviewJob( job );
+}
+
+/* when the dialog is destroyed; jobs still on a worker see closed */
+static void ClosePreview( gpointer data, GClosure *closure )
+{
+    Preview *preview = (Preview*)data;
+    PreviewJob *ready, *next;
+
+    pthread_mutex_lock( &previewLock );
+    preview->closed = 1;
+    ready = preview->ready;
+    preview->ready = NULL;
+    for ( next = ready; next; next = next->next )
+        g_source_remove( next->source );
+    pthread_mutex_unlock( &previewLock );
+
+    for ( ; ready; ready = next )
+    {
+        next = ready->next;
+        FreePreviewJob( ready );
+    }
+    ReleasePreview( preview );
+}
+
+static void AddPreviewToDialog( GtkWidget *dialog, nfdrequest_t *request )
+{
+    Preview *preview;
+
+    if ( !(NFDi_Request_GetFlags( request ) & NFD_REQUEST_PREVIEW) )
+        return;
+
+    /* without memory the dialog still works, just without the pane */
+    preview = malloc( sizeof(Preview) );
+    if ( !preview )
+        return;
+    preview->dialog = dialog;
+    preview->image = gtk_image_new();
+    preview->generation = 0;
+    preview->refs = 1;
+    preview->closed = 0;
+    preview->ready = NULL;
+
+    gtk_widget_set_size_request( preview->image, PREVIEW_SIZE, -1 );
+    gtk_file_chooser_set_preview_widget( GTK_FILE_CHOOSER(dialog), preview->image );
+    gtk_file_chooser_set_use_preview_label( GTK_FILE_CHOOSER(dialog), FALSE );
+    g_signal_connect_data( dialog, "update-preview", G_CALLBACK(OnUpdatePreview),
+                           preview, ClosePreview, 0 );
+}
+
+/* NFD_SearchDialog: a search entry over the best matches from the file
+   name index, asked again on every change to the text and whenever the
+   index has news */
+#define SEARCH_RESULTS 200
+
+enum { SEARCH_NAME_COLUMN, SEARCH_DIR_COLUMN };
+
+typedef struct
+{
+    GtkWidget *entry;
+    GtkListStore *store;
+    GtkWidget *view;
+    GtkWidget *status;
+    nfdindex_t *index;
+    nfdindexsnapshot_t *snapshot;
+    int updating;
+    nfdfilter_t filter;
+    uint32_t hits[SEARCH_RESULTS];
+} Search;
+
+static void RunSearch( Search *search )
+{
+    char status[64];
+    GtkTreeIter iter;
+    size_t count = 0, i;
+
+    /* the store copies the strings, the snapshot can go any time after */
+    gtk_list_store_clear( search->store );
+    if ( search->snapshot )
+        count = NFDi_Index_Query( search->snapshot, gtk_entry_get_text( GTK_ENTRY(search->entry) ),
+                                  &search->filter, search->hits, SEARCH_RESULTS );
+    for ( i = 0; i < count; ++i )
+    {
+        gtk_list_store_insert_with_values( search->store, &iter, -1,
+                                           SEARCH_NAME_COLUMN, NFDi_Index_GetName( search->snapshot, search->hits[i] ),
+                                           SEARCH_DIR_COLUMN, NFDi_Index_GetDir( search->snapshot, search->hits[i] ),
+                                           -1 );
+    }
+    if ( gtk_tree_model_get_iter_first( GTK_TREE_MODEL(search->store), &iter ) )
+        gtk_tree_selection_select_iter( gtk_tree_view_get_selection( GTK_TREE_VIEW(search->view) ), &iter );
+
+    if ( !search->snapshot )
+        snprintf( status, sizeof(status), "Indexing..." );
+    else
+        snprintf( status, sizeof(status), search->updating ? "%zu%s matches, indexing..." : "%zu%s matches",
+                  count, count == SEARCH_RESULTS ? "+" : "" );
+    gtk_label_set_text( GTK_LABEL(search->status), status );
+}
+
+static void OnSearchChanged( GtkEditable *editable, gpointer data )
+{
+    RunSearch( (Search*)data );
+}
+
+static gboolean OnIndexWake( gint fd, GIOCondition condition, gpointer data )
+{
+    Search *search = (Search*)data;
+    nfdindexsnapshot_t *snapshot = NFDi_Index_GetSnapshot( search->index, &search->updating );
+
+    NFDi_Index_ReleaseSnapshot( search->snapshot );
+    search->snapshot = snapshot;
+    RunSearch( search );
+    return G_SOURCE_CONTINUE;
+}
+
+static void OnSearchRowActivated( GtkTreeView *view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data )
+{
+    gtk_dialog_response( GTK_DIALOG(data), GTK_RESPONSE_ACCEPT );
+}
+
+/* the selected file, NFDi_Malloc'd, or NULL */
+static nfdchar_t *GetSearchSelection( Search *search )
+{
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    gchar *name, *dir;
+    nfdchar_t *path;
+    size_t dirLen, nameLen;
+
+    if ( !gtk_tree_selection_get_selected( gtk_tree_view_get_selection( GTK_TREE_VIEW(search->view) ),
+                                           &model, &iter ) )
+        return NULL;
+    gtk_tree_model_get( model, &iter, SEARCH_NAME_COLUMN, &name, SEARCH_DIR_COLUMN, &dir, -1 );
+
+    dirLen = strlen( dir );
+    nameLen = strlen( name );
+    path = NFDi_Malloc( dirLen + nameLen + 2 );
+    if ( path )
+    {
+        /* "/" is the only folder that already ends in a separator */
+        memcpy( path, dir, dirLen );
+        if ( dirLen != 1 )
+            path[dirLen++] = '/';
+        memcpy( path + dirLen, name, nameLen + 1 );
+    }
+    g_free( name );
+    g_free( dir );
+    return path;
+}
                                  
 /* public */
 
-nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
-                            const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath )
-{    
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
     GtkWidget *dialog;
     nfdresult_t result;
 
-    if ( !gtk_init_check( NULL, NULL ) )
-    {
-        NFDi_SetError(INIT_FAIL_MSG);
+    if ( !InitGtk() )
         return NFD_ERROR;
-    }
 
     dialog = gtk_file_chooser_dialog_new( "Open File",
                                           NULL,
@@ -186,13 +1058,19 @@ nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
                                           NULL );
 
     /* Build the filter list */
-    AddFiltersToDialog(dialog, filterList);
+    if ( !AddFiltersToDialog(dialog, filterList) )
+    {
+        gtk_widget_destroy(dialog);
+        return NFD_ERROR;
+    }
 
     /* Set the default path */
     SetDefaultPath(dialog, defaultPath);
 
+    AddPreviewToDialog( dialog, request );
+
     result = NFD_CANCEL;
-    if ( gtk_dialog_run( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+    if ( RunDialog( dialog, request ) == GTK_RESPONSE_ACCEPT )
     {
         char *filename;
 
@@ -218,22 +1096,20 @@ nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
     gtk_widget_destroy(dialog);
     WaitForCleanup();
 
-    return result;
+    return NFDi_Request_FinishPath( request, result, outPath );
 }
 
 
-nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
-                                    const nfdchar_t *defaultPath,
-                                    nfdpathset_t *outPaths )
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
 {
     GtkWidget *dialog;
     nfdresult_t result;
 
-    if ( !gtk_init_check( NULL, NULL ) )
-    {
-        NFDi_SetError(INIT_FAIL_MSG);
+    if ( !InitGtk() )
         return NFD_ERROR;
-    }
 
     dialog = gtk_file_chooser_dialog_new( "Open Files",
                                           NULL,
@@ -244,13 +1120,19 @@ nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
     gtk_file_chooser_set_select_multiple( GTK_FILE_CHOOSER(dialog), TRUE );
 
     /* Build the filter list */
-    AddFiltersToDialog(dialog, filterList);
+    if ( !AddFiltersToDialog(dialog, filterList) )
+    {
+        gtk_widget_destroy(dialog);
+        return NFD_ERROR;
+    }
 
     /* Set the default path */
     SetDefaultPath(dialog, defaultPath);
 
+    AddPreviewToDialog( dialog, request );
+
     result = NFD_CANCEL;
-    if ( gtk_dialog_run( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+    if ( RunDialog( dialog, request ) == GTK_RESPONSE_ACCEPT )
     {
         GSList *fileList = gtk_file_chooser_get_filenames( GTK_FILE_CHOOSER(dialog) );
         if ( AllocPathSet( fileList, outPaths ) == NFD_ERROR )
@@ -266,21 +1148,19 @@ nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
     gtk_widget_destroy(dialog);
     WaitForCleanup();
 
-    return result;
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
 }
 
-nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
-                            const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath )
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
 {
     GtkWidget *dialog;
     nfdresult_t result;
 
-    if ( !gtk_init_check( NULL, NULL ) )
-    {
-        NFDi_SetError(INIT_FAIL_MSG);
+    if ( !InitGtk() )
         return NFD_ERROR;
-    }
 
     dialog = gtk_file_chooser_dialog_new( "Save File",
                                           NULL,
@@ -290,14 +1170,18 @@ nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
                                           NULL ); 
     gtk_file_chooser_set_do_overwrite_confirmation( GTK_FILE_CHOOSER(dialog), TRUE );
 
-    /* Build the filter list */    
-    AddFiltersToDialog(dialog, filterList);
+    /* Build the filter list */
+    if ( !AddFiltersToDialog(dialog, filterList) )
+    {
+        gtk_widget_destroy(dialog);
+        return NFD_ERROR;
+    }
 
     /* Set the default path */
     SetDefaultPath(dialog, defaultPath);
     
     result = NFD_CANCEL;    
-    if ( gtk_dialog_run( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+    if ( RunDialog( dialog, request ) == GTK_RESPONSE_ACCEPT )
     {
         char *filename;
         filename = gtk_file_chooser_get_filename( GTK_FILE_CHOOSER(dialog) );
@@ -325,17 +1209,15 @@ nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
     return result;
 }
 
-nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
-    nfdchar_t **outPath)
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
 {
     GtkWidget *dialog;
     nfdresult_t result;
 
-    if (!gtk_init_check(NULL, NULL))
-    {
-        NFDi_SetError(INIT_FAIL_MSG);
+    if ( !InitGtk() )
         return NFD_ERROR;
-    }
 
     dialog = gtk_file_chooser_dialog_new( "Select folder",
                                           NULL,
@@ -350,7 +1232,7 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
     SetDefaultPath(dialog, defaultPath);
     
     result = NFD_CANCEL;    
-    if ( gtk_dialog_run( GTK_DIALOG(dialog) ) == GTK_RESPONSE_ACCEPT )
+    if ( RunDialog( dialog, request ) == GTK_RESPONSE_ACCEPT )
     {
         char *filename;
         filename = gtk_file_chooser_get_filename( GTK_FILE_CHOOSER(dialog) );
@@ -375,5 +1257,113 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
     gtk_widget_destroy(dialog);
     WaitForCleanup();
     
-    return result;
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    GtkWidget *dialog, *content, *scrolled;
+    Search search;
+    guint wakeSource;
+    nfdresult_t result;
+
+    if ( !InitGtk() )
+        return NFD_ERROR;
+
+    memset( &search, 0, sizeof(search) );
+    if ( !NFDi_Filter_Parse( &search.filter, filterList ) )
+        return NFD_ERROR;
+    search.index = NFDi_Index_Acquire( roots );
+    if ( !search.index )
+    {
+        NFDi_Filter_Free( &search.filter );
+        return NFD_ERROR;
+    }
+    search.updating = 1;
+
+    dialog = gtk_dialog_new_with_buttons( "Find File",
+                                          NULL,
+                                          0,
+                                          "_Cancel", GTK_RESPONSE_CANCEL,
+                                          "_Open", GTK_RESPONSE_ACCEPT,
+                                          NULL );
+    gtk_dialog_set_default_response( GTK_DIALOG(dialog), GTK_RESPONSE_ACCEPT );
+    content = gtk_dialog_get_content_area( GTK_DIALOG(dialog) );
+
+    search.entry = gtk_entry_new();
+    gtk_entry_set_activates_default( GTK_ENTRY(search.entry), TRUE );
+    gtk_box_pack_start( GTK_BOX(content), search.entry, FALSE, FALSE, 0 );
+
+    search.store = gtk_list_store_new( 2, G_TYPE_STRING, G_TYPE_STRING );
+    search.view = gtk_tree_view_new_with_model( GTK_TREE_MODEL(search.store) );
+    g_object_unref( search.store );
+    gtk_tree_view_insert_column_with_attributes( GTK_TREE_VIEW(search.view), -1, "Name",
+                                                 gtk_cell_renderer_text_new(), "text", SEARCH_NAME_COLUMN, NULL );
+    gtk_tree_view_insert_column_with_attributes( GTK_TREE_VIEW(search.view), -1, "Folder",
+                                                 gtk_cell_renderer_text_new(), "text", SEARCH_DIR_COLUMN, NULL );
+    scrolled = gtk_scrolled_window_new( NULL, NULL );
+    gtk_widget_set_size_request( scrolled, 640, 400 );
+    gtk_container_add( GTK_CONTAINER(scrolled), search.view );
+    gtk_box_pack_start( GTK_BOX(content), scrolled, TRUE, TRUE, 0 );
+
+    search.status = gtk_label_new( NULL );
+    gtk_box_pack_start( GTK_BOX(content), search.status, FALSE, FALSE, 0 );
+    gtk_widget_show_all( content );
+
+    g_signal_connect_data( search.entry, "changed", G_CALLBACK(OnSearchChanged), &search, NULL, 0 );
+    g_signal_connect_data( search.view, "row-activated", G_CALLBACK(OnSearchRowActivated), dialog, NULL, 0 );
+    wakeSource = g_unix_fd_add( NFDi_Index_GetWakeFd( search.index ), G_IO_IN, OnIndexWake, &search );
+    OnIndexWake( -1, G_IO_IN, &search );
+
+    /* Enter with nothing found leaves the dialog up */
+    result = NFD_CANCEL;
+    while ( RunDialog( dialog, request ) == GTK_RESPONSE_ACCEPT )
+    {
+        *outPath = GetSearchSelection( &search );
+        if ( *outPath )
+        {
+            result = NFD_OKAY;
+            break;
+        }
+    }
+
+    g_source_remove( wakeSource );
+    WaitForCleanup();
+    gtk_widget_destroy(dialog);
+    WaitForCleanup();
+
+    NFDi_Index_ReleaseSnapshot( search.snapshot );
+    NFDi_Index_Release( search.index );
+    NFDi_Filter_Free( &search.filter );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
 }
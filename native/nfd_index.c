@@ -0,0 +1,2202 @@
+/*
+  Native File Dialog
+
+  File name index for NFD_SearchDialog, see nfd_index.h.
+
+  A snapshot is one flat blob, the same in memory and in the disk cache at
+  $XDG_CACHE_HOME/nfd/index/<hash of the roots>.idx, so a cached index is
+  mapped and used without being parsed:
+
+    header
+    dirs      sorted by path, with the mtime they were read at
+    files     grouped by folder and sorted by name within it
+    grams     every trigram of the lowercased names, sorted
+    postings  for each trigram, the ascending ids of the files having it
+    strings   the roots, then each folder's path followed by its file names
+
+  Names are padded with two NULs before taking trigrams, so a term of one
+  or two bytes is the start of a range of trigrams.  A query walks the
+  shortest posting list, skips ahead in the next shortest ones, and checks
+  each candidate's name before taking it, which stops as soon as enough
+  files were found.
+
+  Keeping up to date is by folder: a folder whose mtime moved, or that
+  inotify reported, is read again and a new snapshot is built from the
+  old one with that folder replaced.  When inotify runs out of watches or
+  overflows, every folder's mtime is checked instead.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nfd_index.h"
+#include "nfd_probes.h"
+
+
+static const char NO_ROOTS_MSG[] = "NFD_SearchDialog needs at least one folder to search";
+static const char BAD_ROOT_MSG[] = "A folder to search does not exist";
+static const char NO_THREAD_MSG[] = "Could not start the search index";
+
+#define INDEX_MAGIC        "NFDX"
+#define INDEX_VERSION      1
+#define INDEX_BYTE_ORDER   0x01020304u
+#define INDEX_MAX_THREADS  8
+#define INDEX_MAX_GRAMS    256     /* per name, NAME_MAX is 255 */
+#define INDEX_MAX_TERMS    8
+#define INDEX_MAX_LISTS    64      /* posting lists a query looks at */
+#define INDEX_SKIP_LISTS   3       /* lists skipped through besides the one walked */
+#define INDEX_MAX_IDLE     4       /* indexes kept with no dialog using them */
+#define INDEX_SETTLE_MS    200     /* quiet time after a change before reading again */
+#define INDEX_MAX_DELAY_MS 1000    /* ... but never longer than this after the first */
+#define INDEX_SAVE_MS      60000   /* least time between writes of the disk cache */
+#define INDEX_WATCH_MASK   ( IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                             IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW )
+#define NOT_FOUND          ((size_t)-1)
+
+/* the disk format; every section keeps the next one aligned */
+typedef struct
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t byteOrder;     /* INDEX_BYTE_ORDER as written by the producer */
+    uint32_t rootsLen;      /* bytes of roots at the start of strings */
+    uint64_t dirCount;
+    uint64_t fileCount;
+    uint64_t gramCount;
+    uint64_t postingCount;
+    uint64_t stringsSize;
+} IndexHeader;
+
+typedef struct
+{
+    uint32_t path;          /* offset into strings */
+    uint32_t firstFile;
+    uint32_t fileCount;
+    uint32_t mtimeNsec;
+    int64_t mtimeSec;
+} IndexDirRecord;
+
+typedef struct
+{
+    uint32_t name;          /* offset into strings */
+    uint32_t dir;
+} IndexFileRecord;
+
+typedef struct
+{
+    uint32_t gram;          /* three lowercased bytes, the first one highest */
+    uint32_t first;         /* into postings */
+    uint32_t count;
+} IndexGramRecord;
+
+struct nfdindexsnapshot_s
+{
+    int refs;               /* __atomic */
+    void *base;
+    size_t size;
+    int mapped;             /* base is a mapping of the disk cache, else malloc'd */
+    const IndexHeader *header;
+    const IndexDirRecord *dirs;
+    const IndexFileRecord *files;
+    const IndexGramRecord *grams;
+    const uint32_t *postings;
+    const char *strings;
+};
+
+/* one folder as the background thread knows it */
+typedef struct
+{
+    const char *path;
+    const char *names;      /* file names back to back, sorted, NULL if none */
+    size_t namesLen;
+    uint32_t fileCount;
+    uint32_t mtimeNsec;
+    int64_t mtimeSec;
+    int wd;                 /* inotify watch, -1 for none */
+    char *ownedPath;        /* path and names, when they aren't in the base snapshot */
+    char *ownedNames;
+    int removed;
+} IndexDir;
+
+typedef struct
+{
+    IndexDir *dirs;
+    size_t count;
+    size_t cap;
+    size_t sorted;          /* dirs[0..sorted) are in path order, the rest came since */
+    size_t *buckets;        /* by path, index + 1, 0 for empty */
+    size_t bucketMask;
+    nfdindexsnapshot_t *base;
+} IndexModel;
+
+typedef struct
+{
+    char **paths;
+    size_t count;
+    size_t cap;
+} PathList;
+
+typedef struct
+{
+    int wd;                 /* -1 for empty */
+    char *path;
+} WatchSlot;
+
+typedef struct IndexEngine IndexEngine;
+
+struct nfdindex_s
+{
+    nfdindex_t *next;
+    IndexEngine *engine;
+    int wakePipe[2];
+    int woken;              /* under the engine's lock */
+};
+
+struct IndexEngine
+{
+    IndexEngine *next;
+    char *roots;            /* resolved, sorted, back to back */
+    size_t rootsLen;
+    char cachePath[PATH_MAX];   /* empty to run without the disk cache */
+    int users;              /* handles, under indexLock */
+    long long lastUsed;
+    int stop;               /* __atomic */
+    int controlPipe[2];     /* 'q' stops the thread, 'r' asks for a check */
+    pthread_t thread;
+
+    pthread_mutex_t lock;   /* what follows */
+    nfdindexsnapshot_t *snapshot;
+    int updating;
+    nfdindex_t *handles;
+};
+
+/* the background thread's own state */
+typedef struct
+{
+    IndexEngine *engine;
+    IndexModel model;
+    int inotifyFd;
+    WatchSlot *watches;
+    size_t watchMask;
+    size_t watchCount;
+    int watchesFull;        /* ran out of inotify watches */
+    int watchedAll;         /* every folder and root is watched */
+    PathList dirty;
+    int revalidate;
+    long long firstChange;
+    long long lastChange;
+    long long lastSave;
+    int changed;
+} IndexWorker;
+
+static pthread_mutex_t indexLock = PTHREAD_MUTEX_INITIALIZER;
+static IndexEngine *engines = NULL;
+
+
+static unsigned char Fold( unsigned char c )
+{
+    return ( c >= 'A' && c <= 'Z' ) ? (unsigned char)( c + 'a' - 'A' ) : c;
+}
+
+/* '/' sorts before every other byte, so a folder is followed by everything
+   below it and nothing else */
+static int ComparePaths( const char *a, const char *b )
+{
+    const unsigned char *x = (const unsigned char*)a;
+    const unsigned char *y = (const unsigned char*)b;
+    int cx, cy;
+
+    for ( ;; ++x, ++y )
+    {
+        cx = *x == '/' ? 1 : *x == '\0' ? 0 : *x + 1;
+        cy = *y == '/' ? 1 : *y == '\0' ? 0 : *y + 1;
+        if ( cx != cy || cx == 0 )
+            return cx - cy;
+    }
+}
+
+/* bytes of parent's path at the start of its children's, the '/' included */
+static size_t ChildPrefixLen( const char *parent, size_t len )
+{
+    return ( len == 1 && parent[0] == '/' ) ? 1 : len + 1;
+}
+
+static int IsUnder( const char *path, const char *parent, size_t len )
+{
+    size_t prefix = ChildPrefixLen( parent, len );
+    return strncmp( path, parent, len ) == 0 && path[prefix - 1] == '/' && path[prefix] != '\0';
+}
+
+static char *JoinPath( const char *dir, const char *name )
+{
+    size_t dirLen = strlen( dir ), nameLen = strlen( name );
+    size_t prefix = ChildPrefixLen( dir, dirLen );
+    char *path = malloc( prefix + nameLen + 1 );
+
+    if ( path )
+    {
+        memcpy( path, dir, dirLen );
+        path[prefix - 1] = '/';
+        memcpy( path + prefix, name, nameLen + 1 );
+    }
+    return path;
+}
+
+/* the distinct trigrams of a name, sorted */
+static size_t NameGrams( const char *name, uint32_t *grams )
+{
+    const unsigned char *s = (const unsigned char*)name;
+    size_t n = 0, i, j, count;
+    uint32_t gram;
+
+    for ( i = 0; s[i] && n < INDEX_MAX_GRAMS; ++i )
+    {
+        gram = (uint32_t)Fold( s[i] ) << 16;
+        if ( s[i + 1] )
+            gram |= (uint32_t)Fold( s[i + 1] ) << 8 | Fold( s[i + 2] );
+        for ( j = n; j > 0 && grams[j - 1] > gram; --j )
+            grams[j] = grams[j - 1];
+        grams[j] = gram;
+        ++n;
+    }
+
+    for ( i = 0, count = 0; i < n; ++i )
+    {
+        if ( count == 0 || grams[count - 1] != grams[i] )
+            grams[count++] = grams[i];
+    }
+    return count;
+}
+
+/* snapshots */
+
+static int SetSections( nfdindexsnapshot_t *snapshot )
+{
+    const unsigned char *p = (const unsigned char*)snapshot->base;
+    const IndexHeader *header = (const IndexHeader*)p;
+    uint64_t need;
+
+    if ( snapshot->size < sizeof(IndexHeader) ||
+         memcmp( header->magic, INDEX_MAGIC, sizeof(header->magic) ) != 0 ||
+         header->version != INDEX_VERSION ||
+         header->byteOrder != INDEX_BYTE_ORDER )
+        return 0;
+    if ( header->dirCount > UINT32_MAX || header->fileCount > UINT32_MAX ||
+         header->gramCount > UINT32_MAX || header->postingCount > UINT32_MAX ||
+         header->stringsSize > UINT32_MAX )
+        return 0;
+
+    need = sizeof(IndexHeader) +
+           header->dirCount * sizeof(IndexDirRecord) +
+           header->fileCount * sizeof(IndexFileRecord) +
+           header->gramCount * sizeof(IndexGramRecord) +
+           header->postingCount * sizeof(uint32_t) +
+           header->stringsSize;
+    if ( need != snapshot->size )
+        return 0;
+
+    snapshot->header = header;
+    p += sizeof(IndexHeader);
+    snapshot->dirs = (const IndexDirRecord*)p;
+    p += header->dirCount * sizeof(IndexDirRecord);
+    snapshot->files = (const IndexFileRecord*)p;
+    p += header->fileCount * sizeof(IndexFileRecord);
+    snapshot->grams = (const IndexGramRecord*)p;
+    p += header->gramCount * sizeof(IndexGramRecord);
+    snapshot->postings = (const uint32_t*)p;
+    p += header->postingCount * sizeof(uint32_t);
+    snapshot->strings = (const char*)p;
+    return 1;
+}
+
+/* a cache file is checked through once, so that queries can trust it */
+static int ValidateSnapshot( const nfdindexsnapshot_t *snapshot )
+{
+    const IndexHeader *header = snapshot->header;
+    uint64_t i, j, end;
+
+    if ( header->stringsSize == 0 || snapshot->strings[header->stringsSize - 1] != '\0' ||
+         header->rootsLen > header->stringsSize )
+        return 0;
+
+    for ( i = 0; i < header->dirCount; ++i )
+    {
+        const IndexDirRecord *dir = &snapshot->dirs[i];
+        if ( dir->path >= header->stringsSize ||
+             (uint64_t)dir->firstFile + dir->fileCount > header->fileCount )
+            return 0;
+    }
+    for ( i = 0; i < header->fileCount; ++i )
+    {
+        const IndexFileRecord *file = &snapshot->files[i];
+        if ( file->name >= header->stringsSize || file->dir >= header->dirCount )
+            return 0;
+    }
+    for ( i = 0; i < header->gramCount; ++i )
+    {
+        const IndexGramRecord *gram = &snapshot->grams[i];
+        end = (uint64_t)gram->first + gram->count;
+        if ( end > header->postingCount || gram->count == 0 ||
+             ( i > 0 && snapshot->grams[i - 1].gram >= gram->gram ) )
+            return 0;
+        for ( j = gram->first; j < end; ++j )
+        {
+            if ( snapshot->postings[j] >= header->fileCount ||
+                 ( j > gram->first && snapshot->postings[j - 1] >= snapshot->postings[j] ) )
+                return 0;
+        }
+    }
+    return 1;
+}
+
+static void FreeSnapshot( nfdindexsnapshot_t *snapshot )
+{
+    if ( snapshot->mapped )
+        munmap( snapshot->base, snapshot->size );
+    else
+        free( snapshot->base );
+    free( snapshot );
+}
+
+static nfdindexsnapshot_t *RetainSnapshot( nfdindexsnapshot_t *snapshot )
+{
+    if ( snapshot )
+        __atomic_add_fetch( &snapshot->refs, 1, __ATOMIC_RELAXED );
+    return snapshot;
+}
+
+void NFDi_Index_ReleaseSnapshot( nfdindexsnapshot_t *snapshot )
+{
+    if ( snapshot && __atomic_sub_fetch( &snapshot->refs, 1, __ATOMIC_ACQ_REL ) == 0 )
+        FreeSnapshot( snapshot );
+}
+
+size_t NFDi_Index_GetFileCount( const nfdindexsnapshot_t *snapshot )
+{
+    return (size_t)snapshot->header->fileCount;
+}
+
+const char *NFDi_Index_GetName( const nfdindexsnapshot_t *snapshot, uint32_t file )
+{
+    return snapshot->strings + snapshot->files[file].name;
+}
+
+const char *NFDi_Index_GetDir( const nfdindexsnapshot_t *snapshot, uint32_t file )
+{
+    return snapshot->strings + snapshot->dirs[snapshot->files[file].dir].path;
+}
+
+/* queries */
+
+typedef struct
+{
+    const uint32_t *ids;
+    size_t count;
+    size_t cursor;
+} PostingList;
+
+static size_t FindGram( const nfdindexsnapshot_t *snapshot, uint32_t gram )
+{
+    size_t lo = 0, hi = (size_t)snapshot->header->gramCount;
+    while ( lo < hi )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+        if ( snapshot->grams[mid].gram < gram )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* first position at or after list->cursor holding at least id */
+static int SkipTo( PostingList *list, uint32_t id )
+{
+    size_t lo = list->cursor, step = 1, hi;
+
+    if ( lo >= list->count )
+        return 0;
+    if ( list->ids[lo] >= id )
+        return list->ids[lo] == id;
+
+    /* gallop, then binary search the last step */
+    hi = lo + 1;
+    while ( hi < list->count && list->ids[hi] < id )
+    {
+        lo = hi;
+        step *= 2;
+        hi = lo + step;
+    }
+    if ( hi > list->count )
+        hi = list->count;
+    while ( lo + 1 < hi )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+        if ( list->ids[mid] < id )
+            lo = mid;
+        else
+            hi = mid;
+    }
+    list->cursor = hi;
+    return hi < list->count && list->ids[hi] == id;
+}
+
+static int ContainsFolded( const char *name, const char *term, size_t len )
+{
+    const unsigned char *s = (const unsigned char*)name;
+    const unsigned char *t = (const unsigned char*)term;
+    size_t i;
+
+    for ( ; *s; ++s )
+    {
+        if ( Fold( *s ) != t[0] )
+            continue;
+        for ( i = 1; i < len && s[i] && Fold( s[i] ) == t[i]; ++i )
+            ;
+        if ( i == len )
+            return 1;
+    }
+    return 0;
+}
+
+typedef struct
+{
+    const nfdindexsnapshot_t *snapshot;
+    const nfdfilter_t *filter;
+    const char *terms[INDEX_MAX_TERMS];
+    size_t termLens[INDEX_MAX_TERMS];
+    size_t termCount;
+    PostingList *skip;
+    size_t skipCount;
+    uint32_t *out;
+    size_t found;
+    size_t max;
+} QueryState;
+
+/* 1 once there are enough */
+static int Consider( QueryState *query, uint32_t id )
+{
+    const char *name = query->snapshot->strings + query->snapshot->files[id].name;
+    size_t i;
+
+    for ( i = 0; i < query->skipCount; ++i )
+    {
+        if ( !SkipTo( &query->skip[i], id ) )
+            return 0;
+    }
+    for ( i = 0; i < query->termCount; ++i )
+    {
+        if ( !ContainsFolded( name, query->terms[i], query->termLens[i] ) )
+            return 0;
+    }
+    if ( query->filter && query->filter->groupCount > 0 &&
+         NFDi_Filter_Match( query->filter, name, strlen( name ) ) < 0 )
+        return 0;
+
+    query->out[query->found++] = id;
+    return query->found == query->max;
+}
+
+static int CompareListSizes( const void *a, const void *b )
+{
+    size_t x = ((const PostingList*)a)->count;
+    size_t y = ((const PostingList*)b)->count;
+    return x < y ? -1 : x > y;
+}
+
+size_t NFDi_Index_Query( const nfdindexsnapshot_t *snapshot,
+                         const char *query,
+                         const nfdfilter_t *filter,
+                         uint32_t *outFiles,
+                         size_t maxResults )
+{
+    char folded[NFD_MAX_STRLEN];
+    PostingList lists[INDEX_MAX_LISTS];
+    QueryState state;
+    size_t listCount = 0, fileCount = (size_t)snapshot->header->fileCount;
+    size_t rangeFirst = 0, rangeLast = 0, rangeSize = NOT_FOUND;
+    size_t i, j, len;
+    int walked = 0;
+    char *p;
+
+    memset( &state, 0, sizeof(state) );
+    state.snapshot = snapshot;
+    state.filter = filter;
+    state.out = outFiles;
+    state.max = maxResults;
+    if ( maxResults == 0 )
+        return 0;
+
+    NFDi_SafeStrncpy( folded, query ? query : "", sizeof(folded) );
+    for ( p = folded; *p; ++p )
+        *p = (char)Fold( (unsigned char)*p );
+
+    /* each term narrows down to its own posting lists */
+    for ( p = folded; *p && state.termCount < INDEX_MAX_TERMS; p += len )
+    {
+        const unsigned char *t;
+
+        if ( *p == ' ' )
+        {
+            len = 1;
+            continue;
+        }
+        for ( len = 0; p[len] && p[len] != ' '; ++len )
+            ;
+        t = (const unsigned char*)p;
+        state.terms[state.termCount] = p;
+        state.termLens[state.termCount++] = len;
+
+        if ( len < 3 )
+        {
+            /* every trigram starting with the term */
+            uint32_t lo = (uint32_t)t[0] << 16 | ( len == 2 ? (uint32_t)t[1] << 8 : 0 );
+            uint32_t hi = lo | ( len == 2 ? 0xff : 0xffff );
+            size_t first = FindGram( snapshot, lo ), last = first, size = 0;
+
+            for ( ; last < snapshot->header->gramCount && snapshot->grams[last].gram <= hi; ++last )
+                size += snapshot->grams[last].count;
+            if ( size == 0 )
+                return 0;
+            if ( size < rangeSize )
+            {
+                rangeFirst = first;
+                rangeLast = last;
+                rangeSize = size;
+            }
+            continue;
+        }
+
+        for ( i = 0; i + 3 <= len; ++i )
+        {
+            uint32_t gram = (uint32_t)t[i] << 16 | (uint32_t)t[i + 1] << 8 | t[i + 2];
+            size_t at = FindGram( snapshot, gram );
+
+            if ( at == snapshot->header->gramCount || snapshot->grams[at].gram != gram )
+                return 0;
+            if ( listCount < INDEX_MAX_LISTS )
+            {
+                lists[listCount].ids = snapshot->postings + snapshot->grams[at].first;
+                lists[listCount].count = snapshot->grams[at].count;
+                lists[listCount++].cursor = 0;
+            }
+        }
+    }
+
+    qsort( lists, listCount, sizeof(PostingList), CompareListSizes );
+    /* duplicate trigrams of a term would only be skipped through twice */
+    for ( i = 1, j = listCount > 0; i < listCount; ++i )
+    {
+        if ( lists[i].ids != lists[j - 1].ids )
+            lists[j++] = lists[i];
+    }
+    listCount = j;
+
+    if ( listCount > 0 && lists[0].count <= rangeSize && lists[0].count <= fileCount / 4 )
+    {
+        walked = 1;
+        /* walk the rarest trigram */
+        state.skip = lists + 1;
+        state.skipCount = listCount - 1 < INDEX_SKIP_LISTS ? listCount - 1 : INDEX_SKIP_LISTS;
+        for ( i = 0; i < lists[0].count; ++i )
+        {
+            if ( Consider( &state, lists[0].ids[i] ) )
+                break;
+        }
+    }
+    else if ( rangeSize != NOT_FOUND && rangeSize <= fileCount / 4 )
+    {
+        /* a short term's trigrams may share files, so they are merged
+           through a bitmap rather than sorted */
+        size_t words = ( fileCount + 63 ) / 64;
+        uint64_t *bits = calloc( words, sizeof(uint64_t) );
+
+        if ( bits )
+        {
+            walked = 1;
+            state.skip = lists;
+            state.skipCount = listCount < INDEX_SKIP_LISTS ? listCount : INDEX_SKIP_LISTS;
+            for ( i = rangeFirst; i < rangeLast; ++i )
+            {
+                const uint32_t *ids = snapshot->postings + snapshot->grams[i].first;
+                for ( j = 0; j < snapshot->grams[i].count; ++j )
+                    bits[ids[j] / 64] |= 1ull << ( ids[j] % 64 );
+            }
+            for ( i = 0; i < words; ++i )
+            {
+                uint64_t word = bits[i];
+                while ( word )
+                {
+                    uint32_t id = (uint32_t)( i * 64 + (size_t)__builtin_ctzll( word ) );
+                    word &= word - 1;
+                    if ( Consider( &state, id ) )
+                    {
+                        i = words;
+                        break;
+                    }
+                }
+            }
+            free( bits );
+        }
+    }
+
+    if ( !walked )
+    {
+        /* common enough that every name is as quick to check */
+        for ( i = 0; i < listCount; ++i )
+            lists[i].cursor = 0;
+        state.skip = NULL;
+        state.skipCount = 0;
+        for ( i = 0; i < fileCount; ++i )
+        {
+            if ( Consider( &state, (uint32_t)i ) )
+                break;
+        }
+    }
+
+    NFD_PROBE2( index_query, query, state.found );
+    return state.found;
+}
+
+/* building */
+
+typedef struct
+{
+    uint32_t gram;          /* 0 for an empty slot, no name starts with NUL */
+    uint32_t count;
+    uint32_t next;          /* where its next posting goes */
+} GramSlot;
+
+typedef struct
+{
+    GramSlot *slots;
+    size_t mask;
+    size_t used;
+} GramTable;
+
+static size_t GramBucket( uint32_t gram, size_t mask )
+{
+    return (size_t)( ( gram * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+}
+
+static GramSlot *LookupGram( GramTable *table, uint32_t gram, int insert )
+{
+    size_t i;
+
+    if ( insert && ( table->used + 1 ) * 2 > table->mask + 1 )
+    {
+        size_t mask = table->mask ? table->mask * 2 + 1 : 4095;
+        GramSlot *slots = calloc( mask + 1, sizeof(GramSlot) );
+        if ( !slots )
+            return NULL;
+        for ( i = 0; i <= table->mask && table->slots; ++i )
+        {
+            size_t at;
+            if ( !table->slots[i].gram )
+                continue;
+            for ( at = GramBucket( table->slots[i].gram, mask ); slots[at].gram; at = ( at + 1 ) & mask )
+                ;
+            slots[at] = table->slots[i];
+        }
+        free( table->slots );
+        table->slots = slots;
+        table->mask = mask;
+    }
+
+    for ( i = GramBucket( gram, table->mask ); table->slots[i].gram; i = ( i + 1 ) & table->mask )
+    {
+        if ( table->slots[i].gram == gram )
+            return &table->slots[i];
+    }
+    if ( !insert )
+        return NULL;
+    table->slots[i].gram = gram;
+    ++table->used;
+    return &table->slots[i];
+}
+
+static int CompareGramSlots( const void *a, const void *b )
+{
+    uint32_t x = (*(const GramSlot* const*)a)->gram;
+    uint32_t y = (*(const GramSlot* const*)b)->gram;
+    return x < y ? -1 : x > y;
+}
+
+static int CompareDirs( const void *a, const void *b )
+{
+    return ComparePaths( (*(const IndexDir* const*)a)->path, (*(const IndexDir* const*)b)->path );
+}
+
+static int Stopping( const IndexEngine *engine )
+{
+    return __atomic_load_n( &engine->stop, __ATOMIC_RELAXED );
+}
+
+static nfdindexsnapshot_t *BuildSnapshot( const IndexEngine *engine, const IndexModel *model )
+{
+    uint32_t grams[INDEX_MAX_GRAMS];
+    GramTable table = { NULL, 0, 0 };
+    const IndexDir **live = NULL;
+    GramSlot **order = NULL;
+    nfdindexsnapshot_t *snapshot = NULL;
+    IndexHeader *header;
+    IndexDirRecord *dirRecords;
+    IndexFileRecord *fileRecords;
+    IndexGramRecord *gramRecords;
+    uint32_t *postings;
+    char *strings;
+    uint64_t fileCount = 0, postingCount = 0, stringsSize = engine->rootsLen;
+    size_t liveCount = 0, size, i, j, n, offset;
+    uint32_t file;
+    unsigned char *base;
+    const char *name;
+
+    live = malloc( sizeof(IndexDir*) * ( model->count ? model->count : 1 ) );
+    if ( !live )
+        return NULL;
+    for ( i = 0; i < model->count; ++i )
+    {
+        if ( !model->dirs[i].removed )
+            live[liveCount++] = &model->dirs[i];
+    }
+    qsort( (void*)live, liveCount, sizeof(IndexDir*), CompareDirs );
+
+    /* first pass, how many files each trigram has */
+    for ( i = 0; i < liveCount && !Stopping( engine ); ++i )
+    {
+        stringsSize += strlen( live[i]->path ) + 1 + live[i]->namesLen;
+        fileCount += live[i]->fileCount;
+        for ( name = live[i]->names, j = 0; j < live[i]->fileCount; ++j, name += strlen( name ) + 1 )
+        {
+            n = NameGrams( name, grams );
+            postingCount += n;
+            while ( n-- > 0 )
+            {
+                GramSlot *slot = LookupGram( &table, grams[n], 1 );
+                if ( !slot )
+                    goto done;
+                ++slot->count;
+            }
+        }
+    }
+    if ( Stopping( engine ) || stringsSize > UINT32_MAX || fileCount > UINT32_MAX ||
+         postingCount > UINT32_MAX || liveCount > UINT32_MAX )
+        goto done;
+
+    order = malloc( sizeof(GramSlot*) * ( table.used ? table.used : 1 ) );
+    if ( !order )
+        goto done;
+    for ( i = 0, n = 0; i <= table.mask && table.slots; ++i )
+    {
+        if ( table.slots[i].gram )
+            order[n++] = &table.slots[i];
+    }
+    qsort( order, n, sizeof(GramSlot*), CompareGramSlots );
+
+    size = sizeof(IndexHeader) + liveCount * sizeof(IndexDirRecord) +
+           (size_t)fileCount * sizeof(IndexFileRecord) + table.used * sizeof(IndexGramRecord) +
+           (size_t)postingCount * sizeof(uint32_t) + (size_t)stringsSize;
+    snapshot = calloc( 1, sizeof(nfdindexsnapshot_t) );
+    base = malloc( size );
+    if ( !snapshot || !base )
+    {
+        free( base );
+        free( snapshot );
+        snapshot = NULL;
+        goto done;
+    }
+    snapshot->refs = 1;
+    snapshot->base = base;
+    snapshot->size = size;
+
+    header = (IndexHeader*)base;
+    memset( header, 0, sizeof(IndexHeader) );
+    memcpy( header->magic, INDEX_MAGIC, sizeof(header->magic) );
+    header->version = INDEX_VERSION;
+    header->byteOrder = INDEX_BYTE_ORDER;
+    header->rootsLen = (uint32_t)engine->rootsLen;
+    header->dirCount = liveCount;
+    header->fileCount = fileCount;
+    header->gramCount = table.used;
+    header->postingCount = postingCount;
+    header->stringsSize = stringsSize;
+    SetSections( snapshot );
+
+    dirRecords = (IndexDirRecord*)snapshot->dirs;
+    fileRecords = (IndexFileRecord*)snapshot->files;
+    gramRecords = (IndexGramRecord*)snapshot->grams;
+    postings = (uint32_t*)snapshot->postings;
+    strings = (char*)snapshot->strings;
+
+    for ( i = 0, offset = 0; i < table.used; ++i )
+    {
+        gramRecords[i].gram = order[i]->gram;
+        gramRecords[i].first = (uint32_t)offset;
+        gramRecords[i].count = order[i]->count;
+        order[i]->next = (uint32_t)offset;
+        offset += order[i]->count;
+    }
+
+    /* second pass, in file order, so every posting list comes out sorted */
+    memcpy( strings, engine->roots, engine->rootsLen );
+    offset = engine->rootsLen;
+    for ( i = 0, file = 0; i < liveCount; ++i )
+    {
+        const IndexDir *dir = live[i];
+        size_t pathLen = strlen( dir->path ) + 1;
+
+        dirRecords[i].path = (uint32_t)offset;
+        dirRecords[i].firstFile = file;
+        dirRecords[i].fileCount = dir->fileCount;
+        dirRecords[i].mtimeSec = dir->mtimeSec;
+        dirRecords[i].mtimeNsec = dir->mtimeNsec;
+        memcpy( strings + offset, dir->path, pathLen );
+        offset += pathLen;
+        if ( dir->namesLen > 0 )
+            memcpy( strings + offset, dir->names, dir->namesLen );
+
+        for ( name = strings + offset, j = 0; j < dir->fileCount; ++j, ++file )
+        {
+            size_t nameLen = strlen( name ) + 1;
+            fileRecords[file].name = (uint32_t)( name - strings );
+            fileRecords[file].dir = (uint32_t)i;
+            n = NameGrams( name, grams );
+            while ( n-- > 0 )
+            {
+                GramSlot *slot = LookupGram( &table, grams[n], 0 );
+                postings[slot->next++] = file;
+            }
+            name += nameLen;
+        }
+        offset += dir->namesLen;
+    }
+
+    NFD_PROBE2( index_built, fileCount, table.used );
+
+done:
+    free( (void*)live );
+    free( order );
+    free( table.slots );
+    return snapshot;
+}
+
+/* the disk cache */
+
+/* $XDG_CACHE_HOME/nfd/index/<hash>.idx, or empty to run without it */
+static void GetCachePath( IndexEngine *engine )
+{
+    const char *cache = getenv( "XDG_CACHE_HOME" );
+    const char *home = getenv( "HOME" );
+    char *path = engine->cachePath;
+    int len = -1;
+
+    if ( cache && cache[0] == '/' )
+        len = snprintf( path, PATH_MAX, "%s", cache );
+    else if ( home && home[0] == '/' )
+        len = snprintf( path, PATH_MAX, "%s/.cache", home );
+
+    /* leave room for "/nfd/index/<hash>.idx.XXXXXX" */
+    if ( len < 0 || (size_t)len + 48 > PATH_MAX )
+    {
+        path[0] = '\0';
+        return;
+    }
+
+    mkdir( path, 0700 );
+    strcpy( path + len, "/nfd" );
+    mkdir( path, 0700 );
+    strcpy( path + len + 4, "/index" );
+    if ( mkdir( path, 0700 ) != 0 && errno != EEXIST )
+    {
+        path[0] = '\0';
+        return;
+    }
+    snprintf( path + len + 10, PATH_MAX - (size_t)len - 10, "/%016llx.idx",
+              (unsigned long long)NFDi_Hash( NFDi_HASH_INIT, engine->roots, engine->rootsLen ) );
+}
+
+static nfdindexsnapshot_t *LoadSnapshot( const IndexEngine *engine )
+{
+    nfdindexsnapshot_t *snapshot;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if ( !engine->cachePath[0] )
+        return NULL;
+    fd = open( engine->cachePath, O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+        return NULL;
+    if ( fstat( fd, &st ) != 0 || st.st_size <= 0 )
+    {
+        close( fd );
+        return NULL;
+    }
+    map = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );
+    if ( map == MAP_FAILED )
+        return NULL;
+
+    snapshot = calloc( 1, sizeof(nfdindexsnapshot_t) );
+    if ( !snapshot )
+    {
+        munmap( map, (size_t)st.st_size );
+        return NULL;
+    }
+    snapshot->refs = 1;
+    snapshot->base = map;
+    snapshot->size = (size_t)st.st_size;
+    snapshot->mapped = 1;
+
+    /* a hash collision with other roots, or a damaged file */
+    if ( !SetSections( snapshot ) || !ValidateSnapshot( snapshot ) ||
+         snapshot->header->rootsLen != engine->rootsLen ||
+         memcmp( snapshot->strings, engine->roots, engine->rootsLen ) != 0 )
+    {
+        FreeSnapshot( snapshot );
+        return NULL;
+    }
+    return snapshot;
+}
+
+/* written aside and renamed over, so a reader never maps half an index */
+static void SaveSnapshot( const IndexEngine *engine, const nfdindexsnapshot_t *snapshot )
+{
+    char tmpPath[PATH_MAX];
+    int fd, ok;
+
+    if ( !engine->cachePath[0] )
+        return;
+    if ( snprintf( tmpPath, sizeof(tmpPath), "%s.XXXXXX", engine->cachePath ) >= (int)sizeof(tmpPath) )
+        return;
+    fd = mkstemp( tmpPath );
+    if ( fd < 0 )
+        return;
+    fcntl( fd, F_SETFD, FD_CLOEXEC );
+
+    ok = NFDi_WriteAll( fd, snapshot->base, snapshot->size );
+    ok = close( fd ) == 0 && ok;
+    if ( !ok || rename( tmpPath, engine->cachePath ) != 0 )
+        unlink( tmpPath );
+}
+
+/* reading folders, several at a time */
+
+typedef struct
+{
+    char *path;             /* moves into the model */
+    char *names;            /* file names back to back, sorted */
+    size_t namesLen;
+    uint32_t fileCount;
+    char *subdirs;          /* folder names back to back, sorted */
+    size_t subdirsLen;
+    uint32_t subdirCount;
+    uint32_t mtimeNsec;
+    int64_t mtimeSec;
+    int error;
+} DirRead;
+
+typedef struct
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t count;
+} NameList;
+
+static int AppendName( NameList *list, const char *name )
+{
+    size_t len = strlen( name ) + 1;
+
+    if ( list->len + len > list->cap )
+    {
+        size_t cap = list->cap ? list->cap * 2 : 4096;
+        char *buf;
+        while ( cap < list->len + len )
+            cap *= 2;
+        buf = realloc( list->buf, cap );
+        if ( !buf )
+            return 0;
+        list->buf = buf;
+        list->cap = cap;
+    }
+    memcpy( list->buf + list->len, name, len );
+    list->len += len;
+    ++list->count;
+    return 1;
+}
+
+static int CompareNames( const void *a, const void *b )
+{
+    return strcmp( *(const char* const*)a, *(const char* const*)b );
+}
+
+/* the list's names sorted into a new buffer, which it takes over */
+static int SortNames( NameList *list )
+{
+    const char **names;
+    char *sorted, *p;
+    size_t i;
+
+    if ( list->count < 2 )
+        return 1;
+    names = malloc( sizeof(char*) * list->count );
+    sorted = malloc( list->len );
+    if ( !names || !sorted )
+    {
+        free( (void*)names );
+        free( sorted );
+        return 0;
+    }
+    for ( p = list->buf, i = 0; i < list->count; p += strlen( p ) + 1 )
+        names[i++] = p;
+    qsort( (void*)names, list->count, sizeof(char*), CompareNames );
+    for ( p = sorted, i = 0; i < list->count; ++i )
+    {
+        size_t len = strlen( names[i] ) + 1;
+        memcpy( p, names[i], len );
+        p += len;
+    }
+    free( (void*)names );
+    free( list->buf );
+    list->buf = sorted;
+    list->cap = list->len;
+    return 1;
+}
+
+static void ReadDir( DirRead *read )
+{
+    NameList files = { NULL, 0, 0, 0 }, subdirs = { NULL, 0, 0, 0 };
+    struct dirent *entry;
+    struct stat st;
+    int type, ok = 1;
+    DIR *stream;
+
+    /* stat before reading, so a change while reading is seen next time */
+    stream = NFDi_OpenDir( read->path, &st );
+    if ( !stream )
+    {
+        read->error = errno;
+        return;
+    }
+    read->mtimeSec = (int64_t)st.st_mtim.tv_sec;
+    read->mtimeNsec = (uint32_t)st.st_mtim.tv_nsec;
+
+    while ( ok && ( entry = readdir( stream ) ) != NULL )
+    {
+        /* ".", ".." and everything hidden */
+        if ( entry->d_name[0] == '.' )
+            continue;
+
+        type = NFDi_EntryType( stream, entry );
+        if ( type == NFDi_ENTRY_DIR )
+            ok = AppendName( &subdirs, entry->d_name );
+        else if ( type == NFDi_ENTRY_FILE )
+            ok = AppendName( &files, entry->d_name );
+    }
+    closedir( stream );
+
+    if ( !ok || !SortNames( &files ) || !SortNames( &subdirs ) || files.count > UINT32_MAX )
+    {
+        free( files.buf );
+        free( subdirs.buf );
+        read->error = ENOMEM;
+        return;
+    }
+    read->names = files.buf;
+    read->namesLen = files.len;
+    read->fileCount = (uint32_t)files.count;
+    read->subdirs = subdirs.buf;
+    read->subdirsLen = subdirs.len;
+    read->subdirCount = (uint32_t)subdirs.count;
+}
+
+typedef struct
+{
+    const IndexEngine *engine;
+    DirRead *reads;
+    const IndexDir *dirs;
+    unsigned char *stale;
+    size_t count;
+    size_t next;            /* __atomic */
+} ParallelJob;
+
+static void RunParallel( void *(*main)( void* ), ParallelJob *job )
+{
+    pthread_t threads[INDEX_MAX_THREADS];
+    long cpus = sysconf( _SC_NPROCESSORS_ONLN );
+    size_t started = 0, i;
+
+    /* this thread works as well */
+    for ( i = 1; i < INDEX_MAX_THREADS && (long)i < cpus && i < job->count; ++i )
+    {
+        if ( pthread_create( &threads[started], NULL, main, job ) == 0 )
+            ++started;
+    }
+    main( job );
+    for ( i = 0; i < started; ++i )
+        pthread_join( threads[i], NULL );
+}
+
+static void *ReadWorkerMain( void *data )
+{
+    ParallelJob *job = (ParallelJob*)data;
+    size_t i;
+
+    while ( ( i = __atomic_fetch_add( &job->next, 1, __ATOMIC_RELAXED ) ) < job->count )
+    {
+        if ( Stopping( job->engine ) )
+            job->reads[i].error = EINTR;
+        else
+            ReadDir( &job->reads[i] );
+    }
+    return NULL;
+}
+
+#define STAT_CHUNK 64
+
+/* marks every folder whose mtime moved or that is gone */
+static void *StatWorkerMain( void *data )
+{
+    ParallelJob *job = (ParallelJob*)data;
+    struct stat st;
+    size_t first, i;
+
+    while ( ( first = __atomic_fetch_add( &job->next, STAT_CHUNK, __ATOMIC_RELAXED ) ) < job->count )
+    {
+        for ( i = first; i < first + STAT_CHUNK && i < job->count && !Stopping( job->engine ); ++i )
+        {
+            const IndexDir *dir = &job->dirs[i];
+            if ( dir->removed )
+                continue;
+            job->stale[i] = stat( dir->path, &st ) != 0 ||
+                            (int64_t)st.st_mtim.tv_sec != dir->mtimeSec ||
+                            (uint32_t)st.st_mtim.tv_nsec != dir->mtimeNsec;
+        }
+    }
+    return NULL;
+}
+
+/* the model */
+
+static int PushPath( PathList *list, char *path )
+{
+    if ( !path )
+        return 0;
+    if ( list->count == list->cap )
+    {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        char **paths = realloc( list->paths, sizeof(char*) * cap );
+        if ( !paths )
+        {
+            free( path );
+            return 0;
+        }
+        list->paths = paths;
+        list->cap = cap;
+    }
+    list->paths[list->count++] = path;
+    return 1;
+}
+
+static void FreePaths( PathList *list )
+{
+    size_t i;
+    for ( i = 0; i < list->count; ++i )
+        free( list->paths[i] );
+    free( list->paths );
+    memset( list, 0, sizeof(PathList) );
+}
+
+static size_t ModelFind( const IndexModel *model, const char *path )
+{
+    size_t i;
+
+    if ( !model->buckets )
+        return NOT_FOUND;
+    for ( i = (size_t)NFDi_Hash( NFDi_HASH_INIT, path, strlen( path ) ) & model->bucketMask;
+          model->buckets[i];
+          i = ( i + 1 ) & model->bucketMask )
+    {
+        if ( strcmp( model->dirs[model->buckets[i] - 1].path, path ) == 0 )
+            return model->buckets[i] - 1;
+    }
+    return NOT_FOUND;
+}
+
+static void ModelInsertBucket( IndexModel *model, size_t index )
+{
+    const char *path = model->dirs[index].path;
+    size_t i;
+
+    for ( i = (size_t)NFDi_Hash( NFDi_HASH_INIT, path, strlen( path ) ) & model->bucketMask;
+          model->buckets[i];
+          i = ( i + 1 ) & model->bucketMask )
+        ;
+    model->buckets[i] = index + 1;
+}
+
+static int ModelReserve( IndexModel *model, size_t count )
+{
+    size_t i;
+
+    if ( count > model->cap )
+    {
+        size_t cap = model->cap ? model->cap : 256;
+        IndexDir *dirs;
+        while ( cap < count )
+            cap *= 2;
+        dirs = realloc( model->dirs, sizeof(IndexDir) * cap );
+        if ( !dirs )
+            return 0;
+        model->dirs = dirs;
+        model->cap = cap;
+    }
+    if ( count * 2 > model->bucketMask + 1 || !model->buckets )
+    {
+        size_t mask = model->bucketMask ? model->bucketMask : 511;
+        size_t *buckets;
+        while ( count * 2 > mask + 1 )
+            mask = mask * 2 + 1;
+        buckets = calloc( mask + 1, sizeof(size_t) );
+        if ( !buckets )
+            return 0;
+        free( model->buckets );
+        model->buckets = buckets;
+        model->bucketMask = mask;
+        for ( i = 0; i < model->count; ++i )
+            ModelInsertBucket( model, i );
+    }
+    return 1;
+}
+
+static int ModelAdd( IndexModel *model, const IndexDir *dir )
+{
+    if ( !ModelReserve( model, model->count + 1 ) )
+        return 0;
+    model->dirs[model->count] = *dir;
+    ModelInsertBucket( model, model->count );
+    ++model->count;
+    return 1;
+}
+
+/* borrows every folder from base */
+static int ModelInit( IndexModel *model, nfdindexsnapshot_t *base )
+{
+    uint64_t i;
+
+    memset( model, 0, sizeof(IndexModel) );
+    if ( !base )
+        return 1;
+    if ( !ModelReserve( model, (size_t)base->header->dirCount ) )
+        return 0;
+    model->base = RetainSnapshot( base );
+
+    for ( i = 0; i < base->header->dirCount; ++i )
+    {
+        const IndexDirRecord *record = &base->dirs[i];
+        IndexDir dir;
+
+        memset( &dir, 0, sizeof(dir) );
+        dir.path = base->strings + record->path;
+        dir.fileCount = record->fileCount;
+        dir.mtimeSec = record->mtimeSec;
+        dir.mtimeNsec = record->mtimeNsec;
+        dir.wd = -1;
+        if ( record->fileCount > 0 )
+        {
+            const char *last = base->strings + base->files[record->firstFile + record->fileCount - 1].name;
+            dir.names = base->strings + base->files[record->firstFile].name;
+            dir.namesLen = (size_t)( last + strlen( last ) + 1 - dir.names );
+        }
+        ModelAdd( model, &dir );
+    }
+    model->sorted = model->count;
+    return 1;
+}
+
+static void ModelFree( IndexModel *model )
+{
+    size_t i;
+
+    for ( i = 0; i < model->count; ++i )
+    {
+        free( model->dirs[i].ownedPath );
+        free( model->dirs[i].ownedNames );
+    }
+    free( model->dirs );
+    free( model->buckets );
+    NFDi_Index_ReleaseSnapshot( model->base );
+    memset( model, 0, sizeof(IndexModel) );
+}
+
+/* first of the sorted folders at or after path */
+static size_t ModelLowerBound( const IndexModel *model, const char *path )
+{
+    size_t lo = 0, hi = model->sorted;
+    while ( lo < hi )
+    {
+        size_t mid = lo + ( hi - lo ) / 2;
+        if ( ComparePaths( model->dirs[mid].path, path ) < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* watches by descriptor */
+
+static size_t WatchBucket( int wd, size_t mask )
+{
+    return (size_t)( ( (uint32_t)wd * 0x9E3779B97F4A7C15ull ) >> 32 ) & mask;
+}
+
+static char *FindWatch( const IndexWorker *worker, int wd )
+{
+    size_t i;
+
+    if ( !worker->watches )
+        return NULL;
+    for ( i = WatchBucket( wd, worker->watchMask ); worker->watches[i].wd >= 0; i = ( i + 1 ) & worker->watchMask )
+    {
+        if ( worker->watches[i].wd == wd )
+            return worker->watches[i].path;
+    }
+    return NULL;
+}
+
+static int PutWatch( IndexWorker *worker, int wd, const char *path )
+{
+    char *copy = strdup( path );
+    size_t i;
+
+    if ( !copy )
+        return 0;
+    if ( ( worker->watchCount + 1 ) * 2 > worker->watchMask + 1 )
+    {
+        size_t mask = worker->watchMask ? worker->watchMask * 2 + 1 : 1023;
+        WatchSlot *slots = malloc( sizeof(WatchSlot) * ( mask + 1 ) );
+        if ( !slots )
+        {
+            free( copy );
+            return 0;
+        }
+        for ( i = 0; i <= mask; ++i )
+            slots[i].wd = -1;
+        for ( i = 0; worker->watches && i <= worker->watchMask; ++i )
+        {
+            size_t at;
+            if ( worker->watches[i].wd < 0 )
+                continue;
+            for ( at = WatchBucket( worker->watches[i].wd, mask ); slots[at].wd >= 0; at = ( at + 1 ) & mask )
+                ;
+            slots[at] = worker->watches[i];
+        }
+        free( worker->watches );
+        worker->watches = slots;
+        worker->watchMask = mask;
+    }
+
+    for ( i = WatchBucket( wd, worker->watchMask ); worker->watches[i].wd >= 0; i = ( i + 1 ) & worker->watchMask )
+    {
+        if ( worker->watches[i].wd == wd )
+        {
+            /* the same folder under a new path */
+            free( worker->watches[i].path );
+            worker->watches[i].path = copy;
+            return 1;
+        }
+    }
+    worker->watches[i].wd = wd;
+    worker->watches[i].path = copy;
+    ++worker->watchCount;
+    return 1;
+}
+
+static void RemoveWatch( IndexWorker *worker, int wd )
+{
+    size_t mask = worker->watchMask;
+    size_t i, j, home;
+
+    if ( !worker->watches )
+        return;
+    for ( i = WatchBucket( wd, mask ); worker->watches[i].wd != wd; i = ( i + 1 ) & mask )
+    {
+        if ( worker->watches[i].wd < 0 )
+            return;
+    }
+    free( worker->watches[i].path );
+    worker->watches[i].wd = -1;
+    --worker->watchCount;
+
+    /* shift back whatever probed past the hole */
+    for ( j = ( i + 1 ) & mask; worker->watches[j].wd >= 0; j = ( j + 1 ) & mask )
+    {
+        home = WatchBucket( worker->watches[j].wd, mask );
+        if ( ( ( j - home ) & mask ) >= ( ( j - i ) & mask ) )
+        {
+            worker->watches[i] = worker->watches[j];
+            worker->watches[j].wd = -1;
+            i = j;
+        }
+    }
+}
+
+static void MarkChanged( IndexWorker *worker )
+{
+    long long now = NFDi_NowMs();
+    if ( !worker->firstChange )
+        worker->firstChange = now;
+    worker->lastChange = now;
+}
+
+static void ForgetDir( IndexWorker *worker, IndexDir *dir )
+{
+    if ( dir->removed )
+        return;
+    dir->removed = 1;
+    if ( dir->wd >= 0 )
+    {
+        inotify_rm_watch( worker->inotifyFd, dir->wd );
+        RemoveWatch( worker, dir->wd );
+        dir->wd = -1;
+    }
+    worker->changed = 1;
+}
+
+/* path's folder and everything below it */
+static void ForgetTree( IndexWorker *worker, const char *path )
+{
+    IndexModel *model = &worker->model;
+    size_t len = strlen( path );
+    size_t i;
+
+    for ( i = ModelLowerBound( model, path ); i < model->sorted; ++i )
+    {
+        if ( strcmp( model->dirs[i].path, path ) != 0 && !IsUnder( model->dirs[i].path, path, len ) )
+            break;
+        ForgetDir( worker, &model->dirs[i] );
+    }
+    for ( i = model->sorted; i < model->count; ++i )
+    {
+        if ( strcmp( model->dirs[i].path, path ) == 0 || IsUnder( model->dirs[i].path, path, len ) )
+            ForgetDir( worker, &model->dirs[i] );
+    }
+}
+
+static int HasName( char *const *names, size_t count, const char *name )
+{
+    return bsearch( &name, names, count, sizeof(char*), CompareNames ) != NULL;
+}
+
+/* takes the read into the model, and lists the new subfolders to read next */
+static void ApplyRead( IndexWorker *worker, DirRead *read, PathList *next )
+{
+    IndexModel *model = &worker->model;
+    size_t index = ModelFind( model, read->path );
+    char **subdirs = NULL;
+    const char *path;
+    size_t len, prefix, i;
+    char *p;
+
+    if ( read->error )
+    {
+        /* unreadable folders stay as they were, gone ones go with their tree */
+        if ( ( read->error == ENOENT || read->error == ENOTDIR ) && index != NOT_FOUND )
+            ForgetTree( worker, model->dirs[index].path );
+        free( read->path );
+        return;
+    }
+
+    if ( index != NOT_FOUND )
+    {
+        IndexDir *dir = &model->dirs[index];
+        free( dir->ownedNames );
+        free( read->path );
+        dir->names = dir->ownedNames = read->names;
+        dir->removed = 0;
+    }
+    else
+    {
+        IndexDir dir;
+        memset( &dir, 0, sizeof(dir) );
+        dir.path = dir.ownedPath = read->path;
+        dir.names = dir.ownedNames = read->names;
+        dir.wd = -1;
+        if ( !ModelAdd( model, &dir ) )
+        {
+            free( read->path );
+            free( read->names );
+            free( read->subdirs );
+            return;
+        }
+        index = model->count - 1;
+    }
+    model->dirs[index].namesLen = read->namesLen;
+    model->dirs[index].fileCount = read->fileCount;
+    model->dirs[index].mtimeSec = read->mtimeSec;
+    model->dirs[index].mtimeNsec = read->mtimeNsec;
+    worker->changed = 1;
+
+    path = model->dirs[index].path;
+    len = strlen( path );
+    prefix = ChildPrefixLen( path, len );
+
+    subdirs = malloc( sizeof(char*) * ( read->subdirCount ? read->subdirCount : 1 ) );
+    if ( !subdirs )
+    {
+        free( read->subdirs );
+        return;
+    }
+    for ( p = read->subdirs, i = 0; i < read->subdirCount; p += strlen( p ) + 1 )
+        subdirs[i++] = p;
+
+    /* subfolders that went away, with everything below them */
+    for ( i = ModelLowerBound( model, path ); i < model->sorted; ++i )
+    {
+        const char *child = model->dirs[i].path;
+        if ( i == index )
+            continue;
+        if ( !IsUnder( child, path, len ) )
+            break;
+        if ( !model->dirs[i].removed && !strchr( child + prefix, '/' ) && !HasName( subdirs, read->subdirCount, child + prefix ) )
+            ForgetTree( worker, child );
+    }
+    for ( i = model->sorted; i < model->count; ++i )
+    {
+        const char *child = model->dirs[i].path;
+        if ( i != index && !model->dirs[i].removed && IsUnder( child, path, len ) &&
+             !strchr( child + prefix, '/' ) && !HasName( subdirs, read->subdirCount, child + prefix ) )
+            ForgetTree( worker, child );
+    }
+
+    /* and the ones that are new */
+    for ( i = 0; i < read->subdirCount; ++i )
+    {
+        char *child = JoinPath( path, subdirs[i] );
+        size_t at = child ? ModelFind( model, child ) : NOT_FOUND;
+
+        if ( child && ( at == NOT_FOUND || model->dirs[at].removed ) )
+            PushPath( next, child );
+        else
+            free( child );
+    }
+
+    free( (void*)subdirs );
+    free( read->subdirs );
+}
+
+static int CompareStrings( const void *a, const void *b )
+{
+    return strcmp( *(const char* const*)a, *(const char* const*)b );
+}
+
+/* a new snapshot of the model goes out, and the model moves onto it */
+static void PublishModel( IndexWorker *worker )
+{
+    IndexEngine *engine = worker->engine;
+    IndexModel fresh;
+    nfdindexsnapshot_t *snapshot, *old;
+    nfdindex_t *handle;
+    size_t i, at;
+    long long now;
+
+    snapshot = BuildSnapshot( engine, &worker->model );
+    if ( !snapshot )
+        return;
+    if ( !ModelInit( &fresh, snapshot ) )
+    {
+        ModelFree( &fresh );
+        NFDi_Index_ReleaseSnapshot( snapshot );
+        return;
+    }
+
+    /* watches stay with their folders */
+    for ( i = 0; i < fresh.count; ++i )
+    {
+        at = ModelFind( &worker->model, fresh.dirs[i].path );
+        if ( at != NOT_FOUND && !worker->model.dirs[at].removed )
+        {
+            fresh.dirs[i].wd = worker->model.dirs[at].wd;
+            worker->model.dirs[at].wd = -1;
+        }
+    }
+    ModelFree( &worker->model );
+    worker->model = fresh;
+    worker->changed = 0;
+
+    now = NFDi_NowMs();
+    if ( !worker->lastSave || now - worker->lastSave >= INDEX_SAVE_MS )
+    {
+        SaveSnapshot( engine, snapshot );
+        worker->lastSave = now;
+    }
+
+    pthread_mutex_lock( &engine->lock );
+    old = engine->snapshot;
+    engine->snapshot = snapshot;
+    for ( handle = engine->handles; handle; handle = handle->next )
+    {
+        char byte = 0;
+        if ( !handle->woken )
+            handle->woken = write( handle->wakePipe[1], &byte, 1 ) == 1;
+    }
+    pthread_mutex_unlock( &engine->lock );
+    NFDi_Index_ReleaseSnapshot( old );
+}
+
+static void SetUpdating( IndexEngine *engine, int updating )
+{
+    nfdindex_t *handle;
+
+    pthread_mutex_lock( &engine->lock );
+    if ( engine->updating != updating )
+    {
+        engine->updating = updating;
+        for ( handle = engine->handles; handle; handle = handle->next )
+        {
+            char byte = 0;
+            if ( !handle->woken )
+                handle->woken = write( handle->wakePipe[1], &byte, 1 ) == 1;
+        }
+    }
+    pthread_mutex_unlock( &engine->lock );
+}
+
+/* watches every folder that has none yet; one that changed before its
+   watch was in place is read again */
+static void WatchDirs( IndexWorker *worker )
+{
+    IndexModel *model = &worker->model;
+    const char *root;
+    struct stat st;
+    size_t i;
+    int wd;
+
+    worker->watchedAll = 0;
+    if ( worker->inotifyFd < 0 )
+        return;
+
+    for ( i = 0; i < model->count && !worker->watchesFull && !Stopping( worker->engine ); ++i )
+    {
+        IndexDir *dir = &model->dirs[i];
+        if ( dir->removed || dir->wd >= 0 )
+            continue;
+
+        wd = inotify_add_watch( worker->inotifyFd, dir->path, INDEX_WATCH_MASK );
+        if ( wd < 0 )
+        {
+            if ( errno == ENOSPC || errno == ENOMEM )
+                worker->watchesFull = 1;
+            continue;
+        }
+        if ( !PutWatch( worker, wd, dir->path ) )
+        {
+            inotify_rm_watch( worker->inotifyFd, wd );
+            continue;
+        }
+        dir->wd = wd;
+
+        if ( stat( dir->path, &st ) != 0 ||
+             (int64_t)st.st_mtim.tv_sec != dir->mtimeSec ||
+             (uint32_t)st.st_mtim.tv_nsec != dir->mtimeNsec )
+        {
+            PushPath( &worker->dirty, strdup( dir->path ) );
+            MarkChanged( worker );
+        }
+    }
+
+    /* a missing root can only be noticed by looking again */
+    if ( worker->watchesFull )
+        return;
+    for ( root = worker->engine->roots; root < worker->engine->roots + worker->engine->rootsLen;
+          root += strlen( root ) + 1 )
+    {
+        i = ModelFind( model, root );
+        if ( i == NOT_FOUND || model->dirs[i].removed || model->dirs[i].wd < 0 )
+            return;
+    }
+    worker->watchedAll = 1;
+}
+
+/* reads what changed, following new folders down, then publishes */
+static void UpdateIndex( IndexWorker *worker, int revalidate )
+{
+    IndexEngine *engine = worker->engine;
+    IndexModel *model = &worker->model;
+    PathList round = worker->dirty, next = { NULL, 0, 0 };
+    ParallelJob job;
+    const char *root;
+    size_t i, j;
+
+    memset( &worker->dirty, 0, sizeof(PathList) );
+    worker->firstChange = 0;
+
+    if ( revalidate && model->count > 0 )
+    {
+        memset( &job, 0, sizeof(job) );
+        job.engine = engine;
+        job.dirs = model->dirs;
+        job.count = model->count;
+        job.stale = calloc( model->count, 1 );
+        if ( job.stale )
+        {
+            RunParallel( StatWorkerMain, &job );
+            for ( i = 0; i < model->count; ++i )
+            {
+                if ( job.stale[i] )
+                    PushPath( &round, strdup( model->dirs[i].path ) );
+            }
+            free( job.stale );
+        }
+    }
+    for ( root = engine->roots; root < engine->roots + engine->rootsLen; root += strlen( root ) + 1 )
+    {
+        i = ModelFind( model, root );
+        if ( i == NOT_FOUND || model->dirs[i].removed )
+            PushPath( &round, strdup( root ) );
+    }
+
+    /* a folder reported more than once is read once */
+    if ( round.count > 1 )
+        qsort( (void*)round.paths, round.count, sizeof(char*), CompareStrings );
+    for ( i = 0, j = 0; i < round.count; ++i )
+    {
+        if ( j > 0 && strcmp( round.paths[j - 1], round.paths[i] ) == 0 )
+            free( round.paths[i] );
+        else
+            round.paths[j++] = round.paths[i];
+    }
+    round.count = j;
+
+    while ( round.count > 0 && !Stopping( engine ) )
+    {
+        memset( &job, 0, sizeof(job) );
+        job.engine = engine;
+        job.count = round.count;
+        job.reads = calloc( round.count, sizeof(DirRead) );
+        if ( !job.reads )
+            break;
+        for ( i = 0; i < round.count; ++i )
+            job.reads[i].path = round.paths[i];
+        round.count = 0;
+
+        RunParallel( ReadWorkerMain, &job );
+        for ( i = 0; i < job.count; ++i )
+            ApplyRead( worker, &job.reads[i], &next );
+        free( job.reads );
+
+        free( round.paths );
+        round = next;
+        memset( &next, 0, sizeof(PathList) );
+    }
+    FreePaths( &round );
+
+    if ( !Stopping( engine ) && ( worker->changed || !model->base ) )
+        PublishModel( worker );
+    WatchDirs( worker );
+}
+
+static void ReadEvents( IndexWorker *worker )
+{
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    ssize_t len;
+    char *p, *path;
+
+    while ( ( len = read( worker->inotifyFd, buf, sizeof(buf) ) ) > 0 )
+    {
+        for ( p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len )
+        {
+            event = (const struct inotify_event*)p;
+            if ( event->mask & IN_Q_OVERFLOW )
+            {
+                worker->revalidate = 1;
+                MarkChanged( worker );
+                continue;
+            }
+
+            path = FindWatch( worker, event->wd );
+            if ( !path )
+                continue;
+            PushPath( &worker->dirty, strdup( path ) );
+            MarkChanged( worker );
+            if ( event->mask & IN_IGNORED )
+            {
+                /* the watch is gone, reading the folder again puts a new
+                   one on it if it's still there */
+                size_t i = ModelFind( &worker->model, path );
+                if ( i != NOT_FOUND && worker->model.dirs[i].wd == event->wd )
+                    worker->model.dirs[i].wd = -1;
+                RemoveWatch( worker, event->wd );
+                worker->watchedAll = 0;
+            }
+        }
+    }
+}
+
+static void *EngineMain( void *data )
+{
+    IndexEngine *engine = (IndexEngine*)data;
+    IndexWorker worker;
+    nfdindexsnapshot_t *loaded;
+    nfdindex_t *handle;
+
+    memset( &worker, 0, sizeof(worker) );
+    worker.engine = engine;
+
+    /* the cached index goes out as it is, then gets checked */
+    loaded = LoadSnapshot( engine );
+    if ( loaded )
+    {
+        pthread_mutex_lock( &engine->lock );
+        engine->snapshot = loaded;
+        for ( handle = engine->handles; handle; handle = handle->next )
+        {
+            char byte = 0;
+            if ( !handle->woken )
+                handle->woken = write( handle->wakePipe[1], &byte, 1 ) == 1;
+        }
+        pthread_mutex_unlock( &engine->lock );
+        worker.lastSave = NFDi_NowMs();
+    }
+    ModelInit( &worker.model, loaded );
+    worker.inotifyFd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+
+    UpdateIndex( &worker, 1 );
+    SetUpdating( engine, 0 );
+
+    while ( !Stopping( engine ) )
+    {
+        struct pollfd fds[2];
+        int wait = -1;
+        char command;
+
+        if ( worker.dirty.count > 0 || worker.revalidate )
+        {
+            long long now = NFDi_NowMs();
+            long long due = worker.lastChange + INDEX_SETTLE_MS;
+            if ( due > worker.firstChange + INDEX_MAX_DELAY_MS )
+                due = worker.firstChange + INDEX_MAX_DELAY_MS;
+            if ( due <= now )
+            {
+                int revalidate = worker.revalidate;
+                worker.revalidate = 0;
+                SetUpdating( engine, 1 );
+                UpdateIndex( &worker, revalidate );
+                SetUpdating( engine, 0 );
+                continue;
+            }
+            wait = (int)( due - now );
+        }
+
+        fds[0].fd = engine->controlPipe[0];
+        fds[0].events = POLLIN;
+        fds[1].fd = worker.inotifyFd;
+        fds[1].events = POLLIN;
+        if ( poll( fds, 2, wait ) < 0 && errno != EINTR )
+            break;
+
+        while ( ( fds[0].revents & POLLIN ) && read( engine->controlPipe[0], &command, 1 ) == 1 )
+        {
+            /* a new dialog; without inotify everywhere, look for changes */
+            if ( command == 'r' && !worker.watchedAll )
+            {
+                worker.revalidate = 1;
+                MarkChanged( &worker );
+            }
+        }
+        if ( fds[1].revents & POLLIN )
+            ReadEvents( &worker );
+    }
+
+    if ( worker.inotifyFd >= 0 )
+        close( worker.inotifyFd );
+    while ( worker.watches && worker.watchCount > 0 )
+    {
+        size_t i;
+        for ( i = 0; i <= worker.watchMask; ++i )
+        {
+            if ( worker.watches[i].wd >= 0 )
+                RemoveWatch( &worker, worker.watches[i].wd );
+        }
+    }
+    free( worker.watches );
+    FreePaths( &worker.dirty );
+    ModelFree( &worker.model );
+    return NULL;
+}
+
+/* engines */
+
+static void StopEngine( IndexEngine *engine )
+{
+    char command = 'q';
+
+    __atomic_store_n( &engine->stop, 1, __ATOMIC_RELAXED );
+    if ( write( engine->controlPipe[1], &command, 1 ) != 1 )
+    {
+        /* the thread still sees stop within a poll timeout of its own */
+    }
+    pthread_join( engine->thread, NULL );
+
+    NFDi_Index_ReleaseSnapshot( engine->snapshot );
+    close( engine->controlPipe[0] );
+    close( engine->controlPipe[1] );
+    pthread_mutex_destroy( &engine->lock );
+    free( engine->roots );
+    free( engine );
+}
+
+__attribute__((destructor))
+static void StopIndexes( void )
+{
+    IndexEngine *engine;
+
+    pthread_mutex_lock( &indexLock );
+    while ( ( engine = engines ) != NULL )
+    {
+        engines = engine->next;
+        StopEngine( engine );
+    }
+    pthread_mutex_unlock( &indexLock );
+}
+
+static int OpenPipe( int fds[2] )
+{
+    if ( NFDi_Pipe( fds ) != 0 )
+        return 0;
+    fcntl( fds[0], F_SETFL, O_NONBLOCK );
+    fcntl( fds[1], F_SETFL, O_NONBLOCK );
+    return 1;
+}
+
+/* resolved, sorted and without duplicates, so the same folders always
+   find the same index */
+static char *ResolveRoots( const nfdchar_t *const *roots, size_t *rootsLen )
+{
+    char resolved[PATH_MAX];
+    char **sorted;
+    char *blob = NULL, *p;
+    size_t count = 0, len = 0, i, n;
+
+    for ( ; roots && roots[count]; ++count )
+        ;
+    if ( count == 0 )
+    {
+        NFDi_SetError( NO_ROOTS_MSG );
+        return NULL;
+    }
+
+    sorted = calloc( count, sizeof(char*) );
+    if ( !sorted )
+    {
+        NFDi_SetError( "NFDi_Malloc failed." );
+        return NULL;
+    }
+    for ( i = 0; i < count; ++i )
+    {
+        if ( !realpath( roots[i], resolved ) )
+        {
+            NFDi_SetError( BAD_ROOT_MSG );
+            goto done;
+        }
+        sorted[i] = strdup( resolved );
+        if ( !sorted[i] )
+        {
+            NFDi_SetError( "NFDi_Malloc failed." );
+            goto done;
+        }
+        len += strlen( resolved ) + 1;
+    }
+    qsort( (void*)sorted, count, sizeof(char*), CompareStrings );
+
+    blob = malloc( len );
+    if ( !blob )
+    {
+        NFDi_SetError( "NFDi_Malloc failed." );
+        goto done;
+    }
+    for ( p = blob, i = 0; i < count; ++i )
+    {
+        if ( i > 0 && strcmp( sorted[i - 1], sorted[i] ) == 0 )
+            continue;
+        n = strlen( sorted[i] ) + 1;
+        memcpy( p, sorted[i], n );
+        p += n;
+    }
+    *rootsLen = (size_t)( p - blob );
+
+done:
+    for ( i = 0; i < count; ++i )
+        free( sorted[i] );
+    free( (void*)sorted );
+    return blob;
+}
+
+static IndexEngine *StartEngine( char *roots, size_t rootsLen )
+{
+    IndexEngine *engine = calloc( 1, sizeof(IndexEngine) );
+
+    if ( !engine )
+        return NULL;
+    engine->roots = roots;
+    engine->rootsLen = rootsLen;
+    engine->updating = 1;
+    GetCachePath( engine );
+    if ( !OpenPipe( engine->controlPipe ) )
+    {
+        free( engine );
+        return NULL;
+    }
+    pthread_mutex_init( &engine->lock, NULL );
+
+    if ( pthread_create( &engine->thread, NULL, EngineMain, engine ) != 0 )
+    {
+        pthread_mutex_destroy( &engine->lock );
+        close( engine->controlPipe[0] );
+        close( engine->controlPipe[1] );
+        free( engine );
+        return NULL;
+    }
+    return engine;
+}
+
+nfdindex_t *NFDi_Index_Acquire( const nfdchar_t *const *roots )
+{
+    IndexEngine *engine;
+    nfdindex_t *index;
+    size_t rootsLen = 0;
+    char *resolved = ResolveRoots( roots, &rootsLen );
+    char command = 'r';
+
+    if ( !resolved )
+        return NULL;
+
+    index = calloc( 1, sizeof(nfdindex_t) );
+    if ( !index || !OpenPipe( index->wakePipe ) )
+    {
+        free( index );
+        free( resolved );
+        NFDi_SetError( NO_THREAD_MSG );
+        return NULL;
+    }
+
+    pthread_mutex_lock( &indexLock );
+    for ( engine = engines; engine; engine = engine->next )
+    {
+        if ( engine->rootsLen == rootsLen && memcmp( engine->roots, resolved, rootsLen ) == 0 )
+            break;
+    }
+    if ( engine )
+    {
+        free( resolved );
+    }
+    else
+    {
+        engine = StartEngine( resolved, rootsLen );
+        if ( !engine )
+        {
+            pthread_mutex_unlock( &indexLock );
+            close( index->wakePipe[0] );
+            close( index->wakePipe[1] );
+            free( index );
+            free( resolved );
+            NFDi_SetError( NO_THREAD_MSG );
+            return NULL;
+        }
+        engine->next = engines;
+        engines = engine;
+    }
+    ++engine->users;
+    pthread_mutex_unlock( &indexLock );
+
+    index->engine = engine;
+    pthread_mutex_lock( &engine->lock );
+    index->next = engine->handles;
+    engine->handles = index;
+    pthread_mutex_unlock( &engine->lock );
+
+    if ( write( engine->controlPipe[1], &command, 1 ) != 1 )
+    {
+        /* a check is already queued */
+    }
+    return index;
+}
+
+void NFDi_Index_Release( nfdindex_t *index )
+{
+    IndexEngine *engine = index->engine;
+    IndexEngine *oldest, **link;
+    nfdindex_t **handle;
+    size_t idle;
+
+    pthread_mutex_lock( &engine->lock );
+    for ( handle = &engine->handles; *handle != index; handle = &(*handle)->next )
+        ;
+    *handle = index->next;
+    pthread_mutex_unlock( &engine->lock );
+    close( index->wakePipe[0] );
+    close( index->wakePipe[1] );
+    free( index );
+
+    /* unused indexes keep watching for a while, the oldest ones go */
+    pthread_mutex_lock( &indexLock );
+    --engine->users;
+    engine->lastUsed = NFDi_NowMs();
+    for ( ;; )
+    {
+        oldest = NULL;
+        idle = 0;
+        for ( engine = engines; engine; engine = engine->next )
+        {
+            if ( engine->users > 0 )
+                continue;
+            ++idle;
+            if ( !oldest || engine->lastUsed < oldest->lastUsed )
+                oldest = engine;
+        }
+        if ( idle <= INDEX_MAX_IDLE )
+            break;
+        for ( link = &engines; *link != oldest; link = &(*link)->next )
+            ;
+        *link = oldest->next;
+        StopEngine( oldest );
+    }
+    pthread_mutex_unlock( &indexLock );
+}
+
+int NFDi_Index_GetWakeFd( const nfdindex_t *index )
+{
+    return index->wakePipe[0];
+}
+
+nfdindexsnapshot_t *NFDi_Index_GetSnapshot( nfdindex_t *index, int *updating )
+{
+    IndexEngine *engine = index->engine;
+    nfdindexsnapshot_t *snapshot;
+    char byte;
+
+    pthread_mutex_lock( &engine->lock );
+    while ( read( index->wakePipe[0], &byte, 1 ) == 1 )
+        ;
+    index->woken = 0;
+    snapshot = RetainSnapshot( engine->snapshot );
+    if ( updating )
+        *updating = engine->updating;
+    pthread_mutex_unlock( &engine->lock );
+    return snapshot;
+}
@@ -0,0 +1,54 @@
+/*
+  Native File Dialog
+
+  Internal, the file name index behind NFD_SearchDialog (nfd_index.c)
+
+  http://www.frogtoss.com/labs
+ */
+
+
+#ifndef _NFD_INDEX_H
+#define _NFD_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "nfd_common.h"
+
+/* Every file below a set of roots, searchable by name.  There is one index
+   per set of roots for the life of the process, shared by every dialog on
+   them.  A background thread loads it from the disk cache, brings it up to
+   date and then keeps it there with inotify.  Queries run against an
+   immutable snapshot and never wait on that thread.  Dot files and dot
+   folders are left out, and symlinked folders are not followed. */
+
+typedef struct nfdindex_s nfdindex_t;
+typedef struct nfdindexsnapshot_s nfdindexsnapshot_t;
+
+/* roots is NULL-terminated.  NULL with the error set on failure */
+nfdindex_t *NFDi_Index_Acquire( const nfdchar_t *const *roots );
+void        NFDi_Index_Release( nfdindex_t *index );
+
+/* readable once there is a newer snapshot or the updating state changed,
+   until the next NFDi_Index_GetSnapshot */
+int         NFDi_Index_GetWakeFd( const nfdindex_t *index );
+
+/* the newest snapshot, referenced, or NULL until the first one is built.
+   updating is set while the index is catching up with the disk */
+nfdindexsnapshot_t *NFDi_Index_GetSnapshot( nfdindex_t *index, int *updating );
+void        NFDi_Index_ReleaseSnapshot( nfdindexsnapshot_t *snapshot );
+
+size_t      NFDi_Index_GetFileCount( const nfdindexsnapshot_t *snapshot );
+const char *NFDi_Index_GetName( const nfdindexsnapshot_t *snapshot, uint32_t file );
+const char *NFDi_Index_GetDir( const nfdindexsnapshot_t *snapshot, uint32_t file );
+
+/* Up to maxResults files, in path order, whose name contains every space
+   separated term of query (ASCII case-insensitively) and matches filter.
+   A filter without groups matches everything.  Returns how many were
+   written to outFiles. */
+size_t      NFDi_Index_Query( const nfdindexsnapshot_t *snapshot,
+                              const char *query,
+                              const nfdfilter_t *filter,
+                              uint32_t *outFiles,
+                              size_t maxResults );
+
+#endif
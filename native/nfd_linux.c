@@ -24,138 +24,1623 @@
  *
  */
 
-#include <SDL.h>
+/* dlmopen, RTLD_DEFAULT and pthread_setname_np */
+#define _GNU_SOURCE
+#include <assert.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "nfd.h"
+#include "nfd_common.h"
+#include "nfd_probes.h"
+
+/* How long a failed backend probe is remembered before we look again.
+ * Can be overridden with the NFD_BACKEND_RETRY environment variable.
+ */
+#define NFD_INTERNAL_DEFAULT_RETRY_MS 5000
+
+#define NFD_INTERNAL_ARRAYSIZE(a) (sizeof(a) / sizeof(a[0]))
+
+typedef struct NFD_INTERNAL_BackendFuncs
+{
+	nfdresult_t (*OpenDialog)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath
+	);
+	nfdresult_t (*OpenDialogMultiple)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdpathset_t *outPaths
+	);
+	nfdresult_t (*SaveDialog)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath
+	);
+	nfdresult_t (*PickFolder)(
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath
+	);
+	nfdresult_t (*OpenDialogEx)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*OpenDialogMultipleEx)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdpathset_t *outPaths,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*SaveDialogEx)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*PickFolderEx)(
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*SearchDialog)(
+		const nfdchar_t *const *roots,
+		const nfdchar_t *filterList,
+		nfdchar_t **outPath,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*PickFolderAndScan)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath,
+		nfdpathset_t *outPaths,
+		const nfdscanoptions_t *options,
+		nfdrequest_t *request
+	);
+	nfdresult_t (*OpenDialogMapped)(
+		const nfdchar_t *filterList,
+		const nfdchar_t *defaultPath,
+		nfdchar_t **outPath,
+		nfdmapping_t *outMapping,
+		unsigned int mapFlags,
+		nfdrequest_t *request
+	);
+	const char* (*GetError)(void);
+	nfdrequest_t* (*Request_Create)(void);
+	void (*Request_SetTimeout)(nfdrequest_t *request, unsigned int milliseconds);
+	void (*Cancel)(nfdrequest_t *request);
+	void (*Request_SetFlags)(nfdrequest_t *request, unsigned int flags);
+	void (*Request_SetReadAheadLimit)(
+		nfdrequest_t *request,
+		unsigned long long bytes
+	);
+	const nfdpathinfo_t* (*Request_GetPathInfo)(
+		const nfdrequest_t *request,
+		size_t *count
+	);
+	void (*Request_Free)(nfdrequest_t *request);
+	void (*PathSet_Free)(nfdpathset_t *pathSet);
+	void (*Free)(void *ptr);
+} NFD_INTERNAL_BackendFuncs;
+
+#ifdef NFD_MONOLITHIC
+
+/* Built into this library: nfd_common.h renamed each backend's dialogs to
+ * NFDi_<backend>_*, and nfd_common.c provides everything else directly, so
+ * only the first nine entries are ever dispatched through.
+ */
+#define NFD_INTERNAL_BUILTIN_BACKEND(b) \
+	int NFDi_##b##_Probe(void); \
+	__typeof__(NFD_OpenDialog) NFDi_##b##_OpenDialog; \
+	__typeof__(NFD_OpenDialogMultiple) NFDi_##b##_OpenDialogMultiple; \
+	__typeof__(NFD_SaveDialog) NFDi_##b##_SaveDialog; \
+	__typeof__(NFD_PickFolder) NFDi_##b##_PickFolder; \
+	__typeof__(NFD_OpenDialogEx) NFDi_##b##_OpenDialogEx; \
+	__typeof__(NFD_OpenDialogMultipleEx) NFDi_##b##_OpenDialogMultipleEx; \
+	__typeof__(NFD_SaveDialogEx) NFDi_##b##_SaveDialogEx; \
+	__typeof__(NFD_PickFolderEx) NFDi_##b##_PickFolderEx; \
+	__typeof__(NFD_SearchDialog) NFDi_##b##_SearchDialog; \
+	static const NFD_INTERNAL_BackendFuncs b##Funcs = \
+	{ \
+		NFDi_##b##_OpenDialog, \
+		NFDi_##b##_OpenDialogMultiple, \
+		NFDi_##b##_SaveDialog, \
+		NFDi_##b##_PickFolder, \
+		NFDi_##b##_OpenDialogEx, \
+		NFDi_##b##_OpenDialogMultipleEx, \
+		NFDi_##b##_SaveDialogEx, \
+		NFDi_##b##_PickFolderEx, \
+		NFDi_##b##_SearchDialog \
+	};
+NFD_INTERNAL_BUILTIN_BACKEND(gtk)
+NFD_INTERNAL_BUILTIN_BACKEND(zenity)
+NFD_INTERNAL_BUILTIN_BACKEND(script)
+NFD_INTERNAL_BUILTIN_BACKEND(remote)
+#undef NFD_INTERNAL_BUILTIN_BACKEND
+
+typedef struct NFD_INTERNAL_BackendInfo
+{
+	const char *name;
+	int (*probe)(void);
+	const NFD_INTERNAL_BackendFuncs *funcs;
+	int pinnedOnly;
+} NFD_INTERNAL_BackendInfo;
+
+/* The portal and the Xlib chooser need libdbus and libX11, so they are
+ * only available as libnfd_portal.so and libnfd_x11.so
+ */
+static const NFD_INTERNAL_BackendInfo backends[] =
+{
+	{ "gtk", NFDi_gtk_Probe, &gtkFuncs, 0 },
+	{ "zenity", NFDi_zenity_Probe, &zenityFuncs, 0 },
+	{ "script", NFDi_script_Probe, &scriptFuncs, 1 },
+	{ "remote", NFDi_remote_Probe, &remoteFuncs, 1 }
+};
+
+#else
+
+typedef struct NFD_INTERNAL_BackendInfo
+{
+	const char *name;
+	const char *library;
+	int pinnedOnly;
+} NFD_INTERNAL_BackendInfo;
+
+static const NFD_INTERNAL_BackendInfo backends[] =
+{
+	/* First, since its probe asks the session bus for a running portal */
+	{ "portal", "libnfd_portal.so", 0 },
+	{ "gtk", "libnfd_gtk.so", 0 },
+	{ "zenity", "libnfd_zenity.so", 0 },
+	/* Built-in Xlib chooser, for systems with none of the above */
+	{ "x11", "libnfd_x11.so", 0 },
+	{ "script", "libnfd_script.so", 1 },
+	{ "remote", "libnfd_remote.so", 1 }
+};
+
+#endif /* NFD_MONOLITHIC */
 
 static void* backend = NULL;
+static const NFD_INTERNAL_BackendInfo *backendInfo = NULL;
+static NFD_INTERNAL_BackendFuncs backendFuncs;
+#ifndef NFD_MONOLITHIC
+static int backendIsolated = 0;
+#endif
+
+/* NULL means "use NFD_BACKEND, or probe everything" */
+static const NFD_INTERNAL_BackendInfo *requestedBackend = NULL;
+
+/* Negative cache for failed probes, so that machines without any backend
+ * do not walk the library search path on every single call.
+ */
+static int backendFailed = 0;
+static uint32_t backendFailTicks = 0;
 
-static SDL_bool NFD_INTERNAL_LoadBackend(void)
+/* backendLock covers all of the above, plus the two counts below. A backend
+ * is only loaded or switched with it held, and NFD_SetBackend will not
+ * switch away from one that still has calls running or jobs queued
+ * (backendUsers) or, split up, requests alive (backendRequests).
+ */
+static pthread_mutex_t backendLock = PTHREAD_MUTEX_INITIALIZER;
+static int backendUsers = 0;
+static int backendRequests = 0;
+
+/* Our own errors share nfd_common.c's buffer with whatever of it is linked
+ * in. Split up, they are reported until the next call into the backend.
+ * Like the backend's, the buffer is per thread.
+ */
+static void NFD_INTERNAL_SetError(const char *msg)
+{
+	NFDi_SetError(msg);
+}
+
+static uint32_t NFD_INTERNAL_GetTicks(void)
 {
-	static const char *backends[] =
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static const NFD_INTERNAL_BackendInfo* NFD_INTERNAL_FindBackend(const char *name)
+{
+	size_t i;
+	for (i = 0; i < NFD_INTERNAL_ARRAYSIZE(backends); i += 1)
 	{
-		"libnfd_gtk.so",
-		"libnfd_zenity.so"
-	};
-	Uint8 i;
-	for (i = 0; i < SDL_arraysize(backends); i += 1)
+		if (strcmp(backends[i].name, name) == 0)
+		{
+			return &backends[i];
+		}
+	}
+	return NULL;
+}
+
+#ifdef NFD_MONOLITHIC
+static int NFD_INTERNAL_OpenBackend(const NFD_INTERNAL_BackendInfo *info)
+{
+	if (!info->probe())
+	{
+		return 0;
+	}
+	backendFuncs = *info->funcs;
+	backend = (void*) info;
+	backendInfo = info;
+	return 1;
+}
+#else
+/* Backends are opened RTLD_LOCAL, so neither their own NFD_* entry points
+ * nor the toolkit they pull in are visible to the host or to each other.
+ * They are linked -Bsymbolic so that their calls into nfd_common.c bind to
+ * their own copy rather than to ours.
+ *
+ * NFD_BACKEND_ISOLATE=1 goes further and opens the backend in a new link
+ * map with dlmopen: GTK and its glib then cannot be interposed by, or
+ * interpose, libraries of the same name already in the host. The backend
+ * gets its own libc too, so its results are copied into ours before they
+ * are returned; see NFD_INTERNAL_AdoptPath.
+ */
+static void* NFD_INTERNAL_LoadObject(const char *library, int *isolated)
+{
+#ifdef LM_ID_NEWLM
+	const char *isolate = getenv("NFD_BACKEND_ISOLATE");
+	if (isolate != NULL && atoi(isolate) != 0)
+	{
+		*isolated = 1;
+		return dlmopen(LM_ID_NEWLM, library, RTLD_LAZY | RTLD_LOCAL);
+	}
+#endif
+	*isolated = 0;
+	return dlopen(library, RTLD_LAZY | RTLD_LOCAL);
+}
+
+static int NFD_INTERNAL_OpenBackend(const NFD_INTERNAL_BackendInfo *info)
+{
+	int (*probe)(void);
+	int isolated;
+	void *object = NFD_INTERNAL_LoadObject(info->library, &isolated);
+	if (object == NULL)
+	{
+		return 0;
+	}
+
+	#define LOAD_FUNC(func) \
+		*(void**) &backendFuncs.func = dlsym(object, "NFD_" #func); \
+		if (backendFuncs.func == NULL) \
+		{ \
+			dlclose(object); \
+			return 0; \
+		}
+	LOAD_FUNC(OpenDialog)
+	LOAD_FUNC(OpenDialogMultiple)
+	LOAD_FUNC(SaveDialog)
+	LOAD_FUNC(PickFolder)
+	LOAD_FUNC(OpenDialogEx)
+	LOAD_FUNC(OpenDialogMultipleEx)
+	LOAD_FUNC(SaveDialogEx)
+	LOAD_FUNC(PickFolderEx)
+	LOAD_FUNC(SearchDialog)
+	LOAD_FUNC(PickFolderAndScan)
+	LOAD_FUNC(OpenDialogMapped)
+	LOAD_FUNC(GetError)
+	LOAD_FUNC(Request_Create)
+	LOAD_FUNC(Request_SetTimeout)
+	LOAD_FUNC(Cancel)
+	LOAD_FUNC(Request_SetFlags)
+	LOAD_FUNC(Request_SetReadAheadLimit)
+	LOAD_FUNC(Request_GetPathInfo)
+	LOAD_FUNC(Request_Free)
+	LOAD_FUNC(PathSet_Free)
+	LOAD_FUNC(Free)
+	#undef LOAD_FUNC
+
+	/* Optional, for backends that can load without being usable */
+	*(void**) &probe = dlsym(object, "NFDi_Backend_Probe");
+	if (probe != NULL && !probe())
 	{
-		backend = SDL_LoadObject(backends[i]);
-		if (backend != NULL)
+		dlclose(object);
+		return 0;
+	}
+
+	backend = object;
+	backendInfo = info;
+	backendIsolated = isolated;
+	return 1;
+}
+#endif /* NFD_MONOLITHIC */
+
+/* NFD_SCRIPT_RECORD: the answer to every dialog is appended to this file in
+ * the NFD_SCRIPT format of nfd_script.c, so that a session with a real
+ * backend can be replayed later with NFD_BACKEND=script.
+ */
+static NFD_INTERNAL_BackendFuncs recordedFuncs;
+static const char *recordPath = NULL;
+
+static char* NFD_INTERNAL_RecordField(char *dst, const char *field)
+{
+	*dst++ = '\t';
+	for (; *field != '\0'; field += 1)
+	{
+		switch (*field)
 		{
-			return SDL_TRUE;
+		case '\t': *dst++ = '\\'; *dst++ = 't'; break;
+		case '\n': *dst++ = '\\'; *dst++ = 'n'; break;
+		case '\r': *dst++ = '\\'; *dst++ = 'r'; break;
+		case '\\': *dst++ = '\\'; *dst++ = '\\'; break;
+		default: *dst++ = *field; break;
 		}
 	}
-	return SDL_FALSE;
+	return dst;
 }
 
-nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
-                            const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath )
+static void NFD_INTERNAL_Record(
+	const char *dialog,
+	nfdresult_t result,
+	nfdchar_t **outPath,
+	nfdpathset_t *outPaths
+) {
+	const char *resultName;
+	size_t len, count, i;
+	char *line, *end;
+	FILE *file;
+
+	/* Worst case every byte is escaped */
+	len = strlen(dialog) + 16;
+	count = 0;
+	if (result == NFD_OKAY && outPaths != NULL)
+	{
+		count = NFD_PathSet_GetCount(outPaths);
+		for (i = 0; i < count; i += 1)
+		{
+			len += strlen(NFD_PathSet_GetPath(outPaths, i)) * 2 + 1;
+		}
+	}
+	else if (result == NFD_OKAY)
+	{
+		len += strlen(*outPath) * 2 + 1;
+	}
+	else if (result == NFD_ERROR)
+	{
+		len += strlen(NFD_GetError()) * 2 + 1;
+	}
+
+	line = (char*) malloc(len);
+	if (line == NULL)
+	{
+		return;
+	}
+	end = line + strlen(dialog);
+	memcpy(line, dialog, end - line);
+
+	resultName = (result == NFD_OKAY) ? "okay" :
+		(result == NFD_CANCEL) ? "cancel" : "error";
+	end = NFD_INTERNAL_RecordField(end, resultName);
+	if (result == NFD_OKAY && outPaths != NULL)
+	{
+		for (i = 0; i < count; i += 1)
+		{
+			end = NFD_INTERNAL_RecordField(
+				end,
+				NFD_PathSet_GetPath(outPaths, i)
+			);
+		}
+	}
+	else if (result == NFD_OKAY)
+	{
+		end = NFD_INTERNAL_RecordField(end, *outPath);
+	}
+	else if (result == NFD_ERROR)
+	{
+		end = NFD_INTERNAL_RecordField(end, NFD_GetError());
+	}
+	*end++ = '\n';
+
+	/* Reopened for every dialog, so nothing is lost if the app crashes */
+	file = fopen(recordPath, "ab");
+	if (file != NULL)
+	{
+		fwrite(line, 1, end - line, file);
+		fclose(file);
+	}
+	free(line);
+}
+
+static nfdresult_t NFD_INTERNAL_RecordOpenDialogEx(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath,
+	nfdrequest_t *request
+) {
+	nfdresult_t result = recordedFuncs.OpenDialogEx(
+		filterList,
+		defaultPath,
+		outPath,
+		request
+	);
+	NFD_INTERNAL_Record("open", result, outPath, NULL);
+	return result;
+}
+
+static nfdresult_t NFD_INTERNAL_RecordOpenDialogMultipleEx(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdpathset_t *outPaths,
+	nfdrequest_t *request
+) {
+	nfdresult_t result = recordedFuncs.OpenDialogMultipleEx(
+		filterList,
+		defaultPath,
+		outPaths,
+		request
+	);
+	NFD_INTERNAL_Record("multiple", result, NULL, outPaths);
+	return result;
+}
+
+static nfdresult_t NFD_INTERNAL_RecordSaveDialogEx(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath,
+	nfdrequest_t *request
+) {
+	nfdresult_t result = recordedFuncs.SaveDialogEx(
+		filterList,
+		defaultPath,
+		outPath,
+		request
+	);
+	NFD_INTERNAL_Record("save", result, outPath, NULL);
+	return result;
+}
+
+static nfdresult_t NFD_INTERNAL_RecordPickFolderEx(
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath,
+	nfdrequest_t *request
+) {
+	nfdresult_t result = recordedFuncs.PickFolderEx(
+		defaultPath,
+		outPath,
+		request
+	);
+	NFD_INTERNAL_Record("folder", result, outPath, NULL);
+	return result;
+}
+
+static nfdresult_t NFD_INTERNAL_RecordSearchDialog(
+	const nfdchar_t *const *roots,
+	const nfdchar_t *filterList,
+	nfdchar_t **outPath,
+	nfdrequest_t *request
+) {
+	nfdresult_t result = recordedFuncs.SearchDialog(
+		roots,
+		filterList,
+		outPath,
+		request
+	);
+	NFD_INTERNAL_Record("search", result, outPath, NULL);
+	return result;
+}
+
+/* The plain calls go through the Ex ones, so each dialog is recorded once
+ * even when a backend implements one in terms of the other.
+ */
+static nfdresult_t NFD_INTERNAL_RecordOpenDialog(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath
+) {
+	return NFD_INTERNAL_RecordOpenDialogEx(filterList, defaultPath, outPath, NULL);
+}
+
+static nfdresult_t NFD_INTERNAL_RecordOpenDialogMultiple(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdpathset_t *outPaths
+) {
+	return NFD_INTERNAL_RecordOpenDialogMultipleEx(
+		filterList,
+		defaultPath,
+		outPaths,
+		NULL
+	);
+}
+
+static nfdresult_t NFD_INTERNAL_RecordSaveDialog(
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath
+) {
+	return NFD_INTERNAL_RecordSaveDialogEx(filterList, defaultPath, outPath, NULL);
+}
+
+static nfdresult_t NFD_INTERNAL_RecordPickFolder(
+	const nfdchar_t *defaultPath,
+	nfdchar_t **outPath
+) {
+	return NFD_INTERNAL_RecordPickFolderEx(defaultPath, outPath, NULL);
+}
+
+static void NFD_INTERNAL_StartRecording(void)
 {
-	if (backend == NULL)
+	recordPath = getenv("NFD_SCRIPT_RECORD");
+	if (recordPath == NULL || recordPath[0] == '\0')
+	{
+		return;
+	}
+
+	recordedFuncs = backendFuncs;
+	backendFuncs.OpenDialog = NFD_INTERNAL_RecordOpenDialog;
+	backendFuncs.OpenDialogMultiple = NFD_INTERNAL_RecordOpenDialogMultiple;
+	backendFuncs.SaveDialog = NFD_INTERNAL_RecordSaveDialog;
+	backendFuncs.PickFolder = NFD_INTERNAL_RecordPickFolder;
+	backendFuncs.OpenDialogEx = NFD_INTERNAL_RecordOpenDialogEx;
+	backendFuncs.OpenDialogMultipleEx = NFD_INTERNAL_RecordOpenDialogMultipleEx;
+	backendFuncs.SaveDialogEx = NFD_INTERNAL_RecordSaveDialogEx;
+	backendFuncs.PickFolderEx = NFD_INTERNAL_RecordPickFolderEx;
+	backendFuncs.SearchDialog = NFD_INTERNAL_RecordSearchDialog;
+}
+
+static int NFD_INTERNAL_TryBackend(const NFD_INTERNAL_BackendInfo *info)
+{
+	int result;
+
+	NFD_PROBE1(backend_load_start, info->name);
+	result = NFD_INTERNAL_OpenBackend(info);
+	NFD_PROBE2(backend_load_done, info->name, result);
+	if (result)
+	{
+		NFD_INTERNAL_SetError("");
+		NFD_INTERNAL_StartRecording();
+	}
+	return result;
+}
+
+/* Called with backendLock held */
+static int NFD_INTERNAL_LoadBackend(void)
+{
+	const NFD_INTERNAL_BackendInfo *pinned;
+	const char *env;
+	uint32_t retry;
+	size_t i;
+
+	if (backend != NULL)
+	{
+		NFD_INTERNAL_SetError("");
+		return 1;
+	}
+
+	if (backendFailed)
 	{
-		if (!NFD_INTERNAL_LoadBackend())
+		env = getenv("NFD_BACKEND_RETRY");
+		retry = env ? (uint32_t) atoi(env) : NFD_INTERNAL_DEFAULT_RETRY_MS;
+		if ((int32_t) (NFD_INTERNAL_GetTicks() - (backendFailTicks + retry)) < 0)
 		{
-			return NFD_ERROR;
+			return 0;
 		}
+		backendFailed = 0;
 	}
 
-	nfdresult_t (*backend_OpenDialog)(
-		const nfdchar_t *filterList,
-		const nfdchar_t *defaultPath,
-		nfdchar_t **outPath
-	) = SDL_LoadFunction(backend, "NFD_OpenDialog");
-	return backend_OpenDialog(filterList, defaultPath, outPath);
+	pinned = requestedBackend;
+	if (pinned == NULL)
+	{
+		env = getenv("NFD_BACKEND");
+		if (env != NULL && env[0] != '\0')
+		{
+			pinned = NFD_INTERNAL_FindBackend(env);
+			if (pinned == NULL)
+			{
+				NFD_INTERNAL_SetError("NFD_BACKEND names an unknown backend!");
+				goto fail;
+			}
+		}
+	}
+
+	if (pinned != NULL)
+	{
+		if (NFD_INTERNAL_TryBackend(pinned))
+		{
+			return 1;
+		}
+		NFD_INTERNAL_SetError("The requested NFD backend could not be loaded!");
+		goto fail;
+	}
+
+	for (i = 0; i < NFD_INTERNAL_ARRAYSIZE(backends); i += 1)
+	{
+		/* The headless script and remote backends are only used when asked for */
+		if (backends[i].pinnedOnly)
+		{
+			continue;
+		}
+		if (NFD_INTERNAL_TryBackend(&backends[i]))
+		{
+			return 1;
+		}
+	}
+	NFD_INTERNAL_SetError("No NFD backend could be loaded!");
+
+fail:
+	backendFailed = 1;
+	backendFailTicks = NFD_INTERNAL_GetTicks();
+	return 0;
 }
 
-nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
-                                    const nfdchar_t *defaultPath,
-                                    nfdpathset_t *outPaths )
+/* Loads the backend if need be, and keeps it loaded until the matching
+ * NFD_INTERNAL_ReleaseBackend.
+ */
+static int NFD_INTERNAL_AcquireBackend(void)
 {
-	if (backend == NULL)
+	int result;
+
+	pthread_mutex_lock(&backendLock);
+	result = NFD_INTERNAL_LoadBackend();
+	if (result)
+	{
+		backendUsers += 1;
+	}
+	pthread_mutex_unlock(&backendLock);
+	return result;
+}
+
+static void NFD_INTERNAL_ReleaseBackend(void)
+{
+	pthread_mutex_lock(&backendLock);
+	assert(backendUsers > 0);
+	backendUsers -= 1;
+	pthread_mutex_unlock(&backendLock);
+}
+
+nfdresult_t NFD_SetBackend( const char *name )
+{
+	const NFD_INTERNAL_BackendInfo *info = NULL;
+	nfdresult_t result;
+
+	if (name != NULL)
 	{
-		if (!NFD_INTERNAL_LoadBackend())
+		info = NFD_INTERNAL_FindBackend(name);
+		if (info == NULL)
 		{
+			NFD_INTERNAL_SetError("NFD_SetBackend was given an unknown backend!");
 			return NFD_ERROR;
 		}
 	}
 
-	nfdresult_t (*backend_OpenDialogMultiple)(
-		const nfdchar_t *filterList,
-		const nfdchar_t *defaultPath,
-		nfdpathset_t *outPaths
-	) = SDL_LoadFunction(backend, "NFD_OpenDialogMultiple");
-	return backend_OpenDialogMultiple(filterList, defaultPath, outPaths);
+	pthread_mutex_lock(&backendLock);
+
+	/* Selecting the backend that's already loaded is a no-op */
+	if (backend != NULL && (info == NULL || info == backendInfo))
+	{
+		requestedBackend = info;
+		pthread_mutex_unlock(&backendLock);
+		return NFD_OKAY;
+	}
+
+	if (backend != NULL)
+	{
+		if (backendUsers > 0 || backendRequests > 0)
+		{
+			pthread_mutex_unlock(&backendLock);
+			NFD_INTERNAL_SetError("The NFD backend is still in use by dialogs or requests!");
+			return NFD_ERROR;
+		}
+#ifndef NFD_MONOLITHIC
+		dlclose(backend);
+#endif
+		backend = NULL;
+		backendInfo = NULL;
+	}
+	requestedBackend = info;
+	backendFailed = 0;
+	NFD_INTERNAL_SetError("No NFD backend has been loaded!");
+	result = NFD_INTERNAL_LoadBackend() ? NFD_OKAY : NFD_ERROR;
+	pthread_mutex_unlock(&backendLock);
+	return result;
+}
+
+const char *NFD_GetBackendName( void )
+{
+	const char *name = NULL;
+
+	pthread_mutex_lock(&backendLock);
+	if (NFD_INTERNAL_LoadBackend())
+	{
+		name = backendInfo->name;
+	}
+	pthread_mutex_unlock(&backendLock);
+	return name;
+}
+
+#ifndef NFD_MONOLITHIC
+
+/* An isolated backend allocates its results from its own libc, and may be
+ * switched away from before the caller gets to free them. So, with the
+ * backend still held, its results are copied into our heap and its copies
+ * freed; NFD_Free and NFD_PathSet_Free then never need a backend. Otherwise
+ * both sides share one malloc and the pointers are handed over as they are.
+ */
+static nfdresult_t NFD_INTERNAL_AdoptPath(nfdresult_t result, nfdchar_t **outPath)
+{
+	nfdchar_t *copy;
+
+	if (result != NFD_OKAY || !backendIsolated)
+	{
+		return result;
+	}
+	copy = strdup(*outPath);
+	backendFuncs.Free(*outPath);
+	*outPath = copy;
+	if (copy == NULL)
+	{
+		NFD_INTERNAL_SetError("Out of memory copying the selected path!");
+		return NFD_ERROR;
+	}
+	return result;
+}
+
+static nfdresult_t NFD_INTERNAL_AdoptPathSet(nfdresult_t result, nfdpathset_t *outPaths)
+{
+	nfdpathset_t copy;
+	size_t size = 1;
+	size_t end, i;
+
+	if (result != NFD_OKAY || !backendIsolated)
+	{
+		return result;
+	}
+
+	/* Paths need not be packed in order, so copy up to the furthest end */
+	for (i = 0; i < outPaths->count; i += 1)
+	{
+		end = outPaths->indices[i] + strlen(outPaths->buf + outPaths->indices[i]) + 1;
+		if (end > size)
+		{
+			size = end;
+		}
+	}
+	copy.count = outPaths->count;
+	copy.buf = (nfdchar_t*) malloc(size);
+	copy.indices = (size_t*) malloc(sizeof(size_t) * (copy.count + 1));
+	if (copy.buf != NULL && copy.indices != NULL && copy.count > 0)
+	{
+		memcpy(copy.buf, outPaths->buf, size);
+		memcpy(copy.indices, outPaths->indices, sizeof(size_t) * copy.count);
+	}
+	backendFuncs.PathSet_Free(outPaths);
+	if (copy.buf == NULL || copy.indices == NULL)
+	{
+		free(copy.buf);
+		free(copy.indices);
+		memset(outPaths, 0, sizeof(*outPaths));
+		NFD_INTERNAL_SetError("Out of memory copying the selected paths!");
+		return NFD_ERROR;
+	}
+	*outPaths = copy;
+	return result;
+}
+
+#else
+
+/* One library, one malloc */
+#define NFD_INTERNAL_AdoptPath(result, outPath) (result)
+#define NFD_INTERNAL_AdoptPathSet(result, outPaths) (result)
+
+#endif /* NFD_MONOLITHIC */
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.OpenDialog(filterList, defaultPath, outPath),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPathSet(
+		backendFuncs.OpenDialogMultiple(filterList, defaultPath, outPaths),
+		outPaths
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
 }
 
 nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
                             const nfdchar_t *defaultPath,
                             nfdchar_t **outPath )
 {
-	if (backend == NULL)
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
 	{
-		if (!NFD_INTERNAL_LoadBackend())
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.SaveDialog(filterList, defaultPath, outPath),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath)
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.PickFolder(defaultPath, outPath),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.OpenDialogEx(filterList, defaultPath, outPath, request),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPathSet(
+		backendFuncs.OpenDialogMultipleEx(filterList, defaultPath, outPaths, request),
+		outPaths
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.SaveDialogEx(filterList, defaultPath, outPath, request),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.PickFolderEx(defaultPath, outPath, request),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.SearchDialog(roots, filterList, outPath, request),
+		outPath
+	);
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
+
+/* The rest of the public API is nfd_common.c. Split up, whatever works on a
+ * backend's requests is forwarded to the loaded one, and the rest is linked
+ * in here (NFD_DISPATCHER); monolithic it all is. Results have been adopted
+ * by then, so freeing them is ours too.
+ */
+#ifndef NFD_MONOLITHIC
+
+nfdresult_t NFD_PickFolderAndScan( const nfdchar_t *filterList,
+                                   const nfdchar_t *defaultPath,
+                                   nfdchar_t **outPath,
+                                   nfdpathset_t *outPaths,
+                                   const nfdscanoptions_t *options,
+                                   nfdrequest_t *request )
+{
+	nfdresult_t result;
+	nfdresult_t scanned;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	scanned = backendFuncs.PickFolderAndScan(
+		filterList,
+		defaultPath,
+		outPath,
+		outPaths,
+		options,
+		request
+	);
+	result = NFD_INTERNAL_AdoptPath(scanned, outPath);
+	if (result == NFD_OKAY)
+	{
+		result = NFD_INTERNAL_AdoptPathSet(result, outPaths);
+		if (result != NFD_OKAY)
 		{
-			return NFD_ERROR;
+			free(*outPath);
+			*outPath = NULL;
 		}
 	}
+	else if (scanned == NFD_OKAY)
+	{
+		/* The folder could not be copied, so drop its contents too */
+		backendFuncs.PathSet_Free(outPaths);
+		memset(outPaths, 0, sizeof(*outPaths));
+	}
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
+}
 
-	nfdresult_t (*backend_SaveDialog)(
-		const nfdchar_t *filterList,
-		const nfdchar_t *defaultPath,
-		nfdchar_t **outPath
-	) = SDL_LoadFunction(backend, "NFD_SaveDialog");
-	return backend_SaveDialog(filterList, defaultPath, outPath);
+nfdresult_t NFD_OpenDialogMapped( const nfdchar_t *filterList,
+                                  const nfdchar_t *defaultPath,
+                                  nfdchar_t **outPath,
+                                  nfdmapping_t *outMapping,
+                                  unsigned int mapFlags,
+                                  nfdrequest_t *request )
+{
+	nfdresult_t result;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+	result = NFD_INTERNAL_AdoptPath(
+		backendFuncs.OpenDialogMapped(
+			filterList,
+			defaultPath,
+			outPath,
+			outMapping,
+			mapFlags,
+			request
+		),
+		outPath
+	);
+	if (result != NFD_OKAY)
+	{
+		/* The mapping is ours whichever libc made it */
+		NFD_Unmap(outMapping);
+	}
+	NFD_INTERNAL_ReleaseBackend();
+	return result;
 }
 
-nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath)
+/* Requests belong to the backend that created them, so NFD_SetBackend will
+ * not switch backends while any request is alive. Without a backend no
+ * request can exist, so the calls below quietly do nothing.
+ */
+
+/* Like NFD_INTERNAL_AcquireBackend, but never loads one */
+static int NFD_INTERNAL_AcquireLoadedBackend(void)
 {
-	if (backend == NULL)
+	int result;
+
+	pthread_mutex_lock(&backendLock);
+	result = (backend != NULL);
+	if (result)
+	{
+		backendUsers += 1;
+	}
+	pthread_mutex_unlock(&backendLock);
+	return result;
+}
+
+nfdrequest_t *NFD_Request_Create( void )
+{
+	nfdrequest_t *request;
+
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NULL;
+	}
+	request = backendFuncs.Request_Create();
+	if (request != NULL)
+	{
+		pthread_mutex_lock(&backendLock);
+		backendRequests += 1;
+		pthread_mutex_unlock(&backendLock);
+	}
+	NFD_INTERNAL_ReleaseBackend();
+	return request;
+}
+
+void NFD_Request_SetTimeout( nfdrequest_t *request, unsigned int milliseconds )
+{
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
+	{
+		return;
+	}
+	backendFuncs.Request_SetTimeout(request, milliseconds);
+	NFD_INTERNAL_ReleaseBackend();
+}
+
+void NFD_Cancel( nfdrequest_t *request )
+{
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
+	{
+		return;
+	}
+	backendFuncs.Cancel(request);
+	NFD_INTERNAL_ReleaseBackend();
+}
+
+void NFD_Request_SetFlags( nfdrequest_t *request, unsigned int flags )
+{
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
+	{
+		return;
+	}
+	backendFuncs.Request_SetFlags(request, flags);
+	NFD_INTERNAL_ReleaseBackend();
+}
+
+void NFD_Request_SetReadAheadLimit( nfdrequest_t *request, unsigned long long bytes )
+{
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
+	{
+		return;
+	}
+	backendFuncs.Request_SetReadAheadLimit(request, bytes);
+	NFD_INTERNAL_ReleaseBackend();
+}
+
+const nfdpathinfo_t *NFD_Request_GetPathInfo( const nfdrequest_t *request, size_t *count )
+{
+	const nfdpathinfo_t *info;
+
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
 	{
-		if (!NFD_INTERNAL_LoadBackend())
+		if (count != NULL)
 		{
-			return NFD_ERROR;
+			*count = 0;
 		}
+		return NULL;
 	}
+	info = backendFuncs.Request_GetPathInfo(request, count);
+	NFD_INTERNAL_ReleaseBackend();
+	return info;
+}
 
-	nfdresult_t (*backend_PickFolder)(
-		const nfdchar_t *defaultPath,
-		nfdchar_t **outPath
-	) = SDL_LoadFunction(backend, "NFD_PickFolder");
-	return backend_PickFolder(defaultPath, outPath);
+void NFD_Request_Free( nfdrequest_t *request )
+{
+	if (!NFD_INTERNAL_AcquireLoadedBackend())
+	{
+		return;
+	}
+	backendFuncs.Request_Free(request);
+	pthread_mutex_lock(&backendLock);
+	assert(backendRequests > 0);
+	backendRequests -= 1;
+	pthread_mutex_unlock(&backendLock);
+	NFD_INTERNAL_ReleaseBackend();
 }
 
-const char *NFD_GetError( void )
+#endif /* NFD_MONOLITHIC */
+
+/* Asynchronous dialogs
+ *
+ * Jobs are queued to a single dialog thread, which keeps all toolkit calls
+ * on one thread and runs dialogs in the order they were requested.
+ */
+
+typedef enum NFD_INTERNAL_JobType
 {
-	if (backend == NULL)
+	NFD_INTERNAL_JOB_OPEN,
+	NFD_INTERNAL_JOB_OPEN_MULTIPLE,
+	NFD_INTERNAL_JOB_SAVE,
+	NFD_INTERNAL_JOB_PICK_FOLDER
+} NFD_INTERNAL_JobType;
+
+typedef struct NFD_INTERNAL_Job
+{
+	NFD_INTERNAL_JobType type;
+	char *filterList;
+	char *defaultPath;
+	nfdrequest_t *request;
+	nfdcallback_t callback;
+	void *userdata;
+	struct NFD_INTERNAL_Job *next;
+} NFD_INTERNAL_Job;
+
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobCond = PTHREAD_COND_INITIALIZER;
+static int jobThreadStarted = 0;
+static NFD_INTERNAL_Job *jobHead = NULL;
+static NFD_INTERNAL_Job *jobTail = NULL;
+
+static void NFD_INTERNAL_RunJob(NFD_INTERNAL_Job *job)
+{
+	nfdchar_t *outPath = NULL;
+	nfdpathset_t outPaths;
+	nfdresult_t result;
+
+	switch (job->type)
+	{
+	case NFD_INTERNAL_JOB_OPEN:
+		result = backendFuncs.OpenDialogEx(
+			job->filterList,
+			job->defaultPath,
+			&outPath,
+			job->request
+		);
+		break;
+	case NFD_INTERNAL_JOB_OPEN_MULTIPLE:
+		result = backendFuncs.OpenDialogMultipleEx(
+			job->filterList,
+			job->defaultPath,
+			&outPaths,
+			job->request
+		);
+		result = NFD_INTERNAL_AdoptPathSet(result, &outPaths);
+		job->callback(
+			job->userdata,
+			result,
+			NULL,
+			(result == NFD_OKAY) ? &outPaths : NULL
+		);
+		return;
+	case NFD_INTERNAL_JOB_SAVE:
+		result = backendFuncs.SaveDialogEx(
+			job->filterList,
+			job->defaultPath,
+			&outPath,
+			job->request
+		);
+		break;
+	case NFD_INTERNAL_JOB_PICK_FOLDER:
+		result = backendFuncs.PickFolderEx(
+			job->defaultPath,
+			&outPath,
+			job->request
+		);
+		break;
+	default:
+		assert(0 && "Unknown NFD job type!");
+		return;
+	}
+	result = NFD_INTERNAL_AdoptPath(result, &outPath);
+
+	job->callback(
+		job->userdata,
+		result,
+		(result == NFD_OKAY) ? outPath : NULL,
+		NULL
+	);
+}
+
+static void* NFD_INTERNAL_JobThread(void *data)
+{
+	NFD_INTERNAL_Job *job;
+
+	_NFD_UNUSED(data);
+	pthread_setname_np(pthread_self(), "NFD Dialogs");
+	while (1)
+	{
+		pthread_mutex_lock(&jobLock);
+		while (jobHead == NULL)
+		{
+			pthread_cond_wait(&jobCond, &jobLock);
+		}
+		job = jobHead;
+		jobHead = job->next;
+		if (jobHead == NULL)
+		{
+			jobTail = NULL;
+		}
+		pthread_mutex_unlock(&jobLock);
+
+		/* The backend was acquired for us by NFD_INTERNAL_QueueJob, so
+		 * nothing cleared what this thread reported for the last job
+		 */
+		NFD_INTERNAL_SetError("");
+		NFD_INTERNAL_RunJob(job);
+		NFD_INTERNAL_ReleaseBackend();
+
+		free(job->filterList);
+		free(job->defaultPath);
+		free(job);
+	}
+	return NULL;
+}
+
+/* Called with jobLock held */
+static int NFD_INTERNAL_StartJobThread(void)
+{
+	pthread_t thread;
+
+	if (jobThreadStarted)
+	{
+		return 1;
+	}
+	if (pthread_create(&thread, NULL, NFD_INTERNAL_JobThread, NULL) != 0)
+	{
+		return 0;
+	}
+	pthread_detach(thread);
+	jobThreadStarted = 1;
+	return 1;
+}
+
+/* SDL event delivery, for callers that already pump SDL events
+ *
+ * SDL is not linked in: the host's SDL2 is found at runtime, and only once
+ * an async dialog is actually started without a callback.
+ */
+
+/* SDL_UserEvent as laid out by SDL2, padded to at least sizeof(SDL_Event) */
+typedef union NFD_INTERNAL_SDLEvent
+{
+	uint32_t type;
+	struct
+	{
+		uint32_t type;
+		uint32_t timestamp;
+		uint32_t windowID;
+		int32_t code;
+		void *data1;
+		void *data2;
+	} user;
+	uint8_t padding[64];
+} NFD_INTERNAL_SDLEvent;
+
+static pthread_mutex_t eventTypeLock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t eventType = 0;
+static int (*pushEvent)(NFD_INTERNAL_SDLEvent *event) = NULL;
+
+/* Called with eventTypeLock held. Looks in the global scope first, then
+ * for an SDL2 the host opened RTLD_LOCAL, without ever loading one.
+ */
+static void* NFD_INTERNAL_FindSDL(const char *func)
+{
+	static void *object = NULL;
+	void *sym = dlsym(RTLD_DEFAULT, func);
+	if (sym != NULL)
+	{
+		return sym;
+	}
+	if (object == NULL)
+	{
+		object = dlopen("libSDL2-2.0.so.0", RTLD_LAZY | RTLD_LOCAL | RTLD_NOLOAD);
+		if (object == NULL)
+		{
+			return NULL;
+		}
+	}
+	return dlsym(object, func);
+}
+
+unsigned int NFD_GetEventType( void )
+{
+	void (*getVersion)(uint8_t *version);
+	uint32_t (*registerEvents)(int numevents);
+	uint8_t version[3] = { 0, 0, 0 };
+	uint32_t type;
+
+	pthread_mutex_lock(&eventTypeLock);
+	if (eventType == 0)
+	{
+		/* SDL3 exports the same names with other event layouts, and its
+		 * SDL_GetVersion takes no arguments, so version stays zeroed.
+		 */
+		*(void**) &getVersion = NFD_INTERNAL_FindSDL("SDL_GetVersion");
+		*(void**) &registerEvents = NFD_INTERNAL_FindSDL("SDL_RegisterEvents");
+		*(void**) &pushEvent = NFD_INTERNAL_FindSDL("SDL_PushEvent");
+		if (getVersion != NULL)
+		{
+			getVersion(version);
+		}
+		if (version[0] == 2 && registerEvents != NULL && pushEvent != NULL)
+		{
+			type = registerEvents(1);
+			if (type != (uint32_t) -1)
+			{
+				eventType = type;
+			}
+		}
+	}
+	type = eventType;
+	pthread_mutex_unlock(&eventTypeLock);
+	return type;
+}
+
+void NFD_EventResult_Free( nfdeventresult_t *eventResult )
+{
+	if (eventResult == NULL)
+	{
+		return;
+	}
+	NFD_Free(eventResult->outPath);
+	if (eventResult->outPaths.buf != NULL)
+	{
+		NFD_PathSet_Free(&eventResult->outPaths);
+	}
+	free(eventResult->error);
+	free(eventResult);
+}
+
+/* The callback used when the caller passed NULL. The type was registered
+ * when the job was queued, and SDL_PushEvent is safe from any thread.
+ */
+static void NFD_INTERNAL_PostEvent(
+	void *userdata,
+	nfdresult_t result,
+	nfdchar_t *outPath,
+	nfdpathset_t *outPaths
+) {
+	nfdeventresult_t *eventResult;
+	NFD_INTERNAL_SDLEvent event;
+
+	eventResult = (nfdeventresult_t*) calloc(1, sizeof(nfdeventresult_t));
+	if (eventResult != NULL)
+	{
+		eventResult->result = result;
+		eventResult->outPath = outPath;
+		if (outPaths != NULL)
+		{
+			eventResult->outPaths = *outPaths;
+		}
+		/* The error is this thread's, the event's reader will not see it */
+		if (result == NFD_ERROR)
+		{
+			eventResult->error = strdup(NFD_GetError());
+		}
+	}
+	else
+	{
+		NFD_Free(outPath);
+		if (outPaths != NULL)
+		{
+			NFD_PathSet_Free(outPaths);
+		}
+		result = NFD_ERROR;
+	}
+
+	memset(&event, 0, sizeof(event));
+	event.type = eventType;
+	event.user.code = (int32_t) result;
+	event.user.data1 = eventResult;
+	event.user.data2 = userdata;
+	if (pushEvent(&event) <= 0)
+	{
+		/* Events are off or filtered, nobody will ever see this */
+		NFD_EventResult_Free(eventResult);
+	}
+}
+
+static nfdresult_t NFD_INTERNAL_QueueJob(
+	NFD_INTERNAL_JobType type,
+	const nfdchar_t *filterList,
+	const nfdchar_t *defaultPath,
+	nfdrequest_t *request,
+	nfdcallback_t callback,
+	void *userdata
+) {
+	NFD_INTERNAL_Job *job;
+
+	if (callback == NULL)
+	{
+		if (NFD_GetEventType() == 0)
+		{
+			NFD_INTERNAL_SetError("Could not register the NFD SDL event type!");
+			return NFD_ERROR;
+		}
+		callback = NFD_INTERNAL_PostEvent;
+	}
+
+	/* Load here so that a missing backend is reported to the caller. The
+	 * dialog thread releases it once the job has run.
+	 */
+	if (!NFD_INTERNAL_AcquireBackend())
+	{
+		return NFD_ERROR;
+	}
+
+	job = (NFD_INTERNAL_Job*) calloc(1, sizeof(NFD_INTERNAL_Job));
+	if (job == NULL)
+	{
+		NFD_INTERNAL_ReleaseBackend();
+		NFD_INTERNAL_SetError("Out of memory queueing the NFD dialog!");
+		return NFD_ERROR;
+	}
+	job->type = type;
+	job->filterList = filterList ? strdup(filterList) : NULL;
+	job->defaultPath = defaultPath ? strdup(defaultPath) : NULL;
+	if (	(filterList != NULL && job->filterList == NULL) ||
+		(defaultPath != NULL && job->defaultPath == NULL)	)
+	{
+		free(job->filterList);
+		free(job->defaultPath);
+		free(job);
+		NFD_INTERNAL_ReleaseBackend();
+		NFD_INTERNAL_SetError("Out of memory queueing the NFD dialog!");
+		return NFD_ERROR;
+	}
+	job->request = request;
+	job->callback = callback;
+	job->userdata = userdata;
+
+	pthread_mutex_lock(&jobLock);
+	if (!NFD_INTERNAL_StartJobThread())
+	{
+		pthread_mutex_unlock(&jobLock);
+		free(job->filterList);
+		free(job->defaultPath);
+		free(job);
+		NFD_INTERNAL_ReleaseBackend();
+		NFD_INTERNAL_SetError("Could not start the NFD dialog thread!");
+		return NFD_ERROR;
+	}
+	if (jobTail != NULL)
+	{
+		jobTail->next = job;
+	}
+	else
 	{
-		return "No NFD backend has been loaded!";
+		jobHead = job;
 	}
+	jobTail = job;
+	pthread_cond_signal(&jobCond);
+	pthread_mutex_unlock(&jobLock);
+	return NFD_OKAY;
+}
 
-	const char *(*backend_GetError)(void) = SDL_LoadFunction(backend, "NFD_GetError");
-	return backend_GetError();
+nfdresult_t NFD_OpenDialogAsync( const nfdchar_t *filterList,
+                                 const nfdchar_t *defaultPath,
+                                 nfdrequest_t *request,
+                                 nfdcallback_t callback,
+                                 void *userdata )
+{
+	return NFD_INTERNAL_QueueJob(
+		NFD_INTERNAL_JOB_OPEN,
+		filterList,
+		defaultPath,
+		request,
+		callback,
+		userdata
+	);
 }
 
-size_t NFD_PathSet_GetCount( const nfdpathset_t *pathset )
+nfdresult_t NFD_OpenDialogMultipleAsync( const nfdchar_t *filterList,
+                                         const nfdchar_t *defaultPath,
+                                         nfdrequest_t *request,
+                                         nfdcallback_t callback,
+                                         void *userdata )
 {
-	SDL_assert(pathset);
-	return pathset->count;
+	return NFD_INTERNAL_QueueJob(
+		NFD_INTERNAL_JOB_OPEN_MULTIPLE,
+		filterList,
+		defaultPath,
+		request,
+		callback,
+		userdata
+	);
 }
 
-nfdchar_t *NFD_PathSet_GetPath( const nfdpathset_t *pathset, size_t num )
+nfdresult_t NFD_SaveDialogAsync( const nfdchar_t *filterList,
+                                 const nfdchar_t *defaultPath,
+                                 nfdrequest_t *request,
+                                 nfdcallback_t callback,
+                                 void *userdata )
 {
-	SDL_assert(pathset);
-	SDL_assert(num < pathset->count);
+	return NFD_INTERNAL_QueueJob(
+		NFD_INTERNAL_JOB_SAVE,
+		filterList,
+		defaultPath,
+		request,
+		callback,
+		userdata
+	);
+}
 
-	return pathset->buf + pathset->indices[num];
+nfdresult_t NFD_PickFolderAsync( const nfdchar_t *defaultPath,
+                                 nfdrequest_t *request,
+                                 nfdcallback_t callback,
+                                 void *userdata )
+{
+	return NFD_INTERNAL_QueueJob(
+		NFD_INTERNAL_JOB_PICK_FOLDER,
+		NULL,
+		defaultPath,
+		request,
+		callback,
+		userdata
+	);
 }
 
-void NFD_PathSet_Free( nfdpathset_t *pathset )
+#ifndef NFD_MONOLITHIC
+
+const char *NFD_GetError( void )
 {
-	SDL_assert(pathset);
-	SDL_assert(pathset->indices);
-	SDL_assert(pathset->buf);
-	free( pathset->indices );
-	free( pathset->buf );
+	const char *error = NFDi_GetError();
+	if (error[0] != '\0')
+	{
+		return error;
+	}
+	pthread_mutex_lock(&backendLock);
+	if (backend == NULL)
+	{
+		error = "No NFD backend has been loaded!";
+	}
+	else
+	{
+		error = backendFuncs.GetError();
+	}
+	pthread_mutex_unlock(&backendLock);
+	return error;
 }
+
+#endif /* NFD_MONOLITHIC */
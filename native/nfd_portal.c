@@ -0,0 +1,736 @@
+/*
+  Native File Dialog
+
+  xdg-desktop-portal backend, talks to org.freedesktop.portal.FileChooser
+  over the session bus so neither GTK nor zenity is needed in-process.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <dbus/dbus.h>
+#include "nfd.h"
+#include "nfd_common.h"
+#include "nfd_probes.h"
+
+
+#define PORTAL_BUS_NAME    "org.freedesktop.portal.Desktop"
+#define PORTAL_OBJECT_PATH "/org/freedesktop/portal/desktop"
+#define PORTAL_INTERFACE   "org.freedesktop.portal.FileChooser"
+#define REQUEST_INTERFACE  "org.freedesktop.portal.Request"
+
+#define MAX_FILTER_PATTERNS 32
+
+/* long enough for the bus to start the portal */
+#define PROBE_TIMEOUT_MS 5000
+
+const char NO_BUS_MSG[] = "Could not connect to the D-Bus session bus";
+const char NO_PORTAL_MSG[] = "xdg-desktop-portal FileChooser call failed";
+const char BAD_REPLY_MSG[] = "Unexpected reply from xdg-desktop-portal";
+const char BAD_URI_MSG[] = "xdg-desktop-portal returned a non-file URI";
+
+/* portal response codes */
+enum
+{
+    PORTAL_RESPONSE_SUCCESS = 0,
+    PORTAL_RESPONSE_CANCELLED = 1
+};
+
+
+/* a{sv} option helpers */
+
+static void OpenOption( DBusMessageIter *options, const char *key,
+                        const char *signature,
+                        DBusMessageIter *entry, DBusMessageIter *variant )
+{
+    dbus_message_iter_open_container( options, DBUS_TYPE_DICT_ENTRY, NULL, entry );
+    dbus_message_iter_append_basic( entry, DBUS_TYPE_STRING, &key );
+    dbus_message_iter_open_container( entry, DBUS_TYPE_VARIANT, signature, variant );
+}
+
+static void CloseOption( DBusMessageIter *options,
+                         DBusMessageIter *entry, DBusMessageIter *variant )
+{
+    dbus_message_iter_close_container( entry, variant );
+    dbus_message_iter_close_container( options, entry );
+}
+
+static void AppendStringOption( DBusMessageIter *options, const char *key, const char *value )
+{
+    DBusMessageIter entry, variant;
+    OpenOption( options, key, DBUS_TYPE_STRING_AS_STRING, &entry, &variant );
+    dbus_message_iter_append_basic( &variant, DBUS_TYPE_STRING, &value );
+    CloseOption( options, &entry, &variant );
+}
+
+static void AppendBoolOption( DBusMessageIter *options, const char *key, dbus_bool_t value )
+{
+    DBusMessageIter entry, variant;
+    OpenOption( options, key, DBUS_TYPE_BOOLEAN_AS_STRING, &entry, &variant );
+    dbus_message_iter_append_basic( &variant, DBUS_TYPE_BOOLEAN, &value );
+    CloseOption( options, &entry, &variant );
+}
+
+static void AppendPathOption( DBusMessageIter *options, const char *key, const char *path )
+{
+    /* portal paths are null-terminated byte arrays, not strings */
+    DBusMessageIter entry, variant, bytes;
+    int len = (int)strlen(path) + 1;
+
+    OpenOption( options, key, "ay", &entry, &variant );
+    dbus_message_iter_open_container( &variant, DBUS_TYPE_ARRAY, DBUS_TYPE_BYTE_AS_STRING, &bytes );
+    dbus_message_iter_append_fixed_array( &bytes, DBUS_TYPE_BYTE, &path, len );
+    dbus_message_iter_close_container( &variant, &bytes );
+    CloseOption( options, &entry, &variant );
+}
+
+static void AddTypeToFilterName( const char *typebuf, char *filterName, size_t bufsize )
+{
+    const char SEP[] = ", ";
+
+    size_t len = strlen(filterName);
+    if ( len != 0 )
+    {
+        strncat( filterName, SEP, bufsize - len - 1 );
+        len += strlen(SEP);
+    }
+
+    strncat( filterName, typebuf, bufsize - len - 1 );
+}
+
+static void AppendFilter( DBusMessageIter *filterArray, const char *name,
+                          const char **patterns, int patternCount )
+{
+    /* (sa(us)) -- type 0 is a glob pattern */
+    DBusMessageIter filter, patternArray, pattern;
+    const dbus_uint32_t GLOB = 0;
+    int i;
+
+    dbus_message_iter_open_container( filterArray, DBUS_TYPE_STRUCT, NULL, &filter );
+    dbus_message_iter_append_basic( &filter, DBUS_TYPE_STRING, &name );
+    dbus_message_iter_open_container( &filter, DBUS_TYPE_ARRAY, "(us)", &patternArray );
+    for ( i = 0; i < patternCount; ++i )
+    {
+        dbus_message_iter_open_container( &patternArray, DBUS_TYPE_STRUCT, NULL, &pattern );
+        dbus_message_iter_append_basic( &pattern, DBUS_TYPE_UINT32, &GLOB );
+        dbus_message_iter_append_basic( &pattern, DBUS_TYPE_STRING, &patterns[i] );
+        dbus_message_iter_close_container( &patternArray, &pattern );
+    }
+    dbus_message_iter_close_container( &filter, &patternArray );
+    dbus_message_iter_close_container( filterArray, &filter );
+}
+
+static void AddFiltersToOptions( DBusMessageIter *options, const char *filterList )
+{
+    DBusMessageIter entry, variant, filterArray;
+    char typebuf[NFD_MAX_STRLEN] = {0};
+    const char *p_filterList = filterList;
+    char *p_typebuf = typebuf;
+    char filterName[NFD_MAX_STRLEN] = {0};
+    char patternBuf[MAX_FILTER_PATTERNS][NFD_MAX_STRLEN];
+    const char *patterns[MAX_FILTER_PATTERNS];
+    int patternCount = 0;
+    const char *wildcard = "*";
+
+    if ( !filterList || strlen(filterList) == 0 )
+        return;
+
+    OpenOption( options, "filters", "a(sa(us))", &entry, &variant );
+    dbus_message_iter_open_container( &variant, DBUS_TYPE_ARRAY, "(sa(us))", &filterArray );
+
+    while ( 1 )
+    {
+        if ( NFDi_IsFilterSegmentChar(*p_filterList) )
+        {
+            /* add another type to the filter */
+            assert( strlen(typebuf) > 0 );
+            assert( strlen(typebuf) < NFD_MAX_STRLEN-1 );
+
+            if ( patternCount < MAX_FILTER_PATTERNS )
+            {
+                /* the portal's patterns are globs already */
+                NFDi_FilterTypeToPattern( typebuf, patternBuf[patternCount], NFD_MAX_STRLEN );
+                patterns[patternCount] = patternBuf[patternCount];
+                ++patternCount;
+            }
+            AddTypeToFilterName( typebuf, filterName, NFD_MAX_STRLEN );
+
+            p_typebuf = typebuf;
+            memset( typebuf, 0, sizeof(char) * NFD_MAX_STRLEN );
+        }
+
+        if ( *p_filterList == ';' || *p_filterList == '\0' )
+        {
+            /* end of filter -- add it to the dialog */
+            AppendFilter( &filterArray, filterName, patterns, patternCount );
+
+            filterName[0] = '\0';
+            patternCount = 0;
+
+            if ( *p_filterList == '\0' )
+                break;
+        }
+
+        if ( !NFDi_IsFilterSegmentChar( *p_filterList ) )
+        {
+            *p_typebuf = *p_filterList;
+            p_typebuf++;
+        }
+
+        p_filterList++;
+    }
+
+    /* always append a wildcard option to the end*/
+    AppendFilter( &filterArray, "*.*", &wildcard, 1 );
+
+    dbus_message_iter_close_container( &variant, &filterArray );
+    CloseOption( options, &entry, &variant );
+}
+
+static int HexValue( char ch )
+{
+    if ( ch >= '0' && ch <= '9' ) return ch - '0';
+    if ( ch >= 'a' && ch <= 'f' ) return ch - 'a' + 10;
+    if ( ch >= 'A' && ch <= 'F' ) return ch - 'A' + 10;
+    return -1;
+}
+
+/* file:///a%20b -> /a b, or NULL for other schemes.  Caller frees. */
+static char *URIToPath( const char *uri )
+{
+    const char PREFIX[] = "file://";
+    const char *src;
+    char *dst, *path;
+
+    if ( strncmp( uri, PREFIX, sizeof(PREFIX) - 1 ) != 0 )
+        return NULL;
+
+    /* skip an optional authority ("localhost") */
+    src = strchr( uri + sizeof(PREFIX) - 1, '/' );
+    if ( !src )
+        return NULL;
+
+    path = NFDi_Malloc( strlen(src) + 1 );
+    if ( !path )
+        return NULL;
+
+    for ( dst = path; *src; ++src, ++dst )
+    {
+        if ( src[0] == '%' && HexValue(src[1]) >= 0 && HexValue(src[2]) >= 0 )
+        {
+            *dst = (char)((HexValue(src[1]) << 4) | HexValue(src[2]));
+            src += 2;
+        }
+        else
+        {
+            *dst = *src;
+        }
+    }
+    *dst = '\0';
+    return path;
+}
+
+static void FreePaths( char **paths, size_t count )
+{
+    size_t i;
+    for ( i = 0; i < count; ++i )
+        NFDi_Free( paths[i] );
+    free( paths );
+}
+
+static nfdresult_t AllocPathSet( char **paths, size_t count, nfdpathset_t *pathSet )
+{
+    size_t bufSize = 0;
+    size_t i;
+    nfdchar_t *p_buf;
+
+    assert(paths);
+    assert(pathSet);
+    assert(count > 0);
+
+    for ( i = 0; i < count; ++i )
+        bufSize += strlen( paths[i] ) + 1;
+
+    pathSet->count = count;
+    pathSet->indices = NFDi_Malloc( sizeof(size_t)*count );
+    if ( !pathSet->indices )
+        return NFD_ERROR;
+
+    pathSet->buf = NFDi_Malloc( sizeof(nfdchar_t) * bufSize );
+    if ( !pathSet->buf )
+    {
+        NFDi_Free( pathSet->indices );
+        return NFD_ERROR;
+    }
+
+    /* fill buf */
+    p_buf = pathSet->buf;
+    for ( i = 0; i < count; ++i )
+    {
+        size_t byteLen = strlen(paths[i]) + 1;
+        memcpy( p_buf, paths[i], byteLen );
+        pathSet->indices[i] = (size_t)(p_buf - pathSet->buf);
+        p_buf += byteLen;
+    }
+
+    NFD_PROBE2( pathset_built, count, bufSize );
+    return NFD_OKAY;
+}
+
+/* Pulls the "uris" result out of a Response signal as decoded paths.
+   Release them with FreePaths. */
+static nfdresult_t ReadResponse( DBusMessage *msg, char ***outPaths, size_t *outCount )
+{
+    DBusMessageIter args, results, entry, variant, uris;
+    dbus_uint32_t response;
+    char **paths = NULL;
+    size_t count = 0;
+
+    if ( !dbus_message_iter_init( msg, &args ) ||
+         dbus_message_iter_get_arg_type( &args ) != DBUS_TYPE_UINT32 )
+    {
+        NFDi_SetError(BAD_REPLY_MSG);
+        return NFD_ERROR;
+    }
+    dbus_message_iter_get_basic( &args, &response );
+
+    if ( response == PORTAL_RESPONSE_CANCELLED )
+        return NFD_CANCEL;
+    if ( response != PORTAL_RESPONSE_SUCCESS )
+    {
+        NFDi_SetError(NO_PORTAL_MSG);
+        return NFD_ERROR;
+    }
+
+    if ( !dbus_message_iter_next( &args ) ||
+         dbus_message_iter_get_arg_type( &args ) != DBUS_TYPE_ARRAY )
+    {
+        NFDi_SetError(BAD_REPLY_MSG);
+        return NFD_ERROR;
+    }
+
+    for ( dbus_message_iter_recurse( &args, &results );
+          dbus_message_iter_get_arg_type( &results ) == DBUS_TYPE_DICT_ENTRY;
+          dbus_message_iter_next( &results ) )
+    {
+        const char *key;
+
+        dbus_message_iter_recurse( &results, &entry );
+        dbus_message_iter_get_basic( &entry, &key );
+        if ( strcmp( key, "uris" ) != 0 )
+            continue;
+
+        dbus_message_iter_next( &entry );
+        dbus_message_iter_recurse( &entry, &variant );
+        if ( dbus_message_iter_get_arg_type( &variant ) != DBUS_TYPE_ARRAY )
+            break;
+
+        for ( dbus_message_iter_recurse( &variant, &uris );
+              dbus_message_iter_get_arg_type( &uris ) == DBUS_TYPE_STRING;
+              dbus_message_iter_next( &uris ) )
+        {
+            const char *uri;
+            char *path;
+            char **grown;
+
+            dbus_message_iter_get_basic( &uris, &uri );
+            path = URIToPath( uri );
+            if ( !path )
+            {
+                FreePaths( paths, count );
+                NFDi_SetError(BAD_URI_MSG);
+                return NFD_ERROR;
+            }
+
+            grown = realloc( paths, sizeof(char*) * (count + 1) );
+            if ( !grown )
+            {
+                NFDi_Free( path );
+                FreePaths( paths, count );
+                NFDi_SetError("NFDi_Malloc failed.");
+                return NFD_ERROR;
+            }
+            paths = grown;
+            paths[count++] = path;
+        }
+        break;
+    }
+
+    if ( count == 0 )
+    {
+        free( paths );
+        NFDi_SetError(BAD_REPLY_MSG);
+        return NFD_ERROR;
+    }
+
+    *outPaths = paths;
+    *outCount = count;
+    return NFD_OKAY;
+}
+
+/* Blocks until the bus has data, the request is cancelled or the deadline
+   passes.  Returns 0 on cancel/timeout. */
+static int WaitForBus( DBusConnection *conn, nfdrequest_t *request, long long deadline )
+{
+    struct pollfd fds[2];
+    int busFd = -1;
+    int cancelFd = NFDi_Request_GetCancelFd( request );
+    int timeout = -1;
+    int ready;
+
+    if ( !dbus_connection_get_unix_fd( conn, &busFd ) )
+        return 1;
+
+    fds[0].fd = busFd;
+    fds[0].events = POLLIN;
+    fds[1].fd = cancelFd;
+    fds[1].events = POLLIN;
+
+    do
+    {
+        if ( deadline )
+        {
+            long long left = deadline - NFDi_NowMs();
+            timeout = left > 0 ? (int)left : 0;
+        }
+        ready = poll( fds, cancelFd >= 0 ? 2 : 1, timeout );
+    } while ( ready == -1 && errno == EINTR );
+
+    if ( ready == 0 )
+        return 0;
+    if ( cancelFd >= 0 && (fds[1].revents & POLLIN) )
+        return 0;
+    return 1;
+}
+
+/* dismisses the portal dialog, fire-and-forget */
+static void CloseRequest( DBusConnection *conn, const char *requestPath )
+{
+    DBusMessage *msg = dbus_message_new_method_call( PORTAL_BUS_NAME, requestPath,
+                                                     REQUEST_INTERFACE, "Close" );
+    dbus_message_set_no_reply( msg, TRUE );
+    dbus_connection_send( conn, msg, NULL );
+    dbus_connection_flush( conn );
+    dbus_message_unref( msg );
+}
+
+static void AddResponseMatch( DBusConnection *conn, const char *requestPath )
+{
+    char rule[NFD_MAX_STRLEN * 2];
+    snprintf( rule, sizeof(rule),
+              "type='signal',interface='" REQUEST_INTERFACE "',member='Response',path='%s'",
+              requestPath );
+    dbus_bus_add_match( conn, rule, NULL );
+}
+
+/* Loading libnfd_portal.so says nothing about a portal, so nfd_linux.c asks
+   here before it settles on this backend.  xdg-desktop-portal only exports
+   FileChooser when a desktop backend implements it, so reading its version
+   checks both; the call also starts a bus-activated portal. */
+int NFDi_Backend_Probe( void )
+{
+    const char *iface = PORTAL_INTERFACE;
+    const char *property = "version";
+    DBusConnection *conn;
+    DBusMessage *msg, *reply;
+    DBusError err;
+    int found = 0;
+
+    dbus_error_init( &err );
+    conn = dbus_bus_get_private( DBUS_BUS_SESSION, &err );
+    if ( !conn )
+    {
+        dbus_error_free( &err );
+        return 0;
+    }
+    dbus_connection_set_exit_on_disconnect( conn, FALSE );
+
+    msg = dbus_message_new_method_call( PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                                        DBUS_INTERFACE_PROPERTIES, "Get" );
+    dbus_message_append_args( msg,
+                              DBUS_TYPE_STRING, &iface,
+                              DBUS_TYPE_STRING, &property,
+                              DBUS_TYPE_INVALID );
+    reply = dbus_connection_send_with_reply_and_block( conn, msg, PROBE_TIMEOUT_MS, &err );
+    dbus_message_unref( msg );
+    if ( reply )
+    {
+        found = dbus_message_get_type( reply ) == DBUS_MESSAGE_TYPE_METHOD_RETURN;
+        dbus_message_unref( reply );
+    }
+    if ( dbus_error_is_set( &err ) )
+        dbus_error_free( &err );
+
+    dbus_connection_close( conn );
+    dbus_connection_unref( conn );
+    return found;
+}
+
+/* Sends the FileChooser call and blocks until its Request emits Response.
+   On NFD_OKAY the caller owns *outResponse. */
+static nfdresult_t PortalCall( const char *method,
+                               const char *title,
+                               const char *filterList,
+                               const char *defaultPath,
+                               dbus_bool_t multiple,
+                               dbus_bool_t directory,
+                               nfdrequest_t *request,
+                               DBusMessage **outResponse )
+{
+    static unsigned int tokenCounter = 0;
+    DBusConnection *conn;
+    DBusMessage *msg, *reply;
+    DBusMessageIter args, options;
+    DBusError err;
+    char token[64];
+    char requestPath[NFD_MAX_STRLEN];
+    const char *sender;
+    const char *parentWindow = "";
+    const char *handle;
+    char *p;
+    unsigned int timeout = NFDi_Request_GetTimeout( request );
+    long long deadline = timeout > 0 ? NFDi_NowMs() + timeout : 0;
+    nfdresult_t result = NFD_ERROR;
+    int shown = 0;
+
+    *outResponse = NULL;
+
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+
+    dbus_error_init( &err );
+    NFD_PROBE1( toolkit_init_start, "portal" );
+    conn = dbus_bus_get_private( DBUS_BUS_SESSION, &err );
+    NFD_PROBE2( toolkit_init_done, "portal", conn != NULL );
+    if ( !conn )
+    {
+        dbus_error_free( &err );
+        NFDi_SetError(NO_BUS_MSG);
+        return NFD_ERROR;
+    }
+    dbus_connection_set_exit_on_disconnect( conn, FALSE );
+
+    /* Subscribe to the Request object before calling, so the Response
+       cannot race past us.  The path is derived from our unique name. */
+    snprintf( token, sizeof(token), "nfd%u_%u", (unsigned int)getpid(), ++tokenCounter );
+    sender = dbus_bus_get_unique_name( conn );
+    snprintf( requestPath, sizeof(requestPath),
+              PORTAL_OBJECT_PATH "/request/%s/%s", sender + 1, token );
+    for ( p = requestPath; *p; ++p )
+    {
+        if ( *p == '.' )
+            *p = '_';
+    }
+    AddResponseMatch( conn, requestPath );
+
+    msg = dbus_message_new_method_call( PORTAL_BUS_NAME, PORTAL_OBJECT_PATH,
+                                        PORTAL_INTERFACE, method );
+    dbus_message_iter_init_append( msg, &args );
+    dbus_message_iter_append_basic( &args, DBUS_TYPE_STRING, &parentWindow );
+    dbus_message_iter_append_basic( &args, DBUS_TYPE_STRING, &title );
+    dbus_message_iter_open_container( &args, DBUS_TYPE_ARRAY, "{sv}", &options );
+    AppendStringOption( &options, "handle_token", token );
+    AppendBoolOption( &options, "modal", TRUE );
+    if ( multiple )
+        AppendBoolOption( &options, "multiple", TRUE );
+    if ( directory )
+        AppendBoolOption( &options, "directory", TRUE );
+    AddFiltersToOptions( &options, filterList );
+    if ( defaultPath && strlen(defaultPath) > 0 )
+        AppendPathOption( &options, "current_folder", defaultPath );
+    dbus_message_iter_close_container( &args, &options );
+
+    reply = dbus_connection_send_with_reply_and_block( conn, msg, DBUS_TIMEOUT_INFINITE, &err );
+    dbus_message_unref( msg );
+    if ( !reply )
+    {
+        dbus_error_free( &err );
+        NFDi_SetError(NO_PORTAL_MSG);
+        goto end;
+    }
+
+    /* Old portals ignore handle_token and hand back a different path */
+    if ( !dbus_message_get_args( reply, &err, DBUS_TYPE_OBJECT_PATH, &handle, DBUS_TYPE_INVALID ) )
+    {
+        dbus_error_free( &err );
+        dbus_message_unref( reply );
+        NFDi_SetError(BAD_REPLY_MSG);
+        goto end;
+    }
+    if ( strcmp( handle, requestPath ) != 0 )
+    {
+        NFDi_SafeStrncpy( requestPath, handle, sizeof(requestPath) );
+        AddResponseMatch( conn, requestPath );
+    }
+    dbus_message_unref( reply );
+    shown = 1;
+    NFD_PROBE1( dialog_shown, "portal" );
+
+    /* the Response may already be queued behind the method reply */
+    while ( 1 )
+    {
+        while ( (msg = dbus_connection_pop_message( conn )) != NULL )
+        {
+            if ( dbus_message_is_signal( msg, REQUEST_INTERFACE, "Response" ) &&
+                 dbus_message_has_path( msg, requestPath ) )
+            {
+                *outResponse = msg;
+                result = NFD_OKAY;
+                goto end;
+            }
+            dbus_message_unref( msg );
+        }
+
+        if ( !WaitForBus( conn, request, deadline ) )
+        {
+            CloseRequest( conn, requestPath );
+            result = NFD_CANCEL;
+            goto end;
+        }
+        if ( !dbus_connection_read_write( conn, 0 ) )
+            break;
+    }
+
+    /* connection dropped before the portal answered */
+    NFDi_SetError(NO_PORTAL_MSG);
+
+ end:
+    if ( shown )
+        NFD_PROBE2( dialog_closed, "portal", result );
+    dbus_connection_close( conn );
+    dbus_connection_unref( conn );
+    return result;
+}
+
+static nfdresult_t PortalSinglePath( const char *method,
+                                     const char *title,
+                                     const char *filterList,
+                                     const char *defaultPath,
+                                     dbus_bool_t directory,
+                                     nfdchar_t **outPath,
+                                     nfdrequest_t *request )
+{
+    DBusMessage *response;
+    char **paths;
+    size_t count;
+    size_t len;
+    nfdresult_t result;
+
+    result = PortalCall( method, title, filterList, defaultPath, FALSE, directory, request, &response );
+    if ( result != NFD_OKAY )
+        return result;
+
+    result = ReadResponse( response, &paths, &count );
+    if ( result == NFD_OKAY )
+    {
+        len = strlen(paths[0]);
+        *outPath = NFDi_Malloc( len + 1 );
+        if ( *outPath )
+            memcpy( *outPath, paths[0], len + 1 );
+        else
+            result = NFD_ERROR;
+        FreePaths( paths, count );
+    }
+
+    dbus_message_unref( response );
+    return result;
+}
+
+/* public */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = PortalSinglePath( "OpenFile", "Open File", filterList, defaultPath, FALSE, outPath, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    DBusMessage *response;
+    char **paths;
+    size_t count;
+    nfdresult_t result;
+
+    result = PortalCall( "OpenFile", "Open Files", filterList, defaultPath, TRUE, FALSE, request, &response );
+    if ( result != NFD_OKAY )
+        return result;
+
+    result = ReadResponse( response, &paths, &count );
+    if ( result == NFD_OKAY )
+    {
+        result = AllocPathSet( paths, count, outPaths );
+        FreePaths( paths, count );
+    }
+
+    dbus_message_unref( response );
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    return PortalSinglePath( "SaveFile", "Save File", filterList, defaultPath, FALSE, outPath, request );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = PortalSinglePath( "OpenFile", "Select folder", NULL, defaultPath, TRUE, outPath, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    _NFD_UNUSED(roots);
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(request);
+    NFDi_SetError("NFD_SearchDialog is not supported by the portal backend.");
+    return NFD_ERROR;
+}
@@ -0,0 +1,57 @@
+/*
+  Native File Dialog
+
+  Internal, USDT probes
+
+  http://www.frogtoss.com/labs
+ */
+
+
+#ifndef _NFD_PROBES_H
+#define _NFD_PROBES_H
+
+/* Static probes of the "nfd" provider, for bpftrace, perf and SystemTap:
+
+     bpftrace -e 'usdt:/path/to/libnfd_gtk.so:nfd:dialog_closed
+                  { printf("%s %d\n", str(arg0), arg1); }'
+
+   Each one is a nop in the code plus an ELF note, and its arguments are
+   values the code already has at hand.  They are compiled in whenever
+   <sys/sdt.h> (systemtap-sdt-dev) is found; define NFD_NO_PROBES to leave
+   them out.  Strings are arguments of type const char*.
+
+   backend_load_start( name )             nfd_linux.c, before a backend is opened
+   backend_load_done( name, ok )
+   toolkit_init_start( backend )          GTK init, or the portal's bus connection
+   toolkit_init_done( backend, ok )
+   dialog_shown( backend )                the dialog is up, zenity is about to run, or
+                                          the script or remote is about to answer
+   dialog_closed( backend, status )       GTK response id, zenity exit status (-1 if it
+                                          didn't run), or the portal/script/remote/x11
+                                          nfdresult_t
+   spawn( pid, file )                     simple_exec.h, after fork
+   child_exit( pid, status, bytes )       reaped; wait status (-1 if killed by us),
+                                          bytes of stdout read
+   pathset_built( count, bytes )          a dialog or folder scan filled an nfdpathset_t
+   index_built( files, grams )            nfd_index.c, a new search snapshot is published
+   index_query( query, count )            a search query ran, with its result count
+*/
+
+#if !defined(NFD_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define NFD_HAVE_PROBES 1
+#endif
+#endif
+
+#ifdef NFD_HAVE_PROBES
+#define NFD_PROBE1( name, a )       DTRACE_PROBE1( nfd, name, a )
+#define NFD_PROBE2( name, a, b )    DTRACE_PROBE2( nfd, name, a, b )
+#define NFD_PROBE3( name, a, b, c ) DTRACE_PROBE3( nfd, name, a, b, c )
+#else
+#define NFD_PROBE1( name, a )       do {} while ( 0 )
+#define NFD_PROBE2( name, a, b )    do {} while ( 0 )
+#define NFD_PROBE3( name, a, b, c ) do {} while ( 0 )
+#endif
+
+#endif
@@ -0,0 +1,542 @@
+/*
+  Native File Dialog
+
+  Remote backend, for machines without a display: every dialog is sent to
+  a dialog server (nfd_remote_server) on another machine or in another
+  session, which shows it with its own backend and sends back the result.
+
+  NFD_REMOTE is the server's address, "unix:/path" (or just "/path") or
+  "host:port".  There is no authentication or encryption, so across
+  machines tunnel a Unix socket or a loopback port over SSH.
+
+  One connection carries the dialogs of every thread, pipelined; see
+  nfd_remote.h for the wire format.  A reader thread matches responses to
+  their requests, and a dropped connection fails whatever was in flight
+  and is reopened by the next dialog.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "nfd.h"
+#include "nfd_common.h"
+#include "nfd_probes.h"
+
+#define NFD_REMOTE_IMPLEMENTATION
+#include "nfd_remote.h"
+
+
+static const char NO_REMOTE_MSG[] = "NFD_REMOTE is not set";
+static const char CONNECT_MSG[] = "Could not connect to the NFD_REMOTE dialog server";
+static const char DISCONNECT_MSG[] = "Lost the connection to the NFD_REMOTE dialog server";
+static const char BAD_RESPONSE_MSG[] = "Unexpected response from the NFD_REMOTE dialog server";
+
+/* a dialog waiting for its response */
+typedef struct pending_s
+{
+    size_t id;
+    int wakePipe[2];         /* written once the response is in */
+    int done;
+    unsigned char *response; /* body after the id, NULL if the connection dropped */
+    size_t responseLen;
+    struct pending_s *next;
+} pending_t;
+
+/* writeLock serializes frames and keeps the socket open while one is sent;
+   remoteLock covers everything else.  Taken in that order, and send never
+   blocks with remoteLock held, or the reader could not deliver the very
+   responses the server is stuck writing. */
+static pthread_mutex_t writeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t remoteLock = PTHREAD_MUTEX_INITIALIZER;
+static int remoteSocket = -1;
+static pthread_t reader;
+static int readerStarted = 0;
+static size_t lastId = 0;
+static pending_t *pendingList = NULL;
+
+
+static void Wake( pending_t *pending )
+{
+    char byte = 1;
+    ssize_t written = write( pending->wakePipe[1], &byte, 1 );
+    _NFD_UNUSED(written);
+    pending->done = 1;
+}
+
+/* reader thread, with remoteLock held */
+static void Deliver( const unsigned char *body, size_t bodyLen )
+{
+    const unsigned char *p = body;
+    pending_t *pending;
+    size_t id;
+
+    if ( !NFDi_Remote_GetVarint( &p, body + bodyLen, &id ) )
+        return;
+
+    for ( pending = pendingList; pending; pending = pending->next )
+    {
+        if ( pending->id == id && !pending->done )
+        {
+            pending->responseLen = bodyLen - (size_t)(p - body);
+            pending->response = malloc( pending->responseLen ? pending->responseLen : 1 );
+            if ( pending->response )
+                memcpy( pending->response, p, pending->responseLen );
+            Wake( pending );
+            return;
+        }
+    }
+    /* nobody is waiting for it any more */
+}
+
+static void *ReaderMain( void *data )
+{
+    int fd = (int)(size_t)data;
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0;
+    pending_t *pending;
+
+    while ( 1 )
+    {
+        const unsigned char *body;
+        size_t bodyLen, frameLen;
+        ssize_t n;
+        int status = NFDi_Remote_NextFrame( buf, len, &body, &bodyLen, &frameLen );
+
+        if ( status < 0 )
+            break;
+        if ( status > 0 )
+        {
+            pthread_mutex_lock( &remoteLock );
+            Deliver( body, bodyLen );
+            pthread_mutex_unlock( &remoteLock );
+            len -= frameLen;
+            memmove( buf, buf + frameLen, len );
+            continue;
+        }
+
+        if ( cap - len < 4096 )
+        {
+            size_t newCap = cap ? cap * 2 : 16384;
+            unsigned char *grown = realloc( buf, newCap );
+            if ( !grown )
+                break;
+            buf = grown;
+            cap = newCap;
+        }
+
+        n = recv( fd, buf + len, cap - len, 0 );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        len += (size_t)n;
+    }
+    free( buf );
+
+    /* fail any send still blocked on us, then everything in flight; closed
+       under both locks so the descriptor can't be reused by a reconnect
+       while a writer or we still hold it */
+    shutdown( fd, SHUT_RDWR );
+    pthread_mutex_lock( &writeLock );
+    pthread_mutex_lock( &remoteLock );
+    for ( pending = pendingList; pending; pending = pending->next )
+    {
+        if ( !pending->done )
+            Wake( pending );
+    }
+    remoteSocket = -1;
+    close( fd );
+    pthread_mutex_unlock( &remoteLock );
+    pthread_mutex_unlock( &writeLock );
+    return NULL;
+}
+
+/* with writeLock held */
+static int SendAll( int fd, const unsigned char *data, size_t len )
+{
+    size_t sent = 0;
+    while ( sent < len )
+    {
+        ssize_t n = send( fd, data + sent, len - sent, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+        {
+            /* the reader sees the connection go and fails everything */
+            shutdown( fd, SHUT_RDWR );
+            return 0;
+        }
+        sent += (size_t)n;
+    }
+    return 1;
+}
+
+/* with writeLock and remoteLock held */
+static int Connect( void )
+{
+    const char *address;
+    int fd;
+
+    if ( remoteSocket >= 0 )
+        return 1;
+
+    address = getenv( "NFD_REMOTE" );
+    if ( !address || address[0] == '\0' )
+    {
+        NFDi_SetError( NO_REMOTE_MSG );
+        return 0;
+    }
+
+    /* the previous reader has already let go of everything */
+    if ( readerStarted )
+    {
+        pthread_join( reader, NULL );
+        readerStarted = 0;
+    }
+
+    fd = NFDi_Remote_Open( address, 0 );
+    if ( fd < 0 )
+    {
+        NFDi_SetError( CONNECT_MSG );
+        return 0;
+    }
+
+    remoteSocket = fd;
+    if ( !SendAll( fd, (const unsigned char*)NFD_REMOTE_MAGIC, NFD_REMOTE_MAGIC_LEN ) ||
+         pthread_create( &reader, NULL, ReaderMain, (void*)(size_t)fd ) != 0 )
+    {
+        close( fd );
+        remoteSocket = -1;
+        NFDi_SetError( CONNECT_MSG );
+        return 0;
+    }
+    readerStarted = 1;
+    return 1;
+}
+
+/* with writeLock held */
+static void SendCancel( int fd, size_t id )
+{
+    unsigned char frame[1 + NFD_REMOTE_VARINT_MAX + 1];
+    size_t n = 1;
+
+    frame[0] = (unsigned char)(NFDi_Remote_VarintLen( id ) + 1);
+    n += NFDi_Remote_PutVarint( frame + n, id );
+    frame[n++] = NFD_REMOTE_CANCEL;
+    SendAll( fd, frame, n );
+}
+
+/* Blocks until the response is in, the request is cancelled or the
+   deadline passes; pending->done tells which, under remoteLock. */
+static void WaitForResponse( pending_t *pending, nfdrequest_t *request )
+{
+    int cancelFd = NFDi_Request_GetCancelFd( request );
+    unsigned int timeout = NFDi_Request_GetTimeout( request );
+    long long deadline = timeout > 0 ? NFDi_NowMs() + timeout : 0;
+    struct pollfd fds[2];
+    int wait = -1;
+    int ready;
+
+    fds[0].fd = pending->wakePipe[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = cancelFd;
+    fds[1].events = POLLIN;
+
+    do
+    {
+        if ( deadline )
+        {
+            long long left = deadline - NFDi_NowMs();
+            wait = left > 0 ? (int)left : 0;
+        }
+        ready = poll( fds, cancelFd >= 0 ? 2 : 1, wait );
+    } while ( ready == -1 && errno == EINTR );
+}
+
+/* response body after the id: u8 result, varint count, count strings */
+static nfdresult_t ParseResponse( const pending_t *pending,
+                                  nfdchar_t **outPath,
+                                  nfdpathset_t *outPaths )
+{
+    const unsigned char *p = pending->response;
+    const unsigned char *end = p + pending->responseLen;
+    const char *str;
+    size_t count, len, i, bytes;
+    nfdresult_t result;
+
+    if ( !pending->response )
+    {
+        NFDi_SetError( DISCONNECT_MSG );
+        return NFD_ERROR;
+    }
+    if ( p == end || *p > NFD_CANCEL )
+        goto bad;
+    result = (nfdresult_t)*p++;
+    if ( !NFDi_Remote_GetVarint( &p, end, &count ) )
+        goto bad;
+
+    if ( result == NFD_CANCEL )
+        return NFD_CANCEL;
+
+    if ( result == NFD_ERROR )
+    {
+        char msg[NFD_MAX_STRLEN];
+        if ( count < 1 || !NFDi_Remote_GetString( &p, end, &str, &len ) )
+            goto bad;
+        if ( len >= sizeof(msg) )
+            len = sizeof(msg) - 1;
+        memcpy( msg, str, len );
+        msg[len] = '\0';
+        NFDi_SetError( msg );
+        return NFD_ERROR;
+    }
+
+    if ( count < 1 || (count > 1 && !outPaths) )
+        goto bad;
+
+    if ( !outPaths )
+    {
+        if ( !NFDi_Remote_GetString( &p, end, &str, &len ) )
+            goto bad;
+        *outPath = NFDi_Malloc( len + 1 );
+        if ( !*outPath )
+            return NFD_ERROR;
+        memcpy( *outPath, str, len );
+        (*outPath)[len] = '\0';
+        return NFD_OKAY;
+    }
+
+    /* every string is shorter than its encoding, NUL included */
+    if ( count > pending->responseLen )
+        goto bad;
+    outPaths->buf = NFDi_Malloc( pending->responseLen );
+    if ( !outPaths->buf )
+        return NFD_ERROR;
+    outPaths->indices = NFDi_Malloc( sizeof(size_t) * count );
+    if ( !outPaths->indices )
+    {
+        NFDi_Free( outPaths->buf );
+        return NFD_ERROR;
+    }
+
+    bytes = 0;
+    for ( i = 0; i < count; ++i )
+    {
+        if ( !NFDi_Remote_GetString( &p, end, &str, &len ) )
+        {
+            NFDi_Free( outPaths->indices );
+            NFDi_Free( outPaths->buf );
+            goto bad;
+        }
+        outPaths->indices[i] = bytes;
+        memcpy( outPaths->buf + bytes, str, len );
+        bytes += len;
+        outPaths->buf[bytes++] = '\0';
+    }
+    outPaths->count = count;
+
+    NFD_PROBE2( pathset_built, outPaths->count, bytes );
+    return NFD_OKAY;
+
+bad:
+    NFDi_SetError( BAD_RESPONSE_MSG );
+    return NFD_ERROR;
+}
+
+static nfdresult_t RemoteDialog( int op,
+                                 const nfdchar_t *filterList,
+                                 const nfdchar_t *defaultPath,
+                                 nfdchar_t **outPath,
+                                 nfdpathset_t *outPaths,
+                                 nfdrequest_t *request )
+{
+    size_t filterLen = filterList ? strlen( filterList ) : 0;
+    size_t pathLen = defaultPath ? strlen( defaultPath ) : 0;
+    size_t bodyLen, n;
+    unsigned char *frame;
+    pending_t pending, **link;
+    int fd;
+    nfdresult_t result;
+
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+
+    memset( &pending, 0, sizeof(pending) );
+    if ( NFDi_Pipe( pending.wakePipe ) != 0 )
+    {
+        NFDi_SetError( "Could not create the remote dialog wake pipe." );
+        return NFD_ERROR;
+    }
+
+    /* id, op, two strings; the id is at most NFD_REMOTE_VARINT_MAX bytes */
+    bodyLen = NFD_REMOTE_VARINT_MAX + 1 +
+              NFDi_Remote_VarintLen( filterLen ) + filterLen +
+              NFDi_Remote_VarintLen( pathLen ) + pathLen;
+    frame = NFDi_Malloc( NFD_REMOTE_VARINT_MAX + bodyLen );
+    if ( !frame )
+    {
+        result = NFD_ERROR;
+        goto done;
+    }
+
+    pthread_mutex_lock( &writeLock );
+    pthread_mutex_lock( &remoteLock );
+    if ( !Connect() )
+    {
+        pthread_mutex_unlock( &remoteLock );
+        pthread_mutex_unlock( &writeLock );
+        NFDi_Free( frame );
+        result = NFD_ERROR;
+        goto done;
+    }
+
+    pending.id = ++lastId;
+    bodyLen = NFDi_Remote_VarintLen( pending.id ) + 1 +
+              NFDi_Remote_VarintLen( filterLen ) + filterLen +
+              NFDi_Remote_VarintLen( pathLen ) + pathLen;
+    n = NFDi_Remote_PutVarint( frame, bodyLen );
+    n += NFDi_Remote_PutVarint( frame + n, pending.id );
+    frame[n++] = (unsigned char)op;
+    n += NFDi_Remote_PutString( frame + n, filterList, filterLen );
+    n += NFDi_Remote_PutString( frame + n, defaultPath, pathLen );
+
+    pending.next = pendingList;
+    pendingList = &pending;
+    fd = remoteSocket;
+    pthread_mutex_unlock( &remoteLock );
+
+    /* on failure the reader wakes us along with everyone else */
+    SendAll( fd, frame, n );
+    pthread_mutex_unlock( &writeLock );
+    NFDi_Free( frame );
+
+    NFD_PROBE1( dialog_shown, "remote" );
+    WaitForResponse( &pending, request );
+
+    pthread_mutex_lock( &writeLock );
+    pthread_mutex_lock( &remoteLock );
+    for ( link = &pendingList; *link != &pending; link = &(*link)->next )
+        ;
+    *link = pending.next;
+    fd = pending.done ? -1 : remoteSocket;
+    pthread_mutex_unlock( &remoteLock );
+    if ( fd >= 0 )
+        SendCancel( fd, pending.id );
+    pthread_mutex_unlock( &writeLock );
+
+    result = pending.done ? ParseResponse( &pending, outPath, outPaths ) : NFD_CANCEL;
+    NFD_PROBE2( dialog_closed, "remote", result );
+    if ( pending.response )
+        free( pending.response );
+
+done:
+    close( pending.wakePipe[0] );
+    close( pending.wakePipe[1] );
+    return result;
+}
+
+/* a reader still running when the library is unloaded would crash */
+__attribute__((destructor)) static void Shutdown( void )
+{
+    pthread_mutex_lock( &remoteLock );
+    if ( remoteSocket >= 0 )
+        shutdown( remoteSocket, SHUT_RDWR );
+    pthread_mutex_unlock( &remoteLock );
+
+    if ( readerStarted )
+        pthread_join( reader, NULL );
+}
+
+/* public */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = RemoteDialog( NFD_REMOTE_OPEN, filterList, defaultPath, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    nfdresult_t result = RemoteDialog( NFD_REMOTE_OPEN_MULTIPLE, filterList, defaultPath, NULL, outPaths, request );
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    return RemoteDialog( NFD_REMOTE_SAVE, filterList, defaultPath, outPath, NULL, request );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = RemoteDialog( NFD_REMOTE_PICK_FOLDER, NULL, defaultPath, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    _NFD_UNUSED(roots);
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(request);
+    /* the server would search its own disks, not this machine's */
+    NFDi_SetError( "NFD_SearchDialog is not supported by the remote backend." );
+    return NFD_ERROR;
+}
+
+#ifdef NFD_MONOLITHIC_BACKEND
+int NFDi_Backend_Probe( void )
+{
+    /* never probed for, see nfd_linux.c */
+    return 1;
+}
+#endif
@@ -0,0 +1,258 @@
+/*
+  Native File Dialog
+
+  Internal, wire format shared by the remote backend (nfd_remote.c) and
+  its dialog server (nfd_remote_server.c)
+
+  http://www.frogtoss.com/labs
+ */
+
+
+#ifndef _NFD_REMOTE_H
+#define _NFD_REMOTE_H
+
+#include <stddef.h>
+
+/* Wire format.  The client sends NFD_REMOTE_MAGIC once after connecting,
+   then both sides exchange frames: a varint body length and the body.
+   Varints are LEB128, 7 bits per byte with the low bits first.  A string
+   is a varint byte count and the bytes, without a NUL.
+
+     request   varint id, u8 op, string filterList, string defaultPath
+               (empty for NULL; NFD_REMOTE_CANCEL has the id and op only)
+     response  varint id, u8 nfdresult_t, varint count, count strings:
+               the paths for NFD_OKAY, a message for NFD_ERROR
+
+   Ids are picked by the client and any number of requests may be in
+   flight; responses come back in whatever order the dialogs finish, and a
+   response to an id the client gave up on is dropped. */
+
+#define NFD_REMOTE_MAGIC     "NFD\001"
+#define NFD_REMOTE_MAGIC_LEN 4
+
+/* longest varint of a size_t */
+#define NFD_REMOTE_VARINT_MAX 10
+
+/* a bigger frame is a protocol error and drops the connection */
+#define NFD_REMOTE_MAX_FRAME (16 * 1024 * 1024)
+
+enum
+{
+    NFD_REMOTE_OPEN,
+    NFD_REMOTE_OPEN_MULTIPLE,
+    NFD_REMOTE_SAVE,
+    NFD_REMOTE_PICK_FOLDER,
+    NFD_REMOTE_CANCEL    /* give up on a request, closing its dialog */
+};
+
+size_t NFDi_Remote_VarintLen( size_t value );
+size_t NFDi_Remote_PutVarint( unsigned char *dst, size_t value );
+size_t NFDi_Remote_PutString( unsigned char *dst, const char *str, size_t len );
+
+/* 0 if the value runs past end or is too long */
+int    NFDi_Remote_GetVarint( const unsigned char **src, const unsigned char *end, size_t *value );
+int    NFDi_Remote_GetString( const unsigned char **src, const unsigned char *end,
+                              const char **str, size_t *len );
+
+/* 1 and the body if buf starts with a whole frame, 0 if more bytes are
+   needed, -1 if it can never become one */
+int    NFDi_Remote_NextFrame( const unsigned char *buf, size_t len,
+                              const unsigned char **body, size_t *bodyLen, size_t *frameLen );
+
+/* socket for "unix:/path", "/path" or "host:port", connected or listening,
+   close-on-exec.  -1 on failure. */
+int    NFDi_Remote_Open( const char *address, int listening );
+
+#endif
+
+#ifdef NFD_REMOTE_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+size_t NFDi_Remote_VarintLen( size_t value )
+{
+    size_t n = 1;
+    while ( value >= 0x80 )
+    {
+        value >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+size_t NFDi_Remote_PutVarint( unsigned char *dst, size_t value )
+{
+    size_t n = 0;
+    while ( value >= 0x80 )
+    {
+        dst[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    dst[n++] = (unsigned char)value;
+    return n;
+}
+
+size_t NFDi_Remote_PutString( unsigned char *dst, const char *str, size_t len )
+{
+    size_t n = NFDi_Remote_PutVarint( dst, len );
+    if ( len > 0 )
+        memcpy( dst + n, str, len );
+    return n + len;
+}
+
+int NFDi_Remote_GetVarint( const unsigned char **src, const unsigned char *end, size_t *value )
+{
+    const unsigned char *p = *src;
+    size_t v = 0;
+    unsigned int shift = 0;
+
+    while ( p < end && shift < sizeof(size_t) * 8 )
+    {
+        unsigned char b = *p++;
+        v |= (size_t)(b & 0x7f) << shift;
+        if ( !(b & 0x80) )
+        {
+            *src = p;
+            *value = v;
+            return 1;
+        }
+        shift += 7;
+    }
+    return 0;
+}
+
+int NFDi_Remote_GetString( const unsigned char **src, const unsigned char *end,
+                           const char **str, size_t *len )
+{
+    const unsigned char *p = *src;
+
+    if ( !NFDi_Remote_GetVarint( &p, end, len ) || *len > (size_t)(end - p) )
+        return 0;
+    *str = (const char*)p;
+    *src = p + *len;
+    return 1;
+}
+
+int NFDi_Remote_NextFrame( const unsigned char *buf, size_t len,
+                           const unsigned char **body, size_t *bodyLen, size_t *frameLen )
+{
+    const unsigned char *p = buf;
+    size_t n;
+
+    if ( !NFDi_Remote_GetVarint( &p, buf + len, &n ) )
+        return len >= NFD_REMOTE_VARINT_MAX ? -1 : 0;
+    if ( n > NFD_REMOTE_MAX_FRAME )
+        return -1;
+    if ( n > (size_t)(buf + len - p) )
+        return 0;
+
+    *body = p;
+    *bodyLen = n;
+    *frameLen = (size_t)(p - buf) + n;
+    return 1;
+}
+
+static int NFDi_Remote_OpenUnix( const char *path, int listening )
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if ( strlen( path ) >= sizeof(addr.sun_path) )
+        return -1;
+    strcpy( addr.sun_path, path );
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd < 0 )
+        return -1;
+
+    if ( listening )
+    {
+        /* a stale socket file from an earlier server */
+        unlink( path );
+        if ( bind( fd, (struct sockaddr*)&addr, sizeof(addr) ) == 0 && listen( fd, 16 ) == 0 )
+            return fd;
+    }
+    else if ( connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) == 0 )
+    {
+        return fd;
+    }
+
+    close( fd );
+    return -1;
+}
+
+static int NFDi_Remote_OpenTcp( const char *address, int listening )
+{
+    char host[256];
+    const char *colon = strrchr( address, ':' );
+    struct addrinfo hints, *list, *ai;
+    size_t hostLen;
+    int fd = -1;
+    int one = 1;
+
+    if ( !colon || (size_t)(colon - address) >= sizeof(host) )
+        return -1;
+
+    /* [::1]:7777 */
+    hostLen = (size_t)(colon - address);
+    if ( hostLen >= 2 && address[0] == '[' && address[hostLen-1] == ']' )
+    {
+        ++address;
+        hostLen -= 2;
+    }
+    memcpy( host, address, hostLen );
+    host[hostLen] = '\0';
+
+    memset( &hints, 0, sizeof(hints) );
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = listening ? AI_PASSIVE : 0;
+    if ( getaddrinfo( hostLen > 0 ? host : NULL, colon + 1, &hints, &list ) != 0 )
+        return -1;
+
+    for ( ai = list; ai; ai = ai->ai_next )
+    {
+        fd = socket( ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol );
+        if ( fd < 0 )
+            continue;
+
+        /* frames are small and each one is waited on */
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+        if ( listening )
+        {
+            setsockopt( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+            if ( bind( fd, ai->ai_addr, ai->ai_addrlen ) == 0 && listen( fd, 16 ) == 0 )
+                break;
+        }
+        else if ( connect( fd, ai->ai_addr, ai->ai_addrlen ) == 0 )
+        {
+            break;
+        }
+
+        close( fd );
+        fd = -1;
+    }
+
+    freeaddrinfo( list );
+    return fd;
+}
+
+int NFDi_Remote_Open( const char *address, int listening )
+{
+    if ( strncmp( address, "unix:", 5 ) == 0 )
+        return NFDi_Remote_OpenUnix( address + 5, listening );
+    if ( address[0] == '/' )
+        return NFDi_Remote_OpenUnix( address, listening );
+    return NFDi_Remote_OpenTcp( address, listening );
+}
+
+#endif /* NFD_REMOTE_IMPLEMENTATION */
@@ -0,0 +1,399 @@
+/*
+  Native File Dialog
+
+  Dialog server for the remote backend (nfd_remote.c): shows the dialogs
+  of remote clients with this machine's own backend.
+
+    nfd_remote_server unix:/run/user/1000/nfd.sock
+    nfd_remote_server 127.0.0.1:7777
+
+  The backend is picked as usual, NFD_BACKEND included; with
+  NFD_BACKEND=script this is a stand-in server for tests.  Dialogs run one
+  at a time on libnfd's dialog thread, whichever client they came from,
+  and each is answered as soon as it closes.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "nfd.h"
+
+#define NFD_REMOTE_IMPLEMENTATION
+#include "nfd_remote.h"
+
+
+typedef struct job_s job_t;
+
+typedef struct
+{
+    int fd;
+    int refs;             /* the reader, and every job not answered yet */
+    pthread_mutex_t lock; /* sends, refs and jobs */
+    job_t *jobs;
+} client_t;
+
+struct job_s
+{
+    client_t *client;
+    size_t id;
+    nfdrequest_t *request;
+    job_t *next;
+};
+
+
+/* with client->lock held, which it gives up */
+static void Release( client_t *client )
+{
+    int last = --client->refs == 0;
+
+    pthread_mutex_unlock( &client->lock );
+    if ( last )
+    {
+        close( client->fd );
+        pthread_mutex_destroy( &client->lock );
+        free( client );
+    }
+}
+
+/* with client->lock held; a failed send ends the reader, which cancels
+   everything still open for this client */
+static void SendAll( client_t *client, const unsigned char *data, size_t len )
+{
+    size_t sent = 0;
+    while ( sent < len )
+    {
+        ssize_t n = send( client->fd, data + sent, len - sent, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+        {
+            shutdown( client->fd, SHUT_RDWR );
+            return;
+        }
+        sent += (size_t)n;
+    }
+}
+
+static unsigned char *BuildResponse( size_t id,
+                                     nfdresult_t result,
+                                     const nfdchar_t *outPath,
+                                     const nfdpathset_t *outPaths,
+                                     size_t *frameLen )
+{
+    const char *message = NULL;
+    size_t count = 0, bodyLen, n, i;
+    unsigned char *frame;
+
+    if ( result == NFD_OKAY )
+        count = outPaths ? NFD_PathSet_GetCount( outPaths ) : 1;
+    else if ( result == NFD_ERROR )
+    {
+        message = NFD_GetError();
+        count = 1;
+    }
+
+    bodyLen = NFDi_Remote_VarintLen( id ) + 1 + NFDi_Remote_VarintLen( count );
+    for ( i = 0; i < count; ++i )
+    {
+        const char *str = message ? message :
+                          outPaths ? NFD_PathSet_GetPath( outPaths, i ) : outPath;
+        size_t len = strlen( str );
+        bodyLen += NFDi_Remote_VarintLen( len ) + len;
+    }
+
+    frame = malloc( NFD_REMOTE_VARINT_MAX + bodyLen );
+    if ( !frame )
+        return NULL;
+
+    n = NFDi_Remote_PutVarint( frame, bodyLen );
+    n += NFDi_Remote_PutVarint( frame + n, id );
+    frame[n++] = (unsigned char)result;
+    n += NFDi_Remote_PutVarint( frame + n, count );
+    for ( i = 0; i < count; ++i )
+    {
+        const char *str = message ? message :
+                          outPaths ? NFD_PathSet_GetPath( outPaths, i ) : outPath;
+        n += NFDi_Remote_PutString( frame + n, str, strlen( str ) );
+    }
+
+    *frameLen = n;
+    return frame;
+}
+
+/* on libnfd's dialog thread, or on the reader if the dialog never queued */
+static void DialogDone( void *userdata,
+                        nfdresult_t result,
+                        nfdchar_t *outPath,
+                        nfdpathset_t *outPaths )
+{
+    job_t *job = userdata;
+    client_t *client = job->client;
+    job_t **link;
+    size_t frameLen = 0;
+    unsigned char *frame = BuildResponse( job->id, result, outPath, outPaths, &frameLen );
+
+    if ( !frame )
+    {
+        /* still answer, or the client waits forever */
+        frame = BuildResponse( job->id, NFD_CANCEL, NULL, NULL, &frameLen );
+    }
+    if ( outPath )
+        NFD_Free( outPath );
+    if ( outPaths )
+        NFD_PathSet_Free( outPaths );
+
+    pthread_mutex_lock( &client->lock );
+    for ( link = &client->jobs; *link != job; link = &(*link)->next )
+        ;
+    *link = job->next;
+    if ( frame )
+        SendAll( client, frame, frameLen );
+    if ( job->request )
+        NFD_Request_Free( job->request );
+    Release( client );
+
+    free( frame );
+    free( job );
+}
+
+static char *CopyString( const char *str, size_t len )
+{
+    char *copy;
+
+    /* empty is NULL on the wire */
+    if ( len == 0 )
+        return NULL;
+    copy = malloc( len + 1 );
+    if ( copy )
+    {
+        memcpy( copy, str, len );
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+/* 0 if the frame is malformed, which drops the client */
+static int HandleFrame( client_t *client, const unsigned char *body, size_t bodyLen )
+{
+    const unsigned char *p = body;
+    const unsigned char *end = body + bodyLen;
+    const char *str;
+    char *filterList, *defaultPath;
+    size_t id, len;
+    nfdresult_t result;
+    job_t *job;
+    int op;
+
+    if ( !NFDi_Remote_GetVarint( &p, end, &id ) || p == end )
+        return 0;
+    op = *p++;
+
+    if ( op == NFD_REMOTE_CANCEL )
+    {
+        pthread_mutex_lock( &client->lock );
+        for ( job = client->jobs; job; job = job->next )
+        {
+            if ( job->id == id && job->request )
+                NFD_Cancel( job->request );
+        }
+        pthread_mutex_unlock( &client->lock );
+        return 1;
+    }
+    if ( op > NFD_REMOTE_PICK_FOLDER )
+        return 0;
+
+    if ( !NFDi_Remote_GetString( &p, end, &str, &len ) )
+        return 0;
+    filterList = CopyString( str, len );
+    if ( !NFDi_Remote_GetString( &p, end, &str, &len ) )
+    {
+        free( filterList );
+        return 0;
+    }
+    defaultPath = CopyString( str, len );
+
+    job = calloc( 1, sizeof(job_t) );
+    if ( !job )
+    {
+        free( filterList );
+        free( defaultPath );
+        return 0;
+    }
+    job->client = client;
+    job->id = id;
+    job->request = NFD_Request_Create();
+
+    pthread_mutex_lock( &client->lock );
+    job->next = client->jobs;
+    client->jobs = job;
+    client->refs += 1;
+    pthread_mutex_unlock( &client->lock );
+
+    if ( !job->request )
+        result = NFD_ERROR;
+    else if ( op == NFD_REMOTE_OPEN )
+        result = NFD_OpenDialogAsync( filterList, defaultPath, job->request, DialogDone, job );
+    else if ( op == NFD_REMOTE_OPEN_MULTIPLE )
+        result = NFD_OpenDialogMultipleAsync( filterList, defaultPath, job->request, DialogDone, job );
+    else if ( op == NFD_REMOTE_SAVE )
+        result = NFD_SaveDialogAsync( filterList, defaultPath, job->request, DialogDone, job );
+    else
+        result = NFD_PickFolderAsync( defaultPath, job->request, DialogDone, job );
+
+    if ( result != NFD_OKAY )
+        DialogDone( job, NFD_ERROR, NULL, NULL );
+
+    free( filterList );
+    free( defaultPath );
+    return 1;
+}
+
+static int RecvMagic( int fd )
+{
+    unsigned char magic[NFD_REMOTE_MAGIC_LEN];
+    size_t got = 0;
+
+    while ( got < sizeof(magic) )
+    {
+        ssize_t n = recv( fd, magic + got, sizeof(magic) - got, 0 );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            return 0;
+        got += (size_t)n;
+    }
+    return memcmp( magic, NFD_REMOTE_MAGIC, sizeof(magic) ) == 0;
+}
+
+static void *ClientMain( void *data )
+{
+    client_t *client = data;
+    unsigned char *buf = NULL;
+    size_t len = 0, cap = 0;
+    job_t *job;
+    int connected = RecvMagic( client->fd );
+
+    while ( connected )
+    {
+        const unsigned char *body;
+        size_t bodyLen, frameLen;
+        ssize_t n;
+        int status = NFDi_Remote_NextFrame( buf, len, &body, &bodyLen, &frameLen );
+
+        if ( status < 0 )
+            break;
+        if ( status > 0 )
+        {
+            if ( !HandleFrame( client, body, bodyLen ) )
+                break;
+            len -= frameLen;
+            memmove( buf, buf + frameLen, len );
+            continue;
+        }
+
+        if ( cap - len < 4096 )
+        {
+            size_t newCap = cap ? cap * 2 : 16384;
+            unsigned char *grown = realloc( buf, newCap );
+            if ( !grown )
+                break;
+            buf = grown;
+            cap = newCap;
+        }
+
+        n = recv( client->fd, buf + len, cap - len, 0 );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+            break;
+        len += (size_t)n;
+    }
+    free( buf );
+
+    /* the client is gone, close whatever it left open */
+    pthread_mutex_lock( &client->lock );
+    for ( job = client->jobs; job; job = job->next )
+    {
+        if ( job->request )
+            NFD_Cancel( job->request );
+    }
+    Release( client );
+    return NULL;
+}
+
+int main( int argc, char **argv )
+{
+    const char *backend;
+    int listener;
+    int one = 1;
+
+    if ( argc != 2 )
+    {
+        fprintf( stderr, "usage: %s unix:/path | host:port\n", argv[0] );
+        return 1;
+    }
+
+    backend = NFD_GetBackendName();
+    if ( !backend )
+    {
+        fprintf( stderr, "nfd_remote_server: %s\n", NFD_GetError() );
+        return 1;
+    }
+    if ( strcmp( backend, "remote" ) == 0 )
+    {
+        fprintf( stderr, "nfd_remote_server: NFD_BACKEND=remote would forward to another server\n" );
+        return 1;
+    }
+
+    listener = NFDi_Remote_Open( argv[1], 1 );
+    if ( listener < 0 )
+    {
+        fprintf( stderr, "nfd_remote_server: could not listen on %s\n", argv[1] );
+        return 1;
+    }
+    fprintf( stderr, "nfd_remote_server: %s dialogs on %s\n", backend, argv[1] );
+
+    while ( 1 )
+    {
+        pthread_t thread;
+        client_t *client;
+        int fd = accept( listener, NULL, NULL );
+
+        if ( fd < 0 )
+        {
+            if ( errno != EINTR )
+                perror( "nfd_remote_server: accept" );
+            continue;
+        }
+        fcntl( fd, F_SETFD, FD_CLOEXEC );
+        setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+
+        client = calloc( 1, sizeof(client_t) );
+        if ( !client )
+        {
+            close( fd );
+            continue;
+        }
+        client->fd = fd;
+        client->refs = 1;
+        pthread_mutex_init( &client->lock, NULL );
+
+        if ( pthread_create( &thread, NULL, ClientMain, client ) != 0 )
+        {
+            pthread_mutex_destroy( &client->lock );
+            close( fd );
+            free( client );
+            continue;
+        }
+        pthread_detach( thread );
+    }
+}
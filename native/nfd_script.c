@@ -0,0 +1,605 @@
+/*
+  Native File Dialog
+
+  Scripted backend for automated runs: no display, no toolkit, every
+  dialog is answered from NFD_SCRIPT.
+
+  NFD_SCRIPT names either a file or a listening Unix socket.  A file is a
+  list of answers, consumed in order, one per line:
+
+    # dialog  result  [paths...|message], separated by tabs
+    open      okay    /home/ci/level_1.map
+    multiple  okay    /home/ci/a.png  /home/ci/b.png
+    save      cancel
+    folder    error   disk on fire
+    search    okay    /home/ci/src/main.c
+
+  dialog is open, multiple, save, folder or search and has to match the call that
+  consumes the line.  Blank lines and lines starting with # are skipped;
+  \t, \n, \r and \\ are the escapes inside a field.  nfd_linux.c writes
+  this format when NFD_SCRIPT_RECORD is set, so a session with a real
+  backend can be replayed as is.
+
+  With a socket, each dialog sends "dialog\tfilterList\tdefaultPath\n"
+  (escaped the same way, empty for NULL) and reads back one answer line.
+  A search has no defaultPath and sends its roots as further fields.
+  NFD_Cancel and timeouts are honoured while waiting for it.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "nfd.h"
+#include "nfd_common.h"
+#include "nfd_probes.h"
+
+
+static const char NO_SCRIPT_MSG[] = "NFD_SCRIPT is not set";
+static const char BAD_SCRIPT_MSG[] = "NFD_SCRIPT could not be opened";
+static const char SCRIPT_DONE_MSG[] = "NFD_SCRIPT has no answers left";
+static const char BAD_LINE_MSG[] = "NFD_SCRIPT has a malformed answer";
+static const char SOCKET_MSG[] = "NFD_SCRIPT socket closed or failed";
+
+typedef enum
+{
+    SCRIPT_OPEN,
+    SCRIPT_MULTIPLE,
+    SCRIPT_SAVE,
+    SCRIPT_FOLDER,
+    SCRIPT_SEARCH
+} scriptdialog_t;
+
+static const char *const DIALOG_NAMES[] = { "open", "multiple", "save", "folder", "search" };
+
+/* one script per process; the lock also keeps a socket's
+   request/answer pairs from interleaving */
+static pthread_mutex_t scriptLock = PTHREAD_MUTEX_INITIALIZER;
+static char *scriptBuf = NULL;      /* whole NFD_SCRIPT file */
+static char *scriptCursor = NULL;   /* start of the next unread line */
+static int scriptSocket = -1;
+static char *recvBuf = NULL;        /* socket bytes not consumed yet */
+static size_t recvLen = 0;
+static size_t recvCap = 0;
+
+
+static int LoadScript( const char *path )
+{
+    FILE *file = fopen( path, "rb" );
+    size_t cap = 4096, len = 0, got;
+
+    if ( !file )
+    {
+        NFDi_SetError( BAD_SCRIPT_MSG );
+        return 0;
+    }
+
+    scriptBuf = NFDi_Malloc( cap );
+    while ( scriptBuf )
+    {
+        got = fread( scriptBuf + len, 1, cap - len - 1, file );
+        len += got;
+        if ( got == 0 )
+            break;
+        if ( len + 1 == cap )
+        {
+            char *grown = realloc( scriptBuf, cap * 2 );
+            if ( !grown )
+            {
+                NFDi_Free( scriptBuf );
+                scriptBuf = NULL;
+                NFDi_SetError( "NFDi_Malloc failed." );
+                break;
+            }
+            scriptBuf = grown;
+            cap *= 2;
+        }
+    }
+    fclose( file );
+
+    if ( !scriptBuf )
+        return 0;
+    scriptBuf[len] = '\0';
+    scriptCursor = scriptBuf;
+    return 1;
+}
+
+static int ConnectScript( const char *path )
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+    if ( NFDi_SafeStrncpy( addr.sun_path, path, sizeof(addr.sun_path) ) )
+    {
+        NFDi_SetError( BAD_SCRIPT_MSG );
+        return 0;
+    }
+
+    fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd < 0 || connect( fd, (struct sockaddr*)&addr, sizeof(addr) ) != 0 )
+    {
+        if ( fd >= 0 )
+            close( fd );
+        NFDi_SetError( BAD_SCRIPT_MSG );
+        return 0;
+    }
+
+    scriptSocket = fd;
+    recvLen = 0;
+    return 1;
+}
+
+/* loads or connects to NFD_SCRIPT on first use, and reconnects a socket
+   that was dropped */
+static int OpenScript( void )
+{
+    const char *path;
+    struct stat st;
+
+    if ( scriptBuf || scriptSocket >= 0 )
+        return 1;
+
+    path = getenv( "NFD_SCRIPT" );
+    if ( !path || path[0] == '\0' )
+    {
+        NFDi_SetError( NO_SCRIPT_MSG );
+        return 0;
+    }
+    if ( stat( path, &st ) != 0 )
+    {
+        NFDi_SetError( BAD_SCRIPT_MSG );
+        return 0;
+    }
+
+    return S_ISSOCK( st.st_mode ) ? ConnectScript( path ) : LoadScript( path );
+}
+
+static void CloseSocket( void )
+{
+    close( scriptSocket );
+    scriptSocket = -1;
+    recvLen = 0;
+}
+
+/* strips the line ending, so that CRLF scripts work too */
+static void TrimLine( char *line )
+{
+    size_t len = strlen( line );
+    if ( len > 0 && line[len-1] == '\r' )
+        line[len-1] = '\0';
+}
+
+static char *NextFileLine( void )
+{
+    while ( *scriptCursor != '\0' )
+    {
+        char *line = scriptCursor;
+        char *end = strchr( line, '\n' );
+
+        if ( end )
+        {
+            *end = '\0';
+            scriptCursor = end + 1;
+        }
+        else
+        {
+            scriptCursor = line + strlen( line );
+        }
+
+        TrimLine( line );
+        if ( line[0] != '\0' && line[0] != '#' )
+            return line;
+    }
+
+    NFDi_SetError( SCRIPT_DONE_MSG );
+    return NULL;
+}
+
+static size_t EscapedLen( const char *str )
+{
+    size_t len = 0;
+    for ( ; str && *str; ++str )
+        len += ( *str == '\t' || *str == '\n' || *str == '\r' || *str == '\\' ) ? 2 : 1;
+    return len;
+}
+
+static char *AppendEscaped( char *dst, const char *str )
+{
+    for ( ; str && *str; ++str )
+    {
+        switch ( *str )
+        {
+        case '\t': *dst++ = '\\'; *dst++ = 't'; break;
+        case '\n': *dst++ = '\\'; *dst++ = 'n'; break;
+        case '\r': *dst++ = '\\'; *dst++ = 'r'; break;
+        case '\\': *dst++ = '\\'; *dst++ = '\\'; break;
+        default: *dst++ = *str; break;
+        }
+    }
+    return dst;
+}
+
+static int SendRequest( scriptdialog_t dialog,
+                        const char *filterList,
+                        const char *defaultPath,
+                        const char *const *roots )
+{
+    const char *name = DIALOG_NAMES[dialog];
+    size_t len = strlen( name ) + EscapedLen( filterList ) + EscapedLen( defaultPath ) + 3;
+    char *msg;
+    char *p;
+    size_t sent = 0, i;
+
+    for ( i = 0; roots && roots[i]; ++i )
+        len += EscapedLen( roots[i] ) + 1;
+    msg = NFDi_Malloc( len );
+    if ( !msg )
+        return 0;
+
+    p = AppendEscaped( msg, name );
+    *p++ = '\t';
+    p = AppendEscaped( p, filterList );
+    *p++ = '\t';
+    p = AppendEscaped( p, defaultPath );
+    for ( i = 0; roots && roots[i]; ++i )
+    {
+        *p++ = '\t';
+        p = AppendEscaped( p, roots[i] );
+    }
+    *p++ = '\n';
+    assert( (size_t)(p - msg) == len );
+
+    while ( sent < len )
+    {
+        ssize_t n = send( scriptSocket, msg + sent, len - sent, MSG_NOSIGNAL );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+        {
+            NFDi_Free( msg );
+            NFDi_SetError( SOCKET_MSG );
+            return 0;
+        }
+        sent += (size_t)n;
+    }
+
+    NFDi_Free( msg );
+    return 1;
+}
+
+/* Blocks until the server sent a whole line, which is moved to the front of
+   recvBuf and NUL-terminated; the caller drops it with ConsumeLine.
+   Returns NFD_CANCEL on cancel/timeout. */
+static nfdresult_t ReceiveLine( nfdrequest_t *request, size_t *lineLen )
+{
+    int cancelFd = NFDi_Request_GetCancelFd( request );
+    unsigned int timeout = NFDi_Request_GetTimeout( request );
+    long long deadline = timeout > 0 ? NFDi_NowMs() + timeout : 0;
+    struct pollfd fds[2];
+    char *end;
+
+    fds[0].fd = scriptSocket;
+    fds[0].events = POLLIN;
+    fds[1].fd = cancelFd;
+    fds[1].events = POLLIN;
+
+    while ( !recvBuf || !(end = memchr( recvBuf, '\n', recvLen )) )
+    {
+        int wait = -1;
+        int ready;
+        ssize_t n;
+
+        if ( recvLen + 1 >= recvCap )
+        {
+            size_t cap = recvCap ? recvCap * 2 : 1024;
+            char *grown = realloc( recvBuf, cap );
+            if ( !grown )
+            {
+                NFDi_SetError( "NFDi_Malloc failed." );
+                return NFD_ERROR;
+            }
+            recvBuf = grown;
+            recvCap = cap;
+        }
+
+        if ( deadline )
+        {
+            long long left = deadline - NFDi_NowMs();
+            wait = left > 0 ? (int)left : 0;
+        }
+        ready = poll( fds, cancelFd >= 0 ? 2 : 1, wait );
+        if ( ready == -1 && errno == EINTR )
+            continue;
+        if ( ready == 0 || (cancelFd >= 0 && (fds[1].revents & POLLIN)) )
+            return NFD_CANCEL;
+
+        n = recv( scriptSocket, recvBuf + recvLen, recvCap - recvLen - 1, 0 );
+        if ( n < 0 && errno == EINTR )
+            continue;
+        if ( n <= 0 )
+        {
+            NFDi_SetError( SOCKET_MSG );
+            return NFD_ERROR;
+        }
+        recvLen += (size_t)n;
+    }
+
+    *end = '\0';
+    *lineLen = (size_t)(end - recvBuf) + 1;
+    TrimLine( recvBuf );
+    return NFD_OKAY;
+}
+
+static void ConsumeLine( size_t lineLen )
+{
+    recvLen -= lineLen;
+    memmove( recvBuf, recvBuf + lineLen, recvLen );
+}
+
+/* Unescapes line in place and splits it at the tabs, leaving the fields as
+   NUL-terminated strings back to back -- the layout of nfdpathset_t.buf.
+   Returns the number of fields, or 0 on a bad escape. */
+static int SplitFields( char *line, size_t *outBytes )
+{
+    const char *r = line;
+    char *w = line;
+    int count = 1;
+
+    while ( *r != '\0' )
+    {
+        if ( *r == '\t' )
+        {
+            *w++ = '\0';
+            ++count;
+            ++r;
+        }
+        else if ( *r == '\\' )
+        {
+            switch ( r[1] )
+            {
+            case 't': *w++ = '\t'; break;
+            case 'n': *w++ = '\n'; break;
+            case 'r': *w++ = '\r'; break;
+            case '\\': *w++ = '\\'; break;
+            default: return 0;
+            }
+            r += 2;
+        }
+        else
+        {
+            *w++ = *r++;
+        }
+    }
+    *w = '\0';
+
+    *outBytes = (size_t)(w - line) + 1;
+    return count;
+}
+
+static nfdresult_t AllocPathSet( const char *paths, size_t bytes, size_t count, nfdpathset_t *pathSet )
+{
+    size_t i, offset = 0;
+
+    pathSet->buf = NFDi_Malloc( bytes );
+    if ( !pathSet->buf )
+        return NFD_ERROR;
+    pathSet->indices = NFDi_Malloc( sizeof(size_t) * count );
+    if ( !pathSet->indices )
+    {
+        NFDi_Free( pathSet->buf );
+        return NFD_ERROR;
+    }
+
+    memcpy( pathSet->buf, paths, bytes );
+    for ( i = 0; i < count; ++i )
+    {
+        pathSet->indices[i] = offset;
+        offset += strlen( pathSet->buf + offset ) + 1;
+    }
+    pathSet->count = count;
+
+    NFD_PROBE2( pathset_built, pathSet->count, bytes );
+    return NFD_OKAY;
+}
+
+/* turns one answer line into the dialog's result */
+static nfdresult_t ParseAnswer( scriptdialog_t dialog,
+                                char *line,
+                                nfdchar_t **outPath,
+                                nfdpathset_t *outPaths )
+{
+    size_t bytes;
+    int count = SplitFields( line, &bytes );
+    const char *result;
+    const char *rest;
+
+    if ( count < 2 )
+    {
+        NFDi_SetError( BAD_LINE_MSG );
+        return NFD_ERROR;
+    }
+    result = line + strlen( line ) + 1;
+    rest = result + strlen( result ) + 1;
+
+    if ( strcmp( line, DIALOG_NAMES[dialog] ) != 0 )
+    {
+        char msg[NFD_MAX_STRLEN];
+        snprintf( msg, sizeof(msg), "NFD_SCRIPT answers a '%.64s' dialog, but '%s' was opened",
+                  line, DIALOG_NAMES[dialog] );
+        NFDi_SetError( msg );
+        return NFD_ERROR;
+    }
+
+    if ( strcmp( result, "cancel" ) == 0 )
+        return NFD_CANCEL;
+
+    if ( strcmp( result, "error" ) == 0 )
+    {
+        char msg[NFD_MAX_STRLEN];
+        NFDi_SafeStrncpy( msg, count > 2 ? rest : "NFD_SCRIPT answered with an error", sizeof(msg) );
+        NFDi_SetError( msg );
+        return NFD_ERROR;
+    }
+
+    if ( strcmp( result, "okay" ) != 0 || count < 3 ||
+         (count > 3 && dialog != SCRIPT_MULTIPLE) )
+    {
+        NFDi_SetError( BAD_LINE_MSG );
+        return NFD_ERROR;
+    }
+
+    if ( outPaths )
+        return AllocPathSet( rest, bytes - (size_t)(rest - line), (size_t)count - 2, outPaths );
+
+    {
+        size_t len = strlen( rest );
+        *outPath = NFDi_Malloc( len + 1 );
+        if ( !*outPath )
+            return NFD_ERROR;
+        memcpy( *outPath, rest, len + 1 );
+    }
+    return NFD_OKAY;
+}
+
+static nfdresult_t ScriptDialog( scriptdialog_t dialog,
+                                 const nfdchar_t *filterList,
+                                 const nfdchar_t *defaultPath,
+                                 const nfdchar_t *const *roots,
+                                 nfdchar_t **outPath,
+                                 nfdpathset_t *outPaths,
+                                 nfdrequest_t *request )
+{
+    nfdresult_t result = NFD_ERROR;
+    size_t lineLen;
+    char *line;
+
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+
+    pthread_mutex_lock( &scriptLock );
+    if ( !OpenScript() )
+        goto done;
+
+    NFD_PROBE1( dialog_shown, "script" );
+    if ( scriptBuf )
+    {
+        line = NextFileLine();
+        if ( line )
+            result = ParseAnswer( dialog, line, outPath, outPaths );
+    }
+    else if ( SendRequest( dialog, filterList, defaultPath, roots ) )
+    {
+        result = ReceiveLine( request, &lineLen );
+        if ( result == NFD_OKAY )
+        {
+            result = ParseAnswer( dialog, recvBuf, outPath, outPaths );
+            ConsumeLine( lineLen );
+        }
+        else
+        {
+            /* the answer may still arrive, and would go to the next dialog */
+            CloseSocket();
+        }
+    }
+    else
+    {
+        CloseSocket();
+    }
+    NFD_PROBE2( dialog_closed, "script", result );
+
+done:
+    pthread_mutex_unlock( &scriptLock );
+    return result;
+}
+
+/* public */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = ScriptDialog( SCRIPT_OPEN, filterList, defaultPath, NULL, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    nfdresult_t result = ScriptDialog( SCRIPT_MULTIPLE, filterList, defaultPath, NULL, NULL, outPaths, request );
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    return ScriptDialog( SCRIPT_SAVE, filterList, defaultPath, NULL, outPath, NULL, request );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = ScriptDialog( SCRIPT_FOLDER, NULL, defaultPath, NULL, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = ScriptDialog( SCRIPT_SEARCH, filterList, NULL, roots, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
+}
+
+#ifdef NFD_MONOLITHIC_BACKEND
+int NFDi_Backend_Probe( void )
+{
+    /* never probed for, see nfd_linux.c */
+    return 1;
+}
+#endif
@@ -24,6 +24,7 @@
 #endif
 
 #include <wchar.h>
+#include <string.h>
 #include <stdio.h>
 #include <assert.h>
 #include <windows.h>
@@ -135,7 +136,7 @@ static void CopyNFDCharToWChar( const nfdchar_t *inStr, wchar_t **outStr )
 }
 
 
-/* ext is in format "jpg", no wildcards or separators */
+/* ext is "jpg" or a glob such as "level_*.map", no separators */
 static int AppendExtensionToSpecBuf( const char *ext, char *specBuf, size_t specBufLen )
 {
     const char SEP[] = ";";
@@ -147,10 +148,9 @@ static int AppendExtensionToSpecBuf( const char *ext, char *specBuf, size_t spec
         specBufLen += strlen(SEP);
     }
 
+    /* IFileDialog specs are globs, so pass those through */
     char extWildcard[NFD_MAX_STRLEN];
-    int bytesWritten = sprintf_s( extWildcard, NFD_MAX_STRLEN, "*.%s", ext );
-    assert( bytesWritten == (int)(strlen(ext)+2) );
-    _NFD_UNUSED(bytesWritten);
+    NFDi_FilterTypeToPattern( ext, extWildcard, NFD_MAX_STRLEN );
     
     strncat( specBuf, extWildcard, specBufLen - strlen(specBuf) - 1 );
 
@@ -764,3 +764,161 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
 
     return nfdResult;
 }
+
+/* requests can only be honoured before the dialog opens on this platform */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPath( request,
+                                    NFD_OpenDialog( filterList, defaultPath, outPath ),
+                                    outPath );
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPathSet( request,
+                                       NFD_OpenDialogMultiple( filterList, defaultPath, outPaths ),
+                                       outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFD_SaveDialog( filterList, defaultPath, outPath );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    if ( NFDi_Request_IsCancelled( request ) )
+        return NFD_CANCEL;
+    return NFDi_Request_FinishPath( request,
+                                    NFD_PickFolder( defaultPath, outPath ),
+                                    outPath );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    _NFD_UNUSED(roots);
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(request);
+    NFDi_SetError("NFD_SearchDialog is not available on Windows.");
+    return NFD_ERROR;
+}
+
+nfdresult_t NFD_OpenDialogMapped( const nfdchar_t *filterList,
+                                  const nfdchar_t *defaultPath,
+                                  nfdchar_t **outPath,
+                                  nfdmapping_t *outMapping,
+                                  unsigned int mapFlags,
+                                  nfdrequest_t *request )
+{
+    wchar_t *pathW = NULL;
+    HANDLE file, mapping;
+    LARGE_INTEGER size;
+    const void *view;
+    nfdresult_t result;
+
+    assert(outMapping);
+    outMapping->data = NULL;
+    outMapping->length = 0;
+
+    result = NFD_OpenDialogEx( filterList, defaultPath, outPath, request );
+    if ( result != NFD_OKAY )
+        return result;
+
+    CopyNFDCharToWChar( *outPath, &pathW );
+    if ( !pathW )
+        goto fail;
+    file = CreateFileW( pathW, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    NFDi_Free( pathW );
+    if ( file == INVALID_HANDLE_VALUE )
+    {
+        NFDi_SetError("Could not open the selected file.");
+        goto fail;
+    }
+    if ( !GetFileSizeEx( file, &size ) || (unsigned long long) size.QuadPart > (size_t) -1 )
+    {
+        NFDi_SetError("The selected file cannot be mapped.");
+        CloseHandle( file );
+        goto fail;
+    }
+
+    /* CreateFileMapping refuses empty files, those just get no data */
+    if ( size.QuadPart > 0 )
+    {
+        mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        view = mapping ? MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 ) : NULL;
+        if ( mapping )
+            CloseHandle( mapping );
+        if ( !view )
+        {
+            NFDi_SetError("Could not map the selected file.");
+            CloseHandle( file );
+            goto fail;
+        }
+        if ( mapFlags & NFD_MAP_POPULATE )
+        {
+            /* PrefetchVirtualMemory is Windows 8+, so touch every page */
+            const volatile char *page = (const volatile char*) view;
+            size_t offset;
+            for ( offset = 0; offset < (size_t) size.QuadPart; offset += 4096 )
+                (void) page[offset];
+        }
+        outMapping->data = view;
+        outMapping->length = (size_t) size.QuadPart;
+    }
+
+    /* the view keeps the file alive */
+    CloseHandle( file );
+    return NFD_OKAY;
+
+fail:
+    NFDi_Free( *outPath );
+    *outPath = NULL;
+    return NFD_ERROR;
+}
+
+void NFD_Unmap( nfdmapping_t *mapping )
+{
+    assert(mapping);
+    if ( mapping->data )
+        UnmapViewOfFile( mapping->data );
+    mapping->data = NULL;
+    mapping->length = 0;
+}
+
+nfdresult_t NFD_SetBackend( const char *name )
+{
+    if ( name && strcmp( name, "win32" ) != 0 )
+    {
+        NFDi_SetError("Only the win32 backend is available.");
+        return NFD_ERROR;
+    }
+    return NFD_OKAY;
+}
+
+const char *NFD_GetBackendName( void )
+{
+    return "win32";
+}
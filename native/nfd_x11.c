@@ -0,0 +1,1499 @@
+/*
+  Native File Dialog
+
+  Built-in chooser drawn with plain Xlib, for machines with neither GTK nor
+  zenity.  Nothing but libX11 is needed, core fonts included.
+
+  The directory is read on a background thread and handed over in
+  batches, so the window is up before a large directory is half read.
+  Only the rows on screen are ever drawn, and typing filters the list as
+  it goes.  Keys:
+
+    Up/Down/PageUp/PageDown/Home/End   move the selection
+    Enter or double-click              enter a folder, or pick a file
+    Ctrl+Enter or the Select button    pick the current folder, or the
+                                       one the filter text narrowed to
+    Backspace on empty text, Alt+Up    go to the parent folder
+    Space or Ctrl+click                mark files in one folder, in the
+                                       multiple dialog
+    Ctrl+H                             show or hide dot files
+    Escape                             cancel
+
+  In the save dialog the text is the file name, which also filters.  In
+  the search dialog it is looked up in the file name index (nfd_index.c)
+  below every root, and the list shows the best matches with their folder.
+
+  http://www.frogtoss.com/labs
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include "nfd.h"
+#include "nfd_common.h"
+#include "nfd_index.h"
+#include "nfd_probes.h"
+
+
+static const char NO_DISPLAY_MSG[] = "Could not open the X display";
+static const char NO_FONT_MSG[] = "Could not load an X core font";
+static const char NO_THREAD_MSG[] = "Could not start the directory scan";
+
+/* iso10646 shows most file names as they are; "fixed" is always there */
+static const char *const FONT_NAMES[] =
+{
+    "-misc-fixed-medium-r-normal--13-*-*-*-*-*-iso10646-1",
+    "fixed"
+};
+
+#define SCAN_BATCH        512     /* entries per hand-over to the dialog */
+#define NAME_CHUNK_SIZE   65536
+#define DOUBLE_CLICK_MS   400
+#define WHEEL_ROWS        3
+#define PAD               6
+#define NO_SELECTION      ((size_t)-1)
+#define SEARCH_RESULTS    1000    /* rows a search shows at most */
+
+typedef enum
+{
+    X11_OPEN,
+    X11_MULTIPLE,
+    X11_SAVE,
+    X11_FOLDER,
+    X11_SEARCH
+} x11dialog_t;
+
+static const char *const TITLES[] = { "Open File", "Open Files", "Save File", "Select folder", "Find File" };
+static const char *const ACCEPT_LABELS[] = { "Open", "Open", "Save", "Select", "Open" };
+
+typedef struct
+{
+    const char *name;       /* in a NameChunk of the scan, or the snapshot */
+    const char *dir;        /* search results only, else chooser->dir */
+    unsigned char isDir;
+    unsigned char marked;
+} Entry;
+
+/* names are carved out of chunks that never move, so an Entry stays valid
+   on its way from the scanner to the dialog */
+typedef struct NameChunk
+{
+    struct NameChunk *next;
+    size_t used;
+    char data[];
+} NameChunk;
+
+typedef struct
+{
+    pthread_t thread;
+    int started;
+    char dir[PATH_MAX];
+    int stop;               /* atomic, abandons the scan */
+    int wakePipe[2];        /* a byte while there is something to merge */
+    NameChunk *chunks;      /* scanner only, until it is joined */
+
+    pthread_mutex_t lock;   /* everything below */
+    Entry *pending;
+    size_t pendingCount;
+    size_t pendingCap;
+    int woken;
+    int done;
+    int error;              /* errno of a failed scan */
+} Scan;
+
+typedef struct
+{
+    x11dialog_t kind;
+    nfdfilter_t filter;
+    char dir[PATH_MAX];
+    char text[NFD_MAX_STRLEN];  /* typed filter, or the file name to save */
+    size_t textLen;
+    char reselect[NAME_MAX + 1];/* select this entry once it turns up */
+    int showHidden;
+    int confirmOverwrite;       /* Enter again replaces the file */
+
+    Scan scan;
+    int scanning;
+    int scanError;              /* errno, shown instead of the item count */
+    Entry *entries;             /* sorted once the scan is done */
+    size_t entryCount;
+    size_t entryCap;
+    size_t *view;               /* indices of the visible entries */
+    size_t viewCount;
+    size_t viewCap;
+    size_t viewText;            /* textLen the view was filtered with */
+    size_t top;
+    size_t selected;            /* index into view, or NO_SELECTION */
+    int moved;                  /* the user picked the selection */
+
+    nfdindex_t *index;          /* X11_SEARCH */
+    nfdindexsnapshot_t *snapshot;   /* what entries point into */
+    int indexUpdating;
+    uint32_t *hits;
+
+    Display *display;
+    Window window;
+    Atom wmDelete;
+    GC gc;
+    Pixmap buffer;
+    XFontStruct *font;
+    int width, height;
+    int rowHeight;
+    unsigned long fg, bg, dimFg, selBg, selFg, markBg;
+    int dirty;
+    Time lastClick;
+    size_t lastClickRow;
+} Chooser;
+
+
+/* the scan */
+
+static const char *CopyName( Scan *scan, const char *name )
+{
+    size_t len = strlen( name ) + 1;
+    NameChunk *chunk = scan->chunks;
+    char *copy;
+
+    if ( !chunk || NAME_CHUNK_SIZE - chunk->used < len )
+    {
+        chunk = malloc( sizeof(NameChunk) + NAME_CHUNK_SIZE );
+        if ( !chunk )
+            return NULL;
+        chunk->next = scan->chunks;
+        chunk->used = 0;
+        scan->chunks = chunk;
+    }
+
+    copy = chunk->data + chunk->used;
+    memcpy( copy, name, len );
+    chunk->used += len;
+    return copy;
+}
+
+static void Publish( Scan *scan, const Entry *batch, size_t count, int done, int error )
+{
+    pthread_mutex_lock( &scan->lock );
+    if ( scan->pendingCount + count > scan->pendingCap )
+    {
+        size_t cap = scan->pendingCap ? scan->pendingCap * 2 : SCAN_BATCH * 4;
+        Entry *grown;
+        while ( cap < scan->pendingCount + count )
+            cap *= 2;
+        grown = realloc( scan->pending, sizeof(Entry) * cap );
+        if ( grown )
+        {
+            scan->pending = grown;
+            scan->pendingCap = cap;
+        }
+        else
+        {
+            count = 0;
+            done = 1;
+            error = ENOMEM;
+        }
+    }
+    if ( count > 0 )
+        memcpy( scan->pending + scan->pendingCount, batch, sizeof(Entry) * count );
+    scan->pendingCount += count;
+    if ( done )
+    {
+        scan->done = 1;
+        scan->error = error;
+    }
+    if ( !scan->woken )
+    {
+        char byte = 0;
+        scan->woken = write( scan->wakePipe[1], &byte, 1 ) == 1;
+    }
+    pthread_mutex_unlock( &scan->lock );
+}
+
+static void *ScanMain( void *data )
+{
+    Scan *scan = (Scan*)data;
+    Entry batch[SCAN_BATCH];
+    size_t count = 0;
+    struct dirent *ent;
+    int error = 0;
+    DIR *dir = opendir( scan->dir );
+
+    if ( !dir )
+    {
+        Publish( scan, NULL, 0, 1, errno );
+        return NULL;
+    }
+
+    while ( !__atomic_load_n( &scan->stop, __ATOMIC_RELAXED ) && (ent = readdir( dir )) )
+    {
+        Entry *entry = &batch[count];
+        const char *name = ent->d_name;
+
+        if ( name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')) )
+            continue;
+
+        entry->isDir = ent->d_type == DT_DIR;
+        if ( ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK )
+        {
+            /* symlinks to folders are folders */
+            struct stat st;
+            entry->isDir = fstatat( dirfd( dir ), name, &st, 0 ) == 0 && S_ISDIR( st.st_mode );
+        }
+        entry->marked = 0;
+        entry->dir = NULL;
+        entry->name = CopyName( scan, name );
+        if ( !entry->name )
+        {
+            error = ENOMEM;
+            break;
+        }
+
+        if ( ++count == SCAN_BATCH )
+        {
+            Publish( scan, batch, count, 0, 0 );
+            count = 0;
+        }
+    }
+
+    closedir( dir );
+    Publish( scan, batch, count, 1, error );
+    return NULL;
+}
+
+static int StartScan( Scan *scan, const char *dir )
+{
+    memset( scan, 0, sizeof(Scan) );
+    if ( NFDi_SafeStrncpy( scan->dir, dir, sizeof(scan->dir) ) )
+        return 0;
+    if ( NFDi_Pipe( scan->wakePipe ) != 0 )
+        return 0;
+    fcntl( scan->wakePipe[0], F_SETFL, O_NONBLOCK );
+    pthread_mutex_init( &scan->lock, NULL );
+
+    if ( pthread_create( &scan->thread, NULL, ScanMain, scan ) != 0 )
+    {
+        pthread_mutex_destroy( &scan->lock );
+        close( scan->wakePipe[0] );
+        close( scan->wakePipe[1] );
+        return 0;
+    }
+    scan->started = 1;
+    return 1;
+}
+
+/* also frees every name the dialog got from this scan */
+static void StopScan( Scan *scan )
+{
+    NameChunk *chunk;
+
+    if ( !scan->started )
+        return;
+
+    __atomic_store_n( &scan->stop, 1, __ATOMIC_RELAXED );
+    pthread_join( scan->thread, NULL );
+    scan->started = 0;
+
+    while ( (chunk = scan->chunks) != NULL )
+    {
+        scan->chunks = chunk->next;
+        free( chunk );
+    }
+    free( scan->pending );
+    pthread_mutex_destroy( &scan->lock );
+    close( scan->wakePipe[0] );
+    close( scan->wakePipe[1] );
+}
+
+/* the list */
+
+static int ContainsNoCase( const char *haystack, const char *needle, size_t needleLen )
+{
+    size_t i;
+
+    if ( needleLen == 0 )
+        return 1;
+    for ( ; *haystack; ++haystack )
+    {
+        for ( i = 0; i < needleLen && haystack[i]; ++i )
+        {
+            char a = haystack[i], b = needle[i];
+            if ( a >= 'A' && a <= 'Z' )
+                a += 'a' - 'A';
+            if ( b >= 'A' && b <= 'Z' )
+                b += 'a' - 'A';
+            if ( a != b )
+                break;
+        }
+        if ( i == needleLen )
+            return 1;
+    }
+    return 0;
+}
+
+static int IsVisible( const Chooser *chooser, const Entry *entry )
+{
+    if ( entry->name[0] == '.' && !chooser->showHidden && chooser->text[0] != '.' )
+        return 0;
+    if ( !entry->isDir )
+    {
+        if ( chooser->kind == X11_FOLDER )
+            return 0;
+        if ( chooser->filter.groupCount > 0 &&
+             NFDi_Filter_Match( &chooser->filter, entry->name, strlen( entry->name ) ) < 0 )
+            return 0;
+    }
+    return ContainsNoCase( entry->name, chooser->text, chooser->textLen );
+}
+
+static int ReserveView( Chooser *chooser, size_t count )
+{
+    size_t *grown;
+    size_t cap = chooser->viewCap ? chooser->viewCap : 1024;
+
+    if ( count <= chooser->viewCap )
+        return 1;
+    while ( cap < count )
+        cap *= 2;
+    grown = realloc( chooser->view, sizeof(size_t) * cap );
+    if ( !grown )
+        return 0;
+    chooser->view = grown;
+    chooser->viewCap = cap;
+    return 1;
+}
+
+static const Entry *SelectedEntry( const Chooser *chooser )
+{
+    if ( chooser->selected >= chooser->viewCount )
+        return NULL;
+    return &chooser->entries[chooser->view[chooser->selected]];
+}
+
+static size_t VisibleRows( const Chooser *chooser );
+
+static void ScrollToSelection( Chooser *chooser, size_t rows )
+{
+    if ( chooser->selected >= chooser->viewCount || rows == 0 )
+        return;
+    if ( chooser->selected < chooser->top )
+        chooser->top = chooser->selected;
+    else if ( chooser->selected >= chooser->top + rows )
+        chooser->top = chooser->selected - rows + 1;
+}
+
+/* appending to the text only ever hides entries, so the current view is
+   narrowed instead of going through every entry again */
+static void Refilter( Chooser *chooser )
+{
+    const Entry *keep = SelectedEntry( chooser );
+    int narrowing = chooser->textLen > chooser->viewText && chooser->viewText > 0;
+    size_t i, count = 0;
+
+    if ( chooser->kind == X11_SEARCH )
+    {
+        /* the index is quick enough to ask again on every key */
+        if ( chooser->snapshot )
+            count = NFDi_Index_Query( chooser->snapshot, chooser->text, &chooser->filter,
+                                      chooser->hits, SEARCH_RESULTS );
+        for ( i = 0; i < count; ++i )
+        {
+            chooser->entries[i].name = NFDi_Index_GetName( chooser->snapshot, chooser->hits[i] );
+            chooser->entries[i].dir = NFDi_Index_GetDir( chooser->snapshot, chooser->hits[i] );
+            chooser->entries[i].isDir = 0;
+            chooser->entries[i].marked = 0;
+            chooser->view[i] = i;
+        }
+        chooser->entryCount = count;
+        keep = NULL;
+    }
+    else if ( narrowing )
+    {
+        for ( i = 0; i < chooser->viewCount; ++i )
+        {
+            if ( IsVisible( chooser, &chooser->entries[chooser->view[i]] ) )
+                chooser->view[count++] = chooser->view[i];
+        }
+    }
+    else if ( ReserveView( chooser, chooser->entryCount ) )
+    {
+        for ( i = 0; i < chooser->entryCount; ++i )
+        {
+            if ( IsVisible( chooser, &chooser->entries[i] ) )
+                chooser->view[count++] = i;
+        }
+    }
+    chooser->viewCount = count;
+    chooser->viewText = chooser->textLen;
+
+    chooser->selected = count > 0 ? 0 : NO_SELECTION;
+    for ( i = 0; keep && i < count; ++i )
+    {
+        if ( &chooser->entries[chooser->view[i]] == keep )
+        {
+            chooser->selected = i;
+            break;
+        }
+    }
+    chooser->top = 0;
+    ScrollToSelection( chooser, VisibleRows( chooser ) );
+    chooser->dirty = 1;
+}
+
+static int CompareEntries( const void *a, const void *b )
+{
+    const Entry *x = (const Entry*)a;
+    const Entry *y = (const Entry*)b;
+    if ( x->isDir != y->isDir )
+        return x->isDir ? -1 : 1;
+    return strcmp( x->name, y->name );
+}
+
+/* takes over what the scanner found so far; new rows go at the bottom, so
+   nothing on screen moves until the one sort at the end */
+static void MergeScan( Chooser *chooser )
+{
+    Scan *scan = &chooser->scan;
+    size_t first = chooser->entryCount;
+    size_t i;
+    char byte;
+    int done, error;
+
+    pthread_mutex_lock( &scan->lock );
+    while ( read( scan->wakePipe[0], &byte, 1 ) == 1 )
+        ;
+    scan->woken = 0;
+    done = scan->done;
+    error = scan->error;
+
+    if ( chooser->entryCount + scan->pendingCount > chooser->entryCap )
+    {
+        size_t cap = chooser->entryCap ? chooser->entryCap : 1024;
+        Entry *grown;
+        while ( cap < chooser->entryCount + scan->pendingCount )
+            cap *= 2;
+        grown = realloc( chooser->entries, sizeof(Entry) * cap );
+        if ( grown )
+        {
+            chooser->entries = grown;
+            chooser->entryCap = cap;
+        }
+    }
+    if ( scan->pendingCount > 0 && chooser->entryCount + scan->pendingCount <= chooser->entryCap )
+    {
+        memcpy( chooser->entries + chooser->entryCount, scan->pending, sizeof(Entry) * scan->pendingCount );
+        chooser->entryCount += scan->pendingCount;
+    }
+    scan->pendingCount = 0;
+    pthread_mutex_unlock( &scan->lock );
+
+    if ( done && chooser->scanning )
+    {
+        /* names don't move, so the user's pick is found again by pointer */
+        const char *keep = chooser->moved && SelectedEntry( chooser ) ?
+                           SelectedEntry( chooser )->name : NULL;
+
+        chooser->scanning = 0;
+        chooser->scanError = error;
+
+        qsort( chooser->entries, chooser->entryCount, sizeof(Entry), CompareEntries );
+        chooser->viewText = 0;
+        chooser->selected = NO_SELECTION;
+        Refilter( chooser );
+        for ( i = 0; keep && i < chooser->viewCount; ++i )
+        {
+            if ( chooser->entries[chooser->view[i]].name == keep )
+            {
+                chooser->selected = i;
+                ScrollToSelection( chooser, VisibleRows( chooser ) );
+            }
+        }
+    }
+    else if ( ReserveView( chooser, chooser->viewCount + (chooser->entryCount - first) ) )
+    {
+        for ( i = first; i < chooser->entryCount; ++i )
+        {
+            if ( IsVisible( chooser, &chooser->entries[i] ) )
+                chooser->view[chooser->viewCount++] = i;
+        }
+        if ( chooser->selected == NO_SELECTION && chooser->viewCount > 0 )
+            chooser->selected = 0;
+    }
+
+    /* coming back up from a folder selects it */
+    if ( chooser->reselect[0] )
+    {
+        for ( i = 0; i < chooser->viewCount; ++i )
+        {
+            if ( strcmp( chooser->entries[chooser->view[i]].name, chooser->reselect ) == 0 )
+            {
+                chooser->selected = i;
+                ScrollToSelection( chooser, VisibleRows( chooser ) );
+                if ( !chooser->scanning )
+                    chooser->reselect[0] = '\0';
+                break;
+            }
+        }
+    }
+    chooser->dirty = 1;
+}
+
+/* the index has a newer snapshot, or finished catching up */
+static void MergeIndex( Chooser *chooser )
+{
+    nfdindexsnapshot_t *snapshot = NFDi_Index_GetSnapshot( chooser->index, &chooser->indexUpdating );
+
+    if ( snapshot != chooser->snapshot )
+    {
+        NFDi_Index_ReleaseSnapshot( chooser->snapshot );
+        chooser->snapshot = snapshot;
+        Refilter( chooser );
+    }
+    else
+    {
+        NFDi_Index_ReleaseSnapshot( snapshot );
+    }
+    chooser->dirty = 1;
+}
+
+static int ChangeDir( Chooser *chooser, const char *dir )
+{
+    char resolved[PATH_MAX];
+
+    if ( !realpath( dir, resolved ) )
+        return 0;
+
+    StopScan( &chooser->scan );
+    chooser->entryCount = 0;
+    chooser->viewCount = 0;
+    chooser->viewText = 0;
+    chooser->top = 0;
+    chooser->selected = NO_SELECTION;
+    chooser->moved = 0;
+    chooser->scanError = 0;
+    chooser->confirmOverwrite = 0;
+    if ( chooser->kind != X11_SAVE )
+    {
+        chooser->text[0] = '\0';
+        chooser->textLen = 0;
+    }
+    strcpy( chooser->dir, resolved );
+    chooser->dirty = 1;
+
+    chooser->scanning = StartScan( &chooser->scan, chooser->dir );
+    if ( !chooser->scanning )
+    {
+        NFDi_SetError( NO_THREAD_MSG );
+        return 0;
+    }
+    return 1;
+}
+
+static void GoToParent( Chooser *chooser )
+{
+    char parent[PATH_MAX];
+    char *slash;
+
+    if ( chooser->kind == X11_SEARCH )
+        return;
+    strcpy( parent, chooser->dir );
+    slash = strrchr( parent, '/' );
+    if ( !slash || slash[1] == '\0' )
+        return;     /* already at / */
+
+    NFDi_SafeStrncpy( chooser->reselect, slash + 1, sizeof(chooser->reselect) );
+    if ( slash == parent )
+        slash[1] = '\0';
+    else
+        slash[0] = '\0';
+    ChangeDir( chooser, parent );
+}
+
+static char *JoinPath( const char *dir, const char *name )
+{
+    size_t dirLen = strlen( dir ), nameLen = strlen( name );
+    int root = dirLen == 1;
+    char *path = NFDi_Malloc( dirLen + nameLen + 2 );
+
+    if ( path )
+    {
+        memcpy( path, dir, dirLen );
+        if ( !root )
+            path[dirLen++] = '/';
+        memcpy( path + dirLen, name, nameLen + 1 );
+    }
+    return path;
+}
+
+static char *CopyPath( const char *path )
+{
+    size_t len = strlen( path );
+    char *copy = NFDi_Malloc( len + 1 );
+
+    if ( copy )
+        memcpy( copy, path, len + 1 );
+    return copy;
+}
+
+static nfdresult_t AllocPathSet( const Chooser *chooser, nfdpathset_t *pathSet )
+{
+    const Entry *selected = SelectedEntry( chooser );
+    size_t dirLen = strlen( chooser->dir );
+    size_t bufSize = 0, count = 0, i;
+    int useMarked = 0;
+    nfdchar_t *p;
+
+    for ( i = 0; i < chooser->entryCount; ++i )
+    {
+        if ( chooser->entries[i].marked )
+        {
+            useMarked = 1;
+            ++count;
+            bufSize += dirLen + strlen( chooser->entries[i].name ) + 2;
+        }
+    }
+    if ( !useMarked )
+    {
+        count = 1;
+        bufSize = dirLen + strlen( selected->name ) + 2;
+    }
+
+    pathSet->count = count;
+    pathSet->indices = NFDi_Malloc( sizeof(size_t) * count );
+    pathSet->buf = NFDi_Malloc( sizeof(nfdchar_t) * bufSize );
+    if ( !pathSet->indices || !pathSet->buf )
+    {
+        NFDi_Free( pathSet->indices );
+        NFDi_Free( pathSet->buf );
+        return NFD_ERROR;
+    }
+
+    p = pathSet->buf;
+    count = 0;
+    for ( i = 0; i < chooser->entryCount; ++i )
+    {
+        const Entry *entry = useMarked ? &chooser->entries[i] : selected;
+        if ( useMarked && !entry->marked )
+            continue;
+        pathSet->indices[count++] = (size_t)(p - pathSet->buf);
+        p += sprintf( p, dirLen == 1 ? "%s%s" : "%s/%s", chooser->dir, entry->name ) + 1;
+        if ( !useMarked )
+            break;
+    }
+
+    NFD_PROBE2( pathset_built, pathSet->count, bufSize );
+    return NFD_OKAY;
+}
+
+/* drawing */
+
+/* UTF-8 to the font's UCS-2; anything else shows as '?' */
+static int ToChar2b( const char *str, size_t len, XChar2b *out, int max )
+{
+    const unsigned char *s = (const unsigned char*)str;
+    const unsigned char *end = s + len;
+    int n = 0;
+
+    while ( s < end && n < max )
+    {
+        unsigned int c = *s++;
+        int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+
+        if ( c >= 0x80 && c < 0xc0 )
+        {
+            c = '?';
+        }
+        else if ( c >= 0x80 )
+        {
+            c &= 0x3f >> extra;
+            for ( ; extra > 0 && s < end && (*s & 0xc0) == 0x80; --extra )
+                c = (c << 6) | (*s++ & 0x3f);
+            if ( extra > 0 || c > 0xffff )
+                c = '?';
+        }
+        out[n].byte1 = (unsigned char)(c >> 8);
+        out[n].byte2 = (unsigned char)c;
+        ++n;
+    }
+    return n;
+}
+
+static int TextWidth( const Chooser *chooser, const char *str )
+{
+    XChar2b chars[NFD_MAX_STRLEN * 2];
+    int n = ToChar2b( str, strlen( str ), chars, NFD_MAX_STRLEN * 2 );
+    return XTextWidth16( chooser->font, chars, n );
+}
+
+/* clipped to maxWidth, keeping the end of the text when keepEnd is set */
+static void DrawText( Chooser *chooser, int x, int y, const char *str, int maxWidth, int keepEnd )
+{
+    XChar2b chars[NFD_MAX_STRLEN * 2];
+    int n = ToChar2b( str, strlen( str ), chars, NFD_MAX_STRLEN * 2 );
+    int first = 0;
+
+    while ( keepEnd && first < n && XTextWidth16( chooser->font, chars + first, n - first ) > maxWidth )
+        ++first;
+    while ( !keepEnd && n > 0 && XTextWidth16( chooser->font, chars, n ) > maxWidth )
+        --n;
+    XDrawString16( chooser->display, chooser->buffer, chooser->gc,
+                   x, y + chooser->font->ascent, chars + first, n - first );
+}
+
+static void GetButtons( const Chooser *chooser, XRectangle *cancel, XRectangle *accept )
+{
+    int w = TextWidth( chooser, "Cancel" ) + PAD * 4;
+    int h = chooser->rowHeight + PAD;
+
+    accept->width = cancel->width = (unsigned short)w;
+    accept->height = cancel->height = (unsigned short)h;
+    accept->x = (short)(chooser->width - PAD - w);
+    cancel->x = (short)(accept->x - PAD - w);
+    accept->y = cancel->y = (short)(chooser->height - PAD - h);
+}
+
+static int ListTop( const Chooser *chooser )
+{
+    return PAD * 3 + chooser->rowHeight * 2;
+}
+
+static size_t VisibleRows( const Chooser *chooser )
+{
+    int h = chooser->height - ListTop( chooser ) - chooser->rowHeight - PAD * 4;
+    return h > 0 ? (size_t)(h / chooser->rowHeight) : 0;
+}
+
+static void DrawButton( Chooser *chooser, const XRectangle *rect, const char *label )
+{
+    XSetForeground( chooser->display, chooser->gc, chooser->fg );
+    XDrawRectangle( chooser->display, chooser->buffer, chooser->gc,
+                    rect->x, rect->y, rect->width, rect->height );
+    DrawText( chooser, rect->x + (rect->width - TextWidth( chooser, label )) / 2,
+              rect->y + PAD / 2, label, rect->width, 0 );
+}
+
+/* only the rows on screen, whatever the size of the folder */
+static void Draw( Chooser *chooser )
+{
+    Display *display = chooser->display;
+    size_t rows = VisibleRows( chooser );
+    int listTop = ListTop( chooser );
+    int y, labelWidth;
+    char status[64];
+    const char *label;
+    XRectangle cancel, accept;
+    size_t i;
+
+    XSetForeground( display, chooser->gc, chooser->bg );
+    XFillRectangle( display, chooser->buffer, chooser->gc, 0, 0,
+                    (unsigned)chooser->width, (unsigned)chooser->height );
+
+    /* folder, and how much of it is in */
+    if ( chooser->scanError )
+        snprintf( status, sizeof(status), "%s", strerror( chooser->scanError ) );
+    else if ( chooser->kind == X11_SEARCH && !chooser->snapshot )
+        snprintf( status, sizeof(status), "indexing..." );
+    else if ( chooser->kind == X11_SEARCH )
+        snprintf( status, sizeof(status), chooser->indexUpdating ? "%zu%s matches, indexing..." : "%zu%s matches",
+                  chooser->viewCount, chooser->viewCount == SEARCH_RESULTS ? "+" : "" );
+    else
+        snprintf( status, sizeof(status), chooser->scanning ? "%zu items..." : "%zu items",
+                  chooser->entryCount );
+    XSetForeground( display, chooser->gc, chooser->dimFg );
+    DrawText( chooser, chooser->width - PAD - TextWidth( chooser, status ), PAD, status, chooser->width, 0 );
+    XSetForeground( display, chooser->gc, chooser->fg );
+    DrawText( chooser, PAD, PAD, chooser->dir,
+              chooser->width - PAD * 3 - TextWidth( chooser, status ), 1 );
+
+    /* the text and its cursor */
+    y = PAD * 2 + chooser->rowHeight;
+    label = chooser->confirmOverwrite ? "Replace? " : chooser->kind == X11_SAVE ? "Name: " :
+            chooser->kind == X11_SEARCH ? "Search: " : "Filter: ";
+    labelWidth = TextWidth( chooser, label );
+    XSetForeground( display, chooser->gc, chooser->dimFg );
+    DrawText( chooser, PAD, y, label, chooser->width, 0 );
+    XSetForeground( display, chooser->gc, chooser->fg );
+    DrawText( chooser, PAD + labelWidth, y, chooser->text, chooser->width - PAD * 2 - labelWidth, 1 );
+    XFillRectangle( display, chooser->buffer, chooser->gc,
+                    PAD + labelWidth + TextWidth( chooser, chooser->text ) + 1, y, 2,
+                    (unsigned)chooser->rowHeight );
+
+    for ( i = 0; i < rows && chooser->top + i < chooser->viewCount; ++i )
+    {
+        size_t row = chooser->top + i;
+        const Entry *entry = &chooser->entries[chooser->view[row]];
+        int rowY = listTop + (int)i * chooser->rowHeight;
+        int x = PAD + chooser->rowHeight;
+
+        if ( row == chooser->selected )
+        {
+            XSetForeground( display, chooser->gc, chooser->selBg );
+            XFillRectangle( display, chooser->buffer, chooser->gc, 0, rowY,
+                            (unsigned)chooser->width, (unsigned)chooser->rowHeight );
+        }
+        if ( entry->marked )
+        {
+            XSetForeground( display, chooser->gc, chooser->markBg );
+            XFillRectangle( display, chooser->buffer, chooser->gc, PAD, rowY + 2,
+                            (unsigned)chooser->rowHeight - 4, (unsigned)chooser->rowHeight - 4 );
+        }
+
+        XSetForeground( display, chooser->gc, row == chooser->selected ? chooser->selFg : chooser->fg );
+        DrawText( chooser, x, rowY, entry->name, chooser->width - x - PAD * 3, 0 );
+        if ( entry->isDir )
+            DrawText( chooser, x + TextWidth( chooser, entry->name ), rowY, "/", PAD * 2, 0 );
+        if ( entry->dir )
+        {
+            /* the folder after the name, its end being the telling part */
+            int dirX = x + TextWidth( chooser, entry->name ) + PAD * 3;
+            if ( row != chooser->selected )
+                XSetForeground( display, chooser->gc, chooser->dimFg );
+            if ( dirX < chooser->width - PAD * 3 )
+                DrawText( chooser, dirX, rowY, entry->dir, chooser->width - dirX - PAD * 3, 1 );
+        }
+    }
+
+    /* scroll position */
+    if ( chooser->viewCount > rows && rows > 0 )
+    {
+        int listHeight = (int)rows * chooser->rowHeight;
+        int barHeight = (int)((long long)listHeight * rows / chooser->viewCount);
+        int barY = listTop + (int)((long long)listHeight * chooser->top / chooser->viewCount);
+        XSetForeground( display, chooser->gc, chooser->dimFg );
+        XFillRectangle( display, chooser->buffer, chooser->gc, chooser->width - PAD, barY, 3,
+                        (unsigned)(barHeight > 4 ? barHeight : 4) );
+    }
+
+    GetButtons( chooser, &cancel, &accept );
+    DrawButton( chooser, &cancel, "Cancel" );
+    DrawButton( chooser, &accept, ACCEPT_LABELS[chooser->kind] );
+
+    XCopyArea( display, chooser->buffer, chooser->window, chooser->gc, 0, 0,
+               (unsigned)chooser->width, (unsigned)chooser->height, 0, 0 );
+    chooser->dirty = 0;
+}
+
+static unsigned long GetColor( Chooser *chooser, const char *name, unsigned long fallback )
+{
+    XColor color, exact;
+    Colormap colormap = DefaultColormap( chooser->display, DefaultScreen( chooser->display ) );
+
+    if ( XAllocNamedColor( chooser->display, colormap, name, &color, &exact ) )
+        return color.pixel;
+    return fallback;
+}
+
+static void ResizeBuffer( Chooser *chooser, int width, int height )
+{
+    int screen = DefaultScreen( chooser->display );
+
+    if ( chooser->buffer )
+        XFreePixmap( chooser->display, chooser->buffer );
+    chooser->width = width > 1 ? width : 1;
+    chooser->height = height > 1 ? height : 1;
+    chooser->buffer = XCreatePixmap( chooser->display, chooser->window,
+                                     (unsigned)chooser->width, (unsigned)chooser->height,
+                                     (unsigned)DefaultDepth( chooser->display, screen ) );
+    chooser->dirty = 1;
+}
+
+static int OpenWindow( Chooser *chooser )
+{
+    Display *display;
+    int screen;
+    unsigned long black, white;
+    size_t i;
+
+    display = chooser->display = XOpenDisplay( NULL );
+    if ( !display )
+    {
+        NFDi_SetError( NO_DISPLAY_MSG );
+        return 0;
+    }
+
+    for ( i = 0; i < sizeof(FONT_NAMES) / sizeof(FONT_NAMES[0]) && !chooser->font; ++i )
+        chooser->font = XLoadQueryFont( display, FONT_NAMES[i] );
+    if ( !chooser->font )
+    {
+        NFDi_SetError( NO_FONT_MSG );
+        return 0;
+    }
+    chooser->rowHeight = chooser->font->ascent + chooser->font->descent + 2;
+
+    screen = DefaultScreen( display );
+    black = BlackPixel( display, screen );
+    white = WhitePixel( display, screen );
+    chooser->fg = black;
+    chooser->bg = white;
+    chooser->dimFg = GetColor( chooser, "gray40", black );
+    chooser->selBg = GetColor( chooser, "#3465a4", black );
+    chooser->selFg = white;
+    chooser->markBg = GetColor( chooser, "#73d216", black );
+
+    chooser->window = XCreateSimpleWindow( display, RootWindow( display, screen ), 0, 0,
+                                           640, 480, 0, black, white );
+    XStoreName( display, chooser->window, TITLES[chooser->kind] );
+    XSelectInput( display, chooser->window,
+                  ExposureMask | KeyPressMask | ButtonPressMask | StructureNotifyMask );
+    chooser->wmDelete = XInternAtom( display, "WM_DELETE_WINDOW", False );
+    XSetWMProtocols( display, chooser->window, &chooser->wmDelete, 1 );
+
+    chooser->gc = XCreateGC( display, chooser->window, 0, NULL );
+    XSetFont( display, chooser->gc, chooser->font->fid );
+    ResizeBuffer( chooser, 640, 480 );
+
+    XMapRaised( display, chooser->window );
+    XFlush( display );
+    return 1;
+}
+
+static void CloseWindow( Chooser *chooser )
+{
+    if ( !chooser->display )
+        return;
+    if ( chooser->buffer )
+        XFreePixmap( chooser->display, chooser->buffer );
+    if ( chooser->gc )
+        XFreeGC( chooser->display, chooser->gc );
+    if ( chooser->window )
+        XDestroyWindow( chooser->display, chooser->window );
+    if ( chooser->font )
+        XFreeFont( chooser->display, chooser->font );
+    XCloseDisplay( chooser->display );
+}
+
+/* input */
+
+typedef enum
+{
+    INPUT_CONTINUE,
+    INPUT_ACCEPT,
+    INPUT_CANCEL
+} inputresult_t;
+
+static void SetText( Chooser *chooser, const char *text )
+{
+    NFDi_SafeStrncpy( chooser->text, text, sizeof(chooser->text) );
+    chooser->textLen = strlen( chooser->text );
+    chooser->viewText = 0;
+    chooser->confirmOverwrite = 0;
+    Refilter( chooser );
+}
+
+static int HasMarked( const Chooser *chooser );
+
+/* Enter or a double-click; pickFolder for Ctrl+Enter and the accept button */
+static inputresult_t Activate( Chooser *chooser, int pickFolder )
+{
+    const Entry *entry = SelectedEntry( chooser );
+    char *path;
+    struct stat st;
+    int exists;
+
+    if ( chooser->kind == X11_FOLDER && pickFolder )
+        return INPUT_ACCEPT;
+    if ( chooser->kind == X11_MULTIPLE && pickFolder && HasMarked( chooser ) )
+        return INPUT_ACCEPT;
+
+    if ( chooser->kind == X11_SAVE )
+    {
+        if ( chooser->textLen == 0 )
+        {
+            if ( entry && entry->isDir )
+            {
+                path = JoinPath( chooser->dir, entry->name );
+                if ( path )
+                    ChangeDir( chooser, path );
+                NFDi_Free( path );
+            }
+            else if ( entry )
+            {
+                SetText( chooser, entry->name );
+            }
+            return INPUT_CONTINUE;
+        }
+
+        path = JoinPath( chooser->dir, chooser->text );
+        if ( !path )
+            return INPUT_CONTINUE;
+        exists = stat( path, &st ) == 0;
+        if ( exists && S_ISDIR( st.st_mode ) )
+        {
+            chooser->text[0] = '\0';
+            chooser->textLen = 0;
+            ChangeDir( chooser, path );
+            NFDi_Free( path );
+            return INPUT_CONTINUE;
+        }
+        NFDi_Free( path );
+
+        /* an existing file takes a second Enter */
+        if ( exists && !chooser->confirmOverwrite )
+        {
+            chooser->confirmOverwrite = 1;
+            chooser->dirty = 1;
+            return INPUT_CONTINUE;
+        }
+        return INPUT_ACCEPT;
+    }
+
+    if ( !entry )
+        return INPUT_CONTINUE;
+    if ( entry->isDir )
+    {
+        path = JoinPath( chooser->dir, entry->name );
+        if ( path )
+            ChangeDir( chooser, path );
+        NFDi_Free( path );
+        return INPUT_CONTINUE;
+    }
+    return INPUT_ACCEPT;
+}
+
+static int HasMarked( const Chooser *chooser )
+{
+    size_t i;
+    for ( i = 0; i < chooser->entryCount; ++i )
+    {
+        if ( chooser->entries[i].marked )
+            return 1;
+    }
+    return 0;
+}
+
+static void ToggleMark( Chooser *chooser )
+{
+    Entry *entry = (Entry*)SelectedEntry( chooser );
+    if ( chooser->kind == X11_MULTIPLE && entry && !entry->isDir )
+    {
+        entry->marked = !entry->marked;
+        chooser->dirty = 1;
+    }
+}
+
+static void MoveSelection( Chooser *chooser, long delta )
+{
+    long selected = chooser->selected >= chooser->viewCount ? 0 : (long)chooser->selected;
+
+    if ( chooser->viewCount == 0 )
+        return;
+    selected += delta;
+    if ( selected < 0 )
+        selected = 0;
+    if ( selected >= (long)chooser->viewCount )
+        selected = (long)chooser->viewCount - 1;
+    chooser->selected = (size_t)selected;
+    chooser->moved = 1;
+    ScrollToSelection( chooser, VisibleRows( chooser ) );
+    chooser->dirty = 1;
+}
+
+static inputresult_t HandleKey( Chooser *chooser, XKeyEvent *event )
+{
+    char buf[16];
+    KeySym key;
+    int len = XLookupString( event, buf, sizeof(buf), &key, NULL );
+    int ctrl = (event->state & ControlMask) != 0;
+    long page = (long)VisibleRows( chooser );
+
+    switch ( key )
+    {
+    case XK_Escape:
+        return INPUT_CANCEL;
+    case XK_Return:
+    case XK_KP_Enter:
+        return Activate( chooser, ctrl );
+    case XK_Up:
+        if ( event->state & Mod1Mask )
+            GoToParent( chooser );
+        else
+            MoveSelection( chooser, -1 );
+        return INPUT_CONTINUE;
+    case XK_Down:
+        MoveSelection( chooser, 1 );
+        return INPUT_CONTINUE;
+    case XK_Page_Up:
+        MoveSelection( chooser, -page );
+        return INPUT_CONTINUE;
+    case XK_Page_Down:
+        MoveSelection( chooser, page );
+        return INPUT_CONTINUE;
+    case XK_Home:
+        MoveSelection( chooser, -(long)chooser->viewCount );
+        return INPUT_CONTINUE;
+    case XK_End:
+        MoveSelection( chooser, (long)chooser->viewCount );
+        return INPUT_CONTINUE;
+    case XK_BackSpace:
+        if ( chooser->textLen == 0 )
+        {
+            GoToParent( chooser );
+        }
+        else
+        {
+            /* a whole UTF-8 character */
+            size_t n = chooser->textLen;
+            while ( n > 0 && (chooser->text[--n] & 0xc0) == 0x80 )
+                ;
+            chooser->text[n] = '\0';
+            chooser->textLen = n;
+            chooser->confirmOverwrite = 0;
+            Refilter( chooser );
+        }
+        return INPUT_CONTINUE;
+    case XK_space:
+        if ( chooser->kind == X11_MULTIPLE )
+        {
+            ToggleMark( chooser );
+            return INPUT_CONTINUE;
+        }
+        break;
+    case XK_h:
+        if ( ctrl && chooser->kind != X11_SEARCH )
+        {
+            chooser->showHidden = !chooser->showHidden;
+            chooser->viewText = 0;
+            Refilter( chooser );
+            return INPUT_CONTINUE;
+        }
+        break;
+    default:
+        break;
+    }
+
+    /* XLookupString gives Latin-1, the text is UTF-8 */
+    if ( len == 1 && !ctrl && (unsigned char)buf[0] >= 0x20 && buf[0] != 0x7f && buf[0] != '/' )
+    {
+        unsigned char c = (unsigned char)buf[0];
+        if ( chooser->textLen + 3 > sizeof(chooser->text) )
+            return INPUT_CONTINUE;
+        if ( c < 0x80 )
+        {
+            chooser->text[chooser->textLen++] = (char)c;
+        }
+        else
+        {
+            chooser->text[chooser->textLen++] = (char)(0xc0 | (c >> 6));
+            chooser->text[chooser->textLen++] = (char)(0x80 | (c & 0x3f));
+        }
+        chooser->text[chooser->textLen] = '\0';
+        chooser->confirmOverwrite = 0;
+        Refilter( chooser );
+    }
+    return INPUT_CONTINUE;
+}
+
+static inputresult_t HandleButton( Chooser *chooser, XButtonEvent *event )
+{
+    XRectangle cancel, accept;
+    int listTop = ListTop( chooser );
+    size_t rows = VisibleRows( chooser );
+    size_t row;
+
+    if ( event->button == Button4 || event->button == Button5 )
+    {
+        if ( event->button == Button4 )
+            chooser->top = chooser->top > WHEEL_ROWS ? chooser->top - WHEEL_ROWS : 0;
+        else if ( chooser->top + rows < chooser->viewCount )
+            chooser->top += WHEEL_ROWS;
+        chooser->dirty = 1;
+        return INPUT_CONTINUE;
+    }
+    if ( event->button != Button1 )
+        return INPUT_CONTINUE;
+
+    GetButtons( chooser, &cancel, &accept );
+    if ( event->y >= cancel.y && event->y < cancel.y + cancel.height )
+    {
+        if ( event->x >= cancel.x && event->x < cancel.x + cancel.width )
+            return INPUT_CANCEL;
+        if ( event->x >= accept.x && event->x < accept.x + accept.width )
+            return Activate( chooser, 1 );
+    }
+
+    if ( event->y < listTop || event->y >= listTop + (int)rows * chooser->rowHeight )
+        return INPUT_CONTINUE;
+    row = chooser->top + (size_t)((event->y - listTop) / chooser->rowHeight);
+    if ( row >= chooser->viewCount )
+        return INPUT_CONTINUE;
+
+    chooser->selected = row;
+    chooser->moved = 1;
+    chooser->dirty = 1;
+    if ( event->state & ControlMask )
+    {
+        ToggleMark( chooser );
+        return INPUT_CONTINUE;
+    }
+    if ( row == chooser->lastClickRow && event->time - chooser->lastClick < DOUBLE_CLICK_MS )
+    {
+        chooser->lastClick = 0;
+        return Activate( chooser, 0 );
+    }
+    chooser->lastClick = event->time;
+    chooser->lastClickRow = row;
+    return INPUT_CONTINUE;
+}
+
+static inputresult_t HandleEvent( Chooser *chooser, XEvent *event )
+{
+    switch ( event->type )
+    {
+    case Expose:
+        chooser->dirty = 1;
+        break;
+    case ConfigureNotify:
+        if ( event->xconfigure.width != chooser->width || event->xconfigure.height != chooser->height )
+            ResizeBuffer( chooser, event->xconfigure.width, event->xconfigure.height );
+        break;
+    case KeyPress:
+        return HandleKey( chooser, &event->xkey );
+    case ButtonPress:
+        return HandleButton( chooser, &event->xbutton );
+    case ClientMessage:
+        if ( (Atom)event->xclient.data.l[0] == chooser->wmDelete )
+            return INPUT_CANCEL;
+        break;
+    default:
+        break;
+    }
+    return INPUT_CONTINUE;
+}
+
+/* the X connection, the scan, NFD_Cancel and the timeout in one poll */
+static inputresult_t RunChooser( Chooser *chooser, nfdrequest_t *request )
+{
+    int cancelFd = NFDi_Request_GetCancelFd( request );
+    unsigned int timeout = NFDi_Request_GetTimeout( request );
+    long long deadline = timeout > 0 ? NFDi_NowMs() + timeout : 0;
+
+    if ( NFDi_Request_IsCancelled( request ) )
+        return INPUT_CANCEL;
+
+    while ( 1 )
+    {
+        struct pollfd fds[3];
+        nfds_t count = 0;
+        int wait = -1;
+
+        while ( XPending( chooser->display ) )
+        {
+            XEvent event;
+            inputresult_t result;
+
+            XNextEvent( chooser->display, &event );
+            result = HandleEvent( chooser, &event );
+            if ( result != INPUT_CONTINUE )
+                return result;
+        }
+        if ( chooser->dirty )
+            Draw( chooser );
+        XFlush( chooser->display );
+
+        fds[count].fd = ConnectionNumber( chooser->display );
+        fds[count++].events = POLLIN;
+        fds[count].fd = chooser->scanning ? chooser->scan.wakePipe[0] :
+                        chooser->index ? NFDi_Index_GetWakeFd( chooser->index ) : -1;
+        fds[count++].events = POLLIN;
+        fds[count].fd = cancelFd;
+        fds[count++].events = POLLIN;
+
+        if ( deadline )
+        {
+            long long left = deadline - NFDi_NowMs();
+            if ( left <= 0 )
+                return INPUT_CANCEL;
+            wait = (int)left;
+        }
+
+        if ( poll( fds, count, wait ) < 0 && errno != EINTR )
+            return INPUT_CANCEL;
+        if ( fds[2].revents & POLLIN )
+            return INPUT_CANCEL;
+        if ( (fds[1].revents & POLLIN) && chooser->index )
+            MergeIndex( chooser );
+        else if ( fds[1].revents & POLLIN )
+            MergeScan( chooser );
+    }
+}
+
+static nfdresult_t X11Dialog( x11dialog_t kind,
+                              const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              const nfdchar_t *const *roots,
+                              nfdchar_t **outPath,
+                              nfdpathset_t *outPaths,
+                              nfdrequest_t *request )
+{
+    Chooser *chooser;
+    nfdresult_t result = NFD_ERROR;
+    inputresult_t input;
+    char cwd[PATH_MAX];
+
+    chooser = NFDi_Malloc( sizeof(Chooser) );
+    if ( !chooser )
+        return NFD_ERROR;
+    memset( chooser, 0, sizeof(Chooser) );
+    chooser->kind = kind;
+
+    if ( !NFDi_Filter_Parse( &chooser->filter, kind == X11_FOLDER ? NULL : filterList ) )
+    {
+        NFDi_Free( chooser );
+        return NFD_ERROR;
+    }
+
+    if ( kind == X11_SEARCH )
+    {
+        size_t i, len = 0;
+
+        chooser->index = NFDi_Index_Acquire( roots );
+        chooser->entries = malloc( sizeof(Entry) * SEARCH_RESULTS );
+        chooser->view = malloc( sizeof(size_t) * SEARCH_RESULTS );
+        chooser->hits = malloc( sizeof(uint32_t) * SEARCH_RESULTS );
+        if ( !chooser->index )
+            goto done;
+        if ( !chooser->entries || !chooser->view || !chooser->hits )
+        {
+            NFDi_SetError( "NFDi_Malloc failed." );
+            goto done;
+        }
+        chooser->entryCap = chooser->viewCap = SEARCH_RESULTS;
+
+        /* the roots stand in for the folder at the top */
+        for ( i = 0; roots[i] && len + 2 < sizeof(chooser->dir); ++i )
+            len += (size_t)snprintf( chooser->dir + len, sizeof(chooser->dir) - len,
+                                     i > 0 ? ", %s" : "%s", roots[i] );
+        chooser->indexUpdating = 1;
+    }
+
+    if ( !OpenWindow( chooser ) )
+        goto done;
+
+    if ( kind == X11_SEARCH )
+        MergeIndex( chooser );
+    else if ( !(defaultPath && defaultPath[0] && ChangeDir( chooser, defaultPath )) &&
+         !(getcwd( cwd, sizeof(cwd) ) && ChangeDir( chooser, cwd )) &&
+         !ChangeDir( chooser, "/" ) )
+        goto done;
+
+    NFD_PROBE1( dialog_shown, "x11" );
+    input = RunChooser( chooser, request );
+
+    result = NFD_CANCEL;
+    if ( input == INPUT_ACCEPT )
+    {
+        const Entry *entry = SelectedEntry( chooser );
+
+        if ( kind == X11_MULTIPLE )
+            result = AllocPathSet( chooser, outPaths );
+        else if ( kind == X11_SAVE )
+            *outPath = JoinPath( chooser->dir, chooser->text );
+        else if ( kind == X11_FOLDER && entry && chooser->textLen > 0 )
+            *outPath = JoinPath( chooser->dir, entry->name );
+        else if ( kind == X11_FOLDER )
+            *outPath = CopyPath( chooser->dir );
+        else if ( kind == X11_SEARCH )
+            *outPath = JoinPath( entry->dir, entry->name );
+        else
+            *outPath = JoinPath( chooser->dir, entry->name );
+
+        if ( kind != X11_MULTIPLE )
+            result = *outPath ? NFD_OKAY : NFD_ERROR;
+    }
+    NFD_PROBE2( dialog_closed, "x11", result );
+
+done:
+    StopScan( &chooser->scan );
+    CloseWindow( chooser );
+    NFDi_Filter_Free( &chooser->filter );
+    NFDi_Index_ReleaseSnapshot( chooser->snapshot );
+    if ( chooser->index )
+        NFDi_Index_Release( chooser->index );
+    free( chooser->entries );
+    free( chooser->view );
+    free( chooser->hits );
+    NFDi_Free( chooser );
+    return result;
+}
+
+/* public */
+
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = X11Dialog( X11_OPEN, filterList, defaultPath, NULL, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
+{
+    nfdresult_t result = X11Dialog( X11_MULTIPLE, filterList, defaultPath, NULL, NULL, outPaths, request );
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
+}
+
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    return X11Dialog( X11_SAVE, filterList, defaultPath, NULL, outPath, NULL, request );
+}
+
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = X11Dialog( X11_FOLDER, NULL, defaultPath, NULL, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    nfdresult_t result = X11Dialog( X11_SEARCH, filterList, NULL, roots, outPath, NULL, request );
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
+}
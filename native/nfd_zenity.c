@@ -4,11 +4,21 @@
   http://www.frogtoss.com/labs
 */
 
+/* pipe2, for simple_exec.h */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 #include "nfd.h"
 #include "nfd_common.h"
+#include "nfd_probes.h"
 
 #define SIMPLE_EXEC_IMPLEMENTATION
 #include "simple_exec.h"
@@ -17,16 +27,16 @@
 const char NO_ZENITY_MSG[] = "zenity not installed";
 
 
-static void AddTypeToFilterName( const char *typebuf, char *filterName, size_t bufsize )
+static void AddTypeToFilterName( const char *pattern, char *filterName, size_t bufsize )
 {
     size_t len = strlen(filterName);
     if( len > 0 )
-        strncat( filterName, " *.", bufsize - len - 1 );
+        strncat( filterName, " ", bufsize - len - 1 );
     else
-        strncat( filterName, "--file-filter=*.", bufsize - len - 1 );
+        strncat( filterName, "--file-filter=", bufsize - len - 1 );
     
     len = strlen(filterName);
-    strncat( filterName, typebuf, bufsize - len - 1 );
+    strncat( filterName, pattern, bufsize - len - 1 );
 }
 
 static void AddFiltersToCommandArgs(char** commandArgs, int commandArgsLen, const char *filterList )
@@ -50,9 +60,10 @@ static void AddFiltersToCommandArgs(char** commandArgs, int commandArgsLen, cons
             assert( strlen(typebuf) > 0 );
             assert( strlen(typebuf) < NFD_MAX_STRLEN-1 );
             
-            snprintf( typebufWildcard, NFD_MAX_STRLEN, "*.%s", typebuf );
+            /* zenity takes globs as they are */
+            NFDi_FilterTypeToPattern( typebuf, typebufWildcard, NFD_MAX_STRLEN );
 
-            AddTypeToFilterName( typebuf, filterName, NFD_MAX_STRLEN );
+            AddTypeToFilterName( typebufWildcard, filterName, NFD_MAX_STRLEN );
             
             p_typebuf = typebuf;
             memset( typebuf, 0, sizeof(char) * NFD_MAX_STRLEN );
@@ -88,7 +99,7 @@ static void AddFiltersToCommandArgs(char** commandArgs, int commandArgsLen, cons
     commandArgs[i] = strdup("--file-filter=*.*");
 }
 
-static nfdresult_t ZenityCommon(char** command, int commandLen, const char* defaultPath, const char* filterList, char** stdOut)
+static nfdresult_t ZenityCommon(char** command, int commandLen, const char* defaultPath, const char* filterList, char** stdOut, nfdrequest_t* request)
 {
     if(defaultPath != NULL)
     {
@@ -109,7 +120,15 @@ static nfdresult_t ZenityCommon(char** command, int commandLen, const char* defa
 
     int byteCount = 0;
     int exitCode = 0;
-    int processInvokeError = runCommandArray(stdOut, &byteCount, &exitCode, 0, command);
+    int processInvokeError = COMMAND_CANCELLED;
+    if(!NFDi_Request_IsCancelled(request))
+    {
+        NFD_PROBE1(dialog_shown, "zenity");
+        processInvokeError = runCommandArrayCancellable(stdOut, &byteCount, &exitCode, 0, command,
+                                                        NFDi_Request_GetCancelFd(request),
+                                                        (int)NFDi_Request_GetTimeout(request));
+        NFD_PROBE2(dialog_closed, "zenity", processInvokeError == COMMAND_RAN_OK ? exitCode : -1);
+    }
 
     for(int i = 0; command[i] != NULL && i < commandLen; i++)
         free(command[i]);
@@ -121,10 +140,32 @@ static nfdresult_t ZenityCommon(char** command, int commandLen, const char* defa
         NFDi_SetError(NO_ZENITY_MSG);
         result = NFD_ERROR;
     }
+    else if(processInvokeError == COMMAND_FAILED)
+    {
+        NFDi_SetError("Failed to run zenity.");
+        result = NFD_ERROR;
+    }
+    else if(processInvokeError == COMMAND_CANCELLED)
+    {
+        result = NFD_CANCEL;
+    }
     else
     {
         if(exitCode == 1)
             result = NFD_CANCEL;
+        else if(exitCode != 0 || *stdOut == NULL || (*stdOut)[0] == '\0')
+        {
+            // e.g. 127 from a zenity wrapper script that couldn't run it
+            NFDi_SetError("zenity failed.");
+            result = NFD_ERROR;
+        }
+    }
+
+    // nothing useful was printed, don't hand an empty string to the callers
+    if(result != NFD_OKAY && *stdOut != NULL)
+    {
+        free(*stdOut);
+        *stdOut = NULL;
     }
 
     return result;
@@ -171,16 +212,18 @@ static nfdresult_t AllocPathSet(char* zenityList, nfdpathset_t *pathSet )
             pathSet->indices[entry] = i + 1;
         }
     }
-    
+
+    NFD_PROBE2(pathset_built, pathSet->count, len);
     return NFD_OKAY;
 }
                                  
 /* public */
 
-nfdresult_t NFD_OpenDialog( const char *filterList,
-                            const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath )
-{    
+nfdresult_t NFD_OpenDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
     int commandLen = 100;
     char* command[commandLen];
     memset(command, 0, commandLen * sizeof(char*));
@@ -190,7 +233,7 @@ nfdresult_t NFD_OpenDialog( const char *filterList,
     command[2] = strdup("--title=Open File");
 
     char* stdOut = NULL;
-    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut);
+    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut, request);
             
     if(stdOut != NULL)
     {
@@ -205,13 +248,14 @@ nfdresult_t NFD_OpenDialog( const char *filterList,
         *outPath = NULL;
     }
 
-    return result;
+    return NFDi_Request_FinishPath( request, result, outPath );
 }
 
 
-nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
-                                    const nfdchar_t *defaultPath,
-                                    nfdpathset_t *outPaths )
+nfdresult_t NFD_OpenDialogMultipleEx( const nfdchar_t *filterList,
+                                      const nfdchar_t *defaultPath,
+                                      nfdpathset_t *outPaths,
+                                      nfdrequest_t *request )
 {
     int commandLen = 100;
     char* command[commandLen];
@@ -223,7 +267,7 @@ nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
     command[3] = strdup("--multiple");
 
     char* stdOut = NULL;
-    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut);
+    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut, request);
             
     if(stdOut != NULL)
     {
@@ -235,17 +279,18 @@ nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
 
         free(stdOut);
     }
-    else
+    else if ( result == NFD_OKAY )
     {
         result = NFD_ERROR;
     }
 
-    return result;
+    return NFDi_Request_FinishPathSet( request, result, outPaths );
 }
 
-nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
-                            const nfdchar_t *defaultPath,
-                            nfdchar_t **outPath )
+nfdresult_t NFD_SaveDialogEx( const nfdchar_t *filterList,
+                              const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
 {
     int commandLen = 100;
     char* command[commandLen];
@@ -257,7 +302,7 @@ nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
     command[3] = strdup("--save");
 
     char* stdOut = NULL;
-    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut);
+    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, filterList, &stdOut, request);
             
     if(stdOut != NULL)
     {
@@ -275,8 +320,9 @@ nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
     return result;
 }
 
-nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
-    nfdchar_t **outPath)
+nfdresult_t NFD_PickFolderEx( const nfdchar_t *defaultPath,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
 {
     int commandLen = 100;
     char* command[commandLen];
@@ -288,7 +334,7 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
     command[3] = strdup("--title=Select folder");
 
     char* stdOut = NULL;
-    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, "", &stdOut);
+    nfdresult_t result = ZenityCommon(command, commandLen, defaultPath, "", &stdOut, request);
             
     if(stdOut != NULL)
     {
@@ -303,5 +349,72 @@ nfdresult_t NFD_PickFolder(const nfdchar_t *defaultPath,
         *outPath = NULL;
     }
 
-    return result;
+    return NFDi_Request_FinishPath( request, result, outPath );
+}
+
+/* libnfd_zenity.so loads whether or not zenity is installed, so look for
+   it the way execvp will */
+int NFDi_Backend_Probe( void )
+{
+    const char *path = getenv( "PATH" );
+    const char *end;
+    char candidate[PATH_MAX];
+    struct stat st;
+    size_t len;
+
+    if ( !path || !*path )
+        path = "/bin:/usr/bin";
+    for ( ;; path = end + 1 )
+    {
+        end = strchr( path, ':' );
+        len = end ? (size_t)(end - path) : strlen( path );
+        /* an empty entry is the current directory */
+        if ( snprintf( candidate, sizeof(candidate), "%.*s%szenity",
+                       (int)len, path, len ? "/" : "" ) < (int)sizeof(candidate) &&
+             stat( candidate, &st ) == 0 && S_ISREG( st.st_mode ) &&
+             access( candidate, X_OK ) == 0 )
+            return 1;
+        if ( !end )
+            return 0;
+    }
+}
+
+nfdresult_t NFD_OpenDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_OpenDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_OpenDialogMultiple( const nfdchar_t *filterList,
+                                    const nfdchar_t *defaultPath,
+                                    nfdpathset_t *outPaths )
+{
+    return NFD_OpenDialogMultipleEx( filterList, defaultPath, outPaths, NULL );
+}
+
+nfdresult_t NFD_SaveDialog( const nfdchar_t *filterList,
+                            const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_SaveDialogEx( filterList, defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_PickFolder( const nfdchar_t *defaultPath,
+                            nfdchar_t **outPath )
+{
+    return NFD_PickFolderEx( defaultPath, outPath, NULL );
+}
+
+nfdresult_t NFD_SearchDialog( const nfdchar_t *const *roots,
+                              const nfdchar_t *filterList,
+                              nfdchar_t **outPath,
+                              nfdrequest_t *request )
+{
+    _NFD_UNUSED(roots);
+    _NFD_UNUSED(filterList);
+    _NFD_UNUSED(outPath);
+    _NFD_UNUSED(request);
+    NFDi_SetError("NFD_SearchDialog is not supported by the zenity backend.");
+    return NFD_ERROR;
 }
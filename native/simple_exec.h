@@ -14,6 +14,11 @@
 
 int runCommand(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* command, ...);
 int runCommandArray(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* const* allArgs);
+// like runCommandArray, but the child is killed and COMMAND_CANCELLED returned once cancelFd
+// becomes readable or timeoutMs elapses (-1 and 0 disable them)
+// none of these abort the host: a failed pipe, fork or read returns COMMAND_FAILED, and the
+// child inherits nothing but its stdin, stdout and stderr
+int runCommandArrayCancellable(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* const* allArgs, int cancelFd, int timeoutMs);
 
 #endif // SIMPLE_EXEC_H
 
@@ -27,8 +32,19 @@ int runCommandArray(char** stdOut, int* stdOutByteCount, int* returnCode, int in
 #include <sys/wait.h>
 #include <stdarg.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
-#define release_assert(exp) { if (!(exp)) { abort(); } }
+#include "nfd_probes.h"
+
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
 
 enum PIPE_FILE_DESCRIPTORS
 {
@@ -39,10 +55,67 @@ enum PIPE_FILE_DESCRIPTORS
 enum RUN_COMMAND_ERROR
 {
     COMMAND_RAN_OK = 0,
-    COMMAND_NOT_FOUND = 1
+    COMMAND_NOT_FOUND = 1,
+    COMMAND_CANCELLED = 2,
+    COMMAND_FAILED = 3
+};
+
+// what the child writes to errPipe before giving up, the parent reads EOF once exec worked
+enum CHILD_ERROR
+{
+    CHILD_EXEC_FAILED = 1,
+    CHILD_SETUP_FAILED = 2
 };
 
+static long long simpleExecNowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+// every descriptor is created close-on-exec, so a host with thousands of sockets open doesn't
+// hand them all to the child
+static int simpleExecPipe(int fds[2])
+{
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if(pipe(fds) != 0)
+        return -1;
+    fcntl(fds[READ_FD], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[WRITE_FD], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+static void simpleExecClose(int* fd)
+{
+    if(*fd >= 0)
+    {
+        close(*fd);
+        *fd = -1;
+    }
+}
+
+// in the child: anything above stderr that the host opened without O_CLOEXEC is marked so
+// exec drops it.  One close_range call on Linux 5.11+, otherwise one fcntl per descriptor
+static void simpleExecCloseOnExecFrom(int lowFd, long maxFd)
+{
+#if defined(__linux__) && defined(SYS_close_range)
+    if(syscall(SYS_close_range, (unsigned int)lowFd, ~0U, CLOSE_RANGE_CLOEXEC) == 0)
+        return;
+#endif
+    for(long fd = lowFd; fd < maxFd; fd++)
+        fcntl((int)fd, F_SETFD, FD_CLOEXEC);
+}
+
 int runCommandArray(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* const* allArgs)
+{
+    return runCommandArrayCancellable(stdOut, stdOutByteCount, returnCode, includeStdErr, allArgs, -1, 0);
+}
+
+int runCommandArrayCancellable(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* const* allArgs, int cancelFd, int timeoutMs)
 {
     // adapted from: https://stackoverflow.com/a/479103
 
@@ -54,120 +127,174 @@ int runCommandArray(char** stdOut, int* stdOutByteCount, int* returnCode, int in
     int dataReadFromChildUsed = 0;
     char* dataReadFromChild = (char*)malloc(dataReadFromChildSize);
 
-
-    int parentToChild[2];
-    release_assert(pipe(parentToChild) == 0);
-
-    int childToParent[2];
-    release_assert(pipe(childToParent) == 0);
-
-    int errPipe[2];
-    release_assert(pipe(errPipe) == 0);
+    int parentToChild[2] = { -1, -1 };
+    int childToParent[2] = { -1, -1 };
+    int errPipe[2] = { -1, -1 };
+    int devNull = -1;
+    int result = COMMAND_FAILED;
+
+    // only the fallback needs it, but sysconf isn't safe to call after fork
+    long maxFd = sysconf(_SC_OPEN_MAX);
+    if(maxFd < 0)
+        maxFd = 1024;
+
+    if(dataReadFromChild == NULL ||
+       simpleExecPipe(parentToChild) != 0 ||
+       simpleExecPipe(childToParent) != 0 ||
+       simpleExecPipe(errPipe) != 0 ||
+       (!includeStdErr && (devNull = open("/dev/null", O_WRONLY | O_CLOEXEC)) < 0))
+    {
+        goto cleanup;
+    }
 
     pid_t pid;
     switch( pid = fork() )
     {
         case -1:
         {
-            release_assert(0 && "Fork failed");
-            break;
+            goto cleanup;
         }
 
         case 0: // child
         {
-            release_assert(dup2(parentToChild[READ_FD ], STDIN_FILENO ) != -1);
-            release_assert(dup2(childToParent[WRITE_FD], STDOUT_FILENO) != -1);
-            
-            if(includeStdErr)
+            // dup2 clears close-on-exec on the copies, so only these three survive exec
+            char err = CHILD_SETUP_FAILED;
+            if(dup2(parentToChild[READ_FD ], STDIN_FILENO ) != -1 &&
+               dup2(childToParent[WRITE_FD], STDOUT_FILENO) != -1 &&
+               dup2(includeStdErr ? childToParent[WRITE_FD] : devNull, STDERR_FILENO) != -1)
             {
-                release_assert(dup2(childToParent[WRITE_FD], STDERR_FILENO) != -1);
-            }
-            else
-            {
-                int devNull = open("/dev/null", O_WRONLY);
-                release_assert(dup2(devNull, STDERR_FILENO) != -1);
+                simpleExecCloseOnExecFrom(STDERR_FILENO + 1, maxFd);
+
+                const char* command = allArgs[0];
+                execvp(command, allArgs);
+                err = CHILD_EXEC_FAILED;
             }
 
-            // unused
-            release_assert(close(parentToChild[WRITE_FD]) == 0);
-            release_assert(close(childToParent[READ_FD ]) == 0);
-            release_assert(close(errPipe[READ_FD]) == 0);
-            
-            const char* command = allArgs[0];
-            execvp(command, allArgs);
-
-            char err = 1;
-            ssize_t result = write(errPipe[WRITE_FD], &err, 1);
-            release_assert(result != -1);
-            
-            close(errPipe[WRITE_FD]);
-            close(parentToChild[READ_FD]);
-            close(childToParent[WRITE_FD]);
-
-            exit(0);
+            ssize_t written = write(errPipe[WRITE_FD], &err, 1);
+            (void)written;
+
+            // never run the host's atexit handlers or flush its stdio buffers from here
+            _exit(127);
         }
 
 
         default: // parent
         {
+            NFD_PROBE2(spawn, pid, allArgs[0]);
+
             // unused
-            release_assert(close(parentToChild[READ_FD]) == 0);
-            release_assert(close(childToParent[WRITE_FD]) == 0);
-            release_assert(close(errPipe[WRITE_FD]) == 0);
+            simpleExecClose(&parentToChild[READ_FD]);
+            simpleExecClose(&childToParent[WRITE_FD]);
+            simpleExecClose(&errPipe[WRITE_FD]);
+            simpleExecClose(&devNull);
+
+            long long deadline = timeoutMs > 0 ? simpleExecNowMs() + timeoutMs : 0;
 
             while(1)
             {
+                if(cancelFd >= 0 || deadline)
+                {
+                    struct pollfd fds[2];
+                    int remaining = -1;
+                    int ready;
+
+                    fds[0].fd = childToParent[READ_FD];
+                    fds[0].events = POLLIN;
+                    fds[1].fd = cancelFd;
+                    fds[1].events = POLLIN;
+
+                    if(deadline)
+                    {
+                        long long left = deadline - simpleExecNowMs();
+                        remaining = left > 0 ? (int)left : 0;
+                    }
+
+                    ready = poll(fds, cancelFd >= 0 ? 2 : 1, remaining);
+                    if(ready == -1 && errno == EINTR)
+                        continue;
+
+                    if(ready == 0 || (cancelFd >= 0 && (fds[1].revents & POLLIN)))
+                    {
+                        // cancelled or timed out -- kill the child and reap it so no zombie is left
+                        kill(pid, SIGKILL);
+                        waitpid(pid, NULL, 0);
+                        NFD_PROBE3(child_exit, pid, -1, dataReadFromChildUsed);
+                        result = COMMAND_CANCELLED;
+                        goto cleanup;
+                    }
+                }
+
                 ssize_t bytesRead = 0;
                 switch(bytesRead = read(childToParent[READ_FD], buffer, bufferSize))
                 {
                     case 0: // End-of-File, or non-blocking read.
                     {
                         int status = 0;
-                        release_assert(waitpid(pid, &status, 0) == pid);
-
-                        // done with these now
-                        release_assert(close(parentToChild[WRITE_FD]) == 0);
-                        release_assert(close(childToParent[READ_FD]) == 0);
+                        while(waitpid(pid, &status, 0) == -1)
+                        {
+                            if(errno != EINTR)
+                                goto cleanup;
+                        }
+                        NFD_PROBE3(child_exit, pid, status, dataReadFromChildUsed);
 
                         char errChar = 0;
-                        ssize_t result = read(errPipe[READ_FD], &errChar, 1);
-                        release_assert(result != -1);
-                        close(errPipe[READ_FD]);
+                        ssize_t errRead;
+                        do
+                        {
+                            errRead = read(errPipe[READ_FD], &errChar, 1);
+                        } while(errRead == -1 && errno == EINTR);
 
-                        if(errChar)
+                        if(errRead == -1 || errChar == CHILD_SETUP_FAILED)
+                            goto cleanup;
+                        if(errChar == CHILD_EXEC_FAILED)
                         {
-                            free(dataReadFromChild); 
-                            return COMMAND_NOT_FOUND;
+                            result = COMMAND_NOT_FOUND;
+                            goto cleanup;
                         }
                         
                         // free any un-needed memory with realloc + add a null terminator for convenience
-                        dataReadFromChild = (char*)realloc(dataReadFromChild, dataReadFromChildUsed + 1);
+                        char* shrunk = (char*)realloc(dataReadFromChild, dataReadFromChildUsed + 1);
+                        if(shrunk != NULL)
+                            dataReadFromChild = shrunk;
                         dataReadFromChild[dataReadFromChildUsed] = '\0';
                         
                         if(stdOut != NULL)
+                        {
                             *stdOut = dataReadFromChild;
-                        else
-                            free(dataReadFromChild);
+                            dataReadFromChild = NULL;
+                        }
 
                         if(stdOutByteCount != NULL)
                             *stdOutByteCount = dataReadFromChildUsed;
                         if(returnCode != NULL)
                             *returnCode = WEXITSTATUS(status);
 
-                        return COMMAND_RAN_OK;
+                        result = COMMAND_RAN_OK;
+                        goto cleanup;
                     }
                     case -1:
                     {
-                        release_assert(0 && "read() failed");
-                        break;
+                        if(errno == EINTR)
+                            break;
+
+                        kill(pid, SIGKILL);
+                        waitpid(pid, NULL, 0);
+                        goto cleanup;
                     }
 
                     default:
                     {
                         if(dataReadFromChildUsed + bytesRead + 1 >= dataReadFromChildSize)
                         {
+                            char* grown = (char*)realloc(dataReadFromChild, dataReadFromChildSize + dataReadFromChildDefaultSize);
+                            if(grown == NULL)
+                            {
+                                kill(pid, SIGKILL);
+                                waitpid(pid, NULL, 0);
+                                goto cleanup;
+                            }
+                            dataReadFromChild = grown;
                             dataReadFromChildSize += dataReadFromChildDefaultSize;
-                            dataReadFromChild = (char*)realloc(dataReadFromChild, dataReadFromChildSize);
                         }
 
                         memcpy(dataReadFromChild + dataReadFromChildUsed, buffer, bytesRead);
@@ -178,6 +305,17 @@ int runCommandArray(char** stdOut, int* stdOutByteCount, int* returnCode, int in
             }
         }
     }
+
+cleanup:
+    simpleExecClose(&parentToChild[READ_FD]);
+    simpleExecClose(&parentToChild[WRITE_FD]);
+    simpleExecClose(&childToParent[READ_FD]);
+    simpleExecClose(&childToParent[WRITE_FD]);
+    simpleExecClose(&errPipe[READ_FD]);
+    simpleExecClose(&errPipe[WRITE_FD]);
+    simpleExecClose(&devNull);
+    free(dataReadFromChild);
+    return result;
 }
 
 int runCommand(char** stdOut, int* stdOutByteCount, int* returnCode, int includeStdErr, char* command, ...)
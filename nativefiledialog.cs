@@ -26,8 +26,15 @@
 
 #region Using Statements
 using System;
+using System.Collections;
+using System.Collections.Generic;
+#if NETSTANDARD2_1 || NETCOREAPP
+using System.Buffers;
+#endif
 using System.Runtime.InteropServices;
 using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
 #endregion
 
 public static class nativefiledialog
@@ -110,16 +117,14 @@ public static class nativefiledialog
 		string result = new string(chars, 0, strLen);
 #endif
 
-		/* Some SDL functions will malloc, we have to free! */
+		/* Some NFD functions will malloc, we have to free! */
 		if (freePtr)
 		{
-			free(s);
+			INTERNAL_NFD_Free(s);
 		}
 		return result;
 	}
 
-	[DllImport("msvcrt", CallingConvention = CallingConvention.Cdecl)]
-	private static extern void free(IntPtr ptr);
 
 	#endregion
 
@@ -135,141 +140,2273 @@ public static class nativefiledialog
 	[StructLayout(LayoutKind.Sequential)]
 	public struct nfdpathset_t
 	{
-		IntPtr buf; /* nfdchar_t* */
-		IntPtr indices; /* size_t* */
-		IntPtr count; /* size_t */
+		internal IntPtr buf; /* nfdchar_t* */
+		internal IntPtr indices; /* size_t* */
+		internal IntPtr count; /* size_t */
+	}
+
+	public const uint NFD_MAP_POPULATE = 0x1;
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct nfdmapping_t
+	{
+		public IntPtr data; /* const void*, IntPtr.Zero for an empty file */
+		public IntPtr length; /* size_t */
+
+#if NETSTANDARD2_1 || NETCOREAPP
+		/* Throws OverflowException for files of 2 GiB and up */
+		public unsafe ReadOnlySpan<byte> Span
+		{
+			get
+			{
+				return new ReadOnlySpan<byte>(
+					(void*) data,
+					checked((int) (long) length)
+				);
+			}
+		}
+#endif
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct nfdscanoptions_t
+	{
+		public uint maxDepth; /* 1 for the chosen folder only, 0 for no limit */
+		public IntPtr maxCount; /* size_t, 0 for no limit */
+		public IntPtr progress; /* nfdscanprogress_t, may be IntPtr.Zero */
+		public IntPtr userdata;
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct nfdeventresult_t
+	{
+		public nfdresult_t result;
+		internal IntPtr outPath; /* nfdchar_t* */
+		internal nfdpathset_t outPaths;
+		internal IntPtr error; /* char*, set on NFD_ERROR */
+	}
+
+	/* Flags for NFD_Request_SetFlags */
+	public const uint NFD_REQUEST_PATHINFO =	0x1;
+	public const uint NFD_REQUEST_READAHEAD =	0x2;
+	public const uint NFD_REQUEST_PREVIEW =		0x4;
+
+	public enum nfdfiletype_t
+	{
+		NFD_FILETYPE_UNKNOWN,
+		NFD_FILETYPE_REGULAR,
+		NFD_FILETYPE_DIRECTORY,
+		NFD_FILETYPE_OTHER
+	}
+
+	[StructLayout(LayoutKind.Sequential)]
+	public struct nfdpathinfo_t
+	{
+		public ulong size;
+		public long mtime; /* Seconds since the Unix epoch */
+		public ulong inode;
+		public ulong device;
+		public nfdfiletype_t type;
+		public int error; /* errno, 0 if the above are valid */
 	}
 
 	#endregion
 
-	#region Entry Points
+	#region Native Imports
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialog", CallingConvention = CallingConvention.Cdecl)]
-	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialog(
+	/* Every import is blittable: pointers instead of out/ref parameters, so
+	 * no marshaling stub has to pin or copy anything per call.
+	 */
+
+#if NET5_0_OR_GREATER
+	/* Modern .NET calls through cached function pointers instead of going
+	 * through DllImport binding. The library is resolved once, see
+	 * ResolveNativeLibrary, and each export on first use.
+	 */
+
+	private static IntPtr nativeLibHandle;
+
+	private static IntPtr ResolveNativeLibrary()
+	{
+		IntPtr handle;
+
+		/* Default probing first: app directory, then the system */
+		if (NativeLibrary.TryLoad(
+			nativeLibName,
+			typeof(nativefiledialog).Assembly,
+			null,
+			out handle
+		)) {
+			return handle;
+		}
+
+		/* Then the fnalibs layout next to the application */
+		string dir, file;
+		if (OperatingSystem.IsWindows())
+		{
+			dir = Environment.Is64BitProcess ? "x64" : "x86";
+			file = nativeLibName + ".dll";
+		}
+		else if (OperatingSystem.IsMacOS())
+		{
+			dir = "osx";
+			file = "lib" + nativeLibName + ".dylib";
+		}
+		else
+		{
+			dir = Environment.Is64BitProcess ? "lib64" : "lib";
+			file = "lib" + nativeLibName + ".so";
+		}
+		string path = System.IO.Path.Combine(AppContext.BaseDirectory, dir, file);
+		if (NativeLibrary.TryLoad(path, out handle))
+		{
+			return handle;
+		}
+
+		throw new DllNotFoundException(
+			"Unable to load " + nativeLibName + " (also tried " + path + ")"
+		);
+	}
+
+	private static IntPtr GetExport(ref IntPtr cache, string name)
+	{
+		IntPtr fn = cache;
+		if (fn == IntPtr.Zero)
+		{
+			/* Racing threads resolve the same values, so no lock */
+			if (nativeLibHandle == IntPtr.Zero)
+			{
+				nativeLibHandle = ResolveNativeLibrary();
+			}
+			fn = NativeLibrary.GetExport(nativeLibHandle, name);
+			cache = fn;
+		}
+		return fn;
+	}
+
+	private static IntPtr NFD_OpenDialog_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialog(
 		byte* filterList,
 		byte* defaultPath,
-		out IntPtr outPath
-	);
-	public static unsafe nfdresult_t NFD_OpenDialog(
-		string filterList,
-		string defaultPath,
-		out string outPath
+		IntPtr* outPath
 	) {
-		byte* filterListPtr = Utf8EncodeNullable(filterList);
-		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
-		IntPtr outPathPtr;
-
-		nfdresult_t result = INTERNAL_NFD_OpenDialog(
-			filterListPtr,
-			defaultPathPtr,
-			out outPathPtr
-		);
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, nfdresult_t>) GetExport(
+			ref NFD_OpenDialog_ptr,
+			"NFD_OpenDialog"
+		))(filterList, defaultPath, outPath);
+	}
 
-		Marshal.FreeHGlobal((IntPtr) filterListPtr);
-		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
-		outPath = UTF8_ToManaged(outPathPtr, true);
-		return result;
+	private static IntPtr NFD_OpenDialogMultiple_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultiple(
+		byte* filterList,
+		byte* defaultPath,
+		nfdpathset_t* outPaths
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, nfdpathset_t*, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogMultiple_ptr,
+			"NFD_OpenDialogMultiple"
+		))(filterList, defaultPath, outPaths);
 	}
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogMultiple", CallingConvention = CallingConvention.Cdecl)]
-	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultiple(
+	private static IntPtr NFD_SaveDialog_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_SaveDialog(
 		byte* filterList,
 		byte* defaultPath,
-		out nfdpathset_t outPaths
-	);
-	public static unsafe nfdresult_t NFD_OpenDialogMultiple(
-		string filterList,
-		string defaultPath,
-		out nfdpathset_t outPaths
+		IntPtr* outPath
 	) {
-		byte* filterListPtr = Utf8EncodeNullable(filterList);
-		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, nfdresult_t>) GetExport(
+			ref NFD_SaveDialog_ptr,
+			"NFD_SaveDialog"
+		))(filterList, defaultPath, outPath);
+	}
 
-		nfdresult_t result = INTERNAL_NFD_OpenDialogMultiple(
-			filterListPtr,
-			defaultPathPtr,
-			out outPaths
-		);
+	private static IntPtr NFD_PickFolder_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_PickFolder(
+		byte* defaultPath,
+		IntPtr* outPath
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, IntPtr*, nfdresult_t>) GetExport(
+			ref NFD_PickFolder_ptr,
+			"NFD_PickFolder"
+		))(defaultPath, outPath);
+	}
 
-		Marshal.FreeHGlobal((IntPtr) filterListPtr);
-		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
-		return result;
+	private static IntPtr NFD_OpenDialogEx_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogEx(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogEx_ptr,
+			"NFD_OpenDialogEx"
+		))(filterList, defaultPath, outPath, request);
 	}
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_SaveDialog", CallingConvention = CallingConvention.Cdecl)]
-	private static extern unsafe nfdresult_t INTERNAL_NFD_SaveDialog(
+	private static IntPtr NFD_OpenDialogMultipleEx_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultipleEx(
 		byte* filterList,
 		byte* defaultPath,
-		out IntPtr outPath
-	);
-	public static unsafe nfdresult_t NFD_SaveDialog(
-		string filterList,
-		string defaultPath,
-		out string outPath
+		nfdpathset_t* outPaths,
+		IntPtr request
 	) {
-		byte* filterListPtr = Utf8EncodeNullable(filterList);
-		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
-		IntPtr outPathPtr;
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, nfdpathset_t*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogMultipleEx_ptr,
+			"NFD_OpenDialogMultipleEx"
+		))(filterList, defaultPath, outPaths, request);
+	}
 
-		nfdresult_t result = INTERNAL_NFD_SaveDialog(
-			filterListPtr,
-			defaultPathPtr,
-			out outPathPtr
-		);
+	private static IntPtr NFD_SaveDialogEx_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_SaveDialogEx(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_SaveDialogEx_ptr,
+			"NFD_SaveDialogEx"
+		))(filterList, defaultPath, outPath, request);
+	}
 
-		Marshal.FreeHGlobal((IntPtr) filterListPtr);
-		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
-		outPath = UTF8_ToManaged(outPathPtr, true);
-		return result;
+	private static IntPtr NFD_PickFolderEx_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_PickFolderEx(
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, IntPtr*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_PickFolderEx_ptr,
+			"NFD_PickFolderEx"
+		))(defaultPath, outPath, request);
 	}
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_PickFolder", CallingConvention = CallingConvention.Cdecl)]
-	private static extern unsafe nfdresult_t INTERNAL_NFD_PickFolder(
+	private static IntPtr NFD_SetBackend_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_SetBackend(
+		byte* name
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, nfdresult_t>) GetExport(
+			ref NFD_SetBackend_ptr,
+			"NFD_SetBackend"
+		))(name);
+	}
+
+	private static IntPtr NFD_GetBackendName_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_GetBackendName()
+	{
+		return ((delegate* unmanaged[Cdecl]<IntPtr>) GetExport(
+			ref NFD_GetBackendName_ptr,
+			"NFD_GetBackendName"
+		))();
+	}
+
+	private static IntPtr NFD_GetError_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_GetError()
+	{
+		return ((delegate* unmanaged[Cdecl]<IntPtr>) GetExport(
+			ref NFD_GetError_ptr,
+			"NFD_GetError"
+		))();
+	}
+
+	private static IntPtr NFD_PathSet_GetCount_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_PathSet_GetCount(
+		nfdpathset_t* pathset
+	) {
+		return ((delegate* unmanaged[Cdecl]<nfdpathset_t*, IntPtr>) GetExport(
+			ref NFD_PathSet_GetCount_ptr,
+			"NFD_PathSet_GetCount"
+		))(pathset);
+	}
+
+	private static IntPtr NFD_PathSet_GetPath_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_PathSet_GetPath(
+		nfdpathset_t* pathset,
+		IntPtr index
+	) {
+		return ((delegate* unmanaged[Cdecl]<nfdpathset_t*, IntPtr, IntPtr>) GetExport(
+			ref NFD_PathSet_GetPath_ptr,
+			"NFD_PathSet_GetPath"
+		))(pathset, index);
+	}
+
+	private static IntPtr NFD_PathSet_Free_ptr;
+	private static unsafe void INTERNAL_NFD_PathSet_Free(
+		nfdpathset_t* pathset
+	) {
+		((delegate* unmanaged[Cdecl]<nfdpathset_t*, void>) GetExport(
+			ref NFD_PathSet_Free_ptr,
+			"NFD_PathSet_Free"
+		))(pathset);
+	}
+
+	private static IntPtr NFD_Free_ptr;
+	private static unsafe void INTERNAL_NFD_Free(
+		IntPtr ptr
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, void>) GetExport(
+			ref NFD_Free_ptr,
+			"NFD_Free"
+		))(ptr);
+	}
+
+	private static IntPtr NFD_PathSet_Serialize_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_PathSet_Serialize(
+		nfdpathset_t* pathset,
+		void* buf,
+		IntPtr bufSize
+	) {
+		return ((delegate* unmanaged[Cdecl]<nfdpathset_t*, void*, IntPtr, IntPtr>) GetExport(
+			ref NFD_PathSet_Serialize_ptr,
+			"NFD_PathSet_Serialize"
+		))(pathset, buf, bufSize);
+	}
+
+	private static IntPtr NFD_PathSet_View_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_PathSet_View(
+		void* blob,
+		IntPtr blobSize,
+		nfdpathset_t* outView
+	) {
+		return ((delegate* unmanaged[Cdecl]<void*, IntPtr, nfdpathset_t*, nfdresult_t>) GetExport(
+			ref NFD_PathSet_View_ptr,
+			"NFD_PathSet_View"
+		))(blob, blobSize, outView);
+	}
+
+	private static IntPtr NFD_PathSet_Compact_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_PathSet_Compact(
+		nfdpathset_t* pathset
+	) {
+		return ((delegate* unmanaged[Cdecl]<nfdpathset_t*, IntPtr>) GetExport(
+			ref NFD_PathSet_Compact_ptr,
+			"NFD_PathSet_Compact"
+		))(pathset);
+	}
+
+	private static IntPtr NFD_CompactPathSet_GetCount_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_CompactPathSet_GetCount(
+		IntPtr pathset
+	) {
+		return ((delegate* unmanaged[Cdecl]<IntPtr, IntPtr>) GetExport(
+			ref NFD_CompactPathSet_GetCount_ptr,
+			"NFD_CompactPathSet_GetCount"
+		))(pathset);
+	}
+
+	private static IntPtr NFD_CompactPathSet_GetPath_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_CompactPathSet_GetPath(
+		IntPtr pathset,
+		IntPtr index,
+		byte* buf,
+		IntPtr bufSize
+	) {
+		return ((delegate* unmanaged[Cdecl]<IntPtr, IntPtr, byte*, IntPtr, IntPtr>) GetExport(
+			ref NFD_CompactPathSet_GetPath_ptr,
+			"NFD_CompactPathSet_GetPath"
+		))(pathset, index, buf, bufSize);
+	}
+
+	private static IntPtr NFD_CompactPathSet_Free_ptr;
+	private static unsafe void INTERNAL_NFD_CompactPathSet_Free(
+		IntPtr pathset
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, void>) GetExport(
+			ref NFD_CompactPathSet_Free_ptr,
+			"NFD_CompactPathSet_Free"
+		))(pathset);
+	}
+
+	private static IntPtr NFD_Filter_MatchBatch_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_Filter_MatchBatch(
+		byte* filterList,
+		IntPtr* paths,
+		IntPtr count,
+		int* outGroups
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, IntPtr*, IntPtr, int*, nfdresult_t>) GetExport(
+			ref NFD_Filter_MatchBatch_ptr,
+			"NFD_Filter_MatchBatch"
+		))(filterList, paths, count, outGroups);
+	}
+
+	private static IntPtr NFD_OpenDialogMapped_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogMapped(
+		byte* filterList,
 		byte* defaultPath,
-		out IntPtr outPath
-	);
-	public static unsafe nfdresult_t NFD_PickFolder(
-		string defaultPath,
-		out string outPath
+		IntPtr* outPath,
+		nfdmapping_t* outMapping,
+		uint mapFlags,
+		IntPtr request
 	) {
-		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
-		IntPtr outPathPtr;
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, nfdmapping_t*, uint, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogMapped_ptr,
+			"NFD_OpenDialogMapped"
+		))(filterList, defaultPath, outPath, outMapping, mapFlags, request);
+	}
 
-		nfdresult_t result = INTERNAL_NFD_PickFolder(
-			defaultPathPtr,
-			out outPathPtr
-		);
+	private static IntPtr NFD_PickFolderAndScan_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_PickFolderAndScan(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		nfdpathset_t* outPaths,
+		nfdscanoptions_t* options,
+		IntPtr request
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr*, nfdpathset_t*, nfdscanoptions_t*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_PickFolderAndScan_ptr,
+			"NFD_PickFolderAndScan"
+		))(filterList, defaultPath, outPath, outPaths, options, request);
+	}
 
-		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
-		outPath = UTF8_ToManaged(outPathPtr, true);
-		return result;
+	private static IntPtr NFD_SearchDialog_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_SearchDialog(
+		IntPtr* roots,
+		byte* filterList,
+		IntPtr* outPath,
+		IntPtr request
+	) {
+		return ((delegate* unmanaged[Cdecl]<IntPtr*, byte*, IntPtr*, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_SearchDialog_ptr,
+			"NFD_SearchDialog"
+		))(roots, filterList, outPath, request);
 	}
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_GetError", CallingConvention = CallingConvention.Cdecl)]
-	private static extern IntPtr INTERNAL_NFD_GetError();
-	public static string NFD_GetError()
+	private static IntPtr NFD_Unmap_ptr;
+	private static unsafe void INTERNAL_NFD_Unmap(
+		nfdmapping_t* mapping
+	) {
+		((delegate* unmanaged[Cdecl]<nfdmapping_t*, void>) GetExport(
+			ref NFD_Unmap_ptr,
+			"NFD_Unmap"
+		))(mapping);
+	}
+
+	private static IntPtr NFD_Request_Create_ptr;
+	private static unsafe IntPtr INTERNAL_NFD_Request_Create()
 	{
-		return UTF8_ToManaged(INTERNAL_NFD_GetError());
+		return ((delegate* unmanaged[Cdecl]<IntPtr>) GetExport(
+			ref NFD_Request_Create_ptr,
+			"NFD_Request_Create"
+		))();
 	}
 
-	/* IntPtr refers to a size_t */
-	[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
-	public static extern IntPtr NFD_PathSet_GetCount(ref nfdpathset_t pathset);
+	private static IntPtr NFD_Request_SetTimeout_ptr;
+	private static unsafe void INTERNAL_NFD_Request_SetTimeout(
+		IntPtr request,
+		uint milliseconds
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, uint, void>) GetExport(
+			ref NFD_Request_SetTimeout_ptr,
+			"NFD_Request_SetTimeout"
+		))(request, milliseconds);
+	}
 
-	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_GetPath", CallingConvention = CallingConvention.Cdecl)]
-	private static extern IntPtr INTERNAL_NFD_PathSet_GetPath(
-		ref nfdpathset_t pathset,
-		IntPtr index /* size_t */
-	);
-	public static string NFD_PathSet_GetPath(
-		ref nfdpathset_t pathset,
-		IntPtr index /* size_t */
+	private static IntPtr NFD_Cancel_ptr;
+	private static unsafe void INTERNAL_NFD_Cancel(
+		IntPtr request
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, void>) GetExport(
+			ref NFD_Cancel_ptr,
+			"NFD_Cancel"
+		))(request);
+	}
+
+	private static IntPtr NFD_Request_SetFlags_ptr;
+	private static unsafe void INTERNAL_NFD_Request_SetFlags(
+		IntPtr request,
+		uint flags
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, uint, void>) GetExport(
+			ref NFD_Request_SetFlags_ptr,
+			"NFD_Request_SetFlags"
+		))(request, flags);
+	}
+
+	private static IntPtr NFD_Request_SetReadAheadLimit_ptr;
+	private static unsafe void INTERNAL_NFD_Request_SetReadAheadLimit(
+		IntPtr request,
+		ulong bytes
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, ulong, void>) GetExport(
+			ref NFD_Request_SetReadAheadLimit_ptr,
+			"NFD_Request_SetReadAheadLimit"
+		))(request, bytes);
+	}
+
+	private static IntPtr NFD_Request_GetPathInfo_ptr;
+	private static unsafe nfdpathinfo_t* INTERNAL_NFD_Request_GetPathInfo(
+		IntPtr request,
+		IntPtr* count
+	) {
+		return ((delegate* unmanaged[Cdecl]<IntPtr, IntPtr*, nfdpathinfo_t*>) GetExport(
+			ref NFD_Request_GetPathInfo_ptr,
+			"NFD_Request_GetPathInfo"
+		))(request, count);
+	}
+
+	private static IntPtr NFD_Request_Free_ptr;
+	private static unsafe void INTERNAL_NFD_Request_Free(
+		IntPtr request
+	) {
+		((delegate* unmanaged[Cdecl]<IntPtr, void>) GetExport(
+			ref NFD_Request_Free_ptr,
+			"NFD_Request_Free"
+		))(request);
+	}
+
+	private static IntPtr NFD_OpenDialogAsync_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr, IntPtr, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogAsync_ptr,
+			"NFD_OpenDialogAsync"
+		))(filterList, defaultPath, request, callback, userdata);
+	}
+
+	private static IntPtr NFD_OpenDialogMultipleAsync_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultipleAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr, IntPtr, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_OpenDialogMultipleAsync_ptr,
+			"NFD_OpenDialogMultipleAsync"
+		))(filterList, defaultPath, request, callback, userdata);
+	}
+
+	private static IntPtr NFD_SaveDialogAsync_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_SaveDialogAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, byte*, IntPtr, IntPtr, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_SaveDialogAsync_ptr,
+			"NFD_SaveDialogAsync"
+		))(filterList, defaultPath, request, callback, userdata);
+	}
+
+	private static IntPtr NFD_PickFolderAsync_ptr;
+	private static unsafe nfdresult_t INTERNAL_NFD_PickFolderAsync(
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	) {
+		return ((delegate* unmanaged[Cdecl]<byte*, IntPtr, IntPtr, IntPtr, nfdresult_t>) GetExport(
+			ref NFD_PickFolderAsync_ptr,
+			"NFD_PickFolderAsync"
+		))(defaultPath, request, callback, userdata);
+	}
+
+	private static IntPtr NFD_GetEventType_ptr;
+	private static unsafe uint INTERNAL_NFD_GetEventType()
+	{
+		return ((delegate* unmanaged[Cdecl]<uint>) GetExport(
+			ref NFD_GetEventType_ptr,
+			"NFD_GetEventType"
+		))();
+	}
+
+	private static IntPtr NFD_EventResult_Free_ptr;
+	private static unsafe void INTERNAL_NFD_EventResult_Free(
+		nfdeventresult_t* eventResult
 	) {
-		return UTF8_ToManaged(INTERNAL_NFD_PathSet_GetPath(ref pathset, index));
+		((delegate* unmanaged[Cdecl]<nfdeventresult_t*, void>) GetExport(
+			ref NFD_EventResult_Free_ptr,
+			"NFD_EventResult_Free"
+		))(eventResult);
 	}
+#else
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialog", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialog(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogMultiple", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultiple(
+		byte* filterList,
+		byte* defaultPath,
+		nfdpathset_t* outPaths
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_SaveDialog", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_SaveDialog(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath
+	);
 
-	[DllImport(nativeLibName, CallingConvention = CallingConvention.Cdecl)]
-	public static extern void NFD_PathSet_Free(ref nfdpathset_t pathset);
+	[DllImport(nativeLibName, EntryPoint = "NFD_PickFolder", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_PickFolder(
+		byte* defaultPath,
+		IntPtr* outPath
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogEx", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogEx(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogMultipleEx", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultipleEx(
+		byte* filterList,
+		byte* defaultPath,
+		nfdpathset_t* outPaths,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_SaveDialogEx", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_SaveDialogEx(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PickFolderEx", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_PickFolderEx(
+		byte* defaultPath,
+		IntPtr* outPath,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_SetBackend", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_SetBackend(
+		byte* name
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_GetBackendName", CallingConvention = CallingConvention.Cdecl)]
+	private static extern IntPtr INTERNAL_NFD_GetBackendName();
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_GetError", CallingConvention = CallingConvention.Cdecl)]
+	private static extern IntPtr INTERNAL_NFD_GetError();
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_GetCount", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe IntPtr INTERNAL_NFD_PathSet_GetCount(
+		nfdpathset_t* pathset
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_GetPath", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe IntPtr INTERNAL_NFD_PathSet_GetPath(
+		nfdpathset_t* pathset,
+		IntPtr index
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_Free", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe void INTERNAL_NFD_PathSet_Free(
+		nfdpathset_t* pathset
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Free", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Free(
+		IntPtr ptr
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_Serialize", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe IntPtr INTERNAL_NFD_PathSet_Serialize(
+		nfdpathset_t* pathset,
+		void* buf,
+		IntPtr bufSize
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_View", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_PathSet_View(
+		void* blob,
+		IntPtr blobSize,
+		nfdpathset_t* outView
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PathSet_Compact", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe IntPtr INTERNAL_NFD_PathSet_Compact(
+		nfdpathset_t* pathset
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_CompactPathSet_GetCount", CallingConvention = CallingConvention.Cdecl)]
+	private static extern IntPtr INTERNAL_NFD_CompactPathSet_GetCount(
+		IntPtr pathset
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_CompactPathSet_GetPath", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe IntPtr INTERNAL_NFD_CompactPathSet_GetPath(
+		IntPtr pathset,
+		IntPtr index,
+		byte* buf,
+		IntPtr bufSize
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_CompactPathSet_Free", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_CompactPathSet_Free(
+		IntPtr pathset
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Filter_MatchBatch", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_Filter_MatchBatch(
+		byte* filterList,
+		IntPtr* paths,
+		IntPtr count,
+		int* outGroups
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogMapped", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogMapped(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		nfdmapping_t* outMapping,
+		uint mapFlags,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PickFolderAndScan", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_PickFolderAndScan(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr* outPath,
+		nfdpathset_t* outPaths,
+		nfdscanoptions_t* options,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_SearchDialog", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_SearchDialog(
+		IntPtr* roots,
+		byte* filterList,
+		IntPtr* outPath,
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Unmap", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe void INTERNAL_NFD_Unmap(
+		nfdmapping_t* mapping
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_Create", CallingConvention = CallingConvention.Cdecl)]
+	private static extern IntPtr INTERNAL_NFD_Request_Create();
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_SetTimeout", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Request_SetTimeout(
+		IntPtr request,
+		uint milliseconds
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Cancel", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Cancel(
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_SetFlags", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Request_SetFlags(
+		IntPtr request,
+		uint flags
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_SetReadAheadLimit", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Request_SetReadAheadLimit(
+		IntPtr request,
+		ulong bytes
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_GetPathInfo", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdpathinfo_t* INTERNAL_NFD_Request_GetPathInfo(
+		IntPtr request,
+		IntPtr* count
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_Request_Free", CallingConvention = CallingConvention.Cdecl)]
+	private static extern void INTERNAL_NFD_Request_Free(
+		IntPtr request
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogAsync", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_OpenDialogMultipleAsync", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_OpenDialogMultipleAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_SaveDialogAsync", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_SaveDialogAsync(
+		byte* filterList,
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_PickFolderAsync", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe nfdresult_t INTERNAL_NFD_PickFolderAsync(
+		byte* defaultPath,
+		IntPtr request,
+		IntPtr callback,
+		IntPtr userdata
+	);
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_GetEventType", CallingConvention = CallingConvention.Cdecl)]
+	private static extern uint INTERNAL_NFD_GetEventType();
+
+	[DllImport(nativeLibName, EntryPoint = "NFD_EventResult_Free", CallingConvention = CallingConvention.Cdecl)]
+	private static extern unsafe void INTERNAL_NFD_EventResult_Free(
+		nfdeventresult_t* eventResult
+	);
+#endif
+
+	#endregion
+
+	#region Entry Points
+
+	public static unsafe nfdresult_t NFD_OpenDialog(
+		string filterList,
+		string defaultPath,
+		out string outPath
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_OpenDialog(
+			filterListPtr,
+			defaultPathPtr,
+			&outPathPtr
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogMultiple(
+		string filterList,
+		string defaultPath,
+		out nfdpathset_t outPaths
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result;
+		outPaths = default(nfdpathset_t);
+		fixed (nfdpathset_t* outPathsPtr = &outPaths)
+		{
+			result = INTERNAL_NFD_OpenDialogMultiple(
+				filterListPtr,
+				defaultPathPtr,
+				outPathsPtr
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_SaveDialog(
+		string filterList,
+		string defaultPath,
+		out string outPath
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_SaveDialog(
+			filterListPtr,
+			defaultPathPtr,
+			&outPathPtr
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_PickFolder(
+		string defaultPath,
+		out string outPath
+	) {
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_PickFolder(
+			defaultPathPtr,
+			&outPathPtr
+		);
+
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogEx(
+		string filterList,
+		string defaultPath,
+		out string outPath,
+		IntPtr request
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_OpenDialogEx(
+			filterListPtr,
+			defaultPathPtr,
+			&outPathPtr,
+			request
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogMultipleEx(
+		string filterList,
+		string defaultPath,
+		out nfdpathset_t outPaths,
+		IntPtr request
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result;
+		outPaths = default(nfdpathset_t);
+		fixed (nfdpathset_t* outPathsPtr = &outPaths)
+		{
+			result = INTERNAL_NFD_OpenDialogMultipleEx(
+				filterListPtr,
+				defaultPathPtr,
+				outPathsPtr,
+				request
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_SaveDialogEx(
+		string filterList,
+		string defaultPath,
+		out string outPath,
+		IntPtr request
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_SaveDialogEx(
+			filterListPtr,
+			defaultPathPtr,
+			&outPathPtr,
+			request
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_PickFolderEx(
+		string defaultPath,
+		out string outPath,
+		IntPtr request
+	) {
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result = INTERNAL_NFD_PickFolderEx(
+			defaultPathPtr,
+			&outPathPtr,
+			request
+		);
+
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogMapped(
+		string filterList,
+		string defaultPath,
+		out string outPath,
+		out nfdmapping_t outMapping,
+		uint mapFlags,
+		IntPtr request
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result;
+		outMapping = default(nfdmapping_t);
+		fixed (nfdmapping_t* outMappingPtr = &outMapping)
+		{
+			result = INTERNAL_NFD_OpenDialogMapped(
+				filterListPtr,
+				defaultPathPtr,
+				&outPathPtr,
+				outMappingPtr,
+				mapFlags,
+				request
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_PickFolderAndScan(
+		string filterList,
+		string defaultPath,
+		out string outPath,
+		out nfdpathset_t outPaths,
+		ref nfdscanoptions_t options,
+		IntPtr request
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result;
+		outPaths = default(nfdpathset_t);
+		fixed (nfdpathset_t* outPathsPtr = &outPaths)
+		fixed (nfdscanoptions_t* optionsPtr = &options)
+		{
+			result = INTERNAL_NFD_PickFolderAndScan(
+				filterListPtr,
+				defaultPathPtr,
+				&outPathPtr,
+				outPathsPtr,
+				optionsPtr,
+				request
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_SearchDialog(
+		string[] roots,
+		string filterList,
+		out string outPath,
+		IntPtr request
+	) {
+		/* One buffer for every root, and a NULL-terminated pointer array */
+		int size = 0;
+		for (int i = 0; i < roots.Length; i += 1)
+		{
+			size += Encoding.UTF8.GetByteCount(roots[i]) + 1;
+		}
+
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* buf = (byte*) Marshal.AllocHGlobal(Math.Max(size, 1));
+		IntPtr[] rootPtrs = new IntPtr[roots.Length + 1];
+		byte* cur = buf;
+		for (int i = 0; i < roots.Length; i += 1)
+		{
+			rootPtrs[i] = (IntPtr) cur;
+			fixed (char* rootPtr = roots[i])
+			{
+				cur += Encoding.UTF8.GetBytes(
+					rootPtr,
+					roots[i].Length,
+					cur,
+					size - (int) (cur - buf)
+				);
+			}
+			*cur++ = 0;
+		}
+		IntPtr outPathPtr = IntPtr.Zero;
+
+		nfdresult_t result;
+		fixed (IntPtr* rootPtrsPtr = rootPtrs)
+		{
+			result = INTERNAL_NFD_SearchDialog(
+				rootPtrsPtr,
+				filterListPtr,
+				&outPathPtr,
+				request
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) buf);
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		outPath = UTF8_ToManaged(outPathPtr, true);
+		return result;
+	}
+
+	public static unsafe void NFD_Unmap(ref nfdmapping_t mapping)
+	{
+		fixed (nfdmapping_t* mappingPtr = &mapping)
+		{
+			INTERNAL_NFD_Unmap(mappingPtr);
+		}
+	}
+
+	public static unsafe nfdresult_t NFD_SetBackend(string name)
+	{
+		byte* namePtr = Utf8EncodeNullable(name);
+		nfdresult_t result = INTERNAL_NFD_SetBackend(namePtr);
+		Marshal.FreeHGlobal((IntPtr) namePtr);
+		return result;
+	}
+
+	public static string NFD_GetBackendName()
+	{
+		return UTF8_ToManaged(INTERNAL_NFD_GetBackendName());
+	}
+
+	public static string NFD_GetError()
+	{
+		return UTF8_ToManaged(INTERNAL_NFD_GetError());
+	}
+
+
+	/* IntPtr refers to a size_t */
+	public static unsafe IntPtr NFD_PathSet_GetCount(ref nfdpathset_t pathset)
+	{
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			return INTERNAL_NFD_PathSet_GetCount(pathsetPtr);
+		}
+	}
+
+	public static unsafe string NFD_PathSet_GetPath(
+		ref nfdpathset_t pathset,
+		IntPtr index /* size_t */
+	) {
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			return UTF8_ToManaged(
+				INTERNAL_NFD_PathSet_GetPath(pathsetPtr, index)
+			);
+		}
+	}
+
+	public static unsafe void NFD_PathSet_Free(ref nfdpathset_t pathset)
+	{
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			INTERNAL_NFD_PathSet_Free(pathsetPtr);
+		}
+	}
+
+	/* Returns the size needed, buf is only written if it's large enough */
+	public static unsafe IntPtr NFD_PathSet_Serialize(
+		ref nfdpathset_t pathset,
+		IntPtr buf,
+		IntPtr bufSize
+	) {
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			return INTERNAL_NFD_PathSet_Serialize(
+				pathsetPtr,
+				(void*) buf,
+				bufSize
+			);
+		}
+	}
+
+	/* null on failure, see NFD_GetError */
+	public static unsafe byte[] NFD_PathSet_Serialize(ref nfdpathset_t pathset)
+	{
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			int size = (int) INTERNAL_NFD_PathSet_Serialize(
+				pathsetPtr,
+				null,
+				IntPtr.Zero
+			);
+			if (size == 0)
+			{
+				return null;
+			}
+			byte[] result = new byte[size];
+			int written;
+
+			/* Array data is pointer-aligned, as the blob requires */
+			fixed (byte* resultPtr = result)
+			{
+				written = (int) INTERNAL_NFD_PathSet_Serialize(
+					pathsetPtr,
+					resultPtr,
+					(IntPtr) size
+				);
+			}
+			return (written == size) ? result : null;
+		}
+	}
+
+	/* The view points into blob, so blob has to stay put while it's used.
+	 * Never pass the view to NFD_PathSet_Free!
+	 */
+	public static unsafe nfdresult_t NFD_PathSet_View(
+		IntPtr blob,
+		IntPtr blobSize,
+		out nfdpathset_t outView
+	) {
+		outView = default(nfdpathset_t);
+		fixed (nfdpathset_t* outViewPtr = &outView)
+		{
+			return INTERNAL_NFD_PathSet_View(
+				(void*) blob,
+				blobSize,
+				outViewPtr
+			);
+		}
+	}
+
+	/* IntPtr refers to an nfdcompactpathset_t* */
+	public static unsafe IntPtr NFD_PathSet_Compact(ref nfdpathset_t pathset)
+	{
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			return INTERNAL_NFD_PathSet_Compact(pathsetPtr);
+		}
+	}
+
+	public static IntPtr NFD_CompactPathSet_GetCount(IntPtr pathset)
+	{
+		return INTERNAL_NFD_CompactPathSet_GetCount(pathset);
+	}
+
+	public static unsafe string NFD_CompactPathSet_GetPath(
+		IntPtr pathset,
+		IntPtr index /* size_t */
+	) {
+		/* Most paths fit, the rest take a second call */
+		const int stackSize = 512;
+		byte* buf = stackalloc byte[stackSize];
+		int len = (int) INTERNAL_NFD_CompactPathSet_GetPath(
+			pathset,
+			index,
+			buf,
+			(IntPtr) stackSize
+		);
+		if (len < stackSize)
+		{
+			return UTF8_ToManaged((IntPtr) buf);
+		}
+
+		IntPtr heap = Marshal.AllocHGlobal(len + 1);
+		INTERNAL_NFD_CompactPathSet_GetPath(
+			pathset,
+			index,
+			(byte*) heap,
+			(IntPtr) (len + 1)
+		);
+		string result = UTF8_ToManaged(heap);
+		Marshal.FreeHGlobal(heap);
+		return result;
+	}
+
+	public static void NFD_CompactPathSet_Free(IntPtr pathset)
+	{
+		INTERNAL_NFD_CompactPathSet_Free(pathset);
+	}
+
+	/* outGroups must be at least as long as paths */
+	public static unsafe nfdresult_t NFD_Filter_MatchBatch(
+		string filterList,
+		string[] paths,
+		int[] outGroups
+	) {
+		if (outGroups.Length < paths.Length)
+		{
+			throw new ArgumentException("outGroups is shorter than paths");
+		}
+
+		/* Encode every path into one buffer rather than one per path */
+		int size = 0;
+		for (int i = 0; i < paths.Length; i += 1)
+		{
+			if (paths[i] != null)
+			{
+				size += Encoding.UTF8.GetByteCount(paths[i]) + 1;
+			}
+		}
+
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* buf = (byte*) Marshal.AllocHGlobal(Math.Max(size, 1));
+		IntPtr[] pathPtrs = new IntPtr[paths.Length];
+		byte* cur = buf;
+		for (int i = 0; i < paths.Length; i += 1)
+		{
+			if (paths[i] == null)
+			{
+				continue;
+			}
+			pathPtrs[i] = (IntPtr) cur;
+			fixed (char* pathPtr = paths[i])
+			{
+				cur += Encoding.UTF8.GetBytes(
+					pathPtr,
+					paths[i].Length,
+					cur,
+					size - (int) (cur - buf)
+				);
+			}
+			*cur++ = 0;
+		}
+
+		nfdresult_t result;
+		fixed (IntPtr* pathPtrsPtr = pathPtrs)
+		fixed (int* outGroupsPtr = outGroups)
+		{
+			result = INTERNAL_NFD_Filter_MatchBatch(
+				filterListPtr,
+				pathPtrsPtr,
+				(IntPtr) paths.Length,
+				outGroupsPtr
+			);
+		}
+
+		Marshal.FreeHGlobal((IntPtr) buf);
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		return result;
+	}
+
+	/* IntPtr refers to an nfdrequest_t* */
+	public static IntPtr NFD_Request_Create()
+	{
+		return INTERNAL_NFD_Request_Create();
+	}
+
+	public static void NFD_Request_SetTimeout(
+		IntPtr request,
+		uint milliseconds
+	) {
+		INTERNAL_NFD_Request_SetTimeout(request, milliseconds);
+	}
+
+	/* Safe to call from any thread */
+	public static void NFD_Cancel(IntPtr request)
+	{
+		INTERNAL_NFD_Cancel(request);
+	}
+
+	public static void NFD_Request_SetFlags(IntPtr request, uint flags)
+	{
+		INTERNAL_NFD_Request_SetFlags(request, flags);
+	}
+
+	public static void NFD_Request_SetReadAheadLimit(
+		IntPtr request,
+		ulong bytes
+	) {
+		INTERNAL_NFD_Request_SetReadAheadLimit(request, bytes);
+	}
+
+	/* Copied out, so the result outlives the request. Null without
+	 * NFD_REQUEST_PATHINFO or before the first NFD_OKAY.
+	 */
+	public static unsafe nfdpathinfo_t[] NFD_Request_GetPathInfo(IntPtr request)
+	{
+		IntPtr count;
+		nfdpathinfo_t* info = INTERNAL_NFD_Request_GetPathInfo(request, &count);
+		if (info == null)
+		{
+			return null;
+		}
+		nfdpathinfo_t[] result = new nfdpathinfo_t[(int) count];
+		for (int i = 0; i < result.Length; i += 1)
+		{
+			result[i] = info[i];
+		}
+		return result;
+	}
+
+	public static void NFD_Request_Free(IntPtr request)
+	{
+		INTERNAL_NFD_Request_Free(request);
+	}
+
+	#endregion
+
+	#region UTF8 Span Entry Points
+
+#if NETSTANDARD2_1 || NETCOREAPP
+	/* These skip UTF-16 entirely: inputs are passed as UTF-8 bytes and
+	 * results are handed out as views of the native UTF-8 buffers.
+	 */
+
+	/* Owns a native outPath. The bytes exclude the null terminator and stay
+	 * valid until Dispose, after which Span/Memory must not be touched.
+	 * There is deliberately no finalizer: a Span from GetSpan does not keep
+	 * this object alive, so the GC could free the path under a reader.
+	 * Always Dispose it (or use it in a using block).
+	 */
+	public sealed unsafe class nfdutf8path_t : MemoryManager<byte>
+	{
+		private IntPtr ptr;
+		private readonly int length;
+
+		internal nfdutf8path_t(IntPtr ptr)
+		{
+			this.ptr = ptr;
+			byte* end = (byte*) ptr;
+			while (*end != 0)
+			{
+				end++;
+			}
+			length = (int) (end - (byte*) ptr);
+		}
+
+		/* Null-terminated, for passing straight back to native code */
+		public IntPtr Pointer
+		{
+			get
+			{
+				return ptr;
+			}
+		}
+
+		public int Length
+		{
+			get
+			{
+				return length;
+			}
+		}
+
+		public ReadOnlySpan<byte> Span
+		{
+			get
+			{
+				return GetSpan();
+			}
+		}
+
+		public override Span<byte> GetSpan()
+		{
+			if (ptr == IntPtr.Zero)
+			{
+				throw new ObjectDisposedException("nfdutf8path_t");
+			}
+			return new Span<byte>((void*) ptr, length);
+		}
+
+		/* Native memory never moves, so pinning is free */
+		public override MemoryHandle Pin(int elementIndex = 0)
+		{
+			if (ptr == IntPtr.Zero)
+			{
+				throw new ObjectDisposedException("nfdutf8path_t");
+			}
+			return new MemoryHandle((byte*) ptr + elementIndex);
+		}
+
+		public override void Unpin()
+		{
+		}
+
+		/* MemoryManager only implements IDisposable explicitly */
+		public void Dispose()
+		{
+			((IDisposable) this).Dispose();
+		}
+
+		protected override void Dispose(bool disposing)
+		{
+			if (ptr != IntPtr.Zero)
+			{
+				INTERNAL_NFD_Free(ptr);
+				ptr = IntPtr.Zero;
+			}
+		}
+
+		public override string ToString()
+		{
+			return UTF8_ToManaged(ptr);
+		}
+	}
+
+	/* Empty means NULL, a trailing 0 is used in place, otherwise we copy */
+	private static unsafe byte* Utf8Terminate(
+		ReadOnlySpan<byte> str,
+		byte* pinned,
+		out IntPtr allocated
+	) {
+		allocated = IntPtr.Zero;
+		if (str.IsEmpty)
+		{
+			return (byte*) 0;
+		}
+		if (str[str.Length - 1] == 0)
+		{
+			return pinned;
+		}
+		allocated = Marshal.AllocHGlobal(str.Length + 1);
+		byte* buffer = (byte*) allocated;
+		str.CopyTo(new Span<byte>(buffer, str.Length));
+		buffer[str.Length] = 0;
+		return buffer;
+	}
+
+	private static nfdutf8path_t Utf8PathOrNull(IntPtr outPathPtr)
+	{
+		return (outPathPtr == IntPtr.Zero) ? null : new nfdutf8path_t(outPathPtr);
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialog(
+		ReadOnlySpan<byte> filterList,
+		ReadOnlySpan<byte> defaultPath,
+		out nfdutf8path_t outPath,
+		IntPtr request = default(IntPtr)
+	) {
+		nfdresult_t result;
+		IntPtr outPathPtr = IntPtr.Zero;
+		IntPtr filterListAlloc, defaultPathAlloc;
+		fixed (byte* filterListPin = filterList)
+		fixed (byte* defaultPathPin = defaultPath)
+		{
+			result = INTERNAL_NFD_OpenDialogEx(
+				Utf8Terminate(filterList, filterListPin, out filterListAlloc),
+				Utf8Terminate(defaultPath, defaultPathPin, out defaultPathAlloc),
+				&outPathPtr,
+				request
+			);
+		}
+		Marshal.FreeHGlobal(filterListAlloc);
+		Marshal.FreeHGlobal(defaultPathAlloc);
+		outPath = Utf8PathOrNull(outPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogMultiple(
+		ReadOnlySpan<byte> filterList,
+		ReadOnlySpan<byte> defaultPath,
+		out nfdpathset_t outPaths,
+		IntPtr request = default(IntPtr)
+	) {
+		nfdresult_t result;
+		IntPtr filterListAlloc, defaultPathAlloc;
+		outPaths = default(nfdpathset_t);
+		fixed (byte* filterListPin = filterList)
+		fixed (byte* defaultPathPin = defaultPath)
+		fixed (nfdpathset_t* outPathsPtr = &outPaths)
+		{
+			result = INTERNAL_NFD_OpenDialogMultipleEx(
+				Utf8Terminate(filterList, filterListPin, out filterListAlloc),
+				Utf8Terminate(defaultPath, defaultPathPin, out defaultPathAlloc),
+				outPathsPtr,
+				request
+			);
+		}
+		Marshal.FreeHGlobal(filterListAlloc);
+		Marshal.FreeHGlobal(defaultPathAlloc);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_SaveDialog(
+		ReadOnlySpan<byte> filterList,
+		ReadOnlySpan<byte> defaultPath,
+		out nfdutf8path_t outPath,
+		IntPtr request = default(IntPtr)
+	) {
+		nfdresult_t result;
+		IntPtr outPathPtr = IntPtr.Zero;
+		IntPtr filterListAlloc, defaultPathAlloc;
+		fixed (byte* filterListPin = filterList)
+		fixed (byte* defaultPathPin = defaultPath)
+		{
+			result = INTERNAL_NFD_SaveDialogEx(
+				Utf8Terminate(filterList, filterListPin, out filterListAlloc),
+				Utf8Terminate(defaultPath, defaultPathPin, out defaultPathAlloc),
+				&outPathPtr,
+				request
+			);
+		}
+		Marshal.FreeHGlobal(filterListAlloc);
+		Marshal.FreeHGlobal(defaultPathAlloc);
+		outPath = Utf8PathOrNull(outPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_PickFolder(
+		ReadOnlySpan<byte> defaultPath,
+		out nfdutf8path_t outPath,
+		IntPtr request = default(IntPtr)
+	) {
+		nfdresult_t result;
+		IntPtr outPathPtr = IntPtr.Zero;
+		IntPtr defaultPathAlloc;
+		fixed (byte* defaultPathPin = defaultPath)
+		{
+			result = INTERNAL_NFD_PickFolderEx(
+				Utf8Terminate(defaultPath, defaultPathPin, out defaultPathAlloc),
+				&outPathPtr,
+				request
+			);
+		}
+		Marshal.FreeHGlobal(defaultPathAlloc);
+		outPath = Utf8PathOrNull(outPathPtr);
+		return result;
+	}
+
+	/* A view into the path set's buffer, without the null terminator.
+	 * Only valid until NFD_PathSet_Free.
+	 */
+	public static unsafe ReadOnlySpan<byte> NFD_PathSet_GetPathUtf8(
+		ref nfdpathset_t pathset,
+		IntPtr index /* size_t */
+	) {
+		byte* path;
+		fixed (nfdpathset_t* pathsetPtr = &pathset)
+		{
+			path = (byte*) INTERNAL_NFD_PathSet_GetPath(pathsetPtr, index);
+		}
+		byte* end = path;
+		while (*end != 0)
+		{
+			end++;
+		}
+		return new ReadOnlySpan<byte>(path, (int) (end - path));
+	}
+#endif
+
+	#endregion
+
+	#region Path Lists
+
+	/* Owns a path set and frees it on Dispose/finalization. Entries are
+	 * read straight out of the native buffer, so there's no P/Invoke per
+	 * item, and each string is only decoded the first time it's asked for.
+	 * Decoded strings remain available after Dispose.
+	 */
+	public sealed class nfdpathlist_t : SafeHandle, IReadOnlyList<string>
+	{
+		private readonly IntPtr indices; /* size_t* */
+		private readonly int count;
+		private readonly string[] cache;
+
+		/* Takes ownership, pathset is cleared so it can't be freed twice */
+		public nfdpathlist_t(ref nfdpathset_t pathset) : base(IntPtr.Zero, true)
+		{
+			SetHandle(pathset.buf);
+			indices = pathset.indices;
+			count = (pathset.buf == IntPtr.Zero) ? 0 : (int) pathset.count;
+			cache = new string[count];
+			pathset = default(nfdpathset_t);
+		}
+
+		public override bool IsInvalid
+		{
+			get
+			{
+				return handle == IntPtr.Zero;
+			}
+		}
+
+		protected override unsafe bool ReleaseHandle()
+		{
+			nfdpathset_t pathset;
+			pathset.buf = handle;
+			pathset.indices = indices;
+			pathset.count = (IntPtr) count;
+			INTERNAL_NFD_PathSet_Free(&pathset);
+			return true;
+		}
+
+		public int Count
+		{
+			get
+			{
+				return count;
+			}
+		}
+
+		public string this[int index]
+		{
+			get
+			{
+				if ((uint) index >= (uint) count)
+				{
+					throw new ArgumentOutOfRangeException("index");
+				}
+
+				/* Racing threads just decode the same string twice */
+				string result = cache[index];
+				if (result == null)
+				{
+					result = GetString(index);
+					cache[index] = result;
+				}
+				return result;
+			}
+		}
+
+		private unsafe string GetString(int index)
+		{
+			return UTF8_ToManaged((IntPtr) GetPointer(index));
+		}
+
+		private unsafe byte* GetPointer(int index)
+		{
+			if (IsClosed)
+			{
+				throw new ObjectDisposedException("nfdpathlist_t");
+			}
+			return (byte*) handle + (long) ((IntPtr*) indices)[index];
+		}
+
+		private unsafe int GetLength(int index)
+		{
+			/* Paths are packed back to back, only the last needs a strlen */
+			if (index < count - 1)
+			{
+				IntPtr* offsets = (IntPtr*) indices;
+				return (int) ((long) offsets[index + 1] - (long) offsets[index]) - 1;
+			}
+			byte* start = GetPointer(index);
+			byte* end = start;
+			while (*end != 0)
+			{
+				end++;
+			}
+			return (int) (end - start);
+		}
+
+		public IEnumerator<string> GetEnumerator()
+		{
+			for (int i = 0; i < count; i += 1)
+			{
+				yield return this[i];
+			}
+		}
+
+		IEnumerator IEnumerable.GetEnumerator()
+		{
+			return GetEnumerator();
+		}
+
+#if NETSTANDARD2_1 || NETCOREAPP
+		/* A view into the native buffer, without the null terminator.
+		 * Only valid until Dispose.
+		 */
+		public unsafe ReadOnlySpan<byte> GetUtf8(int index)
+		{
+			if ((uint) index >= (uint) count)
+			{
+				throw new ArgumentOutOfRangeException("index");
+			}
+			return new ReadOnlySpan<byte>(GetPointer(index), GetLength(index));
+		}
+
+		public Utf8Enumerator EnumerateUtf8()
+		{
+			return new Utf8Enumerator(this);
+		}
+
+		public ref struct Utf8Enumerator
+		{
+			private readonly nfdpathlist_t list;
+			private int index;
+
+			internal Utf8Enumerator(nfdpathlist_t list)
+			{
+				this.list = list;
+				index = -1;
+			}
+
+			public ReadOnlySpan<byte> Current
+			{
+				get
+				{
+					return list.GetUtf8(index);
+				}
+			}
+
+			public bool MoveNext()
+			{
+				index += 1;
+				return index < list.count;
+			}
+
+			public Utf8Enumerator GetEnumerator()
+			{
+				return this;
+			}
+		}
+#endif
+	}
+
+	public static nfdresult_t NFD_OpenDialogMultiple(
+		string filterList,
+		string defaultPath,
+		out nfdpathlist_t outPaths
+	) {
+		return NFD_OpenDialogMultipleEx(
+			filterList,
+			defaultPath,
+			out outPaths,
+			IntPtr.Zero
+		);
+	}
+
+	public static nfdresult_t NFD_OpenDialogMultipleEx(
+		string filterList,
+		string defaultPath,
+		out nfdpathlist_t outPaths,
+		IntPtr request
+	) {
+		nfdpathset_t pathset;
+		nfdresult_t result = NFD_OpenDialogMultipleEx(
+			filterList,
+			defaultPath,
+			out pathset,
+			request
+		);
+		outPaths = new nfdpathlist_t(ref pathset);
+		return result;
+	}
+
+	#endregion
+
+	#region Async Entry Points
+
+	/* The async dialogs are only provided by the Linux dispatcher. The
+	 * completion callback runs on the library's dialog thread, so no
+	 * managed thread waits while the dialog is open.
+	 */
+
+	[UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+	private delegate void nfdcallback_t(
+		IntPtr userdata,
+		nfdresult_t result,
+		IntPtr outPath, /* nfdchar_t* */
+		IntPtr outPaths /* nfdpathset_t* */
+	);
+
+	/* Kept alive here, the native side holds on to it forever */
+	private static readonly nfdcallback_t asyncCallback = AsyncCallback;
+	private static readonly IntPtr asyncCallbackPtr =
+		Marshal.GetFunctionPointerForDelegate(asyncCallback);
+
+	private abstract class AsyncState
+	{
+		public IntPtr Request;
+		public CancellationToken Token;
+		public CancellationTokenRegistration Registration;
+
+		public abstract void Complete(
+			nfdresult_t result,
+			IntPtr outPath,
+			IntPtr outPaths,
+			string error
+		);
+		public abstract void Fail(Exception e);
+	}
+
+	private sealed class AsyncState<T> : AsyncState
+	{
+		public readonly TaskCompletionSource<T> Source = new TaskCompletionSource<T>(
+			TaskCreationOptions.RunContinuationsAsynchronously
+		);
+		public Func<IntPtr, IntPtr, T> Convert;
+
+		public override void Complete(
+			nfdresult_t result,
+			IntPtr outPath,
+			IntPtr outPaths,
+			string error
+		) {
+			if (result == nfdresult_t.NFD_OKAY)
+			{
+				Source.TrySetResult(Convert(outPath, outPaths));
+			}
+			else if (result == nfdresult_t.NFD_CANCEL && Token.IsCancellationRequested)
+			{
+				Source.TrySetCanceled(Token);
+			}
+			else if (result == nfdresult_t.NFD_CANCEL)
+			{
+				Source.TrySetResult(default(T));
+			}
+			else
+			{
+				Fail(new InvalidOperationException(error));
+			}
+		}
+
+		public override void Fail(Exception e)
+		{
+			Source.TrySetException(e);
+		}
+	}
+
+	private static void AsyncCallback(
+		IntPtr userdata,
+		nfdresult_t result,
+		IntPtr outPath,
+		IntPtr outPaths
+	) {
+		GCHandle handle = GCHandle.FromIntPtr(userdata);
+		AsyncState state = (AsyncState) handle.Target;
+		handle.Free();
+
+		/* The error is per thread, so read it here before anything else
+		 * on the dialog thread can replace it
+		 */
+		string error = null;
+		if (result == nfdresult_t.NFD_ERROR)
+		{
+			error = NFD_GetError();
+		}
+
+		/* Waits for a concurrent NFD_Cancel, so the request can go */
+		state.Registration.Dispose();
+		NFD_Request_Free(state.Request);
+
+		try
+		{
+			state.Complete(result, outPath, outPaths, error);
+		}
+		catch (Exception e)
+		{
+			/* Never let an exception unwind into the dialog thread */
+			state.Fail(e);
+		}
+	}
+
+	private static unsafe Task<T> StartAsync<T>(
+		Func<IntPtr, IntPtr, T> convert,
+		CancellationToken cancellationToken,
+		Func<IntPtr, IntPtr, nfdresult_t> start
+	) {
+		AsyncState<T> state = new AsyncState<T>();
+		state.Convert = convert;
+		state.Token = cancellationToken;
+		state.Request = NFD_Request_Create();
+		if (state.Request == IntPtr.Zero)
+		{
+			throw new InvalidOperationException(NFD_GetError());
+		}
+		if (cancellationToken.CanBeCanceled)
+		{
+			IntPtr request = state.Request;
+			state.Registration = cancellationToken.Register(
+				() => NFD_Cancel(request)
+			);
+		}
+
+		GCHandle handle = GCHandle.Alloc(state);
+		if (start(state.Request, GCHandle.ToIntPtr(handle)) != nfdresult_t.NFD_OKAY)
+		{
+			handle.Free();
+			state.Registration.Dispose();
+			NFD_Request_Free(state.Request);
+			throw new InvalidOperationException(NFD_GetError());
+		}
+		return state.Source.Task;
+	}
+
+	private static string ConvertPath(IntPtr outPath, IntPtr outPaths)
+	{
+		return UTF8_ToManaged(outPath, true);
+	}
+
+	private static unsafe string[] ConvertPathSet(IntPtr outPath, IntPtr outPaths)
+	{
+		nfdpathset_t* pathset = (nfdpathset_t*) outPaths;
+		string[] result = new string[(int) NFD_PathSet_GetCount(ref *pathset)];
+		for (int i = 0; i < result.Length; i += 1)
+		{
+			result[i] = NFD_PathSet_GetPath(ref *pathset, (IntPtr) i);
+		}
+		NFD_PathSet_Free(ref *pathset);
+		return result;
+	}
+
+	/* Result is null if the user cancelled the dialog */
+	public static unsafe Task<string> NFD_OpenDialogAsync(
+		string filterList,
+		string defaultPath,
+		CancellationToken cancellationToken = default(CancellationToken)
+	) {
+		return StartAsync(ConvertPath, cancellationToken, (request, userdata) =>
+		{
+			byte* filterListPtr = Utf8EncodeNullable(filterList);
+			byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+			nfdresult_t result = INTERNAL_NFD_OpenDialogAsync(
+				filterListPtr,
+				defaultPathPtr,
+				request,
+				asyncCallbackPtr,
+				userdata
+			);
+
+			Marshal.FreeHGlobal((IntPtr) filterListPtr);
+			Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+			return result;
+		});
+	}
+
+	/* Result is null if the user cancelled the dialog */
+	public static unsafe Task<string[]> NFD_OpenDialogMultipleAsync(
+		string filterList,
+		string defaultPath,
+		CancellationToken cancellationToken = default(CancellationToken)
+	) {
+		return StartAsync(ConvertPathSet, cancellationToken, (request, userdata) =>
+		{
+			byte* filterListPtr = Utf8EncodeNullable(filterList);
+			byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+			nfdresult_t result = INTERNAL_NFD_OpenDialogMultipleAsync(
+				filterListPtr,
+				defaultPathPtr,
+				request,
+				asyncCallbackPtr,
+				userdata
+			);
+
+			Marshal.FreeHGlobal((IntPtr) filterListPtr);
+			Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+			return result;
+		});
+	}
+
+	/* Result is null if the user cancelled the dialog */
+	public static unsafe Task<string> NFD_SaveDialogAsync(
+		string filterList,
+		string defaultPath,
+		CancellationToken cancellationToken = default(CancellationToken)
+	) {
+		return StartAsync(ConvertPath, cancellationToken, (request, userdata) =>
+		{
+			byte* filterListPtr = Utf8EncodeNullable(filterList);
+			byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+			nfdresult_t result = INTERNAL_NFD_SaveDialogAsync(
+				filterListPtr,
+				defaultPathPtr,
+				request,
+				asyncCallbackPtr,
+				userdata
+			);
+
+			Marshal.FreeHGlobal((IntPtr) filterListPtr);
+			Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+			return result;
+		});
+	}
+
+	/* Result is null if the user cancelled the dialog */
+	public static unsafe Task<string> NFD_PickFolderAsync(
+		string defaultPath,
+		CancellationToken cancellationToken = default(CancellationToken)
+	) {
+		return StartAsync(ConvertPath, cancellationToken, (request, userdata) =>
+		{
+			byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+			nfdresult_t result = INTERNAL_NFD_PickFolderAsync(
+				defaultPathPtr,
+				request,
+				asyncCallbackPtr,
+				userdata
+			);
+
+			Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+			return result;
+		});
+	}
+
+	#endregion
+
+	#region SDL Event Entry Points
+
+	/* Also Linux only. Instead of a callback, the result is pushed to the
+	 * SDL event queue as a user event of type NFD_GetEventType(), so SDL
+	 * and FNA games get it from their own SDL_PollEvent loop. Hand the
+	 * event's user.data1 to NFD_EventResult_Read exactly once.
+	 */
+
+	/* 0 if SDL has no event types left, or SDL2 has not been loaded yet */
+	public static uint NFD_GetEventType()
+	{
+		return INTERNAL_NFD_GetEventType();
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogAsync(
+		string filterList,
+		string defaultPath,
+		IntPtr request,
+		IntPtr userdata
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result = INTERNAL_NFD_OpenDialogAsync(
+			filterListPtr,
+			defaultPathPtr,
+			request,
+			IntPtr.Zero,
+			userdata
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_OpenDialogMultipleAsync(
+		string filterList,
+		string defaultPath,
+		IntPtr request,
+		IntPtr userdata
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result = INTERNAL_NFD_OpenDialogMultipleAsync(
+			filterListPtr,
+			defaultPathPtr,
+			request,
+			IntPtr.Zero,
+			userdata
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_SaveDialogAsync(
+		string filterList,
+		string defaultPath,
+		IntPtr request,
+		IntPtr userdata
+	) {
+		byte* filterListPtr = Utf8EncodeNullable(filterList);
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result = INTERNAL_NFD_SaveDialogAsync(
+			filterListPtr,
+			defaultPathPtr,
+			request,
+			IntPtr.Zero,
+			userdata
+		);
+
+		Marshal.FreeHGlobal((IntPtr) filterListPtr);
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	public static unsafe nfdresult_t NFD_PickFolderAsync(
+		string defaultPath,
+		IntPtr request,
+		IntPtr userdata
+	) {
+		byte* defaultPathPtr = Utf8EncodeNullable(defaultPath);
+
+		nfdresult_t result = INTERNAL_NFD_PickFolderAsync(
+			defaultPathPtr,
+			request,
+			IntPtr.Zero,
+			userdata
+		);
+
+		Marshal.FreeHGlobal((IntPtr) defaultPathPtr);
+		return result;
+	}
+
+	/* Converts and frees an event's user.data1. outPath is set for the
+	 * single path dialogs and outPaths for NFD_OpenDialogMultipleAsync,
+	 * both only on NFD_OKAY.
+	 */
+	public static nfdresult_t NFD_EventResult_Read(
+		IntPtr data1,
+		out string outPath,
+		out string[] outPaths
+	) {
+		string error;
+		return NFD_EventResult_Read(data1, out outPath, out outPaths, out error);
+	}
+
+	/* As above, with error set on NFD_ERROR. The dialog failed on the
+	 * dialog thread, so NFD_GetError has nothing to say about it here.
+	 */
+	public static unsafe nfdresult_t NFD_EventResult_Read(
+		IntPtr data1,
+		out string outPath,
+		out string[] outPaths,
+		out string error
+	) {
+		nfdeventresult_t* eventResult = (nfdeventresult_t*) data1;
+		outPath = null;
+		outPaths = null;
+		error = null;
+		if (eventResult == null)
+		{
+			error = "Out of memory posting the NFD result event!";
+			return nfdresult_t.NFD_ERROR;
+		}
+
+		nfdresult_t result = eventResult->result;
+		if (result == nfdresult_t.NFD_ERROR)
+		{
+			error = UTF8_ToManaged(eventResult->error);
+		}
+		if (result == nfdresult_t.NFD_OKAY)
+		{
+			outPath = UTF8_ToManaged(eventResult->outPath);
+			if (eventResult->outPaths.buf != IntPtr.Zero)
+			{
+				outPaths = new string[(int) NFD_PathSet_GetCount(ref eventResult->outPaths)];
+				for (int i = 0; i < outPaths.Length; i += 1)
+				{
+					outPaths[i] = NFD_PathSet_GetPath(
+						ref eventResult->outPaths,
+						(IntPtr) i
+					);
+				}
+			}
+		}
+		INTERNAL_NFD_EventResult_Free(eventResult);
+		return result;
+	}
 
 	#endregion
 }